@@ -0,0 +1,825 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * Codec microbenchmarks.
+ *
+ * Times the hot decode/encode paths without any socket in the way:
+ *
+ *  - amqp_handle_input() over prebuilt frame streams (a mix of
+ *    deliver/header/body, also with lazy properties, many small frames, and
+ *    one large multi-frame body)
+ *  - amqp_encode_method()/amqp_decode_method() per method id
+ *  - amqp_encode_properties()/amqp_decode_properties() with 0..all basic
+ *    property flags set
+ *  - amqp_encode_table()/amqp_decode_table()/amqp_table_clone() on realistic
+ *    header tables
+ *
+ * Results are written to stdout as one JSON document so runs can be diffed
+ * or tracked over time. An optional argument restricts the run to
+ * benchmarks whose name contains it.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#define MIN_RUN_NS 200000000ULL
+#define ENCODE_BUFFER_SIZE 65536
+#define INPUT_CHUNK_SIZE 131072
+
+#define DELIVER_MIX_MESSAGES 256
+#define SMALL_FRAMES 4096
+#define LARGE_BODY_SIZE (4 * 1024 * 1024)
+
+typedef void (*bench_fn)(void *ctx);
+
+struct frame_buffer {
+  uint8_t *bytes;
+  size_t len;
+  size_t cap;
+};
+
+struct input_bench {
+  amqp_connection_state_t conn;
+  struct frame_buffer stream;
+  size_t frames;
+};
+
+struct method_bench {
+  amqp_method_number_t id;
+  void *decoded;
+  uint8_t buffer[ENCODE_BUFFER_SIZE];
+  amqp_bytes_t encoded;
+  amqp_pool_t pool;
+};
+
+struct properties_bench {
+  amqp_basic_properties_t props;
+  uint8_t buffer[ENCODE_BUFFER_SIZE];
+  amqp_bytes_t encoded;
+  amqp_pool_t pool;
+};
+
+struct table_bench {
+  amqp_table_t table;
+  uint8_t buffer[ENCODE_BUFFER_SIZE];
+  amqp_bytes_t encoded;
+  amqp_pool_t pool;
+};
+
+static const char *filter;
+static int results_written;
+
+static void die_on_error(int x, const char *context)
+{
+  if (x < 0) {
+    fprintf(stderr, "%s: %s\n", context, amqp_error_string2(x));
+    exit(1);
+  }
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Doubles the iteration count until one timed run lasts MIN_RUN_NS. */
+static void run_bench(const char *name, bench_fn fn, void *ctx,
+                      size_t bytes_per_op)
+{
+  uint64_t iterations = 1;
+  uint64_t elapsed;
+  uint64_t i;
+  double ns_per_op;
+
+  if (filter != NULL && strstr(name, filter) == NULL) {
+    return;
+  }
+
+  fn(ctx);
+  for (;;) {
+    uint64_t start = now_ns();
+    for (i = 0; i < iterations; ++i) {
+      fn(ctx);
+    }
+    elapsed = now_ns() - start;
+    if (elapsed >= MIN_RUN_NS) {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  ns_per_op = (double)elapsed / (double)iterations;
+  printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, "
+         "\"ns_per_op\": %.2f, \"bytes_per_op\": %lu, \"mb_per_s\": %.2f}",
+         results_written ? "," : "", name, (unsigned long long)iterations,
+         ns_per_op, (unsigned long)bytes_per_op,
+         bytes_per_op * 1000.0 / ns_per_op);
+  fflush(stdout);
+  ++results_written;
+}
+
+static amqp_table_entry_t utf8_entry(const char *key, const char *value)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_UTF8;
+  entry.value.value.bytes = amqp_cstring_bytes(value);
+  return entry;
+}
+
+static amqp_table_entry_t i32_entry(const char *key, int32_t value)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_I32;
+  entry.value.value.i32 = value;
+  return entry;
+}
+
+static amqp_table_entry_t i64_entry(const char *key, int64_t value)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_I64;
+  entry.value.value.i64 = value;
+  return entry;
+}
+
+static amqp_table_entry_t bool_entry(const char *key, amqp_boolean_t value)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_BOOLEAN;
+  entry.value.value.boolean = value;
+  return entry;
+}
+
+static amqp_table_entry_t timestamp_entry(const char *key, uint64_t value)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_TIMESTAMP;
+  entry.value.value.u64 = value;
+  return entry;
+}
+
+static amqp_table_entry_t table_entry(const char *key, amqp_table_entry_t *entries,
+                                      int num_entries)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_TABLE;
+  entry.value.value.table.num_entries = num_entries;
+  entry.value.value.table.entries = entries;
+  return entry;
+}
+
+static amqp_table_entry_t array_entry(const char *key, amqp_field_value_t *values,
+                                      int num_values)
+{
+  amqp_table_entry_t entry;
+  entry.key = amqp_cstring_bytes(key);
+  entry.value.kind = AMQP_FIELD_KIND_ARRAY;
+  entry.value.value.array.num_entries = num_values;
+  entry.value.value.array.entries = values;
+  return entry;
+}
+
+/* Distributed tracing headers as set by most instrumented publishers. */
+static amqp_table_entry_t trace_headers[4];
+
+static amqp_table_t make_trace_headers(void)
+{
+  amqp_table_t table;
+  trace_headers[0] = utf8_entry("x-trace-id", "4bf92f3577b34da6a3ce929d0e0e4736");
+  trace_headers[1] = utf8_entry("x-span-id", "00f067aa0ba902b7");
+  trace_headers[2] = i32_entry("x-retry-count", 0);
+  trace_headers[3] = timestamp_entry("x-published-at", 1700000000);
+  table.num_entries = 4;
+  table.entries = trace_headers;
+  return table;
+}
+
+/* Headers the broker attaches to a message that was dead-lettered twice. */
+static amqp_table_entry_t death_entries[2][6];
+static amqp_field_value_t death_routing_keys[2];
+static amqp_field_value_t deaths[2];
+static amqp_table_entry_t dead_letter_headers[4];
+
+static amqp_table_t make_dead_letter_headers(void)
+{
+  amqp_table_t table;
+  int i;
+
+  for (i = 0; i < 2; ++i) {
+    death_routing_keys[i].kind = AMQP_FIELD_KIND_UTF8;
+    death_routing_keys[i].value.bytes =
+        amqp_cstring_bytes(i ? "orders.retry" : "orders.created");
+    death_entries[i][0] = i64_entry("count", i + 1);
+    death_entries[i][1] = utf8_entry("reason", i ? "expired" : "rejected");
+    death_entries[i][2] = utf8_entry("queue", i ? "orders.retry" : "orders");
+    death_entries[i][3] = timestamp_entry("time", 1700000000 + i);
+    death_entries[i][4] = utf8_entry("exchange", "orders");
+    death_entries[i][5] = array_entry("routing-keys", &death_routing_keys[i], 1);
+    deaths[i].kind = AMQP_FIELD_KIND_TABLE;
+    deaths[i].value.table.num_entries = 6;
+    deaths[i].value.table.entries = death_entries[i];
+  }
+
+  dead_letter_headers[0] = utf8_entry("x-first-death-exchange", "orders");
+  dead_letter_headers[1] = utf8_entry("x-first-death-queue", "orders");
+  dead_letter_headers[2] = utf8_entry("x-first-death-reason", "rejected");
+  dead_letter_headers[3] = array_entry("x-death", deaths, 2);
+  table.num_entries = 4;
+  table.entries = dead_letter_headers;
+  return table;
+}
+
+/* Client properties as sent in connection.start-ok. */
+static amqp_table_entry_t capabilities[6];
+static amqp_table_entry_t client_properties[6];
+
+static amqp_table_t make_client_properties(void)
+{
+  amqp_table_t table;
+
+  capabilities[0] = bool_entry("authentication_failure_close", 1);
+  capabilities[1] = bool_entry("basic.nack", 1);
+  capabilities[2] = bool_entry("connection.blocked", 1);
+  capabilities[3] = bool_entry("consumer_cancel_notify", 1);
+  capabilities[4] = bool_entry("exchange_exchange_bindings", 1);
+  capabilities[5] = bool_entry("publisher_confirms", 1);
+
+  client_properties[0] = utf8_entry("product", "rabbitmq-c");
+  client_properties[1] = utf8_entry("version", AMQ_VERSION_STRING);
+  client_properties[2] = utf8_entry("platform", "FreeRTOS/lwIP");
+  client_properties[3] = utf8_entry("copyright", "Copyright (c) 2007-2014 VMWare Inc, Tony Garnock-Jones, and Alan Antonuk.");
+  client_properties[4] = utf8_entry("information", "See https://github.com/alanxz/rabbitmq-c");
+  client_properties[5] = table_entry("capabilities", capabilities, 6);
+  table.num_entries = 6;
+  table.entries = client_properties;
+  return table;
+}
+
+/* frame streams */
+
+static uint8_t *frame_buffer_reserve(struct frame_buffer *buf, size_t len)
+{
+  if (buf->len + len > buf->cap) {
+    size_t cap = buf->cap ? buf->cap : 65536;
+    while (cap < buf->len + len) {
+      cap *= 2;
+    }
+    buf->bytes = realloc(buf->bytes, cap);
+    if (buf->bytes == NULL) {
+      die_on_error(AMQP_STATUS_NO_MEMORY, "growing frame buffer");
+    }
+    buf->cap = cap;
+  }
+  return buf->bytes + buf->len;
+}
+
+static void put_frame(struct frame_buffer *buf, uint8_t type,
+                      amqp_channel_t channel, const uint8_t *payload,
+                      size_t len)
+{
+  uint8_t *out = frame_buffer_reserve(buf, len + 8);
+
+  out[0] = type;
+  out[1] = (uint8_t)(channel >> 8);
+  out[2] = (uint8_t)channel;
+  out[3] = (uint8_t)(len >> 24);
+  out[4] = (uint8_t)(len >> 16);
+  out[5] = (uint8_t)(len >> 8);
+  out[6] = (uint8_t)len;
+  if (len > 0) {
+    memcpy(out + 7, payload, len);
+  }
+  out[7 + len] = AMQP_FRAME_END;
+  buf->len += len + 8;
+}
+
+static void put_method(struct frame_buffer *buf, amqp_channel_t channel,
+                       amqp_method_number_t id, void *decoded)
+{
+  uint8_t payload[4096];
+  amqp_bytes_t encoded;
+  int len;
+
+  payload[0] = (uint8_t)(id >> 24);
+  payload[1] = (uint8_t)(id >> 16);
+  payload[2] = (uint8_t)(id >> 8);
+  payload[3] = (uint8_t)id;
+  encoded.bytes = payload + 4;
+  encoded.len = sizeof(payload) - 4;
+  len = amqp_encode_method(id, decoded, encoded);
+  die_on_error(len, "encoding method");
+  put_frame(buf, AMQP_FRAME_METHOD, channel, payload, len + 4);
+}
+
+static void put_header(struct frame_buffer *buf, amqp_channel_t channel,
+                       amqp_basic_properties_t *props, uint64_t body_size)
+{
+  uint8_t payload[4096];
+  amqp_bytes_t encoded;
+  int len;
+  int i;
+
+  memset(payload, 0, 12);
+  payload[1] = 60;
+  for (i = 0; i < 8; ++i) {
+    payload[4 + i] = (uint8_t)(body_size >> (56 - 8 * i));
+  }
+  encoded.bytes = payload + 12;
+  encoded.len = sizeof(payload) - 12;
+  len = amqp_encode_properties(AMQP_BASIC_CLASS, props, encoded);
+  die_on_error(len, "encoding properties");
+  put_frame(buf, AMQP_FRAME_HEADER, channel, payload, len + 12);
+}
+
+/* Splits the body into frames no larger than the default frame_max. */
+static size_t put_body(struct frame_buffer *buf, amqp_channel_t channel,
+                       const uint8_t *body, size_t len)
+{
+  const size_t max_payload = AMQP_DEFAULT_FRAME_SIZE - 8;
+  size_t frames = 0;
+
+  while (len > 0) {
+    size_t n = len < max_payload ? len : max_payload;
+    put_frame(buf, AMQP_FRAME_BODY, channel, body, n);
+    body += n;
+    len -= n;
+    ++frames;
+  }
+  return frames;
+}
+
+static void init_deliver(amqp_basic_deliver_t *deliver, uint64_t delivery_tag)
+{
+  memset(deliver, 0, sizeof(*deliver));
+  deliver->consumer_tag = amqp_cstring_bytes("amq.ctag-pCK3PnOZSs1oRlYlVS1QxA");
+  deliver->delivery_tag = delivery_tag;
+  deliver->exchange = amqp_cstring_bytes("amq.topic");
+  deliver->routing_key = amqp_cstring_bytes("sensors.temperature.device-42");
+}
+
+static void build_deliver_mix(struct input_bench *b)
+{
+  static const size_t body_sizes[] = {64, 512, 4096};
+  static uint8_t body[4096];
+  amqp_basic_deliver_t deliver;
+  amqp_basic_properties_t props;
+  int i;
+
+  memset(&props, 0, sizeof(props));
+  props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG |
+                 AMQP_BASIC_HEADERS_FLAG;
+  props.content_type = amqp_cstring_bytes("application/json");
+  props.delivery_mode = 2;
+  props.headers = make_trace_headers();
+  memset(body, 'x', sizeof(body));
+
+  for (i = 0; i < DELIVER_MIX_MESSAGES; ++i) {
+    size_t body_size = body_sizes[i % 3];
+    init_deliver(&deliver, (uint64_t)i + 1);
+    put_method(&b->stream, 1, AMQP_BASIC_DELIVER_METHOD, &deliver);
+    put_header(&b->stream, 1, &props, body_size);
+    b->frames += 2 + put_body(&b->stream, 1, body, body_size);
+  }
+}
+
+static void build_small_frames(struct input_bench *b)
+{
+  amqp_basic_ack_t ack;
+  int i;
+
+  for (i = 0; i < SMALL_FRAMES; ++i) {
+    if (i % 4 == 3) {
+      put_frame(&b->stream, AMQP_FRAME_HEARTBEAT, 0, NULL, 0);
+    } else {
+      ack.delivery_tag = (uint64_t)i + 1;
+      ack.multiple = 0;
+      put_method(&b->stream, 1, AMQP_BASIC_ACK_METHOD, &ack);
+    }
+    ++b->frames;
+  }
+}
+
+static void build_large_body(struct input_bench *b)
+{
+  amqp_basic_deliver_t deliver;
+  amqp_basic_properties_t props;
+  uint8_t *body = malloc(LARGE_BODY_SIZE);
+
+  if (body == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating body");
+  }
+  memset(body, 'x', LARGE_BODY_SIZE);
+  memset(&props, 0, sizeof(props));
+  props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG;
+  props.content_type = amqp_cstring_bytes("application/octet-stream");
+
+  init_deliver(&deliver, 1);
+  put_method(&b->stream, 1, AMQP_BASIC_DELIVER_METHOD, &deliver);
+  put_header(&b->stream, 1, &props, LARGE_BODY_SIZE);
+  b->frames += 2 + put_body(&b->stream, 1, body, LARGE_BODY_SIZE);
+  free(body);
+}
+
+/* Feeds the stream in socket-read sized chunks, releasing frame memory the
+ * way amqp_simple_wait_frame() callers do between frames. */
+static size_t feed_stream(struct input_bench *b)
+{
+  size_t offset = 0;
+  size_t frames = 0;
+
+  while (offset < b->stream.len) {
+    amqp_bytes_t data;
+    data.bytes = b->stream.bytes + offset;
+    data.len = b->stream.len - offset;
+    if (data.len > INPUT_CHUNK_SIZE) {
+      data.len = INPUT_CHUNK_SIZE;
+    }
+    offset += data.len;
+
+    while (data.len > 0) {
+      amqp_frame_t frame;
+      int res = amqp_handle_input(b->conn, data, &frame);
+      die_on_error(res, "amqp_handle_input");
+      data.bytes = (char *)data.bytes + res;
+      data.len -= res;
+      if (frame.frame_type != 0) {
+        ++frames;
+        amqp_maybe_release_buffers(b->conn);
+      }
+    }
+  }
+  return frames;
+}
+
+static void bench_handle_input(void *ctx)
+{
+  feed_stream(ctx);
+}
+
+static void run_input_bench(const char *name,
+                            void (*build)(struct input_bench *),
+                            amqp_boolean_t lazy)
+{
+  struct input_bench b;
+  amqp_connection_start_t start;
+  size_t frames;
+
+  memset(&b, 0, sizeof(b));
+  b.conn = amqp_new_connection();
+  if (b.conn == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "creating connection");
+  }
+  /* connection.start moves the connection out of its initial state, after
+   * which it can be tuned as it would be during the handshake */
+  memset(&start, 0, sizeof(start));
+  start.version_minor = 9;
+  start.server_properties = amqp_empty_table;
+  start.mechanisms = amqp_cstring_bytes("PLAIN");
+  start.locales = amqp_cstring_bytes("en_US");
+  put_method(&b.stream, 0, AMQP_CONNECTION_START_METHOD, &start);
+  feed_stream(&b);
+  b.stream.len = 0;
+  die_on_error(amqp_tune_connection(b.conn, 0, AMQP_DEFAULT_FRAME_SIZE, 0),
+               "tuning connection");
+  amqp_set_lazy_properties(b.conn, lazy);
+  build(&b);
+
+  frames = feed_stream(&b);
+  if (frames != b.frames) {
+    fprintf(stderr, "%s: decoded %lu frames, expected %lu\n", name,
+            (unsigned long)frames, (unsigned long)b.frames);
+    exit(1);
+  }
+  run_bench(name, bench_handle_input, &b, b.stream.len);
+
+  amqp_destroy_connection(b.conn);
+  free(b.stream.bytes);
+}
+
+/* methods */
+
+static void bench_encode_method(void *ctx)
+{
+  struct method_bench *b = ctx;
+  amqp_bytes_t out;
+
+  out.bytes = b->buffer;
+  out.len = sizeof(b->buffer);
+  die_on_error(amqp_encode_method(b->id, b->decoded, out), "encoding method");
+}
+
+static void bench_decode_method(void *ctx)
+{
+  struct method_bench *b = ctx;
+  void *decoded;
+
+  recycle_amqp_pool(&b->pool);
+  die_on_error(amqp_decode_method(b->id, &b->pool, b->encoded, &decoded),
+               "decoding method");
+}
+
+static void run_method_bench(amqp_method_number_t id, void *decoded)
+{
+  struct method_bench *b = malloc(sizeof(*b));
+  char name[128];
+  int len;
+
+  if (b == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating method bench");
+  }
+  b->id = id;
+  b->decoded = decoded;
+  b->encoded.bytes = b->buffer;
+  b->encoded.len = sizeof(b->buffer);
+  len = amqp_encode_method(id, decoded, b->encoded);
+  die_on_error(len, "encoding method");
+  b->encoded.len = len;
+  init_amqp_pool(&b->pool, 4096);
+
+  snprintf(name, sizeof(name), "encode_method/%s", amqp_method_name(id));
+  run_bench(name, bench_encode_method, b, (size_t)len);
+  snprintf(name, sizeof(name), "decode_method/%s", amqp_method_name(id));
+  run_bench(name, bench_decode_method, b, (size_t)len);
+
+  empty_amqp_pool(&b->pool);
+  free(b);
+}
+
+static void run_method_benches(void)
+{
+  static amqp_table_entry_t queue_args[3];
+  amqp_connection_tune_t tune;
+  amqp_channel_open_t channel_open;
+  amqp_exchange_declare_t exchange_declare;
+  amqp_queue_declare_t queue_declare;
+  amqp_queue_bind_t queue_bind;
+  amqp_basic_qos_t qos;
+  amqp_basic_consume_t consume;
+  amqp_basic_publish_t publish;
+  amqp_basic_deliver_t deliver;
+  amqp_basic_ack_t ack;
+
+  tune.channel_max = 2047;
+  tune.frame_max = AMQP_DEFAULT_FRAME_SIZE;
+  tune.heartbeat = 60;
+  run_method_bench(AMQP_CONNECTION_TUNE_METHOD, &tune);
+
+  channel_open.out_of_band = amqp_empty_bytes;
+  run_method_bench(AMQP_CHANNEL_OPEN_METHOD, &channel_open);
+
+  memset(&exchange_declare, 0, sizeof(exchange_declare));
+  exchange_declare.exchange = amqp_cstring_bytes("sensors");
+  exchange_declare.type = amqp_cstring_bytes("topic");
+  exchange_declare.durable = 1;
+  exchange_declare.arguments = amqp_empty_table;
+  run_method_bench(AMQP_EXCHANGE_DECLARE_METHOD, &exchange_declare);
+
+  queue_args[0] = i32_entry("x-message-ttl", 60000);
+  queue_args[1] = i32_entry("x-max-length", 10000);
+  queue_args[2] = utf8_entry("x-dead-letter-exchange", "sensors.dlx");
+  memset(&queue_declare, 0, sizeof(queue_declare));
+  queue_declare.queue = amqp_cstring_bytes("sensors.temperature");
+  queue_declare.durable = 1;
+  queue_declare.arguments.num_entries = 3;
+  queue_declare.arguments.entries = queue_args;
+  run_method_bench(AMQP_QUEUE_DECLARE_METHOD, &queue_declare);
+
+  memset(&queue_bind, 0, sizeof(queue_bind));
+  queue_bind.queue = amqp_cstring_bytes("sensors.temperature");
+  queue_bind.exchange = amqp_cstring_bytes("sensors");
+  queue_bind.routing_key = amqp_cstring_bytes("sensors.temperature.#");
+  queue_bind.arguments = amqp_empty_table;
+  run_method_bench(AMQP_QUEUE_BIND_METHOD, &queue_bind);
+
+  qos.prefetch_size = 0;
+  qos.prefetch_count = 100;
+  qos.global = 0;
+  run_method_bench(AMQP_BASIC_QOS_METHOD, &qos);
+
+  memset(&consume, 0, sizeof(consume));
+  consume.queue = amqp_cstring_bytes("sensors.temperature");
+  consume.consumer_tag = amqp_empty_bytes;
+  consume.arguments = amqp_empty_table;
+  run_method_bench(AMQP_BASIC_CONSUME_METHOD, &consume);
+
+  memset(&publish, 0, sizeof(publish));
+  publish.exchange = amqp_cstring_bytes("amq.topic");
+  publish.routing_key = amqp_cstring_bytes("sensors.temperature.device-42");
+  run_method_bench(AMQP_BASIC_PUBLISH_METHOD, &publish);
+
+  init_deliver(&deliver, 123456789);
+  run_method_bench(AMQP_BASIC_DELIVER_METHOD, &deliver);
+
+  ack.delivery_tag = 123456789;
+  ack.multiple = 0;
+  run_method_bench(AMQP_BASIC_ACK_METHOD, &ack);
+}
+
+/* properties */
+
+static void bench_encode_properties(void *ctx)
+{
+  struct properties_bench *b = ctx;
+  amqp_bytes_t out;
+
+  out.bytes = b->buffer;
+  out.len = sizeof(b->buffer);
+  die_on_error(amqp_encode_properties(AMQP_BASIC_CLASS, &b->props, out),
+               "encoding properties");
+}
+
+static void bench_decode_properties(void *ctx)
+{
+  struct properties_bench *b = ctx;
+  void *decoded;
+
+  recycle_amqp_pool(&b->pool);
+  die_on_error(amqp_decode_properties(AMQP_BASIC_CLASS, &b->pool, b->encoded,
+                                      &decoded),
+               "decoding properties");
+}
+
+static void run_properties_benches(void)
+{
+  /* flags in wire order, each step enables the next one */
+  static const amqp_flags_t flags[] = {
+      AMQP_BASIC_CONTENT_TYPE_FLAG,   AMQP_BASIC_DELIVERY_MODE_FLAG,
+      AMQP_BASIC_TIMESTAMP_FLAG,      AMQP_BASIC_CONTENT_ENCODING_FLAG,
+      AMQP_BASIC_PRIORITY_FLAG,       AMQP_BASIC_CORRELATION_ID_FLAG,
+      AMQP_BASIC_REPLY_TO_FLAG,       AMQP_BASIC_MESSAGE_ID_FLAG,
+      AMQP_BASIC_APP_ID_FLAG,         AMQP_BASIC_HEADERS_FLAG,
+      AMQP_BASIC_EXPIRATION_FLAG,     AMQP_BASIC_TYPE_FLAG,
+      AMQP_BASIC_USER_ID_FLAG,        AMQP_BASIC_CLUSTER_ID_FLAG};
+  static const int steps[] = {0, 2, 5, 9, 14};
+  struct properties_bench *b = malloc(sizeof(*b));
+  size_t i;
+
+  if (b == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating properties bench");
+  }
+  memset(&b->props, 0, sizeof(b->props));
+  b->props.content_type = amqp_cstring_bytes("application/json");
+  b->props.content_encoding = amqp_cstring_bytes("gzip");
+  b->props.headers = make_trace_headers();
+  b->props.delivery_mode = 2;
+  b->props.priority = 5;
+  b->props.correlation_id = amqp_cstring_bytes("b7a5b2c8-5d1f-4f1e-9a8e-2f0c6b1d9e3a");
+  b->props.reply_to = amqp_cstring_bytes("amq.rabbitmq.reply-to.g2dkAA1yYWJiaXRAbG9jYWxob3N0");
+  b->props.expiration = amqp_cstring_bytes("60000");
+  b->props.message_id = amqp_cstring_bytes("msg-00000000000000042");
+  b->props.timestamp = 1700000000;
+  b->props.type = amqp_cstring_bytes("sensor.reading");
+  b->props.user_id = amqp_cstring_bytes("guest");
+  b->props.app_id = amqp_cstring_bytes("sensor-gateway");
+  b->props.cluster_id = amqp_cstring_bytes("eu-west");
+  init_amqp_pool(&b->pool, 4096);
+
+  for (i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+    char name[64];
+    int len;
+    int f;
+
+    b->props._flags = 0;
+    for (f = 0; f < steps[i]; ++f) {
+      b->props._flags |= flags[f];
+    }
+    b->encoded.bytes = b->buffer;
+    b->encoded.len = sizeof(b->buffer);
+    len = amqp_encode_properties(AMQP_BASIC_CLASS, &b->props, b->encoded);
+    die_on_error(len, "encoding properties");
+    b->encoded.len = len;
+
+    snprintf(name, sizeof(name), "encode_properties/flags_%d", steps[i]);
+    run_bench(name, bench_encode_properties, b, (size_t)len);
+    snprintf(name, sizeof(name), "decode_properties/flags_%d", steps[i]);
+    run_bench(name, bench_decode_properties, b, (size_t)len);
+  }
+
+  empty_amqp_pool(&b->pool);
+  free(b);
+}
+
+/* tables */
+
+static void bench_encode_table(void *ctx)
+{
+  struct table_bench *b = ctx;
+  amqp_bytes_t out;
+  size_t offset = 0;
+
+  out.bytes = b->buffer;
+  out.len = sizeof(b->buffer);
+  die_on_error(amqp_encode_table(out, &b->table, &offset), "encoding table");
+}
+
+static void bench_decode_table(void *ctx)
+{
+  struct table_bench *b = ctx;
+  amqp_table_t decoded;
+  size_t offset = 0;
+
+  recycle_amqp_pool(&b->pool);
+  die_on_error(amqp_decode_table(b->encoded, &b->pool, &decoded, &offset),
+               "decoding table");
+}
+
+static void bench_clone_table(void *ctx)
+{
+  struct table_bench *b = ctx;
+  amqp_table_t clone;
+
+  recycle_amqp_pool(&b->pool);
+  die_on_error(amqp_table_clone(&b->table, &clone, &b->pool), "cloning table");
+}
+
+static void run_table_bench(const char *label, amqp_table_t table)
+{
+  struct table_bench *b = malloc(sizeof(*b));
+  size_t offset = 0;
+  char name[64];
+
+  if (b == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating table bench");
+  }
+  b->table = table;
+  b->encoded.bytes = b->buffer;
+  b->encoded.len = sizeof(b->buffer);
+  die_on_error(amqp_encode_table(b->encoded, &b->table, &offset),
+               "encoding table");
+  b->encoded.len = offset;
+  init_amqp_pool(&b->pool, 4096);
+
+  snprintf(name, sizeof(name), "encode_table/%s", label);
+  run_bench(name, bench_encode_table, b, offset);
+  snprintf(name, sizeof(name), "decode_table/%s", label);
+  run_bench(name, bench_decode_table, b, offset);
+  snprintf(name, sizeof(name), "clone_table/%s", label);
+  run_bench(name, bench_clone_table, b, offset);
+
+  empty_amqp_pool(&b->pool);
+  free(b);
+}
+
+int main(int argc, char const *const *argv)
+{
+  if (argc > 1) {
+    filter = argv[1];
+  }
+
+  printf("{\n  \"library\": \"%s\",\n  \"benchmarks\": [", amqp_version());
+
+  run_input_bench("handle_input/deliver_mix", build_deliver_mix, 0);
+  run_input_bench("handle_input/deliver_mix_lazy", build_deliver_mix, 1);
+  run_input_bench("handle_input/small_frames", build_small_frames, 0);
+  run_input_bench("handle_input/large_body", build_large_body, 0);
+
+  run_method_benches();
+  run_properties_benches();
+
+  run_table_bench("trace_headers", make_trace_headers());
+  run_table_bench("dead_letter", make_dead_letter_headers());
+  run_table_bench("client_properties", make_client_properties());
+
+  printf("\n  ]\n}\n");
+  return 0;
+}
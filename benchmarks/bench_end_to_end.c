@@ -0,0 +1,296 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * End-to-end publish/consume benchmark against the in-process fake broker.
+ *
+ * The client logs in, publishes to queue "bench" on channel 1 (plain) or
+ * channel 2 (confirm mode) and consumes the looped-back deliveries on
+ * channel 1, acking each batch with multiple=1. Publishing is done in
+ * batches of at most BATCH_BYTES so neither side blocks on a full socket
+ * buffer while the other is writing.
+ *
+ * Throughput is reported in messages and MB per second, latency as the
+ * round trip of a single publish to its delivery. Results are written to
+ * stdout as JSON.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "fake_broker.h"
+
+#define PLAIN_CHANNEL 1
+#define CONFIRM_CHANNEL 2
+#define CONFIRM_WINDOW 256
+#define BATCH_SIZE 64
+#define BATCH_BYTES 32768
+#define LATENCY_SAMPLES 20000
+
+struct workload {
+  size_t body_size;
+  int messages;
+};
+
+static const struct workload workloads[] = {
+  {64, 200000},
+  {1024, 100000},
+  {65536, 5000},
+};
+
+static int results_written;
+
+static void die_on_error(int x, const char *context)
+{
+  if (x < 0) {
+    fprintf(stderr, "%s: %s\n", context, amqp_error_string2(x));
+    exit(1);
+  }
+}
+
+static void die_on_amqp_error(amqp_rpc_reply_t x, const char *context)
+{
+  switch (x.reply_type) {
+  case AMQP_RESPONSE_NORMAL:
+    return;
+  case AMQP_RESPONSE_LIBRARY_EXCEPTION:
+    die_on_error(x.library_error, context);
+    break;
+  default:
+    break;
+  }
+  fprintf(stderr, "%s: unexpected reply %d\n", context, x.reply_type);
+  exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void publish(amqp_connection_state_t conn, amqp_channel_t channel,
+                    amqp_bytes_t body)
+{
+  die_on_error(amqp_basic_publish(conn, channel, amqp_empty_bytes,
+                                  amqp_cstring_bytes("bench"), 0, 0, NULL,
+                                  body),
+               "publishing");
+}
+
+static uint64_t consume(amqp_connection_state_t conn, size_t body_size)
+{
+  amqp_envelope_t envelope;
+  uint64_t delivery_tag;
+
+  die_on_amqp_error(amqp_consume_message(conn, &envelope, NULL, 0),
+                    "consuming");
+  if (envelope.message.body.len != body_size) {
+    fprintf(stderr, "consuming: got %lu bytes, expected %lu\n",
+            (unsigned long)envelope.message.body.len,
+            (unsigned long)body_size);
+    exit(1);
+  }
+  delivery_tag = envelope.delivery_tag;
+  amqp_destroy_envelope(&envelope);
+  return delivery_tag;
+}
+
+static void drain_confirms(amqp_connection_state_t conn, amqp_boolean_t wait)
+{
+  amqp_confirm_t confirms[BATCH_SIZE];
+  int n;
+
+  do {
+    while ((n = amqp_confirm_poll(conn, CONFIRM_CHANNEL, confirms,
+                                  BATCH_SIZE)) > 0) {
+      int i;
+      for (i = 0; i < n; ++i) {
+        if (!confirms[i].acked) {
+          fprintf(stderr, "message %llu nacked\n",
+                  (unsigned long long)confirms[i].delivery_tag);
+          exit(1);
+        }
+      }
+    }
+    die_on_error(n, "polling confirms");
+    if (wait && amqp_confirm_outstanding(conn, CONFIRM_CHANNEL) > 0) {
+      die_on_error(amqp_confirm_wait(conn, CONFIRM_CHANNEL, NULL),
+                   "waiting for confirms");
+    }
+  } while (wait && amqp_confirm_outstanding(conn, CONFIRM_CHANNEL) > 0);
+}
+
+static void run_throughput(amqp_connection_state_t conn,
+                           const struct workload *w, amqp_boolean_t confirm)
+{
+  amqp_channel_t channel = confirm ? CONFIRM_CHANNEL : PLAIN_CHANNEL;
+  amqp_bytes_t body;
+  int batch = (int)(BATCH_BYTES / w->body_size);
+  int sent;
+  uint64_t start;
+  double seconds;
+
+  if (batch > BATCH_SIZE) {
+    batch = BATCH_SIZE;
+  } else if (batch < 1) {
+    batch = 1;
+  }
+  body.len = w->body_size;
+  body.bytes = calloc(1, w->body_size);
+  if (body.bytes == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating body");
+  }
+
+  start = now_ns();
+  for (sent = 0; sent < w->messages;) {
+    uint64_t last_tag = 0;
+    int n = w->messages - sent < batch ? w->messages - sent : batch;
+    int i;
+
+    for (i = 0; i < n; ++i) {
+      publish(conn, channel, body);
+    }
+    for (i = 0; i < n; ++i) {
+      last_tag = consume(conn, w->body_size);
+    }
+    die_on_error(amqp_basic_ack(conn, PLAIN_CHANNEL, last_tag, 1), "acking");
+    if (confirm) {
+      drain_confirms(conn, 0);
+    }
+    sent += n;
+  }
+  if (confirm) {
+    drain_confirms(conn, 1);
+  }
+  seconds = (now_ns() - start) / 1e9;
+
+  printf("%s\n    {\"name\": \"throughput%s/body_%lu\", \"messages\": %d, "
+         "\"msgs_per_s\": %.0f, \"mb_per_s\": %.2f}",
+         results_written++ ? "," : "", confirm ? "_confirm" : "",
+         (unsigned long)w->body_size, w->messages, w->messages / seconds,
+         (double)w->messages * w->body_size / seconds / 1e6);
+  fflush(stdout);
+  free(body.bytes);
+}
+
+static void run_latency(amqp_connection_state_t conn, const struct workload *w)
+{
+  uint64_t *samples = malloc(LATENCY_SAMPLES * sizeof(uint64_t));
+  amqp_bytes_t body;
+  int i;
+
+  body.len = w->body_size;
+  body.bytes = calloc(1, w->body_size);
+  if (samples == NULL || body.bytes == NULL) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating samples");
+  }
+
+  for (i = 0; i < LATENCY_SAMPLES; ++i) {
+    uint64_t start = now_ns();
+    uint64_t delivery_tag;
+
+    publish(conn, PLAIN_CHANNEL, body);
+    delivery_tag = consume(conn, w->body_size);
+    samples[i] = now_ns() - start;
+    die_on_error(amqp_basic_ack(conn, PLAIN_CHANNEL, delivery_tag, 0),
+                 "acking");
+  }
+  qsort(samples, LATENCY_SAMPLES, sizeof(uint64_t), compare_u64);
+
+  printf("%s\n    {\"name\": \"latency/body_%lu\", \"samples\": %d, "
+         "\"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, "
+         "\"max_us\": %.2f}",
+         results_written++ ? "," : "", (unsigned long)w->body_size,
+         LATENCY_SAMPLES, samples[LATENCY_SAMPLES / 2] / 1e3,
+         samples[LATENCY_SAMPLES * 99 / 100] / 1e3,
+         samples[LATENCY_SAMPLES * 999 / 1000] / 1e3,
+         samples[LATENCY_SAMPLES - 1] / 1e3);
+  fflush(stdout);
+  free(body.bytes);
+  free(samples);
+}
+
+int main(void)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  fake_broker_t *broker;
+  struct fake_broker_stats stats;
+  uint64_t expected = 0;
+  size_t i;
+
+  die_on_error(fake_broker_connect(conn, &broker), "starting broker");
+  die_on_amqp_error(amqp_login(conn, "/", 0, AMQP_DEFAULT_FRAME_SIZE, 0,
+                               AMQP_SASL_METHOD_PLAIN, "guest", "guest"),
+                    "logging in");
+  amqp_channel_open(conn, PLAIN_CHANNEL);
+  die_on_amqp_error(amqp_get_rpc_reply(conn), "opening channel");
+  amqp_channel_open(conn, CONFIRM_CHANNEL);
+  die_on_amqp_error(amqp_get_rpc_reply(conn), "opening channel");
+  die_on_amqp_error(amqp_confirm_enable(conn, CONFIRM_CHANNEL, CONFIRM_WINDOW),
+                    "enabling confirms");
+  amqp_basic_consume(conn, PLAIN_CHANNEL, amqp_cstring_bytes("bench"),
+                     amqp_empty_bytes, 0, 0, 0, amqp_empty_table);
+  die_on_amqp_error(amqp_get_rpc_reply(conn), "consuming");
+
+  printf("{\n  \"library\": \"%s\",\n  \"benchmarks\": [", amqp_version());
+  for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+    run_throughput(conn, &workloads[i], 0);
+    run_throughput(conn, &workloads[i], 1);
+    run_latency(conn, &workloads[i]);
+    expected += 2 * workloads[i].messages + LATENCY_SAMPLES;
+  }
+  printf("\n  ]\n}\n");
+
+  die_on_amqp_error(amqp_connection_close(conn, AMQP_REPLY_SUCCESS),
+                    "closing connection");
+  die_on_error(amqp_destroy_connection(conn), "ending connection");
+  die_on_error(fake_broker_join(broker, &stats), "broker");
+  if (stats.published != expected || stats.delivered != expected) {
+    fprintf(stderr, "broker saw %llu publishes and %llu deliveries, "
+            "expected %llu\n", (unsigned long long)stats.published,
+            (unsigned long long)stats.delivered,
+            (unsigned long long)expected);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * Shared publishing contention benchmark.
+ *
+ * 1..16 threads publish small messages on their own channel of a single
+ * connection. The connection's socket is one end of a socketpair whose other
+ * end is drained by a reader thread, so the numbers reflect encoding, queue
+ * and writev cost rather than a broker.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <amqp.h>
+#include <amqp_tcp_socket.h>
+
+#define MESSAGES_PER_THREAD 200000
+#define MAX_THREADS 16
+#define BODY_SIZE 64
+
+struct publisher_arg {
+  amqp_connection_state_t conn;
+  amqp_channel_t channel;
+};
+
+static void die_on_error(int x, const char *context)
+{
+  if (x < 0) {
+    fprintf(stderr, "%s: %s\n", context, amqp_error_string2(x));
+    exit(1);
+  }
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *drain_socket(void *arg)
+{
+  int fd = *(int *)arg;
+  char buf[65536];
+
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+  return NULL;
+}
+
+static void *publish_loop(void *arg)
+{
+  struct publisher_arg *pa = arg;
+  amqp_publisher_t *publisher = amqp_publisher_new(pa->conn, pa->channel);
+  char body[BODY_SIZE];
+  amqp_bytes_t message;
+  int i;
+
+  if (NULL == publisher) {
+    fprintf(stderr, "amqp_publisher_new failed\n");
+    exit(1);
+  }
+
+  memset(body, 'x', sizeof(body));
+  message.bytes = body;
+  message.len = sizeof(body);
+
+  for (i = 0; i < MESSAGES_PER_THREAD; ++i) {
+    die_on_error(amqp_publisher_publish(publisher, amqp_cstring_bytes("amq.direct"),
+                                        amqp_cstring_bytes("bench"), 0, 0,
+                                        NULL, message),
+                 "publishing");
+  }
+
+  amqp_publisher_destroy(publisher);
+  return NULL;
+}
+
+static void run(int threads)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_tcp_socket_new(conn);
+  struct publisher_arg args[MAX_THREADS];
+  pthread_t tids[MAX_THREADS];
+  pthread_t reader;
+  int fds[2];
+  uint64_t start, elapsed;
+  int i;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  amqp_tcp_socket_set_sockfd(socket, fds[0]);
+  pthread_create(&reader, NULL, drain_socket, &fds[1]);
+
+  die_on_error(amqp_enable_shared_publishing(conn), "enabling shared publishing");
+
+  start = now_ns();
+  for (i = 0; i < threads; ++i) {
+    args[i].conn = conn;
+    args[i].channel = (amqp_channel_t)(i + 1);
+    pthread_create(&tids[i], NULL, publish_loop, &args[i]);
+  }
+  for (i = 0; i < threads; ++i) {
+    pthread_join(tids[i], NULL);
+  }
+  elapsed = now_ns() - start;
+
+  printf("%2d threads: %10.0f msg/s  %8.1f ns/msg\n", threads,
+         (double)threads * MESSAGES_PER_THREAD * 1e9 / elapsed,
+         (double)elapsed / ((double)threads * MESSAGES_PER_THREAD));
+
+  shutdown(fds[0], SHUT_WR);
+  pthread_join(reader, NULL);
+  close(fds[1]);
+  amqp_destroy_connection(conn);
+}
+
+int main(void)
+{
+  int threads;
+
+  for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    run(threads);
+  }
+  return 0;
+}
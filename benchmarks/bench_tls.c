@@ -0,0 +1,280 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * TLS publish throughput over loopback, with and without kernel TLS.
+ *
+ * A thread stands in for "openssl s_server": it generates a throwaway
+ * self-signed certificate, which the client trusts through a temporary CA
+ * file, accepts one TLS connection on 127.0.0.1 and reads and discards
+ * everything until the client hangs up. The client publishes over an
+ * amqp_ssl_socket_new() socket without logging in, so only the framing and
+ * the TLS layer are measured.
+ *
+ * Results are written to stdout as JSON. "ktls" reports whether the kernel
+ * actually took over the records; without the tls module loaded the ktls
+ * runs fall back to userspace and measure the same path twice.
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <amqp.h>
+#include <amqp_ssl_socket.h>
+
+struct workload {
+  size_t body_size;
+  int messages;
+};
+
+static const struct workload workloads[] = {
+  {64, 500000},
+  {1024, 200000},
+  {65536, 10000},
+};
+
+struct sink {
+  int listener;
+  int port;
+  pthread_t thread;
+  unsigned long long received;
+  int status;
+};
+
+static SSL_CTX *server_ctx;
+static char cacert_path[] = "/tmp/bench_tls_XXXXXX";
+static int results_written;
+
+static void die(const char *context)
+{
+  fprintf(stderr, "%s\n", context);
+  ERR_print_errors_fp(stderr);
+  exit(1);
+}
+
+static void die_on_error(int x, const char *context)
+{
+  if (x < 0) {
+    fprintf(stderr, "%s: %s\n", context, amqp_error_string2(x));
+    exit(1);
+  }
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static SSL_CTX *new_server_ctx(void)
+{
+  FILE *cacert;
+  int fd;
+  SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+  EVP_PKEY *key = NULL;
+  X509 *cert = X509_new();
+
+  if (!ctx || !kctx || !cert || EVP_PKEY_keygen_init(kctx) <= 0 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) <= 0 ||
+      EVP_PKEY_keygen(kctx, &key) <= 0) {
+    die("generating key");
+  }
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_get_notBefore(cert), 0);
+  X509_gmtime_adj(X509_get_notAfter(cert), 3600);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                             (const unsigned char *)"localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(cert));
+  X509_set_pubkey(cert, key);
+  if (!X509_sign(cert, key, EVP_sha256()) ||
+      1 != SSL_CTX_use_certificate(ctx, cert) ||
+      1 != SSL_CTX_use_PrivateKey(ctx, key)) {
+    die("creating certificate");
+  }
+
+#ifdef TLS1_3_VERSION
+  /* the client never reads, and unread tickets would make its close reset
+   * the connection before the server has read everything */
+  SSL_CTX_set_num_tickets(ctx, 0);
+#endif
+
+  fd = mkstemp(cacert_path);
+  cacert = fd < 0 ? NULL : fdopen(fd, "w");
+  if (!cacert || !PEM_write_X509(cacert, cert)) {
+    die("writing certificate");
+  }
+  fclose(cacert);
+
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  EVP_PKEY_CTX_free(kctx);
+  return ctx;
+}
+
+static void *sink_run(void *arg)
+{
+  struct sink *sink = arg;
+  char buf[65536];
+  SSL *ssl;
+  int fd;
+  int n;
+
+  fd = accept(sink->listener, NULL, NULL);
+  if (fd < 0) {
+    sink->status = -1;
+    return NULL;
+  }
+  ssl = SSL_new(server_ctx);
+  SSL_set_fd(ssl, fd);
+  if (1 != SSL_accept(ssl)) {
+    sink->status = -1;
+  } else {
+    while ((n = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+      sink->received += n;
+    }
+  }
+  SSL_free(ssl);
+  close(fd);
+  return NULL;
+}
+
+static void sink_start(struct sink *sink)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+
+  memset(sink, 0, sizeof(*sink));
+  sink->listener = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (sink->listener < 0 ||
+      bind(sink->listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(sink->listener, 1) ||
+      getsockname(sink->listener, (struct sockaddr *)&addr, &len) ||
+      pthread_create(&sink->thread, NULL, sink_run, sink)) {
+    die("starting server");
+  }
+  sink->port = ntohs(addr.sin_port);
+}
+
+static void sink_join(struct sink *sink)
+{
+  pthread_join(sink->thread, NULL);
+  close(sink->listener);
+  if (sink->status) {
+    die("server handshake");
+  }
+}
+
+static void run(const struct workload *w, amqp_boolean_t ktls)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_ssl_socket_new(conn);
+  struct sink sink;
+  amqp_bytes_t body;
+  amqp_boolean_t active;
+  uint64_t start;
+  double seconds;
+  int i;
+
+  if (!socket) {
+    die("creating SSL socket");
+  }
+  /* the certificate is trusted but names localhost, not 127.0.0.1 */
+  amqp_ssl_socket_set_verify(socket, 0);
+  die_on_error(amqp_ssl_socket_set_cacert(socket, cacert_path),
+               "loading certificate");
+  if (AMQP_STATUS_OK != amqp_ssl_socket_set_ktls(socket, ktls)) {
+    fprintf(stderr, "kernel TLS not supported by this build\n");
+  }
+  sink_start(&sink);
+  die_on_error(amqp_socket_open(socket, "127.0.0.1", sink.port), "opening");
+  active = amqp_ssl_socket_get_ktls(socket);
+
+  body.len = w->body_size;
+  body.bytes = calloc(1, w->body_size);
+  if (!body.bytes) {
+    die_on_error(AMQP_STATUS_NO_MEMORY, "allocating body");
+  }
+
+  start = now_ns();
+  for (i = 0; i < w->messages; ++i) {
+    die_on_error(amqp_basic_publish(conn, 1, amqp_empty_bytes,
+                                    amqp_cstring_bytes("bench"), 0, 0, NULL,
+                                    body),
+                 "publishing");
+  }
+  seconds = (now_ns() - start) / 1e9;
+
+  die_on_error(amqp_destroy_connection(conn), "ending connection");
+  sink_join(&sink);
+
+  printf("%s\n    {\"name\": \"publish%s/body_%lu\", \"ktls\": %s, "
+         "\"messages\": %d, \"msgs_per_s\": %.0f, \"mb_per_s\": %.2f, "
+         "\"wire_bytes\": %llu}",
+         results_written++ ? "," : "", ktls ? "_ktls" : "",
+         (unsigned long)w->body_size, active ? "true" : "false", w->messages,
+         w->messages / seconds,
+         (double)w->messages * w->body_size / seconds / 1e6, sink.received);
+  fflush(stdout);
+  free(body.bytes);
+}
+
+int main(void)
+{
+  size_t i;
+
+  server_ctx = new_server_ctx();
+  printf("{\n  \"library\": \"%s\",\n  \"benchmarks\": [", amqp_version());
+  for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+    run(&workloads[i], 0);
+    run(&workloads[i], 1);
+  }
+  printf("\n  ]\n}\n");
+
+  SSL_CTX_free(server_ctx);
+  unlink(cacert_path);
+  return 0;
+}
@@ -0,0 +1,260 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/*
+ * Worker pool scaling benchmark.
+ *
+ * A fake broker thread streams basic.deliver/header/body frames for
+ * CHANNELS channels down one end of a socketpair and discards the acks
+ * coming back. The connection thread dispatches them to 1..32 workers
+ * running a CPU-bound handler, so the numbers show how well processing
+ * spreads across cores while each channel stays in order.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_tcp_socket.h>
+
+#define MESSAGES 100000
+#define CHANNELS 64
+#define MAX_WORKERS 32
+#define BODY_SIZE 256
+#define WORK_ROUNDS 40
+
+struct handler_state {
+  uint64_t last_tag[CHANNELS + 1];
+  volatile uint32_t sink[CHANNELS + 1];
+};
+
+static void die_on_error(int x, const char *context)
+{
+  if (x < 0) {
+    fprintf(stderr, "%s: %s\n", context, amqp_error_string2(x));
+    exit(1);
+  }
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t put_frame(uint8_t *out, uint8_t type, amqp_channel_t channel,
+                        const uint8_t *payload, size_t len)
+{
+  out[0] = type;
+  out[1] = (uint8_t)(channel >> 8);
+  out[2] = (uint8_t)channel;
+  out[3] = (uint8_t)(len >> 24);
+  out[4] = (uint8_t)(len >> 16);
+  out[5] = (uint8_t)(len >> 8);
+  out[6] = (uint8_t)len;
+  memcpy(out + 7, payload, len);
+  out[7 + len] = AMQP_FRAME_END;
+  return len + 8;
+}
+
+/* Encodes one complete delivery (method, header and body frames). */
+static size_t encode_delivery(uint8_t *out, amqp_channel_t channel,
+                              uint64_t delivery_tag)
+{
+  uint8_t payload[BODY_SIZE + 64];
+  amqp_basic_deliver_t deliver;
+  amqp_basic_properties_t props;
+  amqp_bytes_t encoded;
+  size_t total = 0;
+  int len;
+
+  memset(&deliver, 0, sizeof(deliver));
+  deliver.consumer_tag = amqp_cstring_bytes("bench");
+  deliver.delivery_tag = delivery_tag;
+  deliver.exchange = amqp_cstring_bytes("amq.direct");
+  deliver.routing_key = amqp_cstring_bytes("bench");
+
+  payload[0] = 0;
+  payload[1] = 60;
+  payload[2] = 0;
+  payload[3] = 60;
+  encoded.bytes = payload + 4;
+  encoded.len = sizeof(payload) - 4;
+  len = amqp_encode_method(AMQP_BASIC_DELIVER_METHOD, &deliver, encoded);
+  die_on_error(len, "encoding basic.deliver");
+  total += put_frame(out, AMQP_FRAME_METHOD, channel, payload, len + 4);
+
+  memset(&props, 0, sizeof(props));
+  memset(payload, 0, 12);
+  payload[1] = 60;
+  payload[10] = (uint8_t)(BODY_SIZE >> 8);
+  payload[11] = (uint8_t)BODY_SIZE;
+  encoded.bytes = payload + 12;
+  encoded.len = sizeof(payload) - 12;
+  len = amqp_encode_properties(AMQP_BASIC_CLASS, &props, encoded);
+  die_on_error(len, "encoding properties");
+  total += put_frame(out + total, AMQP_FRAME_HEADER, channel, payload, len + 12);
+
+  memset(payload, (int)delivery_tag, BODY_SIZE);
+  total += put_frame(out + total, AMQP_FRAME_BODY, channel, payload, BODY_SIZE);
+  return total;
+}
+
+static void *broker_write(void *arg)
+{
+  int fd = *(int *)arg;
+  uint64_t tags[CHANNELS + 1];
+  uint8_t *buf = malloc(64 * (BODY_SIZE + 256));
+  int i;
+
+  memset(tags, 0, sizeof(tags));
+  for (i = 0; i < MESSAGES;) {
+    size_t len = 0;
+    int n;
+
+    for (n = 0; n < 64 && i < MESSAGES; ++n, ++i) {
+      amqp_channel_t channel = (amqp_channel_t)(i % CHANNELS + 1);
+      len += encode_delivery(buf + len, channel, ++tags[channel]);
+    }
+    if (write(fd, buf, len) != (ssize_t)len) {
+      perror("write");
+      exit(1);
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+static void *broker_read(void *arg)
+{
+  int fd = *(int *)arg;
+  char buf[65536];
+
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+  return NULL;
+}
+
+static amqp_worker_result_t handle(void *ctx, const amqp_envelope_t *envelope)
+{
+  struct handler_state *hs = ctx;
+  const uint8_t *body = envelope->message.body.bytes;
+  uint32_t hash = 2166136261u;
+  size_t i;
+  int round;
+
+  /* deliveries on a channel must arrive in order */
+  if (envelope->delivery_tag != hs->last_tag[envelope->channel] + 1) {
+    fprintf(stderr, "channel %d out of order\n", envelope->channel);
+    exit(1);
+  }
+  hs->last_tag[envelope->channel] = envelope->delivery_tag;
+
+  for (round = 0; round < WORK_ROUNDS; ++round) {
+    for (i = 0; i < envelope->message.body.len; ++i) {
+      hash = (hash ^ body[i]) * 16777619u;
+    }
+  }
+  hs->sink[envelope->channel] = hash;
+  return AMQP_WORKER_ACK;
+}
+
+static void run(int workers)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_tcp_socket_new(conn);
+  struct handler_state hs;
+  struct timeval ack_delay = { 0, 1000 };
+  amqp_worker_pool_t *pool;
+  pthread_t writer, reader;
+  uint64_t start, elapsed;
+  int dispatched = 0;
+  int fds[2];
+  int i;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  amqp_tcp_socket_set_sockfd(socket, fds[0]);
+  for (i = 1; i <= CHANNELS; ++i) {
+    die_on_error(amqp_set_ack_batching(conn, (amqp_channel_t)i, 64, &ack_delay),
+                 "enabling ack batching");
+  }
+
+  memset(&hs, 0, sizeof(hs));
+  pool = amqp_worker_pool_new(conn, workers, AMQP_WORKER_ORDER_CHANNEL, 0,
+                              handle, &hs);
+  if (NULL == pool) {
+    fprintf(stderr, "amqp_worker_pool_new failed\n");
+    exit(1);
+  }
+
+  start = now_ns();
+  pthread_create(&writer, NULL, broker_write, &fds[1]);
+  pthread_create(&reader, NULL, broker_read, &fds[1]);
+
+  while (dispatched < MESSAGES) {
+    int res = amqp_worker_pool_dispatch(pool, NULL, MESSAGES - dispatched);
+    die_on_error(res, "dispatching");
+    dispatched += res;
+  }
+  die_on_error(amqp_worker_pool_destroy(pool), "draining");
+  for (i = 1; i <= CHANNELS; ++i) {
+    die_on_error(amqp_flush_acks(conn, (amqp_channel_t)i), "flushing acks");
+  }
+  elapsed = now_ns() - start;
+
+  printf("%2d workers: %10.0f msg/s  %8.1f us/msg\n", workers,
+         (double)MESSAGES * 1e9 / elapsed, (double)elapsed / MESSAGES / 1000);
+
+  pthread_join(writer, NULL);
+  shutdown(fds[0], SHUT_WR);
+  pthread_join(reader, NULL);
+  close(fds[1]);
+  amqp_destroy_connection(conn);
+}
+
+int main(void)
+{
+  int workers;
+
+  for (workers = 1; workers <= MAX_WORKERS; workers *= 2) {
+    run(workers);
+  }
+  return 0;
+}
@@ -0,0 +1,530 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_tcp_socket.h>
+
+#include "fake_broker.h"
+
+#define MAX_CHANNELS 256
+#define MAX_CONSUMERS 64
+#define MAX_NAME 128
+
+/* frame type amqp_handle_input() reports for the client's protocol header,
+ * see amqp_private.h */
+#define PROTOCOL_HEADER_FRAME 'A'
+
+struct fake_consumer {
+  amqp_channel_t channel;       /* 0 when the slot is free */
+  char queue[MAX_NAME];
+  char tag[MAX_NAME];
+};
+
+struct fake_channel {
+  amqp_boolean_t open;
+  amqp_boolean_t confirm;
+  uint64_t publish_seqno;
+  uint64_t next_delivery_tag;
+  /* content of the publish being received */
+  amqp_boolean_t in_content;
+  uint64_t body_remaining;
+  amqp_channel_t target;        /* consumer channel, 0 to drop */
+};
+
+struct fake_broker_t_ {
+  int fd;
+  pthread_t thread;
+  amqp_connection_state_t conn;
+  int status;
+  amqp_boolean_t closed;
+  int next_consumer;
+  int consumer_seq;
+  int queue_seq;
+  struct fake_broker_stats stats;
+  struct fake_channel channels[MAX_CHANNELS];
+  struct fake_consumer consumers[MAX_CONSUMERS];
+};
+
+static void copy_name(char *dst, amqp_bytes_t src)
+{
+  size_t len = src.len < MAX_NAME - 1 ? src.len : MAX_NAME - 1;
+  memcpy(dst, src.bytes, len);
+  dst[len] = '\0';
+}
+
+static amqp_boolean_t name_equals(const char *name, amqp_bytes_t bytes)
+{
+  return strlen(name) == bytes.len && memcmp(name, bytes.bytes, bytes.len) == 0;
+}
+
+static int reply(fake_broker_t *b, amqp_channel_t channel,
+                 amqp_method_number_t id, void *decoded)
+{
+  return amqp_send_method(b->conn, channel, id, decoded);
+}
+
+static int close_connection(fake_broker_t *b, uint16_t code, const char *text,
+                            amqp_method_number_t cause)
+{
+  amqp_connection_close_t close;
+
+  close.reply_code = code;
+  close.reply_text = amqp_cstring_bytes(text);
+  close.class_id = (uint16_t)(cause >> 16);
+  close.method_id = (uint16_t)cause;
+  b->closed = 1;
+  return reply(b, 0, AMQP_CONNECTION_CLOSE_METHOD, &close);
+}
+
+static int handshake(fake_broker_t *b)
+{
+  amqp_table_entry_t capabilities[3];
+  amqp_table_entry_t properties[2];
+  amqp_connection_start_t start;
+  amqp_connection_tune_t tune;
+  amqp_connection_tune_ok_t *tune_ok;
+  amqp_connection_open_ok_t open_ok;
+  amqp_method_t method;
+  amqp_frame_t frame;
+  int i;
+  int res;
+
+  res = amqp_simple_wait_frame(b->conn, &frame);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+  /* the header is "AMQP" 0 major minor revision, decoded one field off */
+  if (frame.frame_type != PROTOCOL_HEADER_FRAME ||
+      frame.payload.protocol_header.transport_low != AMQP_PROTOCOL_VERSION_MAJOR ||
+      frame.payload.protocol_header.protocol_version_major != AMQP_PROTOCOL_VERSION_MINOR ||
+      frame.payload.protocol_header.protocol_version_minor != AMQP_PROTOCOL_VERSION_REVISION) {
+    return AMQP_STATUS_INCOMPATIBLE_AMQP_VERSION;
+  }
+
+  capabilities[0].key = amqp_cstring_bytes("publisher_confirms");
+  capabilities[1].key = amqp_cstring_bytes("basic.nack");
+  capabilities[2].key = amqp_cstring_bytes("consumer_cancel_notify");
+  for (i = 0; i < 3; ++i) {
+    capabilities[i].value.kind = AMQP_FIELD_KIND_BOOLEAN;
+    capabilities[i].value.value.boolean = 1;
+  }
+  properties[0].key = amqp_cstring_bytes("product");
+  properties[0].value.kind = AMQP_FIELD_KIND_UTF8;
+  properties[0].value.value.bytes = amqp_cstring_bytes("fake-broker");
+  properties[1].key = amqp_cstring_bytes("capabilities");
+  properties[1].value.kind = AMQP_FIELD_KIND_TABLE;
+  properties[1].value.value.table.num_entries = 3;
+  properties[1].value.value.table.entries = capabilities;
+
+  start.version_major = 0;
+  start.version_minor = 9;
+  start.server_properties.num_entries = 2;
+  start.server_properties.entries = properties;
+  start.mechanisms = amqp_cstring_bytes("PLAIN");
+  start.locales = amqp_cstring_bytes("en_US");
+  res = reply(b, 0, AMQP_CONNECTION_START_METHOD, &start);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+  res = amqp_simple_wait_method(b->conn, 0, AMQP_CONNECTION_START_OK_METHOD,
+                                &method);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+
+  tune.channel_max = MAX_CHANNELS - 1;
+  tune.frame_max = AMQP_DEFAULT_FRAME_SIZE;
+  tune.heartbeat = 0;
+  res = reply(b, 0, AMQP_CONNECTION_TUNE_METHOD, &tune);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+  res = amqp_simple_wait_method(b->conn, 0, AMQP_CONNECTION_TUNE_OK_METHOD,
+                                &method);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+  tune_ok = method.decoded;
+  res = amqp_tune_connection(b->conn, tune_ok->channel_max,
+                             (int)tune_ok->frame_max, 0);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+
+  res = amqp_simple_wait_method(b->conn, 0, AMQP_CONNECTION_OPEN_METHOD,
+                                &method);
+  if (res != AMQP_STATUS_OK) {
+    return res;
+  }
+  open_ok.known_hosts = amqp_empty_bytes;
+  return reply(b, 0, AMQP_CONNECTION_OPEN_OK_METHOD, &open_ok);
+}
+
+/* Picks the consumer for a routing key, round-robin over matching ones. */
+static amqp_channel_t route(fake_broker_t *b, amqp_bytes_t routing_key,
+                            amqp_bytes_t *consumer_tag)
+{
+  int i;
+
+  for (i = 0; i < MAX_CONSUMERS; ++i) {
+    struct fake_consumer *c =
+        &b->consumers[(b->next_consumer + i) % MAX_CONSUMERS];
+    if (c->channel != 0 && name_equals(c->queue, routing_key)) {
+      b->next_consumer = (b->next_consumer + i + 1) % MAX_CONSUMERS;
+      *consumer_tag = amqp_cstring_bytes(c->tag);
+      return c->channel;
+    }
+  }
+  return 0;
+}
+
+static void remove_consumers(fake_broker_t *b, amqp_channel_t channel,
+                             amqp_bytes_t *tag)
+{
+  int i;
+
+  for (i = 0; i < MAX_CONSUMERS; ++i) {
+    struct fake_consumer *c = &b->consumers[i];
+    if (c->channel == channel && (tag == NULL || name_equals(c->tag, *tag))) {
+      c->channel = 0;
+    }
+  }
+}
+
+static int publish(fake_broker_t *b, amqp_channel_t channel,
+                   amqp_basic_publish_t *m)
+{
+  struct fake_channel *ch = &b->channels[channel];
+  amqp_basic_deliver_t deliver;
+
+  ch->in_content = 1;
+  ch->target = route(b, m->routing_key, &deliver.consumer_tag);
+  if (ch->target == 0) {
+    return AMQP_STATUS_OK;
+  }
+
+  deliver.delivery_tag = ++b->channels[ch->target].next_delivery_tag;
+  deliver.redelivered = 0;
+  deliver.exchange = m->exchange;
+  deliver.routing_key = m->routing_key;
+  return reply(b, ch->target, AMQP_BASIC_DELIVER_METHOD, &deliver);
+}
+
+static int consume(fake_broker_t *b, amqp_channel_t channel,
+                   amqp_basic_consume_t *m)
+{
+  amqp_basic_consume_ok_t ok;
+  int i;
+
+  for (i = 0; i < MAX_CONSUMERS; ++i) {
+    struct fake_consumer *c = &b->consumers[i];
+    if (c->channel == 0) {
+      c->channel = channel;
+      copy_name(c->queue, m->queue);
+      if (m->consumer_tag.len > 0) {
+        copy_name(c->tag, m->consumer_tag);
+      } else {
+        snprintf(c->tag, sizeof(c->tag), "amq.ctag-%d", ++b->consumer_seq);
+      }
+      if (m->nowait) {
+        return AMQP_STATUS_OK;
+      }
+      ok.consumer_tag = amqp_cstring_bytes(c->tag);
+      return reply(b, channel, AMQP_BASIC_CONSUME_OK_METHOD, &ok);
+    }
+  }
+  return close_connection(b, AMQP_RESOURCE_ERROR, "too many consumers",
+                          AMQP_BASIC_CONSUME_METHOD);
+}
+
+static int handle_method(fake_broker_t *b, amqp_channel_t channel,
+                         amqp_method_t *method)
+{
+  struct fake_channel *ch = &b->channels[channel];
+
+  switch (method->id) {
+  case AMQP_CONNECTION_CLOSE_METHOD: {
+    amqp_connection_close_ok_t ok;
+    b->closed = 1;
+    return reply(b, 0, AMQP_CONNECTION_CLOSE_OK_METHOD, &ok);
+  }
+  case AMQP_CONNECTION_CLOSE_OK_METHOD:
+    b->closed = 1;
+    return AMQP_STATUS_OK;
+
+  case AMQP_CHANNEL_OPEN_METHOD: {
+    amqp_channel_open_ok_t ok;
+    memset(ch, 0, sizeof(*ch));
+    ch->open = 1;
+    ok.channel_id = amqp_empty_bytes;
+    return reply(b, channel, AMQP_CHANNEL_OPEN_OK_METHOD, &ok);
+  }
+  case AMQP_CHANNEL_CLOSE_METHOD: {
+    amqp_channel_close_ok_t ok;
+    remove_consumers(b, channel, NULL);
+    memset(ch, 0, sizeof(*ch));
+    return reply(b, channel, AMQP_CHANNEL_CLOSE_OK_METHOD, &ok);
+  }
+
+  case AMQP_QUEUE_DECLARE_METHOD: {
+    amqp_queue_declare_t *m = method->decoded;
+    amqp_queue_declare_ok_t ok;
+    char name[MAX_NAME];
+    if (m->nowait) {
+      return AMQP_STATUS_OK;
+    }
+    if (m->queue.len > 0) {
+      ok.queue = m->queue;
+    } else {
+      snprintf(name, sizeof(name), "amq.gen-%d", ++b->queue_seq);
+      ok.queue = amqp_cstring_bytes(name);
+    }
+    ok.message_count = 0;
+    ok.consumer_count = 0;
+    return reply(b, channel, AMQP_QUEUE_DECLARE_OK_METHOD, &ok);
+  }
+
+  case AMQP_BASIC_QOS_METHOD: {
+    amqp_basic_qos_ok_t ok;
+    return reply(b, channel, AMQP_BASIC_QOS_OK_METHOD, &ok);
+  }
+  case AMQP_BASIC_CONSUME_METHOD:
+    return consume(b, channel, method->decoded);
+  case AMQP_BASIC_CANCEL_METHOD: {
+    amqp_basic_cancel_t *m = method->decoded;
+    amqp_basic_cancel_ok_t ok;
+    remove_consumers(b, channel, &m->consumer_tag);
+    if (m->nowait) {
+      return AMQP_STATUS_OK;
+    }
+    ok.consumer_tag = m->consumer_tag;
+    return reply(b, channel, AMQP_BASIC_CANCEL_OK_METHOD, &ok);
+  }
+
+  case AMQP_CONFIRM_SELECT_METHOD: {
+    amqp_confirm_select_t *m = method->decoded;
+    amqp_confirm_select_ok_t ok;
+    ch->confirm = 1;
+    if (m->nowait) {
+      return AMQP_STATUS_OK;
+    }
+    return reply(b, channel, AMQP_CONFIRM_SELECT_OK_METHOD, &ok);
+  }
+
+  case AMQP_BASIC_PUBLISH_METHOD:
+    return publish(b, channel, method->decoded);
+
+  case AMQP_BASIC_ACK_METHOD:
+  case AMQP_BASIC_NACK_METHOD:
+  case AMQP_BASIC_REJECT_METHOD:
+    ++b->stats.acks;
+    return AMQP_STATUS_OK;
+
+  default:
+    return close_connection(b, AMQP_NOT_IMPLEMENTED, "NOT_IMPLEMENTED",
+                            method->id);
+  }
+}
+
+/* Called once the whole body of a publish has been forwarded. */
+static int content_done(fake_broker_t *b, amqp_channel_t channel)
+{
+  struct fake_channel *ch = &b->channels[channel];
+  amqp_basic_ack_t ack;
+
+  ch->in_content = 0;
+  ++b->stats.published;
+  if (ch->target != 0) {
+    ++b->stats.delivered;
+  }
+  if (!ch->confirm) {
+    return AMQP_STATUS_OK;
+  }
+
+  ack.delivery_tag = ++ch->publish_seqno;
+  ack.multiple = 0;
+  ++b->stats.confirmed;
+  return reply(b, channel, AMQP_BASIC_ACK_METHOD, &ack);
+}
+
+/* Header and body frames are forwarded as they arrive, only the channel
+ * changes. */
+static int handle_content(fake_broker_t *b, amqp_frame_t *frame)
+{
+  struct fake_channel *ch = &b->channels[frame->channel];
+  amqp_frame_t out;
+  int res;
+
+  if (!ch->in_content) {
+    return close_connection(b, AMQP_UNEXPECTED_FRAME, "UNEXPECTED_FRAME", 0);
+  }
+
+  if (frame->frame_type == AMQP_FRAME_HEADER) {
+    ch->body_remaining = frame->payload.properties.body_size;
+  } else {
+    size_t len = frame->payload.body_fragment.len;
+    if (len > ch->body_remaining) {
+      return close_connection(b, AMQP_FRAME_ERROR, "FRAME_ERROR", 0);
+    }
+    ch->body_remaining -= len;
+  }
+
+  if (ch->target != 0) {
+    out = *frame;
+    out.channel = ch->target;
+    res = amqp_send_frame(b->conn, &out);
+    if (res != AMQP_STATUS_OK) {
+      return res;
+    }
+  }
+
+  if (ch->body_remaining == 0) {
+    return content_done(b, frame->channel);
+  }
+  return AMQP_STATUS_OK;
+}
+
+static int serve(fake_broker_t *b)
+{
+  amqp_socket_t *socket;
+  int res;
+
+  b->conn = amqp_new_connection();
+  if (b->conn == NULL) {
+    close(b->fd);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  socket = amqp_tcp_socket_new(b->conn);
+  if (socket == NULL) {
+    close(b->fd);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  amqp_tcp_socket_set_sockfd(socket, b->fd);
+
+  res = handshake(b);
+  while (res == AMQP_STATUS_OK && !b->closed) {
+    amqp_frame_t frame;
+
+    amqp_maybe_release_buffers(b->conn);
+    res = amqp_simple_wait_frame(b->conn, &frame);
+    if (res != AMQP_STATUS_OK) {
+      break;
+    }
+    if (frame.channel >= MAX_CHANNELS) {
+      res = close_connection(b, AMQP_CHANNEL_ERROR, "CHANNEL_ERROR", 0);
+      continue;
+    }
+
+    switch (frame.frame_type) {
+    case AMQP_FRAME_METHOD:
+      res = handle_method(b, frame.channel, &frame.payload.method);
+      break;
+    case AMQP_FRAME_HEADER:
+    case AMQP_FRAME_BODY:
+      res = handle_content(b, &frame);
+      break;
+    default:
+      break;
+    }
+  }
+
+  /* the client hanging up is how an unclosed connection ends */
+  if (res == AMQP_STATUS_CONNECTION_CLOSED) {
+    res = AMQP_STATUS_OK;
+  }
+  amqp_destroy_connection(b->conn);
+  return res;
+}
+
+static void *broker_thread(void *arg)
+{
+  fake_broker_t *b = arg;
+  b->status = serve(b);
+  return NULL;
+}
+
+fake_broker_t *fake_broker_start(int fd)
+{
+  fake_broker_t *b = calloc(1, sizeof(fake_broker_t));
+
+  if (b == NULL) {
+    return NULL;
+  }
+  b->fd = fd;
+  if (pthread_create(&b->thread, NULL, broker_thread, b) != 0) {
+    free(b);
+    return NULL;
+  }
+  return b;
+}
+
+int fake_broker_connect(amqp_connection_state_t conn, fake_broker_t **broker)
+{
+  amqp_socket_t *socket;
+  int fds[2];
+
+  socket = amqp_tcp_socket_new(conn);
+  if (socket == NULL) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return AMQP_STATUS_SOCKET_ERROR;
+  }
+
+  *broker = fake_broker_start(fds[1]);
+  if (*broker == NULL) {
+    close(fds[0]);
+    close(fds[1]);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  amqp_tcp_socket_set_sockfd(socket, fds[0]);
+  return AMQP_STATUS_OK;
+}
+
+int fake_broker_join(fake_broker_t *broker, struct fake_broker_stats *stats)
+{
+  int status;
+
+  pthread_join(broker->thread, NULL);
+  status = broker->status;
+  if (stats != NULL) {
+    *stats = broker->stats;
+  }
+  free(broker);
+  return status;
+}
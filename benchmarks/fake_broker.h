@@ -0,0 +1,82 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * Minimal in-process AMQP 0-9-1 broker for benchmarks.
+ *
+ * The broker serves a single client connection from its own thread, using
+ * this library's codec on a second connection object. It completes the
+ * amqp_login() handshake and understands channel.open/close, queue.declare,
+ * basic.qos, basic.consume/cancel, confirm.select, basic.publish and
+ * basic.ack/nack/reject. Published messages are looped back as deliveries
+ * to a consumer on the queue named by the routing key (default exchange
+ * semantics, round-robin across consumers), and acked when the channel is
+ * in confirm mode. Messages with no consumer are dropped. basic.qos is
+ * accepted but prefetch is not enforced; nothing is stored.
+ *
+ * Any method it does not know closes the connection with 540.
+ */
+
+#ifndef FAKE_BROKER_H
+#define FAKE_BROKER_H
+
+#include <stdint.h>
+
+#include <amqp.h>
+
+typedef struct fake_broker_t_ fake_broker_t;
+
+struct fake_broker_stats {
+  uint64_t published;   /* complete messages received from the client */
+  uint64_t delivered;   /* messages looped back to a consumer */
+  uint64_t confirmed;   /* basic.ack sent for confirm mode publishes */
+  uint64_t acks;        /* basic.ack/nack/reject received from consumers */
+};
+
+/*
+ * Starts serving the connected socket fd in a new thread. fd may be one end
+ * of a socketpair or an accepted loopback TCP socket; the broker owns it
+ * from now on. Returns NULL on failure.
+ */
+fake_broker_t *fake_broker_start(int fd);
+
+/*
+ * Creates a socketpair, starts a broker on one end and attaches the other
+ * end to conn through a new TCP socket object. Returns an amqp_status_enum
+ * value.
+ */
+int fake_broker_connect(amqp_connection_state_t conn, fake_broker_t **broker);
+
+/*
+ * Waits for the broker thread to finish (the client closed the connection
+ * or the socket), copies its counters to stats if not NULL and frees it.
+ * Returns the status the broker stopped with, AMQP_STATUS_OK after a clean
+ * connection.close.
+ */
+int fake_broker_join(fake_broker_t *broker, struct fake_broker_stats *stats);
+
+#endif /* FAKE_BROKER_H */
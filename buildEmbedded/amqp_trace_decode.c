@@ -0,0 +1,122 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/*
+ * Host-side renderer for trace dumps.
+ *
+ * Reads amqp_trace_event_t records, as copied out by amqp_trace_dump() and
+ * written to a file unchanged, and prints one line per event:
+ *
+ *   cc -I../librabbitmq -o amqp_trace_decode amqp_trace_decode.c
+ *   ./amqp_trace_decode [-b] [dump-file]
+ *
+ * Records are read in little-endian order (ARM Cortex-M, x86), -b reads a
+ * dump from a big-endian target. Reads stdin when no file is given.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "amqp_trace.h"
+
+#define RECORD_SIZE 32
+
+#define TRACE_NAME(name, format) #name,
+#define TRACE_FORMAT(name, format) format,
+
+static const char *names[] = { AMQP_TRACE_EVENTS(TRACE_NAME) };
+static const char *formats[] = { AMQP_TRACE_EVENTS(TRACE_FORMAT) };
+
+static uint64_t decode(const unsigned char *p, int bytes, int big_endian)
+{
+  uint64_t value = 0;
+  int i;
+
+  for (i = 0; i < bytes; ++i) {
+    int shift = big_endian ? 8 * (bytes - 1 - i) : 8 * i;
+    value |= (uint64_t)p[i] << shift;
+  }
+  return value;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char record[RECORD_SIZE];
+  FILE *in = stdin;
+  int big_endian = 0;
+  uint64_t first = 0;
+  uint64_t previous = 0;
+  int arg;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (0 == strcmp(argv[arg], "-b")) {
+      big_endian = 1;
+    } else if (NULL == (in = fopen(argv[arg], "rb"))) {
+      perror(argv[arg]);
+      return 1;
+    }
+  }
+
+  while (RECORD_SIZE == fread(record, 1, RECORD_SIZE, in)) {
+    uint64_t timestamp = decode(record, 8, big_endian);
+    uint32_t seq = (uint32_t)decode(record + 8, 4, big_endian);
+    unsigned id = (unsigned)decode(record + 12, 2, big_endian);
+    uint32_t args[4];
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+      args[i] = (uint32_t)decode(record + 16 + 4 * i, 4, big_endian);
+    }
+    if (0 == first) {
+      first = timestamp;
+      previous = timestamp;
+    }
+
+    /* time since the first event and since the previous one, in us */
+    printf("%10u %12.3f %+10.3f  ", (unsigned)seq,
+           (double)(timestamp - first) / 1000.0,
+           (double)(timestamp - previous) / 1000.0);
+    previous = timestamp;
+
+    if (id < AMQP_TRACE_EVENT_COUNT) {
+      printf("%-18s ", names[id]);
+      printf(formats[id], args[0], args[1], args[2], args[3]);
+    } else {
+      printf("unknown event %u: 0x%08x 0x%08x 0x%08x 0x%08x", id,
+             (unsigned)args[0], (unsigned)args[1], (unsigned)args[2],
+             (unsigned)args[3]);
+    }
+    putchar('\n');
+  }
+
+  if (stdin != in) {
+    fclose(in);
+  }
+  return 0;
+}
@@ -52,10 +52,30 @@ $C_FILE_NAMES = %w(
     amqp_table.c
     amqp_url.c
     amqp_tcp_socket.c
+    amqp_memory_socket.c
     amqp_timer.c
+    amqp_timer_wheel.c
+    amqp_lazy_properties.c
     amqp_consumer.c
+    amqp_confirm.c
+    amqp_ack.c
+    amqp_prefetch.c
+    amqp_dispatch.c
+    amqp_publisher.c
+    amqp_io_thread.c
+    amqp_worker_pool.c
+    amqp_os_freertos.c
+    amqp_stats.c
+    amqp_trace.c
+    lightStreams.c
 )
 
+# Set RABBITMQ_FRAMING_COMPACT=1 to build the table-driven framing codec,
+# which is about half the size.
+if ENV['RABBITMQ_FRAMING_COMPACT']
+  $C_FILE_NAMES[$C_FILE_NAMES.index('amqp_framing.c')] = 'amqp_framing_compact.c'
+end
+
 $SRC_FILES = FileList.new($C_FILE_NAMES.map {|file| File.expand_path(file,$SRC_DIR_PATH)})
 $OBJ_FILES = FileList.new()
 
@@ -176,6 +196,7 @@ task :default do
     puts "  rake clean"
     puts "  rake clobber"
     puts "  rake #{$LIB_TARGET}"
+    puts "  rake trace_decode"
     puts
     puts "  rake -T"
 end
@@ -216,11 +237,27 @@ task $LIB_TARGET do
 end
 
 
+# --------------------------------------------------------------+-
+# Target: host-side trace dump decoder (built with the host compiler)
+# --------------------------------------------------------------+-
+$TRACE_DECODER = File.expand_path('buildEmbedded/amqp_trace_decode', $LIB_DIR_PATH)
+
+desc "Build the host tool that renders amqp_trace_dump() output."
+task :trace_decode do
+    cmd  = "cc -O2 -Wall "
+    cmd += "-I#{$SRC_DIR_PATH} "
+    cmd += "-o #{$TRACE_DECODER} "
+    cmd += "#{$TRACE_DECODER}.c"
+    sh cmd
+end
+
+
 # --------------------------------------------------------------+-
 # Targets: Clean/Clobber
 # --------------------------------------------------------------+-
 CLEAN.include("#{$OBJ_DIR_PATH}/*")
 CLOBBER.include("#{$LIB_DIR_PATH}/buildEmbedded/#{$STATIC_LIB}")
+CLOBBER.include($TRACE_DECODER)
 
 
 
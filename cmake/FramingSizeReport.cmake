@@ -0,0 +1,37 @@
+# vim:set ts=2 sw=2 sts=2 et:
+#
+# Prints the flash used by the full and the pruned or compact framing code,
+# see AMQP_FRAMING_METHODS and AMQP_FRAMING_COMPACT. Run with -DSIZE_EXECUTABLE=... -DFULL=<archive>
+# -DPRUNED=<archive> -P FramingSizeReport.cmake.
+
+if (NOT SIZE_EXECUTABLE)
+  message(FATAL_ERROR "No size utility found, set SIZE_EXECUTABLE")
+endif ()
+
+# text + data of every object in an archive, which is what goes to flash
+function(flash_size archive result)
+  execute_process(COMMAND ${SIZE_EXECUTABLE} -B ${archive}
+    OUTPUT_VARIABLE _output
+    RESULT_VARIABLE _failed)
+  if (_failed)
+    message(FATAL_ERROR "${SIZE_EXECUTABLE} ${archive} failed")
+  endif ()
+
+  set(_total 0)
+  string(REPLACE "\n" ";" _lines "${_output}")
+  foreach (_line ${_lines})
+    if (_line MATCHES "^[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+[0-9]+")
+      math(EXPR _total "${_total} + ${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+    endif ()
+  endforeach ()
+  set(${result} ${_total} PARENT_SCOPE)
+endfunction()
+
+flash_size(${FULL} full)
+flash_size(${PRUNED} pruned)
+math(EXPR saved "${full} - ${pruned}")
+
+message("amqp_framing flash (text + data):")
+message("  full:   ${full} bytes")
+message("  build:  ${pruned} bytes")
+message("  saved:  ${saved} bytes")
@@ -706,6 +706,11 @@ typedef enum amqp_status_enum_
                                                         heartbeat */
   AMQP_STATUS_UNEXPECTED_STATE =          -0x0010, /**< Unexpected protocol
                                                         state */
+  AMQP_STATUS_UNSUPPORTED =               -0x0011, /**< Operation is not
+                                                        supported on this
+                                                        platform or in the
+                                                        connection's current
+                                                        mode */
 
   AMQP_STATUS_TCP_ERROR =                 -0x0100, /**< A generic TCP error
                                                         occurred */
@@ -1285,6 +1290,124 @@ AMQP_PUBLIC_FUNCTION
 int
 AMQP_CALL amqp_send_frame(amqp_connection_state_t state, amqp_frame_t const *frame);
 
+/**
+ * Enable or resize the outbound write buffer
+ *
+ * By default every frame is written to the socket as soon as it is
+ * encoded. With a write buffer enabled, frames are coalesced in memory and
+ * written out once flush_threshold bytes are pending, once the oldest
+ * pending byte is older than max_delay, when amqp_flush() is called, or
+ * before the library blocks waiting for a frame from the broker (e.g., in
+ * amqp_simple_rpc()).
+ *
+ * Any data already buffered is flushed before the buffer is resized.
+ *
+ * \param [in] state the connection object
+ * \param [in] size the size of the buffer in bytes, 0 disables buffering
+ * \param [in] flush_threshold number of pending bytes that trigger a write,
+ *             0 or a value larger than size means size
+ * \param [in] max_delay the longest time a frame may sit in the buffer,
+ *             NULL for no deadline. The deadline is checked whenever a frame
+ *             is sent, there is no background timer.
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *  Possible error codes:
+ *  - AMQP_STATUS_NO_MEMORY failed to allocate the buffer
+ *  - AMQP_STATUS_INVALID_PARAMETER max_delay is negative
+ *  - any error amqp_flush() can return
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_set_write_buffer(amqp_connection_state_t state, size_t size,
+                                size_t flush_threshold,
+                                struct timeval *max_delay);
+
+/**
+ * Write any frames pending in the outbound write buffer to the socket
+ *
+ * This is a no-op if the write buffer is disabled or empty.
+ *
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *  Possible error codes:
+ *  - AMQP_STATUS_SOCKET_ERROR
+ *  - AMQP_STATUS_SSL_ERROR
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_flush(amqp_connection_state_t state);
+
+/**
+ * A monotonic clock, see amqp_set_clock()
+ *
+ * \param [in] arg the argument given to amqp_set_clock()
+ * \return the current time in nanoseconds from an arbitrary origin, 0 if the
+ *          clock failed
+ *
+ * \since v0.6.0
+ */
+typedef uint64_t (*amqp_clock_fn)(void *arg);
+
+/**
+ * Replace the clock a connection uses for heartbeats and timeouts
+ *
+ * The library reads the clock once per socket read or write and once per
+ * amqp_basic_publish(), and works from that cached time in between, so the
+ * clock is read far less often than once per frame. By default it is the platform's monotonic
+ * clock; a cheaper source such as a scaled RTOS tick counter can be used
+ * instead, as long as it is monotonic and its resolution is well below the
+ * heartbeat interval.
+ *
+ * Set the clock before opening the connection, heartbeat deadlines already
+ * computed are not converted.
+ *
+ * \param [in] state the connection object
+ * \param [in] clock the clock, NULL to go back to the default one
+ * \param [in] arg passed to clock on every call
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_set_clock(amqp_connection_state_t state, amqp_clock_fn clock,
+                         void *arg);
+
+/**
+ * Decode basic content header properties only when they are read
+ *
+ * By default every content header is decoded as it arrives, headers table
+ * included, and amqp_read_message() then deep copies the result. In lazy
+ * mode only the property flags are read: the properties of a basic content
+ * header are returned as an amqp_lazy_properties_t and each property is
+ * decoded by amqp_lazy_properties_get() the first time it is asked for.
+ *
+ * With lazy mode on:
+ *  - the payload.properties.decoded of a basic content header frame points
+ *    to an amqp_lazy_properties_t. Its first member is the
+ *    amqp_basic_properties_t being filled in, so code reading decoded as an
+ *    amqp_basic_properties_t sees the properties decoded so far. Passed
+ *    to amqp_send_frame(), the frame is sent with its encoded properties
+ *    unchanged.
+ *  - amqp_dispatch() sets delivery->lazy, delivery->properties points to
+ *    its properties member.
+ *  - amqp_read_message() still returns every property decoded, use
+ *    amqp_read_message_lazy() (which works in either mode) to defer that.
+ *
+ *
+ * \param [in] state the connection object
+ * \param [in] enable true for lazy mode, false to decode eagerly (the
+ *             default)
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_set_lazy_properties(amqp_connection_state_t state,
+                                   amqp_boolean_t enable);
+
 /**
  * todo define this prototype.
  */
@@ -1873,6 +1996,139 @@ AMQP_CALL amqp_basic_publish_streaming(amqp_connection_state_t state, amqp_chann
                              struct amqp_basic_properties_t_ const *properties,
                              lightStreamAggregateP_t bodyStreamP);
 
+/**
+ * A per-thread handle for publishing on a shared connection
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_publisher_t_ amqp_publisher_t;
+
+/**
+ * Allow several threads to publish on one connection
+ *
+ * After this call, threads other than the one that owns the connection may
+ * publish using amqp_publisher_new() / amqp_publisher_publish(). Each
+ * message is encoded by the publishing thread and handed to a lock-free
+ * queue; whichever thread currently holds the socket writes out everything
+ * queued with a single writev. The owning thread keeps using the connection
+ * as before (RPCs, consuming, amqp_basic_publish()); its writes take part in
+ * the same scheme.
+ *
+ * Only publishing is thread-safe. Channels have to be opened (and closed) by
+ * the owning thread, and each channel should only be published on by one
+ * amqp_publisher_t. Publisher confirms and ack batching are not supported on
+ * channels used by an amqp_publisher_t. Concurrent writes from several
+ * threads are only safe on plain TCP sockets.
+ *
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_NO_MEMORY on failure
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_enable_shared_publishing(amqp_connection_state_t state);
+
+/**
+ * Create a publisher handle for the calling thread
+ *
+ * \param [in] state the connection object, shared publishing must be enabled
+ * \param [in] channel an open channel, other than 0
+ * \return the publisher, or NULL if shared publishing is not enabled, the
+ *          channel is 0, or memory could not be allocated
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_publisher_t *
+AMQP_CALL amqp_publisher_new(amqp_connection_state_t state,
+                             amqp_channel_t channel);
+
+/**
+ * Destroy a publisher handle
+ *
+ * All publisher handles must be destroyed before the connection.
+ *
+ * \param [in] publisher the publisher, may be NULL
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_publisher_destroy(amqp_publisher_t *publisher);
+
+/**
+ * Publish a message from a publisher thread
+ *
+ * Same parameters and encoding as amqp_basic_publish(). The message is
+ * queued in full before this returns (the body is copied), and is written
+ * to the socket either by this thread or by whichever thread is currently
+ * writing. A write error is reported by the next call on any publisher.
+ *
+ * \param [in] publisher the publisher
+ * \param [in] exchange the exchange to publish to
+ * \param [in] routing_key the routing key
+ * \param [in] mandatory the mandatory flag
+ * \param [in] immediate the immediate flag
+ * \param [in] properties message properties, NULL for defaults
+ * \param [in] body the message body
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_publisher_publish(amqp_publisher_t *publisher,
+                                 amqp_bytes_t exchange, amqp_bytes_t routing_key,
+                                 amqp_boolean_t mandatory, amqp_boolean_t immediate,
+                                 struct amqp_basic_properties_t_ const *properties,
+                                 amqp_bytes_t body);
+
+/**
+ * Move socket I/O onto a background thread
+ *
+ * Call after amqp_login(). From then on a library-owned thread does all
+ * reads and writes on the socket, decodes incoming frames and handles
+ * heartbeats, so a connection stays alive while the application is busy
+ * processing a message. Decoded frames and outgoing frames are passed
+ * between the two threads through single-producer/single-consumer rings;
+ * the rest of the API is used exactly as before (from one thread only), and
+ * frames stay valid until their channel's buffers are released, see
+ * amqp_maybe_release_buffers_on_channel().
+ *
+ * Cannot be combined with amqp_enable_shared_publishing(). Only available
+ * on POSIX systems.
+ *
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_UNSUPPORTED if the platform
+ *         has no I/O thread support, AMQP_STATUS_INVALID_PARAMETER if the
+ *         connection is not open or uses shared publishing, or another
+ *         amqp_status_enum error
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_start_io_thread(amqp_connection_state_t state);
+
+/**
+ * Stop the background I/O thread
+ *
+ * Queued outgoing data is written before the thread exits. Frames it decoded
+ * but the application has not consumed yet are queued on the connection
+ * (see amqp_frames_enqueued()), and anything else it read is decoded by the
+ * application thread as before. Called implicitly by
+ * amqp_destroy_connection().
+ *
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK, or the error that made the I/O thread stop
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_stop_io_thread(amqp_connection_state_t state);
+
 /**
  * Closes an channel
  *
@@ -1918,6 +2174,9 @@ AMQP_CALL amqp_connection_close(amqp_connection_state_t state, int code);
  * \return 0 on success,  0 > on failing to send the ack to the broker.
  *            this will not indicate failure if something goes wrong on the broker
  *
+ * If ack batching is enabled on the channel (see amqp_set_ack_batching())
+ * the ack may be held back and sent later as part of a multiple=1 ack.
+ *
  * \since v0.1
  */
 AMQP_PUBLIC_FUNCTION
@@ -1925,6 +2184,58 @@ int
 AMQP_CALL amqp_basic_ack(amqp_connection_state_t state, amqp_channel_t channel,
                          uint64_t delivery_tag, amqp_boolean_t multiple);
 
+/**
+ * Enable or disable ack batching on a channel
+ *
+ * With batching enabled, in-order calls to amqp_basic_ack() with
+ * multiple == false are accumulated, and a single basic.ack with
+ * multiple == true is sent for the highest contiguous delivery tag once count
+ * acks are pending or the oldest pending ack is older than max_delay. Pending
+ * acks are also sent before the library blocks waiting for data from the
+ * broker, and when the channel is closed with amqp_channel_close().
+ *
+ * Acks that arrive out of delivery order are sent immediately, as are
+ * multiple == true acks. Batching assumes delivery tags on the channel are
+ * only settled through amqp_basic_ack(), amqp_basic_reject() and
+ * amqp_basic_nack().
+ *
+ * Batching starts with the first delivery received after it is enabled;
+ * until then acks are sent as they are made. When it is enabled on a
+ * channel that already has deliveries, those must all be settled before the
+ * next delivery is acked, as the batched multiple == true acks cover them.
+ * If the broker closes the channel (or the connection), acks still held
+ * back are dropped, the broker has already discarded those deliveries, and
+ * batching has to be enabled again on the reopened channel.
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel identifier
+ * \param [in] count the number of acks to accumulate, 0 disables batching
+ *             (sending anything that is pending)
+ * \param [in] max_delay the longest time an ack may be held back, NULL for
+ *             no deadline. The deadline is checked whenever an ack is made.
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_set_ack_batching(amqp_connection_state_t state,
+                                amqp_channel_t channel, unsigned int count,
+                                struct timeval *max_delay);
+
+/**
+ * Send any acks held back by ack batching on a channel
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel identifier
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_flush_acks(amqp_connection_state_t state, amqp_channel_t channel);
+
 /**
  * Do a basic.get
  *
@@ -2116,6 +2427,64 @@ AMQP_PUBLIC_FUNCTION
 int
 AMQP_CALL amqp_table_clone(amqp_table_t *original, amqp_table_t *clone, amqp_pool_t *pool);
 
+/**
+ * Set in properties._flags of every amqp_lazy_properties_t, telling it apart
+ * from a plain amqp_basic_properties_t. Bit 0 is the flag word continuation
+ * bit, which basic properties never use.
+ *
+ * \since v0.6.0
+ */
+#define AMQP_LAZY_PROPERTIES_FLAG (1 << 0)
+
+/**
+ * Basic content header properties decoded on demand
+ *
+ * See amqp_set_lazy_properties().
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_lazy_properties_t_ {
+  amqp_basic_properties_t properties; /**< the properties decoded so far,
+                                           properties._flags tells which,
+                                           along with
+                                           AMQP_LAZY_PROPERTIES_FLAG */
+  amqp_flags_t flags;                 /**< the properties present */
+  amqp_bytes_t raw;                   /**< the encoded properties following
+                                           the flags */
+  amqp_pool_t *pool;                  /**< pool decoded tables are
+                                           allocated from */
+} amqp_lazy_properties_t;
+
+/**
+ * Decode properties of a lazily decoded content header
+ *
+ * Each property in flags that is present and not decoded yet is decoded
+ * into lazy->properties and its flag set in lazy->properties._flags; the
+ * properties already decoded are not looked at again. String properties
+ * point into lazy->raw, the headers table is allocated from lazy->pool.
+ *
+ * \code
+ * res = amqp_lazy_properties_get(lazy, AMQP_BASIC_CONTENT_TYPE_FLAG);
+ * if (AMQP_STATUS_OK == res &&
+ *     (lazy->properties._flags & AMQP_BASIC_CONTENT_TYPE_FLAG)) {
+ *   use(lazy->properties.content_type);
+ * }
+ * \endcode
+ *
+ * \param [in] lazy the properties
+ * \param [in] flags the AMQP_BASIC_*_FLAG values of the properties wanted
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *  Possible error codes:
+ *  - AMQP_STATUS_BAD_AMQP_DATA the encoded properties are malformed
+ *  - AMQP_STATUS_NO_MEMORY decoding the headers table failed to allocate
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_lazy_properties_get(amqp_lazy_properties_t *lazy,
+                                   amqp_flags_t flags);
+
 /**
  * A message object
  *
@@ -2162,6 +2531,57 @@ AMQP_PUBLIC_FUNCTION
 void
 AMQP_CALL amqp_destroy_message(amqp_message_t *message);
 
+/**
+ * A message object whose properties are decoded on demand
+ *
+ * properties->pool points to pool, so the object must not be moved while
+ * the properties are in use.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_lazy_message_t_ {
+  amqp_lazy_properties_t *properties; /**< message properties, see
+                                           amqp_lazy_properties_get() */
+  amqp_bytes_t body;                  /**< message body */
+  amqp_pool_t pool;                   /**< pool used to allocate properties */
+} amqp_lazy_message_t;
+
+/**
+ * Reads the next message on a channel, leaving its properties encoded
+ *
+ * Like amqp_read_message(), but the encoded properties are copied into the
+ * message pool as they are, and decoded one at a time by
+ * amqp_lazy_properties_get(). Works whether or not
+ * amqp_set_lazy_properties() is enabled, though only lazy mode also skips
+ * decoding them when the content header arrives.
+ *
+ * \param [in,out] state the connection object
+ * \param [in] channel the channel on which to read the message from
+ * \param [in,out] message the message object to fill in. Caller should
+ *                 call amqp_destroy_lazy_message() when done with it.
+ * \param [in] flags pass in 0. Currently unused.
+ * \returns a amqp_rpc_reply_t object. ret.reply_type == AMQP_RESPONSE_NORMAL on success.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_rpc_reply_t
+AMQP_CALL amqp_read_message_lazy(amqp_connection_state_t state,
+                                 amqp_channel_t channel,
+                                 amqp_lazy_message_t *message, int flags);
+
+/**
+ * Frees memory associated with a amqp_lazy_message_t filled in by
+ * amqp_read_message_lazy()
+ *
+ * \param [in] message
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_destroy_lazy_message(amqp_lazy_message_t *message);
+
 /**
  * Envelope object
  *
@@ -2224,6 +2644,413 @@ AMQP_PUBLIC_FUNCTION
 void
 AMQP_CALL amqp_destroy_envelope(amqp_envelope_t *envelope);
 
+/**
+ * A message delivered to a registered consumer
+ *
+ * All fields point into memory owned by the connection and are only valid
+ * for the duration of the handler call.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_delivery_view_t_ {
+  amqp_channel_t channel;           /**< channel message was delivered on */
+  amqp_bytes_t consumer_tag;        /**< the consumer tag the message was delivered to */
+  uint64_t delivery_tag;            /**< the messages delivery tag */
+  amqp_boolean_t redelivered;       /**< flag indicating whether this message is being redelivered */
+  amqp_bytes_t exchange;            /**< exchange this message was published to */
+  amqp_bytes_t routing_key;         /**< the routing key this message was published with */
+  amqp_basic_properties_t *properties; /**< message properties */
+  amqp_bytes_t body;                /**< message body */
+  amqp_lazy_properties_t *lazy;     /**< message properties in lazy mode,
+                                         NULL otherwise. See
+                                         amqp_set_lazy_properties() */
+} amqp_delivery_view_t;
+
+/**
+ * Consumer callback invoked by amqp_dispatch()
+ *
+ * Returning anything other than AMQP_STATUS_OK stops amqp_dispatch(), which
+ * then returns that value.
+ *
+ * \since v0.6.0
+ */
+typedef int (*amqp_consumer_handler_t)(void *ctx,
+                                       const amqp_delivery_view_t *delivery);
+
+/**
+ * Register a handler for deliveries to a consumer
+ *
+ * The consumer tag is the one passed to or returned from
+ * amqp_basic_consume(). Registering a tag twice replaces the handler;
+ * passing a NULL handler removes the registration. Registrations on a
+ * channel are dropped when it is closed with amqp_channel_close().
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel the consumer is on
+ * \param [in] consumer_tag the consumer tag, copied by the library
+ * \param [in] handler the callback, or NULL to unregister
+ * \param [in] ctx passed back to the handler unchanged
+ * \return AMQP_STATUS_OK on success, an amqp_status_enum value on failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_register_consumer(amqp_connection_state_t state,
+                                 amqp_channel_t channel,
+                                 amqp_bytes_t consumer_tag,
+                                 amqp_consumer_handler_t handler, void *ctx);
+
+/**
+ * Wait for deliveries and hand them to registered consumers
+ *
+ * Waits up to timeout for the first delivery, then keeps dispatching
+ * whatever is already available without blocking, up to max_msgs messages.
+ * Handlers get a zero-copy view of each delivery.
+ *
+ * If a frame other than a basic.deliver for a registered consumer is read,
+ * it is left in the queue and dispatching stops; the caller should read it
+ * with amqp_simple_wait_frame() (or amqp_consume_message() for deliveries to
+ * unregistered consumers).
+ *
+ * With amqp_set_adaptive_prefetch(), prefetch changes are made between
+ * deliveries. If one fails after messages have been dispatched, their
+ * number is returned and amqp_get_rpc_reply() holds the error.
+ *
+ * \param [in] state the connection object
+ * \param [in] timeout how long to wait for the first delivery, NULL blocks
+ * \param [in] max_msgs the maximum number of messages to dispatch, 0 or
+ *             less means no limit
+ * \return the number of messages dispatched (0 if the timeout expired), or
+ *          an amqp_status_enum value: AMQP_STATUS_UNEXPECTED_STATE if the
+ *          first frame was not a delivery for a registered consumer, the
+ *          handler's return value if it failed, or another error.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_dispatch(amqp_connection_state_t state,
+                        struct timeval *timeout, int max_msgs);
+
+/**
+ * A pool of threads processing deliveries from one connection
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_worker_pool_t_ amqp_worker_pool_t;
+
+/**
+ * What to do with a message once a worker is done with it
+ *
+ * \since v0.6.0
+ */
+typedef enum amqp_worker_result_t_ {
+  AMQP_WORKER_ACK = 0,              /**< basic.ack the message */
+  AMQP_WORKER_REJECT,               /**< basic.reject and discard the message */
+  AMQP_WORKER_REQUEUE,              /**< basic.reject and requeue the message */
+  AMQP_WORKER_NO_ACK                /**< send nothing (no_ack consumers) */
+} amqp_worker_result_t;
+
+/**
+ * The unit within which a worker pool keeps deliveries in order
+ *
+ * \since v0.6.0
+ */
+typedef enum amqp_worker_order_t_ {
+  AMQP_WORKER_ORDER_CHANNEL = 0,     /**< one channel is processed in order */
+  AMQP_WORKER_ORDER_CONSUMER_TAG     /**< one consumer is processed in order */
+} amqp_worker_order_t;
+
+/**
+ * Message handler run on a worker thread
+ *
+ * The envelope stays valid until the handler returns. The handler must not
+ * use the connection.
+ *
+ * \since v0.6.0
+ */
+typedef amqp_worker_result_t (*amqp_worker_handler_t)(void *ctx,
+                                                      const amqp_envelope_t *envelope);
+
+/**
+ * Create a pool of worker threads for a connection
+ *
+ * Deliveries read by amqp_worker_pool_dispatch() are spread across the
+ * workers. Messages sharing a channel (or consumer tag, depending on order)
+ * are processed one at a time and in delivery order; different channels run
+ * in parallel, and idle workers steal work from busy ones. Acks are handed
+ * back to the thread calling amqp_worker_pool_dispatch(), which sends them;
+ * enable amqp_set_ack_batching() on the consuming channels to have them
+ * coalesced.
+ *
+ * Only available on platforms with threading support (POSIX and FreeRTOS).
+ *
+ * \param [in] state the connection object
+ * \param [in] workers number of worker threads
+ * \param [in] order the ordering unit
+ * \param [in] max_in_flight maximum number of messages queued or being
+ *              processed, 0 for a default of 1024
+ * \param [in] handler called for every delivery
+ * \param [in] ctx passed back to the handler unchanged
+ * \return the new pool, or NULL on failure or if not supported
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_worker_pool_t *
+AMQP_CALL amqp_worker_pool_new(amqp_connection_state_t state, int workers,
+                               amqp_worker_order_t order, int max_in_flight,
+                               amqp_worker_handler_t handler, void *ctx);
+
+/**
+ * Read deliveries and hand them to the worker pool
+ *
+ * Sends the acks of messages the workers have finished, then waits up to
+ * timeout for a delivery and keeps reading whatever is already available
+ * without blocking, up to max_msgs messages. While messages are in flight
+ * the wait is done in short slices so acks keep flowing.
+ *
+ * Like amqp_dispatch(), stops at the first frame that is not a
+ * basic.deliver; the caller should read it with amqp_simple_wait_frame().
+ *
+ * \param [in] pool the worker pool
+ * \param [in] timeout how long to wait for the first delivery, NULL to wait
+ *              forever
+ * \param [in] max_msgs maximum number of messages to dispatch, 0 for no
+ *              limit
+ * \return the number of messages dispatched (0 on timeout),
+ *         AMQP_STATUS_UNEXPECTED_STATE if the first frame was not a
+ *         delivery, or another amqp_status_enum error
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_worker_pool_dispatch(amqp_worker_pool_t *pool,
+                                    struct timeval *timeout, int max_msgs);
+
+/**
+ * Wait for all dispatched messages to be processed and acked
+ *
+ * \param [in] pool the worker pool
+ * \return AMQP_STATUS_OK, or the first error sending an ack
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_worker_pool_drain(amqp_worker_pool_t *pool);
+
+/**
+ * Drain and destroy a worker pool
+ *
+ * \param [in] pool the worker pool
+ * \return the result of amqp_worker_pool_drain()
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_worker_pool_destroy(amqp_worker_pool_t *pool);
+
+/**
+ * Adaptive prefetch configuration
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_prefetch_config_t_ {
+  uint16_t min_prefetch;            /**< lowest prefetch count the controller will set, at least 1 */
+  uint16_t max_prefetch;            /**< highest prefetch count the controller will set */
+  uint16_t initial_prefetch;        /**< prefetch count to start with */
+  size_t max_backlog;               /**< deliveries queued locally above which prefetch is reduced */
+  struct timeval interval;          /**< how often to re-evaluate, zero means 1 second */
+} amqp_prefetch_config_t;
+
+/**
+ * Adaptive prefetch metrics, values are from the last evaluation interval
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_prefetch_stats_t_ {
+  uint16_t prefetch_count;          /**< current prefetch count */
+  uint64_t deliveries;              /**< deliveries seen since the controller was enabled */
+  uint32_t arrival_rate;            /**< deliveries per second */
+  uint64_t avg_processing_ns;       /**< time the application spent per message between amqp_consume_message() calls */
+  uint64_t avg_wait_ns;             /**< time amqp_consume_message() spent waiting per message */
+  size_t backlog;                   /**< deliveries queued in the library */
+  uint32_t increases;               /**< number of times prefetch was raised */
+  uint32_t decreases;               /**< number of times prefetch was lowered */
+} amqp_prefetch_stats_t;
+
+/**
+ * Let the library manage basic.qos prefetch on a consuming channel
+ *
+ * Sends basic.qos with config->initial_prefetch, then measures message
+ * arrival rate, the time the application spends between
+ * amqp_consume_message() calls, the time amqp_consume_message() spends
+ * waiting, and the number of deliveries queued in the library. Once per
+ * interval amqp_consume_message() uses these to raise prefetch when the
+ * consumer is starved, or lower it when deliveries pile up locally, and
+ * sends a new basic.qos if the value changed.
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel the consumer is on
+ * \param [in] config the controller limits, NULL disables the controller
+ *             and leaves the current prefetch in place
+ * \return an amqp_rpc_reply_t, reply_type == AMQP_RESPONSE_NORMAL on success
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_rpc_reply_t
+AMQP_CALL amqp_set_adaptive_prefetch(amqp_connection_state_t state,
+                                     amqp_channel_t channel,
+                                     const amqp_prefetch_config_t *config);
+
+/**
+ * Get the adaptive prefetch controller's metrics for a channel
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel
+ * \param [out] stats receives the metrics
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_INVALID_PARAMETER if the
+ *          controller is not enabled on the channel
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_get_prefetch_stats(amqp_connection_state_t state,
+                                  amqp_channel_t channel,
+                                  amqp_prefetch_stats_t *stats);
+
+/**
+ * Result of a single publish on a channel in confirm mode
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_confirm_t_ {
+  uint64_t delivery_tag;            /**< sequence number of the publish, see amqp_confirm_last_seqno() */
+  amqp_boolean_t acked;             /**< non-zero if the broker acked the message, zero if it nacked it */
+} amqp_confirm_t;
+
+/**
+ * Put a channel into publisher confirm mode
+ *
+ * Sends confirm.select and starts tracking publishes on the channel. Each
+ * subsequent amqp_basic_publish() on the channel is assigned the next
+ * sequence number (delivery tag), starting at 1, and occupies a slot in a
+ * window of window_size messages until the broker confirms it and the result
+ * is collected with amqp_confirm_poll(). Broker basic.ack/basic.nack methods
+ * (including multiple=true) are consumed by the library as they arrive and
+ * are not returned by amqp_simple_wait_frame() and friends.
+ *
+ * amqp_basic_publish() only blocks when the window is full. It then reads
+ * from the socket until the oldest publish is confirmed and retires that
+ * result if it is an ack, even if it has not been polled yet. A nack is
+ * never dropped: amqp_basic_publish() fails with
+ * AMQP_STATUS_UNEXPECTED_STATE until it has been collected with
+ * amqp_confirm_poll().
+ *
+ * When the broker closes the channel (or the connection) the window is
+ * dropped along with any results not collected yet, publishes without a
+ * result must be treated as unconfirmed. Functions blocked on the window
+ * return AMQP_STATUS_UNEXPECTED_STATE and the close is left queued for
+ * amqp_simple_wait_frame(). After reopening the channel, call this again.
+ *
+ * Calling this on a channel that is already in confirm mode resizes the
+ * window, which is only allowed when no publishes are outstanding.
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel to enable confirms on
+ * \param [in] window_size the maximum number of unconfirmed publishes, 0
+ *             means the default (256)
+ * \return an amqp_rpc_reply_t, reply_type == AMQP_RESPONSE_NORMAL on success
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_rpc_reply_t
+AMQP_CALL amqp_confirm_enable(amqp_connection_state_t state,
+                              amqp_channel_t channel, size_t window_size);
+
+/**
+ * Get the sequence number assigned to the most recent publish on a channel
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel
+ * \return the delivery tag of the last publish, or 0 if nothing has been
+ *          published or the channel is not in confirm mode
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+uint64_t
+AMQP_CALL amqp_confirm_last_seqno(amqp_connection_state_t state,
+                                  amqp_channel_t channel);
+
+/**
+ * Get the number of publishes on a channel the broker has not confirmed yet
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel
+ * \return the number of unconfirmed publishes, 0 if the channel is not in
+ *          confirm mode
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+size_t
+AMQP_CALL amqp_confirm_outstanding(amqp_connection_state_t state,
+                                   amqp_channel_t channel);
+
+/**
+ * Collect publisher confirms without blocking
+ *
+ * Processes any data already received from the broker, then returns the
+ * results of the oldest publishes in delivery tag order. Results are only
+ * returned once every earlier publish has been confirmed as well. Other
+ * frames read while doing so are queued for amqp_simple_wait_frame().
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel in confirm mode
+ * \param [out] confirms an array that receives the results
+ * \param [in] max the number of elements in confirms
+ * \return the number of results stored in confirms, or an amqp_status_enum
+ *          value on failure. AMQP_STATUS_INVALID_PARAMETER if the channel is
+ *          not in confirm mode, AMQP_STATUS_UNEXPECTED_STATE if the broker
+ *          closed it.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_confirm_poll(amqp_connection_state_t state,
+                            amqp_channel_t channel,
+                            amqp_confirm_t *confirms, size_t max);
+
+/**
+ * Wait until the oldest outstanding publish on a channel is confirmed
+ *
+ * Returns immediately if there is nothing outstanding or a result is ready
+ * to be collected with amqp_confirm_poll().
+ *
+ * \param [in] state the connection object
+ * \param [in] channel the channel in confirm mode
+ * \param [in] timeout the longest time to wait, NULL to block
+ * \return AMQP_STATUS_OK when a result is available, AMQP_STATUS_TIMEOUT if
+ *          the timeout expired, AMQP_STATUS_INVALID_PARAMETER if the channel
+ *          is not in confirm mode, AMQP_STATUS_UNEXPECTED_STATE if the broker
+ *          closed the channel, or another amqp_status_enum value on failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_confirm_wait(amqp_connection_state_t state,
+                            amqp_channel_t channel, struct timeval *timeout);
+
 
 /**
  * Parameters used to connect to the RabbitMQ broker
@@ -2314,12 +3141,19 @@ amqp_socket_open(amqp_socket_t *self, const char *host, int port);
  * socket options and prior to assigning the socket to an AMQP connection with
  * amqp_set_socket().
  *
+ * Despite its name, the call returns only once the socket is open or timeout
+ * has passed. For an SSL socket the TLS handshake runs under the same timeout,
+ * on a non-blocking socket internally, but is not handed back to the
+ * caller half done: there is no way to drive it from an event loop.
+ *
  * \param [in,out] self A socket object.
  * \param [in] host Connect to this host.
  * \param [in] port Connect on this remote port.
- * \param [in] timeout Max allowed time to spent on opening. If NULL - run in blocking mode
+ * \param [in] timeout Max allowed time to spent on opening, including the
+ *             TLS handshake. If NULL - run in blocking mode
  *
- * \return AMQP_STATUS_OK on success, an amqp_status_enum on failure.
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_TIMEOUT if timeout
+ *         passed, an amqp_status_enum on failure.
  *
  * \since v0.4.0
  */
@@ -2374,6 +3208,379 @@ AMQP_PUBLIC_FUNCTION
 amqp_table_t *
 amqp_get_server_properties(amqp_connection_state_t state);
 
+/**
+ * Number of frames of each type, see amqp_conn_stats_t
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_frame_counts_t_ {
+  uint64_t method;                  /**< method frames */
+  uint64_t header;                  /**< content header frames */
+  uint64_t body;                    /**< content body frames */
+  uint64_t heartbeat;               /**< heartbeat frames */
+} amqp_frame_counts_t;
+
+/**
+ * Connection statistics
+ *
+ * Counters start at zero when the connection object is created and only
+ * ever increase, except queued_frames and pool_pages which are current
+ * values. The outbound counters (frames_out, bytes_out) are also updated
+ * by the background I/O thread and by other threads holding the writer
+ * role with shared publishing; they are updated atomically, but a copy
+ * taken while those threads write may lag slightly.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_conn_stats_t_ {
+  amqp_frame_counts_t frames_in;    /**< frames decoded, including heartbeats received */
+  amqp_frame_counts_t frames_out;   /**< frames sent, including heartbeats sent */
+  uint64_t bytes_in;                /**< bytes read off the socket */
+  uint64_t bytes_out;               /**< bytes handed to the socket */
+  uint64_t recv_calls;              /**< recv() system calls */
+  uint64_t send_calls;              /**< send() system calls */
+  uint64_t writev_calls;            /**< writev() system calls */
+  uint64_t partial_writes;          /**< send()/writev() calls that wrote less than asked */
+  uint64_t eintr_retries;           /**< system calls restarted after EINTR */
+  uint64_t select_wait_ns;          /**< time spent blocked in select() waiting for data */
+  size_t queued_frames;             /**< frames currently queued in the library */
+  size_t queued_frames_max;         /**< highest value queued_frames has reached */
+  size_t pool_pages;                /**< memory pool pages currently held by the connection */
+  uint64_t tls_session_hits;        /**< TLS handshakes resumed from the session cache */
+  uint64_t tls_session_misses;      /**< full TLS handshakes despite a session cache */
+} amqp_conn_stats_t;
+
+/**
+ * Get the connection statistics
+ *
+ * Statistics are only collected when the library is built with
+ * ENABLE_CONNECTION_STATS, otherwise the counters compile out entirely.
+ * Socket system call counters are maintained by the plain TCP socket only,
+ * TLS session counters by SSL sockets with a session cache.
+ *
+ * \param [in] state the connection object
+ * \param [out] stats receives the statistics
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_UNSUPPORTED if the library
+ *         was built without statistics, AMQP_STATUS_INVALID_PARAMETER if
+ *         stats is NULL
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_get_connection_stats(amqp_connection_state_t state,
+                                    amqp_conn_stats_t *stats);
+
+/**
+ * Latency histograms kept per connection
+ *
+ * \since v0.6.0
+ */
+typedef enum amqp_histogram_enum_ {
+  AMQP_HISTOGRAM_RPC_WAIT = 0,      /**< time amqp_simple_rpc() waits for the reply */
+  AMQP_HISTOGRAM_PUBLISH_SOCKET,    /**< time a basic.publish spends writing to the socket */
+  AMQP_HISTOGRAM_DECODE_METHOD,     /**< time to decode one method frame */
+  AMQP_HISTOGRAM_DECODE_PROPERTIES, /**< time to decode one content header frame */
+  AMQP_HISTOGRAM_COUNT              /**< number of histograms, not a histogram */
+} amqp_histogram_enum;
+
+/**
+ * Summary of a latency histogram
+ *
+ * Percentiles are the upper bound of the bucket the percentile falls in,
+ * so they overstate the true value by at most the bucket width (12.5% with
+ * the default AMQP_HISTOGRAM_SUB_BITS).
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_histogram_t_ {
+  uint64_t count;                   /**< number of samples */
+  uint64_t min_ns;                  /**< smallest sample */
+  uint64_t max_ns;                  /**< largest sample */
+  uint64_t sum_ns;                  /**< sum of all samples */
+  uint64_t p50_ns;                  /**< median */
+  uint64_t p90_ns;                  /**< 90th percentile */
+  uint64_t p99_ns;                  /**< 99th percentile */
+  uint64_t p999_ns;                 /**< 99.9th percentile */
+} amqp_histogram_t;
+
+/**
+ * One non-empty histogram bucket, see amqp_get_histogram()
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_histogram_bucket_t_ {
+  uint64_t lower_ns;                /**< smallest value counted in the bucket */
+  uint64_t upper_ns;                /**< largest value counted in the bucket */
+  uint64_t count;                   /**< samples in the bucket */
+} amqp_histogram_bucket_t;
+
+/**
+ * Read a latency histogram
+ *
+ * Histograms are log-linear (HDR style): each power of two is split into
+ * a fixed number of linear buckets, so the relative error is the same at
+ * every magnitude and memory use is fixed. They are only collected when
+ * the library is built with ENABLE_LATENCY_HISTOGRAMS.
+ *
+ * \param [in] state the connection object
+ * \param [in] which the histogram to read
+ * \param [out] summary receives the sample count, min, max, sum and
+ *              percentiles, may be NULL
+ * \param [out] buckets receives the non-empty buckets in increasing order,
+ *              may be NULL
+ * \param [in,out] bucket_count in: capacity of buckets; out: number of
+ *                 non-empty buckets, which may exceed the capacity. May be
+ *                 NULL if buckets is NULL.
+ * \param [in] reset non-zero to clear the histogram after reading it
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_UNSUPPORTED if the library
+ *         was built without histograms, AMQP_STATUS_INVALID_PARAMETER if
+ *         which is out of range
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_get_histogram(amqp_connection_state_t state,
+                             amqp_histogram_enum which,
+                             amqp_histogram_t *summary,
+                             amqp_histogram_bucket_t *buckets,
+                             size_t *bucket_count,
+                             amqp_boolean_t reset);
+
+/**
+ * A binary trace record, see amqp_trace_dump()
+ *
+ * The layout is fixed (32 bytes, native byte order) so a dump can be
+ * written out as is and rendered on a host by amqp_trace_decode.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_trace_event_t_ {
+  uint64_t timestamp;               /**< amqp_get_monotonic_timestamp() when recorded, in ns */
+  uint32_t seq;                     /**< sequence number within the ring, starting at 1; wraps, skipping 0 */
+  uint16_t id;                      /**< event id, see amqp_trace.h */
+  uint16_t reserved;                /**< always zero */
+  uint32_t args[4];                 /**< event arguments, unused ones are zero */
+} amqp_trace_event_t;
+
+/**
+ * Copy out the most recent trace events
+ *
+ * Only available when the library is built with AMQP_TRACE_RING. Each
+ * connection records into its own fixed-size ring (AMQP_TRACE_RING_SIZE
+ * events) without taking locks, overwriting the oldest events; events
+ * recorded outside any connection, e.g., while opening a socket, go to a
+ * process-wide ring. Meant to be called after a failure: events being
+ * written while the dump runs are skipped.
+ *
+ * \param [in] state the connection object, or NULL for the process-wide ring
+ * \param [out] events receives the events, oldest first
+ * \param [in,out] count in: capacity of events; out: number of events copied
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_UNSUPPORTED if the library
+ *         was built without the trace ring, AMQP_STATUS_INVALID_PARAMETER if
+ *         events or count is NULL
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_trace_dump(amqp_connection_state_t state,
+                          amqp_trace_event_t *events, size_t *count);
+
+/**
+ * A timer wheel shared by many connections
+ *
+ * Tracks the heartbeat, RPC timeout and ack/write flush deadlines of every
+ * connection added to it, so an event loop driving many connections can
+ * find its next wakeup and the connections that are due without scanning
+ * them all. Deadlines are rounded up to the wheel's resolution and never
+ * fire early. A wheel is not thread-safe; it and its connections must be
+ * driven from one thread, and the connections should use the same clock as
+ * the wheel (see amqp_set_clock()).
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_timer_wheel_t_ amqp_timer_wheel_t;
+
+/**
+ * The deadlines a timer wheel tracks per connection
+ *
+ * \since v0.6.0
+ */
+typedef enum amqp_timer_kind_enum_ {
+  AMQP_TIMER_SEND_HEARTBEAT = 0, /**< a heartbeat is due to the broker */
+  AMQP_TIMER_RECV_HEARTBEAT,     /**< the broker has been silent too long */
+  AMQP_TIMER_RPC_TIMEOUT,        /**< see amqp_timer_wheel_set_rpc_timeout() */
+  AMQP_TIMER_ACK_FLUSH,          /**< batched acks or buffered writes are due */
+  AMQP_TIMER_KIND_COUNT          /**< number of kinds, not a kind */
+} amqp_timer_kind_enum;
+
+/**
+ * An expired timer, see amqp_timer_wheel_expire()
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_timer_event_t_ {
+  amqp_connection_state_t state;  /**< the connection the timer belongs to */
+  amqp_timer_kind_enum kind;      /**< which of its deadlines expired */
+  uint64_t deadline;              /**< the deadline as armed, in ns */
+} amqp_timer_event_t;
+
+/**
+ * Create a timer wheel
+ *
+ * \param [in] resolution the tick length, NULL for 1 millisecond
+ * \param [in] clock the clock to read in nanoseconds, NULL for
+ *              amqp_get_monotonic_timestamp()
+ * \param [in] arg passed to clock
+ * \return the new wheel, or NULL if out of memory, the resolution is
+ *         negative or the clock failed
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_timer_wheel_t *
+AMQP_CALL amqp_timer_wheel_new(const struct timeval *resolution,
+                               amqp_clock_fn clock, void *arg);
+
+/**
+ * Destroy a timer wheel, removing every connection still in it
+ *
+ * \param [in] wheel the wheel, may be NULL
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_timer_wheel_free(amqp_timer_wheel_t *wheel);
+
+/**
+ * Add a connection to a timer wheel and arm its current deadlines
+ *
+ * A connection can be in one wheel at a time; amqp_destroy_connection()
+ * removes it.
+ *
+ * \param [in] wheel the wheel
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_NO_MEMORY, or
+ *         AMQP_STATUS_INVALID_PARAMETER if the connection is in another
+ *         wheel
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_timer_wheel_add(amqp_timer_wheel_t *wheel,
+                               amqp_connection_state_t state);
+
+/**
+ * Remove a connection from a timer wheel
+ *
+ * \param [in] wheel the wheel
+ * \param [in] state the connection object
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL amqp_timer_wheel_remove(amqp_timer_wheel_t *wheel,
+                                  amqp_connection_state_t state);
+
+/**
+ * Re-arm a connection's heartbeat and flush timers
+ *
+ * Call after doing I/O on the connection outside amqp_timer_wheel_handle(),
+ * which moves its heartbeat deadlines, or after batching acks or buffering
+ * writes.
+ *
+ * \param [in] wheel the wheel
+ * \param [in] state the connection object
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_INVALID_PARAMETER if the
+ *         connection is not in the wheel
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_timer_wheel_update(amqp_timer_wheel_t *wheel,
+                                  amqp_connection_state_t state);
+
+/**
+ * Arm or cancel a connection's RPC timeout
+ *
+ * The timer is one-shot: it fires once timeout after this call.
+ *
+ * \param [in] wheel the wheel
+ * \param [in] state the connection object
+ * \param [in] timeout how long from now, NULL to cancel
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_TIMER_FAILURE, or
+ *         AMQP_STATUS_INVALID_PARAMETER if the connection is not in the
+ *         wheel or timeout is negative
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_timer_wheel_set_rpc_timeout(amqp_timer_wheel_t *wheel,
+                                           amqp_connection_state_t state,
+                                           const struct timeval *timeout);
+
+/**
+ * How long until the wheel next has work
+ *
+ * Costs one bit scan per wheel level regardless of the number of timers.
+ * For timers more than 64 ticks away the result may be earlier than the
+ * nearest deadline, in which case amqp_timer_wheel_expire() returns no
+ * events and the wait is simply repeated; it is never later.
+ *
+ * \param [in] wheel the wheel
+ * \param [out] tv receives the wait, zero if work is already due
+ * \return tv, or NULL if no timer is armed
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+struct timeval *
+AMQP_CALL amqp_timer_wheel_next(amqp_timer_wheel_t *wheel, struct timeval *tv);
+
+/**
+ * Collect the expired timers
+ *
+ * Each expired timer is disarmed and reported once. If more than
+ * max_events are due, the rest are returned by the next call.
+ *
+ * \param [in] wheel the wheel
+ * \param [out] events receives the expired timers
+ * \param [in] max_events the capacity of events
+ * \return the number of events, or AMQP_STATUS_TIMER_FAILURE
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_timer_wheel_expire(amqp_timer_wheel_t *wheel,
+                                  amqp_timer_event_t *events, int max_events);
+
+/**
+ * Take the default action for an expired timer
+ *
+ * Sends a heartbeat, flushes batched acks and buffered writes, or reports
+ * a missed heartbeat or RPC timeout, then re-arms the connection's timers.
+ *
+ * \param [in] wheel the wheel
+ * \param [in] event an event returned by amqp_timer_wheel_expire()
+ * \return AMQP_STATUS_OK, AMQP_STATUS_HEARTBEAT_TIMEOUT if the broker
+ *         missed its heartbeats (the socket has been closed),
+ *         AMQP_STATUS_TIMEOUT for an RPC timeout, or an I/O error
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL amqp_timer_wheel_handle(amqp_timer_wheel_t *wheel,
+                                  const amqp_timer_event_t *event);
+
 AMQP_END_DECLS
 
 
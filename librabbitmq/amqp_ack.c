@@ -0,0 +1,346 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+
+/*
+ * Ack batching.
+ *
+ * Instead of one basic.ack per delivery, acks on a batching channel are
+ * accumulated and sent as a single basic.ack with multiple=1 covering the
+ * highest delivery tag below which everything has been settled. This is only
+ * possible while acks arrive in delivery order; an ack that skips ahead is
+ * sent on its own straight away and remembered in a small bitmap so the
+ * batch can pick up again once the gap is filled.
+ *
+ * A batch is sent once `count` acks are pending, once the oldest pending ack
+ * is older than `delay`, before the library blocks on the socket, or when the
+ * channel is closed.
+ *
+ * Tags delivered before batching was enabled are assumed settled: the first
+ * delivery seen afterwards seeds acked_upto, and until then acks pass
+ * straight through. A channel.close from the broker drops the batch without
+ * sending it, acks on a channel the broker closed would be a connection
+ * error, and the tags would mean nothing once the channel is reopened.
+ */
+
+/* number of out-of-order settled tags tracked above acked_upto */
+#define AMQP_ACK_OOO_WINDOW 64
+
+static amqp_ack_batch_t *
+find_batch(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_ack_batch_t *batch;
+
+  for (batch = state->ack_batches; NULL != batch; batch = batch->next) {
+    if (batch->channel == channel) {
+      return batch;
+    }
+  }
+  return NULL;
+}
+
+static int send_ack(amqp_connection_state_t state, amqp_channel_t channel,
+                    uint64_t delivery_tag, amqp_boolean_t multiple)
+{
+  amqp_basic_ack_t m;
+  m.delivery_tag = delivery_tag;
+  m.multiple = multiple;
+  return amqp_send_method(state, channel, AMQP_BASIC_ACK_METHOD, &m);
+}
+
+static int flush_batch(amqp_connection_state_t state, amqp_ack_batch_t *batch)
+{
+  uint64_t tag = batch->pending_tag;
+
+  if (0 == batch->pending_count) {
+    return AMQP_STATUS_OK;
+  }
+
+  batch->pending_tag = 0;
+  batch->pending_count = 0;
+  return send_ack(state, batch->channel, tag, 1);
+}
+
+/* Everything up to and including tag has been settled */
+static void advance_to(amqp_ack_batch_t *batch, uint64_t tag)
+{
+  uint64_t shift;
+
+  if (tag <= batch->acked_upto) {
+    return;
+  }
+
+  shift = tag - batch->acked_upto;
+  batch->ooo_mask = (shift < AMQP_ACK_OOO_WINDOW) ? (batch->ooo_mask >> shift) : 0;
+  batch->acked_upto = tag;
+
+  /* absorb tags that were settled individually while there was a gap */
+  while (batch->ooo_mask & 1) {
+    batch->ooo_mask >>= 1;
+    batch->acked_upto++;
+  }
+}
+
+/* A single delivery was settled outside of the batch (out-of-order ack,
+ * reject or nack) */
+static void settle_one(amqp_ack_batch_t *batch, uint64_t tag)
+{
+  if (tag == batch->acked_upto + 1) {
+    advance_to(batch, tag);
+  } else if (tag > batch->acked_upto &&
+             tag - batch->acked_upto - 1 < AMQP_ACK_OOO_WINDOW) {
+    batch->ooo_mask |= (uint64_t)1 << (tag - batch->acked_upto - 1);
+  }
+}
+
+int amqp_set_ack_batching(amqp_connection_state_t state,
+                          amqp_channel_t channel, unsigned int count,
+                          struct timeval *max_delay)
+{
+  amqp_ack_batch_t *batch = find_batch(state, channel);
+
+  if (max_delay && (max_delay->tv_sec < 0 || max_delay->tv_usec < 0)) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  if (0 == count) {
+    return amqp_ack_batch_release(state, channel);
+  }
+
+  if (NULL == batch) {
+    batch = calloc(1, sizeof(amqp_ack_batch_t));
+    if (NULL == batch) {
+      return AMQP_STATUS_NO_MEMORY;
+    }
+    batch->channel = channel;
+    batch->next = state->ack_batches;
+    state->ack_batches = batch;
+  }
+
+  batch->max_count = count;
+  if (max_delay) {
+    batch->max_delay = (uint64_t)max_delay->tv_sec * AMQP_NS_PER_S +
+                       (uint64_t)max_delay->tv_usec * AMQP_NS_PER_US;
+  } else {
+    batch->max_delay = 0;
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+int amqp_basic_ack(amqp_connection_state_t state,
+                   amqp_channel_t channel,
+                   uint64_t delivery_tag,
+                   amqp_boolean_t multiple)
+{
+  amqp_ack_batch_t *batch = find_batch(state, channel);
+  int res;
+
+  if (NULL == batch || !batch->seeded) {
+    return send_ack(state, channel, delivery_tag, multiple);
+  }
+
+  if (multiple) {
+    res = flush_batch(state, batch);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    advance_to(batch, delivery_tag);
+    return send_ack(state, channel, delivery_tag, multiple);
+  }
+
+  if (delivery_tag != batch->acked_upto + 1) {
+    settle_one(batch, delivery_tag);
+    return send_ack(state, channel, delivery_tag, 0);
+  }
+
+  if (batch->max_delay > 0 && 0 == batch->pending_count) {
+    uint64_t current_time = amqp_clock_refresh(state);
+    if (0 == current_time) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    batch->deadline = current_time + batch->max_delay;
+  }
+
+  advance_to(batch, delivery_tag);
+  batch->pending_tag = delivery_tag;
+  batch->pending_count++;
+
+  if (batch->pending_count >= batch->max_count) {
+    return flush_batch(state, batch);
+  }
+
+  if (batch->max_delay > 0 && batch->pending_count > 1) {
+    uint64_t current_time = amqp_clock_refresh(state);
+    if (0 == current_time) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    if (current_time >= batch->deadline) {
+      return flush_batch(state, batch);
+    }
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+void amqp_ack_batch_settled(amqp_connection_state_t state,
+                            amqp_channel_t channel, uint64_t delivery_tag,
+                            amqp_boolean_t multiple)
+{
+  amqp_ack_batch_t *batch = find_batch(state, channel);
+
+  if (NULL == batch || !batch->seeded) {
+    return;
+  }
+
+  if (multiple) {
+    advance_to(batch, delivery_tag);
+  } else {
+    settle_one(batch, delivery_tag);
+  }
+}
+
+int amqp_flush_acks(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_ack_batch_t *batch = find_batch(state, channel);
+
+  if (NULL == batch) {
+    return AMQP_STATUS_OK;
+  }
+  return flush_batch(state, batch);
+}
+
+int amqp_ack_batch_flush_all(amqp_connection_state_t state)
+{
+  amqp_ack_batch_t *batch;
+
+  for (batch = state->ack_batches; NULL != batch; batch = batch->next) {
+    int res = flush_batch(state, batch);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+  }
+  return AMQP_STATUS_OK;
+}
+
+static void drop_batch(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_ack_batch_t **link = &state->ack_batches;
+
+  while (NULL != *link) {
+    amqp_ack_batch_t *batch = *link;
+    if (batch->channel == channel) {
+      *link = batch->next;
+      free(batch);
+      return;
+    }
+    link = &batch->next;
+  }
+}
+
+void amqp_ack_batch_handle_frame(amqp_connection_state_t state,
+                                 amqp_frame_t *frame)
+{
+  amqp_ack_batch_t *batch;
+  uint64_t delivery_tag;
+
+  if (NULL == state->ack_batches || AMQP_FRAME_METHOD != frame->frame_type) {
+    return;
+  }
+
+  switch (frame->payload.method.id) {
+  case AMQP_CHANNEL_CLOSE_METHOD:
+    drop_batch(state, frame->channel);
+    return;
+  case AMQP_CONNECTION_CLOSE_METHOD:
+    amqp_ack_batch_destroy_all(state);
+    return;
+  case AMQP_BASIC_DELIVER_METHOD:
+    delivery_tag =
+      ((amqp_basic_deliver_t *)frame->payload.method.decoded)->delivery_tag;
+    break;
+  case AMQP_BASIC_GET_OK_METHOD:
+    delivery_tag =
+      ((amqp_basic_get_ok_t *)frame->payload.method.decoded)->delivery_tag;
+    break;
+  default:
+    return;
+  }
+
+  batch = find_batch(state, frame->channel);
+  if (NULL != batch && !batch->seeded) {
+    batch->acked_upto = delivery_tag - 1;
+    batch->ooo_mask = 0;
+    batch->seeded = 1;
+  }
+}
+
+uint64_t amqp_ack_batch_next_deadline(amqp_connection_state_t state)
+{
+  amqp_ack_batch_t *batch;
+  uint64_t deadline = 0;
+
+  for (batch = state->ack_batches; NULL != batch; batch = batch->next) {
+    if (batch->max_delay > 0 && batch->pending_count > 0 &&
+        (0 == deadline || batch->deadline < deadline)) {
+      deadline = batch->deadline;
+    }
+  }
+  return deadline;
+}
+
+int amqp_ack_batch_release(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_ack_batch_t **link = &state->ack_batches;
+
+  while (NULL != *link) {
+    amqp_ack_batch_t *batch = *link;
+    if (batch->channel == channel) {
+      int res = flush_batch(state, batch);
+      *link = batch->next;
+      free(batch);
+      return res;
+    }
+    link = &batch->next;
+  }
+  return AMQP_STATUS_OK;
+}
+
+void amqp_ack_batch_destroy_all(amqp_connection_state_t state)
+{
+  while (NULL != state->ack_batches) {
+    amqp_ack_batch_t *batch = state->ack_batches;
+    state->ack_batches = batch->next;
+    free(batch);
+  }
+}
@@ -73,7 +73,9 @@ static const char *base_error_strings[] = {
   "unexpected method received",         /* AMQP_STATUS_WRONG_METHOD             -0x000C */
   "request timed out",                  /* AMQP_STATUS_TIMEOUT                  -0x000D */
   "system timer has failed",            /* AMQP_STATUS_TIMER_FAILED             -0x000E */
-  "heartbeat timeout, connection closed"/* AMQP_STATUS_HEARTBEAT_TIMEOUT        -0x000F */
+  "heartbeat timeout, connection closed",/* AMQP_STATUS_HEARTBEAT_TIMEOUT        -0x000F */
+  "unexpected protocol state",          /* AMQP_STATUS_UNEXPECTED_STATE         -0x0010 */
+  "operation not supported"             /* AMQP_STATUS_UNSUPPORTED              -0x0011 */
 };
 
 static const char *tcp_error_strings[] = {
@@ -192,7 +194,9 @@ int amqp_basic_publish_method_and_header(
   m.ticket = 0;
 
   if (amqp_heartbeat_enabled(state)) {
-    uint64_t current_timestamp = amqp_get_monotonic_timestamp();
+    /* a stale reading would hide a missed heartbeat for as long as the
+       application only publishes, so read the clock */
+    uint64_t current_timestamp = amqp_clock_refresh(state);
     if (0 == current_timestamp) {
       return AMQP_STATUS_TIMER_FAILURE;
     }
@@ -207,12 +211,21 @@ int amqp_basic_publish_method_and_header(
     }
   }
 
+  /* on a channel in confirm mode this blocks while the window of
+     unconfirmed publishes is full */
+  res = amqp_confirm_reserve(state, channel);
+  if (res < 0) {
+    return res;
+  }
+
   RABBIT_INFO("amqp_send_method(%08x,%d,AMQP_BASIC_PUBLISH_METHOD,%08x )", (int)state, channel, (int)&m);
   res = amqp_send_method(state, channel, AMQP_BASIC_PUBLISH_METHOD, &m);
   RABBIT_INFO("amqp_send_method(%08x,%d,AMQP_BASIC_PUBLISH_METHOD,%08x ) res=%d", (int)state, channel, (int)&m, res);
   if (res < 0) {
     return res;
   }
+  /* the broker numbers the basic.publish methods it receives */
+  amqp_confirm_sent(state, channel);
 
   if (properties == NULL) {
     memset(&default_properties, 0, sizeof(default_properties));
@@ -236,7 +249,7 @@ size_t amqp_usable_body_payload_size( int frame_max )
   return frame_max - (HEADER_SIZE + FOOTER_SIZE);
 }
 
-int amqp_basic_publish(
+static int basic_publish(
     amqp_connection_state_t state,
     amqp_channel_t channel,
     amqp_bytes_t exchange,
@@ -249,6 +262,7 @@ int amqp_basic_publish(
   amqp_frame_t f;
   size_t body_offset;
   size_t usable_body_payload_size = amqp_usable_body_payload_size(state->frame_max);
+  uint64_t socket_time = AMQP_HIST_SOCKET_TIME(state);
   int res;
 
   res = amqp_basic_publish_method_and_header(state,
@@ -292,9 +306,44 @@ int amqp_basic_publish(
     }
   }
 
+  AMQP_HIST_RECORD(state, AMQP_HISTOGRAM_PUBLISH_SOCKET,
+                   AMQP_HIST_SOCKET_TIME(state) - socket_time);
   return AMQP_STATUS_OK;
 }
 
+/* With shared publishing the writer role is held for the whole message, so
+ * that publisher threads cannot get their frames in between its frames. */
+static int publish_queue_unlock(amqp_connection_state_t state, int res)
+{
+  int unlock_res = amqp_publish_queue_unlock(state);
+  return AMQP_STATUS_OK == res ? unlock_res : res;
+}
+
+int amqp_basic_publish(
+    amqp_connection_state_t state,
+    amqp_channel_t channel,
+    amqp_bytes_t exchange,
+    amqp_bytes_t routing_key,
+    amqp_boolean_t mandatory,
+    amqp_boolean_t immediate,
+    amqp_basic_properties_t const *properties,
+    amqp_bytes_t body)
+{
+  int res;
+
+  if (NULL == state->publish_queue) {
+    return basic_publish(state, channel, exchange, routing_key, mandatory,
+                         immediate, properties, body);
+  }
+
+  res = amqp_publish_queue_lock(state);
+  if (AMQP_STATUS_OK == res) {
+    res = basic_publish(state, channel, exchange, routing_key, mandatory,
+                        immediate, properties, body);
+  }
+  return publish_queue_unlock(state, res);
+}
+
 // todo create the stream in the dataRepSet process
 // add abort processing calls to the stream
 // send the stream to here.
@@ -305,7 +354,7 @@ int amqp_basic_publish(
 // when the queue is called it calls the function and a stream to build with.
 // the function builds streams.
 
-int amqp_basic_publish_streaming(amqp_connection_state_t state,
+static int basic_publish_streaming(amqp_connection_state_t state,
                        amqp_channel_t channel,
                        amqp_bytes_t exchange,
                        amqp_bytes_t routing_key,
@@ -317,6 +366,7 @@ int amqp_basic_publish_streaming(amqp_connection_state_t state,
   amqp_frame_t f;
   size_t body_offset;
   size_t usable_body_payload_size = amqp_usable_body_payload_size(state->frame_max);
+  uint64_t socket_time = AMQP_HIST_SOCKET_TIME(state);
   int res;
 
   res = amqp_basic_publish_method_and_header(state,
@@ -365,9 +415,37 @@ int amqp_basic_publish_streaming(amqp_connection_state_t state,
     }
   }
 
+  AMQP_HIST_RECORD(state, AMQP_HISTOGRAM_PUBLISH_SOCKET,
+                   AMQP_HIST_SOCKET_TIME(state) - socket_time);
   return AMQP_STATUS_OK;
 }
 
+int amqp_basic_publish_streaming(amqp_connection_state_t state,
+                       amqp_channel_t channel,
+                       amqp_bytes_t exchange,
+                       amqp_bytes_t routing_key,
+                       amqp_boolean_t mandatory,
+                       amqp_boolean_t immediate,
+                       amqp_basic_properties_t const *properties,
+                       lightStreamAggregateP_t bodyStreamP)
+{
+  int res;
+
+  if (NULL == state->publish_queue) {
+    return basic_publish_streaming(state, channel, exchange, routing_key,
+                                   mandatory, immediate, properties,
+                                   bodyStreamP);
+  }
+
+  res = amqp_publish_queue_lock(state);
+  if (AMQP_STATUS_OK == res) {
+    res = basic_publish_streaming(state, channel, exchange, routing_key,
+                                  mandatory, immediate, properties,
+                                  bodyStreamP);
+  }
+  return publish_queue_unlock(state, res);
+}
+
 amqp_rpc_reply_t amqp_channel_close(amqp_connection_state_t state,
                                     amqp_channel_t channel,
                                     int code)
@@ -382,6 +460,12 @@ amqp_rpc_reply_t amqp_channel_close(amqp_connection_state_t state,
   req.class_id = 0;
   req.method_id = 0;
 
+  amqp_confirm_release(state, channel);
+  /* pending acks are only worth sending before the channel goes away */
+  amqp_ack_batch_release(state, channel);
+  amqp_prefetch_release(state, channel);
+  amqp_consumer_table_release(state, channel);
+
   return amqp_simple_rpc(state, channel, AMQP_CHANNEL_CLOSE_METHOD,
                          replies, &req);
 }
@@ -403,17 +487,6 @@ amqp_rpc_reply_t amqp_connection_close(amqp_connection_state_t state,
                          replies, &req);
 }
 
-int amqp_basic_ack(amqp_connection_state_t state,
-                   amqp_channel_t channel,
-                   uint64_t delivery_tag,
-                   amqp_boolean_t multiple)
-{
-  amqp_basic_ack_t m;
-  m.delivery_tag = delivery_tag;
-  m.multiple = multiple;
-  return amqp_send_method(state, channel, AMQP_BASIC_ACK_METHOD, &m);
-}
-
 amqp_rpc_reply_t amqp_basic_get(amqp_connection_state_t state,
                                 amqp_channel_t channel,
                                 amqp_bytes_t queue,
@@ -442,6 +515,7 @@ int amqp_basic_reject(amqp_connection_state_t state,
   amqp_basic_reject_t req;
   req.delivery_tag = delivery_tag;
   req.requeue = requeue;
+  amqp_ack_batch_settled(state, channel, delivery_tag, 0);
   return amqp_send_method(state, channel, AMQP_BASIC_REJECT_METHOD, &req);
 }
 
@@ -453,5 +527,6 @@ int amqp_basic_nack(amqp_connection_state_t state, amqp_channel_t channel,
   req.delivery_tag = delivery_tag;
   req.multiple = multiple;
   req.requeue = requeue;
+  amqp_ack_batch_settled(state, channel, delivery_tag, multiple);
   return amqp_send_method(state, channel, AMQP_BASIC_NACK_METHOD, &req);
 }
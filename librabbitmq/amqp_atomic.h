@@ -0,0 +1,118 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef AMQP_ATOMIC_H
+#define AMQP_ATOMIC_H
+
+#include <stdint.h>
+
+/*
+ * The handful of atomic operations the lock-free queues need. GCC and clang
+ * (including the arm-none-eabi toolchains used for the embedded build) get
+ * the __atomic builtins, MSVC gets the Interlocked family. All operations are
+ * sequentially consistent.
+ */
+
+#if defined(_MSC_VER)
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#define amqp_atomic_load_ptr(p) \
+  InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#define amqp_atomic_store_ptr(p, v) \
+  ((void)InterlockedExchangePointer((PVOID volatile *)(p), (v)))
+#define amqp_atomic_xchg_ptr(p, v) \
+  InterlockedExchangePointer((PVOID volatile *)(p), (v))
+#define amqp_atomic_load_int(p) \
+  InterlockedCompareExchange((LONG volatile *)(p), 0, 0)
+#define amqp_atomic_store_int(p, v) \
+  ((void)InterlockedExchange((LONG volatile *)(p), (v)))
+#define amqp_atomic_cas_int(p, expected, desired) \
+  (InterlockedCompareExchange((LONG volatile *)(p), (desired), (expected)) == (expected))
+#define amqp_atomic_cas_ptr(p, expected, desired) \
+  (InterlockedCompareExchangePointer((PVOID volatile *)(p), (desired), (expected)) == (expected))
+#define amqp_atomic_add_int(p, v) \
+  (InterlockedExchangeAdd((LONG volatile *)(p), (v)) + (v))
+#define amqp_atomic_add_u64(p, v) \
+  ((uint64_t)InterlockedExchangeAdd64((LONGLONG volatile *)(p), (LONGLONG)(v)) + (v))
+#define amqp_atomic_load_size(p) \
+  ((size_t)InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL))
+#define amqp_atomic_store_size(p, v) \
+  ((void)InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(size_t)(v)))
+
+#else
+
+#define amqp_atomic_load_ptr(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define amqp_atomic_store_ptr(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define amqp_atomic_xchg_ptr(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define amqp_atomic_load_int(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define amqp_atomic_store_int(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define amqp_atomic_cas_int(p, expected, desired) \
+  amqp_atomic_cas_int_impl((p), (expected), (desired))
+#define amqp_atomic_cas_ptr(p, expected, desired) \
+  amqp_atomic_cas_ptr_impl((void **)(p), (expected), (desired))
+#define amqp_atomic_add_int(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define amqp_atomic_load_size(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define amqp_atomic_store_size(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+static inline int amqp_atomic_cas_int_impl(int *p, int expected, int desired)
+{
+  return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline int amqp_atomic_cas_ptr_impl(void **p, void *expected,
+                                           void *desired)
+{
+  return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#if defined(RABBIT_USE_LWIP)
+/* Cortex-M has no 64-bit atomic instructions and newlib ships no libatomic
+ * to fall back on, so 64-bit adds briefly mask interrupts instead. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+static inline uint64_t amqp_atomic_add_u64(uint64_t *p, uint64_t v)
+{
+  uint64_t result;
+
+  taskENTER_CRITICAL();
+  result = (*p += v);
+  taskEXIT_CRITICAL();
+  return result;
+}
+#else
+#define amqp_atomic_add_u64(p, v) \
+  __atomic_add_fetch((p), (uint64_t)(v), __ATOMIC_SEQ_CST)
+#endif
+
+#endif
+
+#endif /* AMQP_ATOMIC_H */
@@ -0,0 +1,425 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef AMQP_DEFAULT_CONFIRM_WINDOW
+#define AMQP_DEFAULT_CONFIRM_WINDOW 256
+#endif
+
+/*
+ * Publisher confirms (confirm.select) on a channel.
+ *
+ * Every publish on a channel in confirm mode gets the next delivery tag,
+ * starting from 1, and occupies slot (tag % size) of the channel's window
+ * until the broker has acked or nacked it and the result was collected with
+ * amqp_confirm_poll(). Acks/nacks are consumed on the inbound path, whenever
+ * the library reads from the socket, and never reach the caller as frames.
+ * A channel.close or connection.close from the broker drops the window (the
+ * broker numbers publishes from 1 again on a reopened channel) and is
+ * passed on to the caller as usual.
+ */
+
+typedef enum amqp_confirm_slot_enum_ {
+  AMQP_CONFIRM_SLOT_PENDING = 0,
+  AMQP_CONFIRM_SLOT_ACKED,
+  AMQP_CONFIRM_SLOT_NACKED
+} amqp_confirm_slot_enum;
+
+static amqp_confirm_window_t *
+find_window(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_confirm_window_t *window;
+
+  for (window = state->confirm_windows; NULL != window; window = window->next) {
+    if (window->channel == channel) {
+      return window;
+    }
+  }
+  return NULL;
+}
+
+static void confirm_range(amqp_confirm_window_t *window, uint64_t first,
+                          uint64_t last, uint8_t result)
+{
+  uint64_t tag;
+
+  if (first < window->oldest_seqno) {
+    first = window->oldest_seqno;
+  }
+  if (last >= window->next_seqno) {
+    last = window->next_seqno - 1;
+  }
+
+  for (tag = first; tag <= last; ++tag) {
+    uint8_t *slot = &window->slots[tag % window->size];
+    if (AMQP_CONFIRM_SLOT_PENDING == *slot) {
+      *slot = result;
+    }
+  }
+}
+
+amqp_boolean_t amqp_confirm_handle_frame(amqp_connection_state_t state,
+                                         amqp_frame_t *frame)
+{
+  amqp_confirm_window_t *window;
+  uint64_t delivery_tag;
+  amqp_boolean_t multiple;
+  uint8_t result;
+
+  if (NULL == state->confirm_windows ||
+      AMQP_FRAME_METHOD != frame->frame_type) {
+    return 0;
+  }
+
+  switch (frame->payload.method.id) {
+  case AMQP_CHANNEL_CLOSE_METHOD:
+    amqp_confirm_release(state, frame->channel);
+    return 0;
+  case AMQP_CONNECTION_CLOSE_METHOD:
+    amqp_confirm_destroy_all(state);
+    return 0;
+  case AMQP_BASIC_ACK_METHOD: {
+    amqp_basic_ack_t *ack = frame->payload.method.decoded;
+    delivery_tag = ack->delivery_tag;
+    multiple = ack->multiple;
+    result = AMQP_CONFIRM_SLOT_ACKED;
+    break;
+  }
+  case AMQP_BASIC_NACK_METHOD: {
+    amqp_basic_nack_t *nack = frame->payload.method.decoded;
+    delivery_tag = nack->delivery_tag;
+    multiple = nack->multiple;
+    result = AMQP_CONFIRM_SLOT_NACKED;
+    break;
+  }
+  default:
+    return 0;
+  }
+
+  window = find_window(state, frame->channel);
+  if (NULL == window) {
+    return 0;
+  }
+
+  if (multiple) {
+    /* delivery-tag 0 with multiple set means everything outstanding */
+    if (0 == delivery_tag) {
+      delivery_tag = window->next_seqno - 1;
+    }
+    confirm_range(window, window->oldest_seqno, delivery_tag, result);
+  } else {
+    confirm_range(window, delivery_tag, delivery_tag, result);
+  }
+
+  amqp_maybe_release_buffers_on_channel(state, frame->channel);
+  return 1;
+}
+
+static amqp_boolean_t window_full(amqp_confirm_window_t *window)
+{
+  return (window->next_seqno - window->oldest_seqno >= window->size);
+}
+
+static uint8_t head_result(amqp_confirm_window_t *window)
+{
+  if (window->oldest_seqno == window->next_seqno) {
+    return AMQP_CONFIRM_SLOT_PENDING;
+  }
+  return window->slots[window->oldest_seqno % window->size];
+}
+
+static amqp_boolean_t head_confirmed(amqp_confirm_window_t *window)
+{
+  return (AMQP_CONFIRM_SLOT_PENDING != head_result(window));
+}
+
+int amqp_confirm_reserve(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_confirm_window_t *window = find_window(state, channel);
+
+  if (NULL == window) {
+    return AMQP_STATUS_OK;
+  }
+
+  while (window_full(window)) {
+    int res;
+
+    switch (head_result(window)) {
+    case AMQP_CONFIRM_SLOT_ACKED:
+      /* make room by retiring the oldest ack, even if nobody polled it */
+      window->oldest_seqno++;
+      continue;
+    case AMQP_CONFIRM_SLOT_NACKED:
+      /* a nack is never dropped, it has to be collected first */
+      return AMQP_STATUS_UNEXPECTED_STATE;
+    default:
+      break;
+    }
+
+    res = amqp_pump_frame(state, NULL);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    window = find_window(state, channel);
+    if (NULL == window) {
+      /* closed by the broker, the close is queued for the caller */
+      return AMQP_STATUS_UNEXPECTED_STATE;
+    }
+  }
+  return AMQP_STATUS_OK;
+}
+
+void amqp_confirm_sent(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_confirm_window_t *window = find_window(state, channel);
+
+  if (NULL == window) {
+    return;
+  }
+  window->slots[window->next_seqno % window->size] = AMQP_CONFIRM_SLOT_PENDING;
+  window->next_seqno++;
+}
+
+void amqp_confirm_release(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_confirm_window_t **link = &state->confirm_windows;
+
+  while (NULL != *link) {
+    amqp_confirm_window_t *window = *link;
+    if (window->channel == channel) {
+      *link = window->next;
+      free(window->slots);
+      free(window);
+      return;
+    }
+    link = &window->next;
+  }
+}
+
+void amqp_confirm_destroy_all(amqp_connection_state_t state)
+{
+  while (NULL != state->confirm_windows) {
+    amqp_confirm_release(state, state->confirm_windows->channel);
+  }
+}
+
+amqp_rpc_reply_t amqp_confirm_enable(amqp_connection_state_t state,
+                                     amqp_channel_t channel,
+                                     size_t window_size)
+{
+  amqp_confirm_window_t *window;
+
+  memset(&state->most_recent_api_result, 0,
+         sizeof(state->most_recent_api_result));
+
+  if (0 == window_size) {
+    window_size = AMQP_DEFAULT_CONFIRM_WINDOW;
+  }
+
+  if (NULL == find_window(state, channel)) {
+    amqp_method_number_t replies[2] = { AMQP_CONFIRM_SELECT_OK_METHOD, 0 };
+    amqp_confirm_select_t req;
+
+    req.nowait = 0;
+    state->most_recent_api_result =
+      amqp_simple_rpc(state, channel, AMQP_CONFIRM_SELECT_METHOD, replies, &req);
+    if (AMQP_RESPONSE_NORMAL != state->most_recent_api_result.reply_type) {
+      return state->most_recent_api_result;
+    }
+
+    window = calloc(1, sizeof(amqp_confirm_window_t));
+    if (NULL == window) {
+      goto out_nomem;
+    }
+    window->channel = channel;
+    window->next_seqno = 1;
+    window->oldest_seqno = 1;
+    window->next = state->confirm_windows;
+    state->confirm_windows = window;
+  } else {
+    window = find_window(state, channel);
+    if (window->next_seqno != window->oldest_seqno) {
+      /* can't resize while messages are in flight */
+      state->most_recent_api_result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+      state->most_recent_api_result.library_error = AMQP_STATUS_INVALID_PARAMETER;
+      return state->most_recent_api_result;
+    }
+    state->most_recent_api_result.reply_type = AMQP_RESPONSE_NORMAL;
+  }
+
+  if (window->size != window_size) {
+    uint8_t *slots = realloc(window->slots, window_size);
+    if (NULL == slots) {
+      goto out_nomem;
+    }
+    window->slots = slots;
+    window->size = window_size;
+  }
+
+  return state->most_recent_api_result;
+
+out_nomem:
+  amqp_confirm_release(state, channel);
+  state->most_recent_api_result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+  state->most_recent_api_result.library_error = AMQP_STATUS_NO_MEMORY;
+  return state->most_recent_api_result;
+}
+
+uint64_t amqp_confirm_last_seqno(amqp_connection_state_t state,
+                                 amqp_channel_t channel)
+{
+  amqp_confirm_window_t *window = find_window(state, channel);
+
+  if (NULL == window) {
+    return 0;
+  }
+  return window->next_seqno - 1;
+}
+
+size_t amqp_confirm_outstanding(amqp_connection_state_t state,
+                                amqp_channel_t channel)
+{
+  amqp_confirm_window_t *window = find_window(state, channel);
+  size_t outstanding = 0;
+  uint64_t tag;
+
+  if (NULL == window) {
+    return 0;
+  }
+
+  for (tag = window->oldest_seqno; tag < window->next_seqno; ++tag) {
+    if (AMQP_CONFIRM_SLOT_PENDING == window->slots[tag % window->size]) {
+      outstanding++;
+    }
+  }
+  return outstanding;
+}
+
+int amqp_confirm_poll(amqp_connection_state_t state, amqp_channel_t channel,
+                      amqp_confirm_t *confirms, size_t max)
+{
+  amqp_confirm_window_t *window;
+  struct timeval tv;
+  int res;
+  int count = 0;
+
+  if (NULL == find_window(state, channel)) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  /* drain whatever the broker has sent so far without blocking */
+  do {
+    memset(&tv, 0, sizeof(struct timeval));
+    res = amqp_pump_frame(state, &tv);
+  } while (AMQP_STATUS_OK == res);
+
+  if (AMQP_STATUS_TIMEOUT != res) {
+    return res;
+  }
+
+  window = find_window(state, channel);
+  if (NULL == window) {
+    return AMQP_STATUS_UNEXPECTED_STATE;
+  }
+
+  while ((size_t)count < max && head_confirmed(window)) {
+    confirms[count].delivery_tag = window->oldest_seqno;
+    confirms[count].acked =
+      (AMQP_CONFIRM_SLOT_ACKED == window->slots[window->oldest_seqno % window->size]);
+    window->oldest_seqno++;
+    count++;
+  }
+
+  return count;
+}
+
+int amqp_confirm_wait(amqp_connection_state_t state, amqp_channel_t channel,
+                      struct timeval *timeout)
+{
+  amqp_confirm_window_t *window = find_window(state, channel);
+  uint64_t deadline = 0;
+
+  if (NULL == window) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  if (timeout) {
+    uint64_t current_time;
+
+    if (timeout->tv_sec < 0 || timeout->tv_usec < 0) {
+      return AMQP_STATUS_INVALID_PARAMETER;
+    }
+    current_time = amqp_clock_refresh(state);
+    if (0 == current_time) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    deadline = current_time +
+               (uint64_t)timeout->tv_sec * AMQP_NS_PER_S +
+               (uint64_t)timeout->tv_usec * AMQP_NS_PER_US;
+  }
+
+  while (window->oldest_seqno < window->next_seqno && !head_confirmed(window)) {
+    struct timeval tv;
+    struct timeval *tvp = NULL;
+    int res;
+
+    if (timeout) {
+      uint64_t current_time = amqp_clock_refresh(state);
+      uint64_t remaining;
+
+      if (0 == current_time) {
+        return AMQP_STATUS_TIMER_FAILURE;
+      }
+      if (current_time >= deadline) {
+        return AMQP_STATUS_TIMEOUT;
+      }
+      remaining = deadline - current_time;
+      tv.tv_sec = remaining / AMQP_NS_PER_S;
+      tv.tv_usec = (remaining % AMQP_NS_PER_S) / AMQP_NS_PER_US;
+      tvp = &tv;
+    }
+
+    res = amqp_pump_frame(state, tvp);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    window = find_window(state, channel);
+    if (NULL == window) {
+      return AMQP_STATUS_UNEXPECTED_STATE;
+    }
+  }
+
+  return AMQP_STATUS_OK;
+}
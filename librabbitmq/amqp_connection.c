@@ -149,11 +149,10 @@ int amqp_tune_connection(amqp_connection_state_t state,
   state->channel_max = channel_max;
   state->frame_max = frame_max;
   state->heartbeat = heartbeat;
-  RABBIT_INFO("on connection: 0x%08X...", state);
-  RABBIT_INFO("heartbeat is: %d", state->heartbeat);
+  AMQP_TRACE(state, TUNE, channel_max, frame_max, heartbeat, 0);
 
   if (amqp_heartbeat_enabled(state)) {
-    uint64_t current_time = amqp_get_monotonic_timestamp();
+    uint64_t current_time = amqp_clock_refresh(state);
     if (0 == current_time) {
       return AMQP_STATUS_TIMER_FAILURE;
     }
@@ -181,10 +180,13 @@ int amqp_destroy_connection(amqp_connection_state_t state)
   int status = AMQP_STATUS_OK;
   if (state) {
     int i;
+    /* the I/O thread may still be using the buffers and the socket */
+    amqp_stop_io_thread(state);
     for (i = 0; i < POOL_TABLE_SIZE; ++i) {
       amqp_pool_table_entry_t *entry = state->pool_table[i];
       while (NULL != entry) {
         amqp_pool_table_entry_t *todelete = entry;
+        amqp_io_thread_release_pools(state, entry);
         empty_amqp_pool(&entry->pool);
         entry = entry->next;
         free(todelete);
@@ -192,7 +194,14 @@ int amqp_destroy_connection(amqp_connection_state_t state)
     }
 
     free(state->outbound_buffer.bytes);
+    free(state->write_buffer.bytes);
     free(state->sock_inbound_buffer.bytes);
+    amqp_publish_queue_destroy(state);
+    amqp_confirm_destroy_all(state);
+    amqp_ack_batch_destroy_all(state);
+    amqp_prefetch_destroy_all(state);
+    amqp_timer_entry_destroy(state);
+    amqp_consumer_table_destroy(state);
     amqp_socket_delete(state->socket);
     empty_amqp_pool(&state->properties_pool);
     free(state);
@@ -227,6 +236,82 @@ static size_t consume_data(amqp_connection_state_t state,
   return bytes_consumed;
 }
 
+static amqp_pool_t *input_pool(amqp_connection_state_t state,
+                               amqp_channel_t channel)
+{
+  if (NULL != state->input_pool) {
+    return state->input_pool;
+  }
+  return amqp_get_or_create_channel_pool(state, channel);
+}
+
+int amqp_move_input(amqp_connection_state_t from, amqp_connection_state_t to)
+{
+  return_to_idle(to);
+  to->state = from->state;
+  to->inbound_offset = from->inbound_offset;
+  to->target_size = from->target_size;
+#ifdef AMQP_FRAMING_PRUNED
+  to->discard_content = from->discard_content;
+  to->discard_channel = from->discard_channel;
+  to->discard_remaining = from->discard_remaining;
+  from->discard_content = 0;
+#endif
+
+  if (CONNECTION_STATE_BODY == from->state) {
+    amqp_pool_t *pool = input_pool(to, amqp_d16(from->inbound_buffer.bytes, 1));
+    if (NULL == pool) {
+      return AMQP_STATUS_NO_MEMORY;
+    }
+    amqp_pool_alloc_bytes(pool, from->target_size, &to->inbound_buffer);
+    if (NULL == to->inbound_buffer.bytes) {
+      return AMQP_STATUS_NO_MEMORY;
+    }
+  }
+  memcpy(to->inbound_buffer.bytes, from->inbound_buffer.bytes,
+         from->inbound_offset);
+
+  return_to_idle(from);
+  return AMQP_STATUS_OK;
+}
+
+#ifdef AMQP_FRAMING_PRUNED
+/* This build only decodes the methods it was generated for (see codegen.py).
+ * Anything else the broker sends is dropped as an ignored frame instead of
+ * failing the connection, together with the header and body frames that
+ * follow a dropped content-bearing method. */
+static void discard_content(amqp_connection_state_t state,
+                            amqp_frame_t *decoded_frame, void *raw_frame)
+{
+  size_t len;
+
+  if (!state->discard_content ||
+      decoded_frame->channel != state->discard_channel) {
+    return;
+  }
+
+  switch (decoded_frame->frame_type) {
+  case AMQP_FRAME_HEADER:
+    state->discard_remaining = amqp_d64(raw_frame, HEADER_SIZE + 4);
+    break;
+
+  case AMQP_FRAME_BODY:
+    len = state->target_size - HEADER_SIZE - FOOTER_SIZE;
+    state->discard_remaining -= (len < state->discard_remaining
+                                 ? len : state->discard_remaining);
+    break;
+
+  default:
+    return;
+  }
+
+  if (0 == state->discard_remaining) {
+    state->discard_content = 0;
+  }
+  decoded_frame->frame_type = 0;
+}
+#endif
+
 int amqp_handle_input(amqp_connection_state_t state,
                       amqp_bytes_t received_data,
                       amqp_frame_t *decoded_frame)
@@ -239,7 +324,6 @@ int amqp_handle_input(amqp_connection_state_t state,
   decoded_frame->frame_type = 0;
 
   if (received_data.len == 0) {
-    RABBIT_INFO("return AMQP_STATUS_OK");
     return AMQP_STATUS_OK;
   }
 
@@ -249,15 +333,12 @@ int amqp_handle_input(amqp_connection_state_t state,
 
   bytes_consumed = consume_data(state, &received_data);
 
-#ifdef RABBIT_INFO_AVAILABLE
-  char * raw_char = state->inbound_buffer.bytes;
-  RABBIT_INFO( "state=%d inbound_offset=%d target_size=%d raw_char =%08x: %02x %02x %02x %02x %02x %02x %02x %02x", state->state, state->inbound_offset, state->target_size, (int)raw_char, (int)raw_char[0], (int)raw_char[1], (int)raw_char[2], (int)raw_char[3], (int)raw_char[4], (int)raw_char[5], (int)raw_char[6], (int)raw_char[7]);
-#endif
+  AMQP_TRACE(state, INPUT, state->state, state->inbound_offset,
+             state->target_size, bytes_consumed);
 
   /* do we have target_size data yet? if not, return with the
      expectation that more will arrive */
   if (state->inbound_offset < state->target_size) {
-    RABBIT_INFO("return %d", bytes_consumed);
     return bytes_consumed;
   }
 
@@ -280,7 +361,7 @@ int amqp_handle_input(amqp_connection_state_t state,
         = amqp_d8(raw_frame, 7);
 
       return_to_idle(state);
-      RABBIT_INFO("return %d", bytes_consumed);
+      AMQP_TRACE(state, INPUT_PROTOCOL, bytes_consumed, 0, 0, 0);
       return bytes_consumed;
     }
 
@@ -294,7 +375,7 @@ int amqp_handle_input(amqp_connection_state_t state,
     /* frame length is 3 bytes in */
     channel = amqp_d16(raw_frame, 1);
 
-    channel_pool = amqp_get_or_create_channel_pool(state, channel);
+    channel_pool = input_pool(state, channel);
     if (NULL == channel_pool) {
       return AMQP_STATUS_NO_MEMORY;
     }
@@ -317,18 +398,12 @@ int amqp_handle_input(amqp_connection_state_t state,
 
     bytes_consumed += consume_data(state, &received_data);
 
-#ifdef RABBIT_INFO_AVAILABLE
-    char * raw_char2 = state->inbound_buffer.bytes;
-    RABBIT_INFO( "state=%d inbound_offset=%d target_size=%d raw_char2=%08x: %02x %02x %02x %02x %02x %02x %02x %02x frame_type=%u channel=%d target_size=%d bytes_consumed=%d",
-            state->state, state->inbound_offset, state->target_size, (int)raw_char2,
-            (int)raw_char2[0], (int)raw_char2[1], (int)raw_char2[2], (int)raw_char2[3], (int)raw_char2[4], (int)raw_char2[5], (int)raw_char2[6], (int)raw_char2[7],
-            (unsigned int)decoded_frame->frame_type, channel, new_target_size, bytes_consumed);
-#endif
+    AMQP_TRACE(state, INPUT_HEADER, amqp_d8(raw_frame, 0), channel,
+               new_target_size, bytes_consumed);
 
     /* do we have target_size data yet? if not, return with the
        expectation that more will arrive */
     if (state->inbound_offset < state->target_size) {
-      RABBIT_INFO("return %d", bytes_consumed);
       return bytes_consumed;
     }
 
@@ -339,6 +414,7 @@ int amqp_handle_input(amqp_connection_state_t state,
     amqp_bytes_t encoded;
     int res;
     amqp_pool_t *channel_pool;
+    uint64_t decode_start;
 
     /* Check frame end marker (footer) */
     if (amqp_d8(raw_frame, state->target_size - 1) != AMQP_FRAME_END) {
@@ -348,22 +424,42 @@ int amqp_handle_input(amqp_connection_state_t state,
     decoded_frame->frame_type = amqp_d8(raw_frame, 0);
     decoded_frame->channel = amqp_d16(raw_frame, 1);
 
-    channel_pool = amqp_get_or_create_channel_pool(state, decoded_frame->channel);
+    channel_pool = input_pool(state, decoded_frame->channel);
     if (NULL == channel_pool) {
       return AMQP_STATUS_NO_MEMORY;
     }
 
+#ifdef AMQP_FRAMING_PRUNED
+    discard_content(state, decoded_frame, raw_frame);
+#endif
+
     switch (decoded_frame->frame_type) {
     case AMQP_FRAME_METHOD:
       decoded_frame->payload.method.id = amqp_d32(raw_frame, HEADER_SIZE);
       encoded.bytes = amqp_offset(raw_frame, HEADER_SIZE + 4);
       encoded.len = state->target_size - HEADER_SIZE - 4 - FOOTER_SIZE;
 
+      decode_start = AMQP_HIST_NOW();
       res = amqp_decode_method(decoded_frame->payload.method.id,
                                channel_pool, encoded,
                                &decoded_frame->payload.method.decoded);
+      AMQP_HIST_SINCE(state, AMQP_HISTOGRAM_DECODE_METHOD, decode_start);
+#ifdef AMQP_FRAMING_PRUNED
+      if (AMQP_STATUS_UNKNOWN_METHOD == res) {
+        AMQP_TRACE(state, DECODE_FAILED, decoded_frame->frame_type,
+                   decoded_frame->channel, res, 0);
+        if (amqp_method_has_content(decoded_frame->payload.method.id)) {
+          state->discard_content = 1;
+          state->discard_channel = decoded_frame->channel;
+          state->discard_remaining = 0;
+        }
+        decoded_frame->frame_type = 0;
+        break;
+      }
+#endif
       if (res < 0) {
-        RABBIT_INFO("return %d", res);
+        AMQP_TRACE(state, DECODE_FAILED, decoded_frame->frame_type,
+                   decoded_frame->channel, res, 0);
         return res;
       }
 
@@ -379,11 +475,20 @@ int amqp_handle_input(amqp_connection_state_t state,
       encoded.len = state->target_size - HEADER_SIZE - 12 - FOOTER_SIZE;
       decoded_frame->payload.properties.raw = encoded;
 
-      res = amqp_decode_properties(decoded_frame->payload.properties.class_id,
-                                   channel_pool, encoded,
-                                   &decoded_frame->payload.properties.decoded);
+      decode_start = AMQP_HIST_NOW();
+      if (state->lazy_properties &&
+          AMQP_BASIC_CLASS == decoded_frame->payload.properties.class_id) {
+        res = amqp_lazy_properties_decode(
+            channel_pool, encoded, &decoded_frame->payload.properties.decoded);
+      } else {
+        res = amqp_decode_properties(decoded_frame->payload.properties.class_id,
+                                     channel_pool, encoded,
+                                     &decoded_frame->payload.properties.decoded);
+      }
+      AMQP_HIST_SINCE(state, AMQP_HISTOGRAM_DECODE_PROPERTIES, decode_start);
       if (res < 0) {
-        RABBIT_INFO("return %d", res);
+        AMQP_TRACE(state, DECODE_FAILED, decoded_frame->frame_type,
+                   decoded_frame->channel, res, 0);
         return res;
       }
 
@@ -405,8 +510,10 @@ int amqp_handle_input(amqp_connection_state_t state,
       break;
     }
 
+    AMQP_STAT_FRAME(state, frames_in, decoded_frame->frame_type);
+    AMQP_TRACE(state, FRAME_IN, decoded_frame->frame_type,
+               decoded_frame->channel, state->target_size, 0);
     return_to_idle(state);
-    RABBIT_INFO("return %d", bytes_consumed);
     return bytes_consumed;
   }
 
@@ -445,7 +552,7 @@ void amqp_maybe_release_buffers(amqp_connection_state_t state)
 void amqp_maybe_release_buffers_on_channel(amqp_connection_state_t state, amqp_channel_t channel)
 {
   amqp_link_t *queued_link;
-  amqp_pool_t *pool;
+  amqp_pool_table_entry_t *entry;
   if (CONNECTION_STATE_IDLE != state->state) {
     return;
   }
@@ -461,37 +568,300 @@ void amqp_maybe_release_buffers_on_channel(amqp_connection_state_t state, amqp_c
     queued_link = queued_link->next;
   }
 
-  pool = amqp_get_channel_pool(state, channel);
+  entry = amqp_get_channel_entry(state, channel);
 
-  if (pool != NULL) {
-    recycle_amqp_pool(pool);
+  if (entry != NULL) {
+    recycle_amqp_pool(&entry->pool);
+    amqp_io_thread_release_pools(state, entry);
   }
 }
 
-int amqp_send_frame_non_body(
-    amqp_connection_state_t state,
-    const amqp_frame_t *frame,
-    void *out_frame )
+void amqp_set_clock(amqp_connection_state_t state, amqp_clock_fn clock,
+                    void *arg)
+{
+  state->clock = clock;
+  state->clock_arg = arg;
+  state->now = 0;
+}
+
+void amqp_set_lazy_properties(amqp_connection_state_t state,
+                              amqp_boolean_t enable)
 {
+  state->lazy_properties = enable ? 1 : 0;
+}
+
+int amqp_set_write_buffer(amqp_connection_state_t state, size_t size,
+                          size_t flush_threshold, struct timeval *max_delay)
+{
+  void *newbuf;
+  int res;
+
+  if (amqp_write_pending(state)) {
+    res = amqp_flush(state);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+  }
+
+  if (0 == size) {
+    free(state->write_buffer.bytes);
+    state->write_buffer.bytes = NULL;
+    state->write_buffer.len = 0;
+    state->write_flush_threshold = 0;
+    state->write_flush_delay = 0;
+    return AMQP_STATUS_OK;
+  }
+
+  if (max_delay && (max_delay->tv_sec < 0 || max_delay->tv_usec < 0)) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  newbuf = realloc(state->write_buffer.bytes, size);
+  if (NULL == newbuf) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  state->write_buffer.bytes = newbuf;
+  state->write_buffer.len = size;
+
+  if (0 == flush_threshold || flush_threshold > size) {
+    flush_threshold = size;
+  }
+  state->write_flush_threshold = flush_threshold;
+
+  if (max_delay) {
+    state->write_flush_delay =
+        (uint64_t)max_delay->tv_sec * AMQP_NS_PER_S +
+        (uint64_t)max_delay->tv_usec * AMQP_NS_PER_US;
+  } else {
+    state->write_flush_delay = 0;
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+#ifdef ENABLE_LATENCY_HISTOGRAMS
+#define SOCKET_TIME_ADD(state, start) \
+  ((state)->socket_write_ns += AMQP_HIST_NOW() - (start))
+#else
+#define SOCKET_TIME_ADD(state, start) ((void)(start))
+#endif
+
+/* Anything written counts as a heartbeat, so the next one is due a full
+ * interval after bytes last reached the socket; frames that are only
+ * buffered do not move it. Returns res, or AMQP_STATUS_TIMER_FAILURE if the
+ * clock cannot be read after a successful write. */
+static int sent_heartbeat_reset(amqp_connection_state_t state, int res)
+{
+  uint64_t current_time;
+
+  if (AMQP_STATUS_OK != res || 0 == state->heartbeat) {
+    return res;
+  }
+  current_time = amqp_clock_refresh(state);
+  if (0 == current_time) {
+    return AMQP_STATUS_TIMER_FAILURE;
+  }
+  state->next_send_heartbeat =
+      amqp_calc_next_send_heartbeat(state, current_time);
+  return AMQP_STATUS_OK;
+}
+
+/* Raw writes go through the I/O thread's outbound ring while it owns the
+ * socket. */
+static int conn_writev(amqp_connection_state_t state,
+                       struct iovec *iov, int iovcnt)
+{
+  uint64_t start = AMQP_HIST_NOW();
+  int res;
+
+  if (NULL != state->io_thread) {
+    res = amqp_io_thread_writev(state, iov, iovcnt);
+  } else {
+    res = amqp_socket_writev(state->socket, iov, iovcnt);
+  }
+  SOCKET_TIME_ADD(state, start);
+#ifdef ENABLE_CONNECTION_STATS
+  if (AMQP_STATUS_OK == res) {
+    int i;
+    for (i = 0; i < iovcnt; ++i) {
+      AMQP_STAT_OUT(state, bytes_out, iov[i].iov_len);
+    }
+  }
+#endif
+  return sent_heartbeat_reset(state, res);
+}
+
+static int conn_send(amqp_connection_state_t state, const void *buf,
+                     size_t len)
+{
+  uint64_t start = AMQP_HIST_NOW();
+  struct iovec iov;
+  int res;
+
+  if (NULL == state->io_thread) {
+    res = amqp_socket_send(state->socket, buf, len);
+  } else {
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    res = amqp_io_thread_writev(state, &iov, 1);
+  }
+  SOCKET_TIME_ADD(state, start);
+  if (AMQP_STATUS_OK == res) {
+    AMQP_STAT_OUT(state, bytes_out, len);
+  }
+  return sent_heartbeat_reset(state, res);
+}
+
+static int flush_write_buffer(amqp_connection_state_t state)
+{
+  int res;
+
+  if (!amqp_write_pending(state)) {
+    return AMQP_STATUS_OK;
+  }
+
+  res = conn_send(state, state->write_buffer.bytes,
+                         state->write_buffer_used);
+  /* on failure the connection is unusable, so the pending bytes are dropped
+   * either way */
+  state->write_buffer_used = 0;
+  return res;
+}
+
+int amqp_flush(amqp_connection_state_t state)
+{
+  int res;
+
+  if (NULL == state->publish_queue) {
+    return flush_write_buffer(state);
+  }
+
+  res = amqp_publish_queue_lock(state);
+  if (AMQP_STATUS_OK == res) {
+    res = flush_write_buffer(state);
+  }
+  if (AMQP_STATUS_OK == res) {
+    res = amqp_publish_queue_unlock(state);
+  } else {
+    amqp_publish_queue_unlock(state);
+  }
+  return res;
+}
+
+/* Writes iov through the connection's write buffer. Small frames are
+ * coalesced; anything that does not fit goes out in a single writev together
+ * with whatever was already buffered. */
+static int buffered_writev(amqp_connection_state_t state,
+                           struct iovec *iov, int iovcnt)
+{
+  struct iovec combined[4];
+  size_t bytes = 0;
+  int i;
+  int res;
+
+  if (0 == state->write_buffer.len) {
+    return conn_writev(state, iov, iovcnt);
+  }
+
+  for (i = 0; i < iovcnt; ++i) {
+    bytes += iov[i].iov_len;
+  }
+
+  if (state->write_buffer_used + bytes <= state->write_buffer.len) {
+    uint64_t current_time = 0;
+
+    if (state->write_flush_delay > 0) {
+      current_time = amqp_clock_refresh(state);
+      if (0 == current_time) {
+        return AMQP_STATUS_TIMER_FAILURE;
+      }
+      if (!amqp_write_pending(state)) {
+        state->write_flush_deadline = current_time + state->write_flush_delay;
+      }
+    }
+
+    for (i = 0; i < iovcnt; ++i) {
+      memcpy(amqp_offset(state->write_buffer.bytes, state->write_buffer_used),
+             iov[i].iov_base, iov[i].iov_len);
+      state->write_buffer_used += iov[i].iov_len;
+    }
+
+    if (state->write_buffer_used >= state->write_flush_threshold ||
+        (current_time && current_time >= state->write_flush_deadline)) {
+      return flush_write_buffer(state);
+    }
+    return AMQP_STATUS_OK;
+  }
+
+  if (!amqp_write_pending(state)) {
+    return conn_writev(state, iov, iovcnt);
+  }
+
+  if (iovcnt >= (int)(sizeof(combined) / sizeof(combined[0]))) {
+    res = flush_write_buffer(state);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    return conn_writev(state, iov, iovcnt);
+  }
+
+  combined[0].iov_base = state->write_buffer.bytes;
+  combined[0].iov_len = state->write_buffer_used;
+  for (i = 0; i < iovcnt; ++i) {
+    combined[i + 1] = iov[i];
+  }
+  state->write_buffer_used = 0;
+  return conn_writev(state, combined, iovcnt + 1);
+}
+
+static int amqp_buffered_writev(amqp_connection_state_t state,
+                                struct iovec *iov, int iovcnt)
+{
+  int res;
+
+  if (NULL == state->publish_queue) {
+    return buffered_writev(state, iov, iovcnt);
+  }
+
+  /* shared publishing: frames from this thread have to take the writer
+     role like everybody else */
+  res = amqp_publish_queue_lock(state);
+  if (AMQP_STATUS_OK == res) {
+    res = buffered_writev(state, iov, iovcnt);
+  }
+  if (AMQP_STATUS_OK == res) {
+    res = amqp_publish_queue_unlock(state);
+  } else {
+    amqp_publish_queue_unlock(state);
+  }
+  return res;
+}
+
+int amqp_encode_frame_non_body(const amqp_frame_t *frame, amqp_bytes_t buffer)
+{
+  void *out_frame = buffer.bytes;
   size_t out_frame_len;
+  amqp_lazy_properties_t *lazy;
   amqp_bytes_t encoded;
   int res;
 
+  amqp_e8(out_frame, 0, frame->frame_type);
+  amqp_e16(out_frame, 1, frame->channel);
+
   switch (frame->frame_type) {
   case AMQP_FRAME_METHOD:
     amqp_e32(out_frame, HEADER_SIZE, frame->payload.method.id);
 
     encoded.bytes = amqp_offset(out_frame, HEADER_SIZE + 4);
-    encoded.len = state->outbound_buffer.len - HEADER_SIZE - 4 - FOOTER_SIZE;
+    encoded.len = buffer.len - HEADER_SIZE - 4 - FOOTER_SIZE;
 
-    RABBIT_INFO("amqp_encode_method out_frame=%08x len=%d method_id=%d decoded=%08x encoded=%08x",
-        (int)out_frame, (int)encoded.len, (int)frame->payload.method.id, (int)frame->payload.method.decoded, (int)&encoded);
     res = amqp_encode_method(frame->payload.method.id,
                              frame->payload.method.decoded, encoded);
-    RABBIT_INFO("amqp_encode_method out_frame=%08x len=%d method_id=%d decoded=%08x encoded=%08x res=%d",
-        (int)out_frame, (int)encoded.len, (int)frame->payload.method.id, (int)frame->payload.method.decoded, (int)&encoded, res);
 
     if (res < 0) {
+      /* no connection here, failures go to the process-wide ring */
+      AMQP_TRACE_TO(NULL, ENCODE_METHOD, frame->payload.method.id,
+                    encoded.len, res, 0);
       return res;
     }
 
@@ -504,17 +874,19 @@ int amqp_send_frame_non_body(
     amqp_e64(out_frame, HEADER_SIZE+4, frame->payload.properties.body_size);
 
     encoded.bytes = amqp_offset(out_frame, HEADER_SIZE + 12);
-    encoded.len = state->outbound_buffer.len - HEADER_SIZE - 12 - FOOTER_SIZE;
-
-    RABBIT_INFO("amqp_encode_properties out_frame=%08x len=%d class_id=%d decoded=%08x encoded=%08x",
-        (int)out_frame, encoded.len, (int)(frame->payload.properties.class_id), (int)(frame->payload.properties.decoded), (int)&encoded);
-
-    res = amqp_encode_properties(frame->payload.properties.class_id,
-                                 frame->payload.properties.decoded, encoded);
-    RABBIT_INFO("amqp_encode_properties out_frame=%08x len=%d class_id=%d decoded=%08x encoded=%08x res=%d",
-        (int)out_frame, encoded.len, (int)(frame->payload.properties.class_id), (int)(frame->payload.properties.decoded), (int)&encoded, res);
+    encoded.len = buffer.len - HEADER_SIZE - 12 - FOOTER_SIZE;
+
+    lazy = amqp_frame_lazy_properties(frame);
+    if (NULL != lazy) {
+      res = amqp_lazy_properties_encode(lazy, encoded);
+    } else {
+      res = amqp_encode_properties(frame->payload.properties.class_id,
+                                   frame->payload.properties.decoded, encoded);
+    }
 
     if (res < 0) {
+      AMQP_TRACE_TO(NULL, ENCODE_PROPERTIES,
+                    frame->payload.properties.class_id, encoded.len, res, 0);
       return res;
     }
 
@@ -522,21 +894,37 @@ int amqp_send_frame_non_body(
     break;
 
   case AMQP_FRAME_HEARTBEAT:
-    RABBIT_INFO("send heartbeat");
     out_frame_len = 0;
     break;
 
   default:
-    RABBIT_INFO("");
+    AMQP_TRACE_TO(NULL, ENCODE_INVALID, frame->frame_type, 0, 0, 0);
     return AMQP_STATUS_INVALID_PARAMETER;
   }
 
   amqp_e32(out_frame, 3, out_frame_len);
   amqp_e8(out_frame, out_frame_len + HEADER_SIZE, AMQP_FRAME_END);
-  RABBIT_INFO("send socket=%08x, outframe=%08x, len=%d", state->socket, out_frame, out_frame_len + HEADER_SIZE + FOOTER_SIZE);
-  res = amqp_socket_send(state->socket, out_frame,
-                         out_frame_len + HEADER_SIZE + FOOTER_SIZE);
-  RABBIT_INFO("send socket=%08x, outframe=%08x, len=%d res=%d", state->socket, out_frame, out_frame_len + HEADER_SIZE + FOOTER_SIZE, res);
+  return (int)(out_frame_len + HEADER_SIZE + FOOTER_SIZE);
+}
+
+int amqp_send_frame_non_body(
+    amqp_connection_state_t state,
+    const amqp_frame_t *frame,
+    void *out_frame )
+{
+  struct iovec iov;
+  int res;
+
+  res = amqp_encode_frame_non_body(frame, state->outbound_buffer);
+  if (res < 0) {
+    return res;
+  }
+
+  iov.iov_base = out_frame;
+  iov.iov_len = res;
+  res = amqp_buffered_writev(state, &iov, 1);
+  AMQP_TRACE(state, SEND_FRAME, frame->frame_type, frame->channel,
+             iov.iov_len, res);
   return res;
 }
 
@@ -566,23 +954,16 @@ int amqp_send_frame(amqp_connection_state_t state,
     iov[2].iov_base = &frame_end_byte;
     iov[2].iov_len = FOOTER_SIZE;
 
-    RABBIT_INFO("writev body->len=%d", body->len);
-    res = amqp_socket_writev(state->socket, iov, 3);
-    RABBIT_INFO("writev body->len=%d res=%d", body->len, res);
+    res = amqp_buffered_writev(state, iov, 3);
+    AMQP_TRACE(state, SEND_FRAME, AMQP_FRAME_BODY, frame->channel,
+               HEADER_SIZE + body->len + FOOTER_SIZE, res);
   } else {
     res = amqp_send_frame_non_body(state, frame, out_frame );
     if (AMQP_STATUS_OK != res) {
       return res;
     }
   }
-
-  if (state->heartbeat > 0) {
-    uint64_t current_time = amqp_get_monotonic_timestamp();
-    if (0 == current_time) {
-      return AMQP_STATUS_TIMER_FAILURE;
-    }
-    state->next_send_heartbeat = amqp_calc_next_send_heartbeat(state, current_time);
-  }
+  AMQP_STAT_FRAME_OUT(state, frame->frame_type);
 
   return res;
 }
@@ -602,10 +983,20 @@ int amqp_send_frame_streaming(
 
     uint8_t frame_end_byte = AMQP_FRAME_END;
     const amqp_bytes_t *body = &frame->payload.body_fragment;
+    amqp_boolean_t locked = 0;
 
     amqp_e32(out_frame, 3, body->len);
 
-    res = amqp_socket_send(state->socket, out_frame, HEADER_SIZE);
+    /* the body is streamed straight to the socket, so anything coalesced
+       ahead of it has to go first */
+    res = amqp_flush(state);
+    if (AMQP_STATUS_OK == res && NULL != state->publish_queue) {
+      locked = 1;
+      res = amqp_publish_queue_lock(state);
+    }
+    if (AMQP_STATUS_OK == res) {
+      res = conn_send(state, out_frame, HEADER_SIZE);
+    }
 
     size_t remaining = body->len;
 #if 0
@@ -613,7 +1004,7 @@ int amqp_send_frame_streaming(
 #endif
     while ((AMQP_STATUS_OK == res) && remaining) {
       int len = lsAvailable(bodyStreamP);
-      RABBIT_INFO("lsAvailable len=%d",len);
+      AMQP_TRACE(state, STREAM_CHUNK, len, remaining, 0, 0);
 #if 0
       lprintf("rabbit remaining=%d lsAvailable=%d\n",remaining, len);
 #endif
@@ -624,8 +1015,7 @@ int amqp_send_frame_streaming(
       if ((size_t)len>remaining) {
         len = remaining;
       }
-      RABBIT_INFO("send bytes=%d", len);
-      res = amqp_socket_send(state->socket, lsPeek(bodyStreamP), len);
+      res = conn_send(state, lsPeek(bodyStreamP), len);
       if (AMQP_STATUS_OK == res) {
 #if 0
         lprintf("taking len=%d\n",len);
@@ -636,9 +1026,15 @@ int amqp_send_frame_streaming(
     }
 
     if (AMQP_STATUS_OK == res) {
-      res = amqp_socket_send(state->socket, &frame_end_byte, FOOTER_SIZE);
+      res = conn_send(state, &frame_end_byte, FOOTER_SIZE);
+    }
+    if (locked) {
+      int unlock_res = amqp_publish_queue_unlock(state);
+      if (AMQP_STATUS_OK == res) {
+        res = unlock_res;
+      }
     }
-    RABBIT_INFO("send body->len=%d res=%d", body->len, res);
+    AMQP_TRACE(state, STREAM_BODY, body->len, res, 0, 0);
 
   } else {
     res = amqp_send_frame_non_body(state, frame, out_frame );
@@ -646,13 +1042,7 @@ int amqp_send_frame_streaming(
       return res;
     }
   }
-  if (state->heartbeat > 0) {
-    uint64_t current_time = amqp_get_monotonic_timestamp();
-    if (0 == current_time) {
-      return AMQP_STATUS_TIMER_FAILURE;
-    }
-    state->next_send_heartbeat = amqp_calc_next_send_heartbeat(state, current_time);
-  }
+  AMQP_STAT_FRAME_OUT(state, frame->frame_type);
 
   return res;
 }
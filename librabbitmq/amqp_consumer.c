@@ -140,10 +140,18 @@ amqp_consume_message(amqp_connection_state_t state, amqp_envelope_t *envelope,
   amqp_frame_t frame;
   amqp_basic_deliver_t *delivery_method;
   amqp_rpc_reply_t ret;
+  uint64_t begin = 0;
 
   memset(&ret, 0, sizeof(amqp_rpc_reply_t));
   memset(envelope, 0, sizeof(amqp_envelope_t));
 
+  if (NULL != state->prefetch_ctls) {
+    ret = amqp_prefetch_consume_begin(state, &begin);
+    if (AMQP_RESPONSE_NORMAL != ret.reply_type) {
+      goto error_out1;
+    }
+  }
+
   res = amqp_simple_wait_frame_noblock(state, &frame, timeout);
   if (AMQP_STATUS_OK != res) {
     ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
@@ -182,6 +190,10 @@ amqp_consume_message(amqp_connection_state_t state, amqp_envelope_t *envelope,
     goto error_out2;
   }
 
+  if (NULL != state->prefetch_ctls) {
+    amqp_prefetch_consume_end(state, envelope->channel, begin);
+  }
+
   ret.reply_type = AMQP_RESPONSE_NORMAL;
   return ret;
 
@@ -193,11 +205,16 @@ error_out1:
   return ret;
 }
 
-amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
-                                   amqp_channel_t channel,
-                                   amqp_message_t *message,
-                                   AMQP_UNUSED int flags)
+/* Reads a message's header and body frames. The properties are either
+ * cloned into *properties or, if lazy is set, kept encoded in *lazy. */
+static amqp_rpc_reply_t read_message(amqp_connection_state_t state,
+                                     amqp_channel_t channel,
+                                     amqp_pool_t *pool,
+                                     amqp_basic_properties_t *properties,
+                                     amqp_lazy_properties_t **lazy,
+                                     amqp_bytes_t *body)
 {
+  amqp_lazy_properties_t *frame_lazy;
   amqp_frame_t frame;
   amqp_rpc_reply_t ret;
 
@@ -206,7 +223,6 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
   int res;
 
   memset(&ret, 0, sizeof(amqp_rpc_reply_t));
-  memset(message, 0, sizeof(amqp_message_t));
 
   res = amqp_simple_wait_frame_on_channel(state, channel, &frame);
   if (AMQP_STATUS_OK != res) {
@@ -235,9 +251,22 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
     goto error_out1;
   }
 
-  init_amqp_pool(&message->pool, 4096);
-  res = amqp_basic_properties_clone(frame.payload.properties.decoded,
-                                    &message->properties, &message->pool);
+  init_amqp_pool(pool, 4096);
+  frame_lazy = amqp_frame_lazy_properties(&frame);
+  if (NULL != lazy) {
+    res = amqp_lazy_properties_copy(frame.payload.properties.raw, lazy, pool);
+  } else if (NULL != frame_lazy) {
+    /* decoded lazily, but the caller wants all of them */
+    res = amqp_lazy_properties_get(frame_lazy, (amqp_flags_t)-1);
+    if (AMQP_STATUS_OK == res) {
+      res = amqp_basic_properties_clone(&frame_lazy->properties, properties,
+                                        pool);
+      properties->_flags &= ~AMQP_LAZY_PROPERTIES_FLAG;
+    }
+  } else {
+    res = amqp_basic_properties_clone(frame.payload.properties.decoded,
+                                      properties, pool);
+  }
 
   if (AMQP_STATUS_OK != res) {
     ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
@@ -246,10 +275,10 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
   }
 
   if (0 == frame.payload.properties.body_size) {
-    message->body = amqp_empty_bytes;
+    *body = amqp_empty_bytes;
   } else {
-    message->body = amqp_bytes_malloc(frame.payload.properties.body_size);
-    if (NULL == message->body.bytes) {
+    *body = amqp_bytes_malloc(frame.payload.properties.body_size);
+    if (NULL == body->bytes) {
       ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
       ret.library_error = AMQP_STATUS_NO_MEMORY;
       goto error_out1;
@@ -257,9 +286,9 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
   }
 
   body_read = 0;
-  body_read_ptr = message->body.bytes;
+  body_read_ptr = body->bytes;
 
-  while (body_read < message->body.len) {
+  while (body_read < body->len) {
     res = amqp_simple_wait_frame_on_channel(state, channel, &frame);
     if (AMQP_STATUS_OK != res) {
       ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
@@ -280,7 +309,7 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
       goto error_out2;
     }
 
-    if (body_read + frame.payload.body_fragment.len > message->body.len) {
+    if (body_read + frame.payload.body_fragment.len > body->len) {
       ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
       ret.library_error = AMQP_STATUS_BAD_AMQP_DATA;
       goto error_out2;
@@ -296,9 +325,35 @@ amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
   return ret;
 
 error_out2:
-  amqp_bytes_free(message->body);
+  amqp_bytes_free(*body);
 error_out3:
-  empty_amqp_pool(&message->pool);
+  empty_amqp_pool(pool);
 error_out1:
   return ret;
 }
+
+amqp_rpc_reply_t amqp_read_message(amqp_connection_state_t state,
+                                   amqp_channel_t channel,
+                                   amqp_message_t *message,
+                                   AMQP_UNUSED int flags)
+{
+  memset(message, 0, sizeof(amqp_message_t));
+  return read_message(state, channel, &message->pool, &message->properties,
+                      NULL, &message->body);
+}
+
+amqp_rpc_reply_t amqp_read_message_lazy(amqp_connection_state_t state,
+                                        amqp_channel_t channel,
+                                        amqp_lazy_message_t *message,
+                                        AMQP_UNUSED int flags)
+{
+  memset(message, 0, sizeof(amqp_lazy_message_t));
+  return read_message(state, channel, &message->pool, NULL,
+                      &message->properties, &message->body);
+}
+
+void amqp_destroy_lazy_message(amqp_lazy_message_t *message)
+{
+  empty_amqp_pool(&message->pool);
+  amqp_bytes_free(message->body);
+}
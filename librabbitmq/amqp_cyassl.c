@@ -26,6 +26,7 @@
 #endif
 #include "amqp_ssl_socket.h"
 #include "amqp_private.h"
+#include "amqp_atomic.h"
 #include "lwip/sockets.h"
 #include <cyassl/ssl.h>
 #include <stdlib.h>
@@ -39,14 +40,23 @@
   -DAMQP_USE_UNTESTED_SSL_BACKEND to use this backend
 #endif
 
+struct amqp_ssl_context_t_ {
+  CYASSL_CTX *ctx;
+  int refs;
+  amqp_boolean_t in_use;      /* shared with sockets, no longer mutable */
+};
+
 struct amqp_ssl_socket_t {
   const struct amqp_socket_class_t *klass;
   CYASSL_CTX *ctx;
+  amqp_ssl_context_t *context; /* NULL with the single global context */
   CYASSL *ssl;
   int sockfd;
   char *buffer;
-  size_t length;
   int last_error;
+#ifdef AMQP_TRACE_RING
+  amqp_trace_ring_t *trace;
+#endif
 };
 
 CYASSL_CTX *amqp_ssl_socket_get_cyassl_ctx(amqp_socket_t *base)
@@ -90,12 +100,12 @@ amqp_ssl_socket_send_inner(void *base, const void *buf, size_t len, int flags)
   uint64_t startTimeNs = amqp_get_monotonic_timestamp();
 
 start:
-  RABBIT_INFO("send_inner: base=%08x, buf=%08x, len=%u flags=0x%08x", (uint32_t)base, (uint32_t)buf, len, flags);
   res = CyaSSL_send(self->ssl, buf_left, len_left, flags);
   uint64_t endTimeNs = amqp_get_monotonic_timestamp();
-  RABBIT_INFO("send_inner: base=%08x, CyaSSL_send res=%d", (uint32_t)base, res);
+  AMQP_TRACE_TO(self->trace, SSL_SEND, len_left, flags, res, 0);
   if (endTimeNs-startTimeNs > 7ULL*1000*1000*1000) {
-    RABBIT_INFO( "send_inner-time %u sec", (uint32_t)((endTimeNs-startTimeNs)/1000/1000/1000));
+    AMQP_TRACE_TO(self->trace, SSL_SEND_SLOW,
+                  (endTimeNs-startTimeNs)/1000/1000/1000, 0, 0, 0);
   }
 
   uint32_t sendTimeMs = (uint32_t)((endTimeNs-startTimeNs)/1000/1000);
@@ -133,7 +143,6 @@ start:
     goto start;
   }
 
-  RABBIT_INFO("send_inner: base=%08x, return res=%d", (uint32_t)base, (int)res);
   return res;
 }
 
@@ -143,23 +152,25 @@ amqp_ssl_socket_send(void *base, const void *buf, size_t len)
   return amqp_ssl_socket_send_inner(base, buf, len, 0);
 }
 
+static ssize_t
+amqp_ssl_socket_write_record(void *base, const void *buf, size_t len, int more)
+{
+  return amqp_ssl_socket_send_inner(base, buf, len, more ? MSG_MORE : 0);
+}
+
 static ssize_t
 amqp_ssl_socket_writev(void *base, struct iovec *iov, int iovcnt)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
-  ssize_t ret;
 
-  int i;
-  for (i = 0; i < iovcnt - 1; ++i) {
-    ret = amqp_ssl_socket_send_inner(self, iov[i].iov_base, iov[i].iov_len, MSG_MORE);
-    if (ret != AMQP_STATUS_OK) {
-      goto exit;
+  if (!self->buffer) {
+    self->buffer = malloc(AMQP_TLS_RECORD_SIZE);
+    if (!self->buffer) {
+      return AMQP_STATUS_NO_MEMORY;
     }
   }
-  ret = amqp_ssl_socket_send_inner(self, iov[i].iov_base, iov[i].iov_len, 0);
-
-exit:
-  return ret;
+  return amqp_tls_gather_writev(self, iov, iovcnt, self->buffer,
+                                amqp_ssl_socket_write_record);
 }
 
 static ssize_t
@@ -174,9 +185,8 @@ amqp_ssl_socket_recv(void *base, void *buf, size_t len, int flags)
 
 
 start:
-  RABBIT_INFO("socket_recv: base=%08x, buf=%08x, len=%u flags=0x%08x", (uint32_t)base, (uint32_t)buf, len, flags);
   res = CyaSSL_recv(self->ssl, buf, len, flags);
-  RABBIT_INFO("socket_recv: base=%08x, CyaSSL_recv ret=%d", (uint32_t)base, res);
+  AMQP_TRACE_TO(self->trace, SSL_RECV, len, res, 0, 0);
 
   if (0 > res) {
     self->last_error = CyaSSL_get_error(self->ssl,res);
@@ -202,10 +212,10 @@ amqp_ssl_socket_get_sockfd(void *base)
 static int
 amqp_ssl_socket_close(void *base)
 {
-  RABBIT_INFO("socket_close: base=%08x", (uint32_t)base);
   int status = -1;
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
   if (self) {
+    AMQP_TRACE_TO(self->trace, SSL_CLOSE, self->sockfd, 0, 0, 0);
     if (self->sockfd >= 0) {
       status = amqp_os_socket_close(self->sockfd);
       if (status) {
@@ -225,17 +235,13 @@ amqp_ssl_socket_close(void *base)
 
 static void amqp_ssl_socket_delete(void *base)
 {
-  RABBIT_INFO("socket_delete: base=%08x", (uint32_t)base);
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
 
   if (self) {
+    AMQP_TRACE_TO(self->trace, SSL_DELETE, self->sockfd, 0, 0, 0);
     amqp_ssl_socket_close(self);
 
-#ifndef CONFIG_APP_CLOUD_MESSAGING_ENA
-    if (self->ctx) {
-      CyaSSL_CTX_free(self->ctx);
-    }
-#endif
+    amqp_ssl_context_free(self->context);
     free(self->buffer);
     free(self);
   }
@@ -271,15 +277,43 @@ amqp_ssl_error_string(AMQP_UNUSED int err)
 
 #endif
 
+/* Drives the handshake on a non-blocking socket when a deadline is given,
+ * waiting for whichever direction CyaSSL asks for. */
+static int
+amqp_ssl_socket_connect(struct amqp_ssl_socket_t *self, amqp_timer_t *deadline,
+                        struct timeval *timeout)
+{
+  int status;
+
+  while (SSL_SUCCESS != (status = CyaSSL_connect(self->ssl))) {
+    int error = CyaSSL_get_error(self->ssl, status);
+    if (!deadline ||
+        (SSL_ERROR_WANT_READ != error && SSL_ERROR_WANT_WRITE != error)) {
+      logOffNominal("CyaSSL_connect failed = %d", error);
+      return AMQP_STATUS_SSL_ERROR;
+    }
+    status = amqp_socket_wait_fd(self->sockfd, SSL_ERROR_WANT_WRITE == error,
+                                 deadline, timeout);
+    if (AMQP_STATUS_OK != status) {
+      return status;
+    }
+  }
+  return AMQP_STATUS_OK;
+}
+
 static int
 amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *timeout)
 {
-  RABBIT_INFO("socket_open: base=%08x host=%s port=%d timeout=%d.%06d", (uint32_t)base, host, port, timeout->tv_sec, timeout->tv_usec);
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
+  amqp_timer_t deadline;
+  AMQP_INIT_TIMER(deadline)
 
   if (NULL == self) {
     return AMQP_STATUS_INVALID_PARAMETER;
   }
+  AMQP_TRACE_TO(self->trace, SSL_OPEN, port,
+                timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1,
+                0, 0);
 
   self->last_error = AMQP_STATUS_OK;
 
@@ -288,27 +322,33 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
     return self->last_error;
   }
 
-  RABBIT_INFO("Calling CyaSSL_new\n");
+  AMQP_TRACE_TO(self->trace, SSL_NEW, 0, 0, 0, 0);
   self->ssl = CyaSSL_new(self->ctx);
   if (NULL == self->ssl) {
     self->last_error = AMQP_STATUS_SSL_ERROR;
     return self->last_error;
   }
 
-  RABBIT_INFO("Calling amqp_open_socket_noblock");
-  self->sockfd = amqp_open_socket_noblock(host, port, timeout);
+  /* with a timeout the socket stays non-blocking until the handshake is
+   * done, so connecting and the handshake share one deadline */
+  self->sockfd = amqp_open_socket_inner(host, port, timeout,
+                                        timeout ? &deadline : NULL);
   if (0 > self->sockfd) {
     self->last_error = - self->sockfd;
     return AMQP_STATUS_SOCKET_ERROR;;
   }
   CyaSSL_set_fd(self->ssl, self->sockfd);
 
-  RABBIT_INFO("Calling CyaSSL_connect");
-  int status = CyaSSL_connect(self->ssl);
+  AMQP_TRACE_TO(self->trace, SSL_CONNECT, self->sockfd, 0, 0, 0);
+  int status = amqp_ssl_socket_connect(self, timeout ? &deadline : NULL,
+                                       timeout);
   logDebug("%d=CyaSSL_connect",status);
-  if (SSL_SUCCESS != status) {
-    logOffNominal("CyaSSL_connect failed = %d", status);
-    self->last_error = AMQP_STATUS_SSL_ERROR;
+  if (AMQP_STATUS_OK != status) {
+    self->last_error = status;
+    return self->last_error;
+  }
+  if (timeout && AMQP_STATUS_OK != amqp_socket_set_blocking(self->sockfd, 1)) {
+    self->last_error = AMQP_STATUS_SOCKET_ERROR;
     return self->last_error;
   }
   return AMQP_STATUS_OK;
@@ -321,87 +361,191 @@ static const struct amqp_socket_class_t amqp_ssl_socket_class = {
   amqp_ssl_socket_open, /* open */
   amqp_ssl_socket_close, /* close */
   amqp_ssl_socket_get_sockfd, /* get_sockfd */
-  amqp_ssl_socket_delete /* delete */
+  amqp_ssl_socket_delete, /* delete */
+  NULL /* wait */
 };
 
-amqp_socket_t *
-amqp_ssl_socket_new(amqp_connection_state_t state)
+amqp_ssl_context_t *
+amqp_ssl_context_new(void)
+{
+  amqp_ssl_context_t *context = calloc(1, sizeof(*context));
+  if (!context) {
+    return NULL;
+  }
+  CyaSSL_Init();
+  context->ctx = CyaSSL_CTX_new(CyaTLSv1_2_client_method());
+  if (!context->ctx) {
+    free(context);
+    return NULL;
+  }
+  context->refs = 1;
+  return context;
+}
+
+void
+amqp_ssl_context_free(amqp_ssl_context_t *context)
+{
+  if (context && 0 == amqp_atomic_add_int(&context->refs, -1)) {
+    CyaSSL_CTX_free(context->ctx);
+    free(context);
+  }
+}
+
+static amqp_socket_t *
+amqp_ssl_socket_new_inner(amqp_connection_state_t state,
+                          amqp_ssl_context_t *context)
 {
   struct amqp_ssl_socket_t *self = calloc(1, sizeof(*self));
   assert(self);
 
-#ifdef CONFIG_APP_CLOUD_MESSAGING_ENA
-  self->ctx = CYASSL_SINGLE_GLOBAL_CONTEXT();
-#else
-  CyaSSL_Init();
-  self->ctx = CyaSSL_CTX_new(CyaTLSv1_2_client_method());
-#endif
+  if (context) {
+    amqp_atomic_add_int(&context->refs, 1);
+    self->context = context;
+    self->ctx = context->ctx;
+  } else {
+    self->ctx = CYASSL_SINGLE_GLOBAL_CONTEXT();
+  }
   assert(self->ctx);
   self->klass = &amqp_ssl_socket_class;
   self->sockfd = -1;
+#ifdef AMQP_TRACE_RING
+  self->trace = &state->trace;
+#endif
 
   amqp_set_socket(state, (amqp_socket_t *)self);
 
   return (amqp_socket_t *)self;
 }
 
-#if defined(CONFIG_RABBITMQ_USE_CYASSL_BUFFER) && CONFIG_RABBITMQ_USE_CYASSL_BUFFER
-int
-amqp_ssl_socket_set_cacert_buffer(amqp_socket_t *base,
-                           const char *cacert,
-                           size_t certSize,
-                           int type)
+amqp_socket_t *
+amqp_ssl_socket_new(amqp_connection_state_t state)
+{
+#ifdef CONFIG_APP_CLOUD_MESSAGING_ENA
+  return amqp_ssl_socket_new_inner(state, NULL);
+#else
+  amqp_ssl_context_t *context = amqp_ssl_context_new();
+  amqp_socket_t *self;
+  assert(context);
+  /* the socket holds the only reference to its private context */
+  self = amqp_ssl_socket_new_inner(state, context);
+  amqp_ssl_context_free(context);
+  return self;
+#endif
+}
+
+amqp_socket_t *
+amqp_ssl_socket_new_with_context(amqp_connection_state_t state,
+                                 amqp_ssl_context_t *context)
+{
+  if (NULL == context) {
+    return NULL;
+  }
+  context->in_use = 1;
+  return amqp_ssl_socket_new_inner(state, context);
+}
+
+static struct amqp_ssl_socket_t *
+amqp_ssl_socket_mutable(amqp_socket_t *base)
 {
-  int status;
   struct amqp_ssl_socket_t *self;
   if (base->klass != &amqp_ssl_socket_class) {
     amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
   }
   self = (struct amqp_ssl_socket_t *)base;
-  status = CyaSSL_CTX_load_verify_buffer(self->ctx, (const unsigned char*)cacert, certSize, type);
+  if (self->context && self->context->in_use) {
+    return NULL;
+  }
+  return self;
+}
+
+#if defined(CONFIG_RABBITMQ_USE_CYASSL_BUFFER) && CONFIG_RABBITMQ_USE_CYASSL_BUFFER
+static int
+ctx_set_cacert_buffer(CYASSL_CTX *ctx,
+                      const char *cacert,
+                      size_t certSize,
+                      int type)
+{
+  int status;
+  status = CyaSSL_CTX_load_verify_buffer(ctx, (const unsigned char*)cacert, certSize, type);
   if (SSL_SUCCESS != status) {
     return -1;
   }
   return 0;
 }
+
+int
+amqp_ssl_socket_set_cacert_buffer(amqp_socket_t *base,
+                           const char *cacert,
+                           size_t certSize,
+                           int type)
+{
+  struct amqp_ssl_socket_t *self = amqp_ssl_socket_mutable(base);
+  if (!self) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_cacert_buffer(self->ctx, cacert, certSize, type);
+}
+
+int
+amqp_ssl_context_set_cacert_buffer(amqp_ssl_context_t *context,
+                                   const char *cacert,
+                                   size_t certSize,
+                                   int type)
+{
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_cacert_buffer(context->ctx, cacert, certSize, type);
+}
 #endif
 
 #if !defined(NO_FILESYSTEM) && !defined(NO_CERTS)
-int
-amqp_ssl_socket_set_cacert(amqp_socket_t *base,
-                           const char *cacert)
+static int
+ctx_set_cacert(CYASSL_CTX *ctx,
+               const char *cacert)
 {
   int status;
-  struct amqp_ssl_socket_t *self;
-  if (base->klass != &amqp_ssl_socket_class) {
-    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
-  }
-  self = (struct amqp_ssl_socket_t *)base;
-  status = CyaSSL_CTX_load_verify_locations(self->ctx, cacert, NULL);
+  status = CyaSSL_CTX_load_verify_locations(ctx, cacert, NULL);
   if (SSL_SUCCESS != status) {
     return -1;
   }
   return 0;
 }
+
+int
+amqp_ssl_socket_set_cacert(amqp_socket_t *base,
+                           const char *cacert)
+{
+  struct amqp_ssl_socket_t *self = amqp_ssl_socket_mutable(base);
+  if (!self) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_cacert(self->ctx, cacert);
+}
+
+int
+amqp_ssl_context_set_cacert(amqp_ssl_context_t *context,
+                            const char *cacert)
+{
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_cacert(context->ctx, cacert);
+}
 #endif
 
 #if defined(CONFIG_RABBITMQ_USE_CYASSL_BUFFER) && CONFIG_RABBITMQ_USE_CYASSL_BUFFER
-int
-amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
-                                   const char *cert,
-                                   const size_t certSize,
-                                   const char *key,
-                                   const size_t keySize,
-                                   const int keyType)
+static int
+ctx_set_key_buffer(CYASSL_CTX *ctx,
+                   const char *cert,
+                   const size_t certSize,
+                   const char *key,
+                   const size_t keySize,
+                   const int keyType)
 {
   int status;
-  struct amqp_ssl_socket_t *self;
-  if (base->klass != &amqp_ssl_socket_class) {
-    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
-  }
-  self = (struct amqp_ssl_socket_t *)base;
   status = CyaSSL_CTX_use_PrivateKey_buffer(
-               self->ctx,
+               ctx,
                (const unsigned char*)key,
                keySize,
                keyType);
@@ -409,41 +553,89 @@ amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
     return -1;
   }
 
-  status = CyaSSL_CTX_use_certificate_chain_buffer(self->ctx, (const unsigned char*)cert, certSize);
+  status = CyaSSL_CTX_use_certificate_chain_buffer(ctx, (const unsigned char*)cert, certSize);
   if (SSL_SUCCESS != status) {
     return -1;
   }
 
   return 0;
 }
+
+int
+amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
+                                   const char *cert,
+                                   const size_t certSize,
+                                   const char *key,
+                                   const size_t keySize,
+                                   const int keyType)
+{
+  struct amqp_ssl_socket_t *self = amqp_ssl_socket_mutable(base);
+  if (!self) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_key_buffer(self->ctx, cert, certSize, key, keySize, keyType);
+}
+
+int
+amqp_ssl_context_set_key_buffer(amqp_ssl_context_t *context,
+                                const char *cert,
+                                const size_t certSize,
+                                const char *key,
+                                const size_t keySize,
+                                const int keyType)
+{
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_key_buffer(context->ctx, cert, certSize, key, keySize,
+                            keyType);
+}
 #endif
 
 
 #if !defined(NO_FILESYSTEM) && !defined(NO_CERTS)
-int
-amqp_ssl_socket_set_key(amqp_socket_t *base,
-                        const char *cert,
-                        const char *key)
+static int
+ctx_set_key(CYASSL_CTX *ctx,
+            const char *cert,
+            const char *key)
 {
   int status;
-  struct amqp_ssl_socket_t *self;
-  if (base->klass != &amqp_ssl_socket_class) {
-    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
-  }
-  self = (struct amqp_ssl_socket_t *)base;
-  status = CyaSSL_CTX_use_PrivateKey_file(self->ctx, key,
+  status = CyaSSL_CTX_use_PrivateKey_file(ctx, key,
                                           SSL_FILETYPE_PEM);
   if (SSL_SUCCESS != status) {
     return -1;
   }
 
-  status = CyaSSL_CTX_use_certificate_chain_file(self->ctx, cert);
+  status = CyaSSL_CTX_use_certificate_chain_file(ctx, cert);
   if (SSL_SUCCESS != status) {
     return -1;
   }
 
   return 0;
 }
+
+int
+amqp_ssl_socket_set_key(amqp_socket_t *base,
+                        const char *cert,
+                        const char *key)
+{
+  struct amqp_ssl_socket_t *self = amqp_ssl_socket_mutable(base);
+  if (!self) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_key(self->ctx, cert, key);
+}
+
+int
+amqp_ssl_context_set_key(amqp_ssl_context_t *context,
+                         const char *cert,
+                         const char *key)
+{
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return ctx_set_key(context->ctx, cert, key);
+}
 #endif
 
 void
@@ -455,6 +647,33 @@ amqp_ssl_socket_set_verify(AMQP_UNUSED amqp_socket_t *base,
 
 }
 
+void
+amqp_ssl_socket_set_session_cache(amqp_socket_t *base,
+                                  AMQP_UNUSED amqp_ssl_session_cache_t *cache)
+{
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  /* CyaSSL_get_session() points into CyaSSL's own session table, where
+   * the entry can be replaced or expire under the cache, and CyaSSL has no
+   * way to copy a session out of it, so sessions are not cached with this
+   * backend */
+}
+
+int
+amqp_ssl_socket_set_ktls(AMQP_UNUSED amqp_socket_t *base,
+                         amqp_boolean_t enable)
+{
+  /* no kernel TLS offload with this backend */
+  return enable ? AMQP_STATUS_UNSUPPORTED : AMQP_STATUS_OK;
+}
+
+amqp_boolean_t
+amqp_ssl_socket_get_ktls(AMQP_UNUSED amqp_socket_t *base)
+{
+  return 0;
+}
+
 void
 amqp_set_initialize_ssl_library(AMQP_UNUSED amqp_boolean_t do_initialize)
 {
@@ -0,0 +1,310 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Consumer dispatch.
+ *
+ * Registered consumers live in a small hash table on the connection keyed by
+ * (channel, consumer tag). amqp_dispatch() hashes the consumer tag of each
+ * basic.deliver once, finds the handler and calls it with a view of the
+ * delivery that points straight into the channel's decoding pool; nothing is
+ * duplicated unless the body spans several frames, in which case it is
+ * reassembled in that same pool. The pool is recycled after the handler
+ * returns.
+ */
+
+/* FNV-1a, seeded with the channel number */
+static uint32_t consumer_hash(amqp_channel_t channel, amqp_bytes_t tag)
+{
+  const uint8_t *p = tag.bytes;
+  uint32_t hash = 2166136261u ^ channel;
+  size_t i;
+
+  for (i = 0; i < tag.len; ++i) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static amqp_consumer_entry_t **
+find_entry(amqp_connection_state_t state, amqp_channel_t channel,
+           amqp_bytes_t tag, uint32_t hash)
+{
+  amqp_consumer_entry_t **link =
+    &state->consumer_table[hash & (CONSUMER_TABLE_SIZE - 1)];
+
+  for (; NULL != *link; link = &(*link)->next) {
+    amqp_consumer_entry_t *entry = *link;
+    if (entry->hash == hash && entry->channel == channel &&
+        entry->tag.len == tag.len &&
+        0 == memcmp(entry->tag.bytes, tag.bytes, tag.len)) {
+      return link;
+    }
+  }
+  return link;
+}
+
+int amqp_register_consumer(amqp_connection_state_t state,
+                           amqp_channel_t channel, amqp_bytes_t consumer_tag,
+                           amqp_consumer_handler_t handler, void *ctx)
+{
+  uint32_t hash;
+  amqp_consumer_entry_t **link;
+  amqp_consumer_entry_t *entry;
+
+  if (NULL == consumer_tag.bytes || 0 == consumer_tag.len) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  hash = consumer_hash(channel, consumer_tag);
+  link = find_entry(state, channel, consumer_tag, hash);
+  entry = *link;
+
+  if (NULL == handler) {
+    if (NULL != entry) {
+      *link = entry->next;
+      free(entry);
+    }
+    return AMQP_STATUS_OK;
+  }
+
+  if (NULL == entry) {
+    /* the tag is stored right after the entry */
+    entry = malloc(sizeof(amqp_consumer_entry_t) + consumer_tag.len);
+    if (NULL == entry) {
+      return AMQP_STATUS_NO_MEMORY;
+    }
+    entry->next = NULL;
+    entry->hash = hash;
+    entry->channel = channel;
+    entry->tag.len = consumer_tag.len;
+    entry->tag.bytes = entry + 1;
+    memcpy(entry->tag.bytes, consumer_tag.bytes, consumer_tag.len);
+    *link = entry;
+  }
+
+  entry->handler = handler;
+  entry->ctx = ctx;
+  return AMQP_STATUS_OK;
+}
+
+void amqp_consumer_table_release(amqp_connection_state_t state,
+                                 amqp_channel_t channel)
+{
+  int i;
+
+  for (i = 0; i < CONSUMER_TABLE_SIZE; ++i) {
+    amqp_consumer_entry_t **link = &state->consumer_table[i];
+    while (NULL != *link) {
+      amqp_consumer_entry_t *entry = *link;
+      if (entry->channel == channel) {
+        *link = entry->next;
+        free(entry);
+      } else {
+        link = &entry->next;
+      }
+    }
+  }
+}
+
+void amqp_consumer_table_destroy(amqp_connection_state_t state)
+{
+  int i;
+
+  for (i = 0; i < CONSUMER_TABLE_SIZE; ++i) {
+    while (NULL != state->consumer_table[i]) {
+      amqp_consumer_entry_t *entry = state->consumer_table[i];
+      state->consumer_table[i] = entry->next;
+      free(entry);
+    }
+  }
+}
+
+static amqp_boolean_t is_close_method(amqp_frame_t *frame)
+{
+  return (AMQP_FRAME_METHOD == frame->frame_type &&
+          (AMQP_CHANNEL_CLOSE_METHOD == frame->payload.method.id ||
+           AMQP_CONNECTION_CLOSE_METHOD == frame->payload.method.id));
+}
+
+/* Reads the header and body frames that follow a basic.deliver. */
+static int read_delivery_content(amqp_connection_state_t state,
+                                 amqp_delivery_view_t *delivery)
+{
+  amqp_frame_t frame;
+  size_t body_read = 0;
+  int res;
+
+  res = amqp_simple_wait_frame_on_channel(state, delivery->channel, &frame);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+  if (AMQP_FRAME_HEADER != frame.frame_type) {
+    if (is_close_method(&frame)) {
+      amqp_put_back_frame(state, &frame);
+      return AMQP_STATUS_UNEXPECTED_STATE;
+    }
+    return AMQP_STATUS_BAD_AMQP_DATA;
+  }
+
+  delivery->properties = frame.payload.properties.decoded;
+  delivery->lazy = amqp_frame_lazy_properties(&frame);
+  delivery->body.len = frame.payload.properties.body_size;
+  delivery->body.bytes = NULL;
+
+  while (body_read < delivery->body.len) {
+    res = amqp_simple_wait_frame_on_channel(state, delivery->channel, &frame);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    if (AMQP_FRAME_BODY != frame.frame_type) {
+      if (is_close_method(&frame)) {
+        amqp_put_back_frame(state, &frame);
+        return AMQP_STATUS_UNEXPECTED_STATE;
+      }
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    }
+    if (body_read + frame.payload.body_fragment.len > delivery->body.len) {
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    }
+
+    if (0 == body_read &&
+        frame.payload.body_fragment.len == delivery->body.len) {
+      /* the common single frame case: hand out the frame's own bytes */
+      delivery->body.bytes = frame.payload.body_fragment.bytes;
+      break;
+    }
+
+    if (NULL == delivery->body.bytes) {
+      amqp_pool_t *pool = amqp_get_channel_pool(state, delivery->channel);
+      delivery->body.bytes = amqp_pool_alloc(pool, delivery->body.len);
+      if (NULL == delivery->body.bytes) {
+        return AMQP_STATUS_NO_MEMORY;
+      }
+    }
+    memcpy(amqp_offset(delivery->body.bytes, body_read),
+           frame.payload.body_fragment.bytes, frame.payload.body_fragment.len);
+    body_read += frame.payload.body_fragment.len;
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+int amqp_dispatch(amqp_connection_state_t state, struct timeval *timeout,
+                  int max_msgs)
+{
+  struct timeval no_wait;
+  struct timeval *wait = timeout;
+  int count = 0;
+
+  while (max_msgs <= 0 || count < max_msgs) {
+    amqp_frame_t frame;
+    amqp_basic_deliver_t *deliver;
+    amqp_delivery_view_t delivery;
+    amqp_consumer_entry_t *entry;
+    uint64_t begin = 0;
+    int res;
+
+    if (NULL != state->prefetch_ctls) {
+      /* a prefetch change is made between deliveries, never while one
+         is being read or handled */
+      amqp_rpc_reply_t ret = amqp_prefetch_consume_begin(state, &begin);
+      if (AMQP_RESPONSE_NORMAL != ret.reply_type) {
+        state->most_recent_api_result = ret;
+        if (count) {
+          /* report the deliveries already handled, the error is left for
+             amqp_get_rpc_reply() */
+          return count;
+        }
+        return (AMQP_RESPONSE_LIBRARY_EXCEPTION == ret.reply_type)
+               ? ret.library_error : AMQP_STATUS_UNEXPECTED_STATE;
+      }
+    }
+
+    res = amqp_simple_wait_frame_noblock(state, &frame, wait);
+    if (AMQP_STATUS_TIMEOUT == res) {
+      return count;
+    }
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    if (AMQP_FRAME_METHOD != frame.frame_type ||
+        AMQP_BASIC_DELIVER_METHOD != frame.payload.method.id) {
+      amqp_put_back_frame(state, &frame);
+      return count ? count : AMQP_STATUS_UNEXPECTED_STATE;
+    }
+
+    deliver = frame.payload.method.decoded;
+    entry = *find_entry(state, frame.channel, deliver->consumer_tag,
+                        consumer_hash(frame.channel, deliver->consumer_tag));
+    if (NULL == entry) {
+      /* not ours, leave it for amqp_consume_message() */
+      amqp_put_back_frame(state, &frame);
+      return count ? count : AMQP_STATUS_UNEXPECTED_STATE;
+    }
+
+    delivery.channel = frame.channel;
+    delivery.consumer_tag = deliver->consumer_tag;
+    delivery.delivery_tag = deliver->delivery_tag;
+    delivery.redelivered = deliver->redelivered;
+    delivery.exchange = deliver->exchange;
+    delivery.routing_key = deliver->routing_key;
+
+    res = read_delivery_content(state, &delivery);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    if (NULL != state->prefetch_ctls) {
+      amqp_prefetch_consume_end(state, delivery.channel, begin);
+    }
+
+    res = entry->handler(entry->ctx, &delivery);
+    amqp_maybe_release_buffers_on_channel(state, delivery.channel);
+    count++;
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    /* only the first message is waited for, the rest is whatever is
+       already available */
+    memset(&no_wait, 0, sizeof(no_wait));
+    wait = &no_wait;
+  }
+
+  return count;
+}
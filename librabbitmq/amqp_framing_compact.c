@@ -0,0 +1,1111 @@
+/* Generated code. Do not edit. Edit and re-run codegen.py instead.
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Portions created by Alan Antonuk are Copyright (c) 2012-2013
+ * Alan Antonuk. All Rights Reserved.
+ *
+ * Portions created by VMware are Copyright (c) 2007-2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Portions created by Tony Garnock-Jones are Copyright (c) 2009-2010
+ * VMware, Inc. and Tony Garnock-Jones. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+char const *amqp_constant_name(int constantNumber) {
+  switch (constantNumber) {
+    case AMQP_FRAME_METHOD: return "AMQP_FRAME_METHOD";
+    case AMQP_FRAME_HEADER: return "AMQP_FRAME_HEADER";
+    case AMQP_FRAME_BODY: return "AMQP_FRAME_BODY";
+    case AMQP_FRAME_HEARTBEAT: return "AMQP_FRAME_HEARTBEAT";
+    case AMQP_FRAME_MIN_SIZE: return "AMQP_FRAME_MIN_SIZE";
+    case AMQP_FRAME_END: return "AMQP_FRAME_END";
+    case AMQP_REPLY_SUCCESS: return "AMQP_REPLY_SUCCESS";
+    case AMQP_CONTENT_TOO_LARGE: return "AMQP_CONTENT_TOO_LARGE";
+    case AMQP_NO_ROUTE: return "AMQP_NO_ROUTE";
+    case AMQP_NO_CONSUMERS: return "AMQP_NO_CONSUMERS";
+    case AMQP_ACCESS_REFUSED: return "AMQP_ACCESS_REFUSED";
+    case AMQP_NOT_FOUND: return "AMQP_NOT_FOUND";
+    case AMQP_RESOURCE_LOCKED: return "AMQP_RESOURCE_LOCKED";
+    case AMQP_PRECONDITION_FAILED: return "AMQP_PRECONDITION_FAILED";
+    case AMQP_CONNECTION_FORCED: return "AMQP_CONNECTION_FORCED";
+    case AMQP_INVALID_PATH: return "AMQP_INVALID_PATH";
+    case AMQP_FRAME_ERROR: return "AMQP_FRAME_ERROR";
+    case AMQP_SYNTAX_ERROR: return "AMQP_SYNTAX_ERROR";
+    case AMQP_COMMAND_INVALID: return "AMQP_COMMAND_INVALID";
+    case AMQP_CHANNEL_ERROR: return "AMQP_CHANNEL_ERROR";
+    case AMQP_UNEXPECTED_FRAME: return "AMQP_UNEXPECTED_FRAME";
+    case AMQP_RESOURCE_ERROR: return "AMQP_RESOURCE_ERROR";
+    case AMQP_NOT_ALLOWED: return "AMQP_NOT_ALLOWED";
+    case AMQP_NOT_IMPLEMENTED: return "AMQP_NOT_IMPLEMENTED";
+    case AMQP_INTERNAL_ERROR: return "AMQP_INTERNAL_ERROR";
+    default: return "(unknown)";
+  }
+}
+
+amqp_boolean_t amqp_constant_is_hard_error(int constantNumber) {
+  switch (constantNumber) {
+    case AMQP_CONNECTION_FORCED: return 1;
+    case AMQP_INVALID_PATH: return 1;
+    case AMQP_FRAME_ERROR: return 1;
+    case AMQP_SYNTAX_ERROR: return 1;
+    case AMQP_COMMAND_INVALID: return 1;
+    case AMQP_CHANNEL_ERROR: return 1;
+    case AMQP_UNEXPECTED_FRAME: return 1;
+    case AMQP_RESOURCE_ERROR: return 1;
+    case AMQP_NOT_ALLOWED: return 1;
+    case AMQP_NOT_IMPLEMENTED: return 1;
+    case AMQP_INTERNAL_ERROR: return 1;
+    default: return 0;
+  }
+}
+
+/* Field types of the descriptor tables below. */
+enum {
+  AMQP_FIELD_OCTET,
+  AMQP_FIELD_SHORT,
+  AMQP_FIELD_LONG,
+  AMQP_FIELD_LONGLONG,
+  AMQP_FIELD_SHORTSTR,   /* 8 bit length prefix */
+  AMQP_FIELD_LONGSTR,    /* 32 bit length prefix */
+  AMQP_FIELD_BIT,
+  AMQP_FIELD_TABLE
+};
+
+typedef struct amqp_field_desc_t_ {
+  uint16_t offset;       /* in the method or properties struct */
+  uint8_t type;          /* AMQP_FIELD_* */
+  uint8_t flag;          /* properties only: bit number of the field's flag */
+} amqp_field_desc_t;
+
+typedef struct amqp_method_desc_t_ {
+  amqp_method_number_t id;
+  char const *name;
+  uint16_t size;
+  uint16_t first_field;  /* in amqp_method_fields */
+  uint16_t field_count;
+} amqp_method_desc_t;
+
+typedef struct amqp_class_desc_t_ {
+  uint16_t id;
+  uint16_t size;         /* 0 ends amqp_classes */
+  uint16_t first_field;  /* in amqp_property_fields */
+  uint16_t field_count;
+} amqp_class_desc_t;
+
+static const amqp_field_desc_t amqp_method_fields[] = {
+  {offsetof(amqp_connection_start_t, version_major), AMQP_FIELD_OCTET, 0},
+  {offsetof(amqp_connection_start_t, version_minor), AMQP_FIELD_OCTET, 0},
+  {offsetof(amqp_connection_start_t, server_properties), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_connection_start_t, mechanisms), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_connection_start_t, locales), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_connection_start_ok_t, client_properties), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_connection_start_ok_t, mechanism), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_start_ok_t, response), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_connection_start_ok_t, locale), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_secure_t, challenge), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_connection_secure_ok_t, response), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_connection_tune_t, channel_max), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_tune_t, frame_max), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_connection_tune_t, heartbeat), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_tune_ok_t, channel_max), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_tune_ok_t, frame_max), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_connection_tune_ok_t, heartbeat), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_open_t, virtual_host), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_open_t, capabilities), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_open_t, insist), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_connection_open_ok_t, known_hosts), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_close_t, reply_code), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_close_t, reply_text), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_connection_close_t, class_id), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_close_t, method_id), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_connection_blocked_t, reason), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_channel_open_t, out_of_band), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_channel_open_ok_t, channel_id), AMQP_FIELD_LONGSTR, 0},
+  {offsetof(amqp_channel_flow_t, active), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_channel_flow_ok_t, active), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_channel_close_t, reply_code), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_channel_close_t, reply_text), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_channel_close_t, class_id), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_channel_close_t, method_id), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_access_request_t, realm), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_access_request_t, exclusive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_access_request_t, passive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_access_request_t, active), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_access_request_t, write), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_access_request_t, read), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_access_request_ok_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_exchange_declare_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_exchange_declare_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_declare_t, type), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_declare_t, passive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_declare_t, durable), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_declare_t, auto_delete), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_declare_t, internal), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_declare_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_declare_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_exchange_delete_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_exchange_delete_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_delete_t, if_unused), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_delete_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_bind_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_exchange_bind_t, destination), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_bind_t, source), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_bind_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_bind_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_bind_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_exchange_unbind_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_exchange_unbind_t, destination), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_unbind_t, source), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_unbind_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_exchange_unbind_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_exchange_unbind_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_queue_declare_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_queue_declare_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_declare_t, passive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_declare_t, durable), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_declare_t, exclusive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_declare_t, auto_delete), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_declare_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_declare_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_queue_declare_ok_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_declare_ok_t, message_count), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_queue_declare_ok_t, consumer_count), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_queue_bind_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_queue_bind_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_bind_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_bind_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_bind_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_bind_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_queue_purge_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_queue_purge_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_purge_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_purge_ok_t, message_count), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_queue_delete_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_queue_delete_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_delete_t, if_unused), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_delete_t, if_empty), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_delete_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_queue_delete_ok_t, message_count), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_queue_unbind_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_queue_unbind_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_unbind_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_unbind_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_queue_unbind_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_basic_qos_t, prefetch_size), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_basic_qos_t, prefetch_count), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_basic_qos_t, global), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_consume_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_basic_consume_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_consume_t, consumer_tag), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_consume_t, no_local), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_consume_t, no_ack), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_consume_t, exclusive), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_consume_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_consume_t, arguments), AMQP_FIELD_TABLE, 0},
+  {offsetof(amqp_basic_consume_ok_t, consumer_tag), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_cancel_t, consumer_tag), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_cancel_t, nowait), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_cancel_ok_t, consumer_tag), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_publish_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_basic_publish_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_publish_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_publish_t, mandatory), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_publish_t, immediate), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_return_t, reply_code), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_basic_return_t, reply_text), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_return_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_return_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_deliver_t, consumer_tag), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_deliver_t, delivery_tag), AMQP_FIELD_LONGLONG, 0},
+  {offsetof(amqp_basic_deliver_t, redelivered), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_deliver_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_deliver_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_get_t, ticket), AMQP_FIELD_SHORT, 0},
+  {offsetof(amqp_basic_get_t, queue), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_get_t, no_ack), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_get_ok_t, delivery_tag), AMQP_FIELD_LONGLONG, 0},
+  {offsetof(amqp_basic_get_ok_t, redelivered), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_get_ok_t, exchange), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_get_ok_t, routing_key), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_get_ok_t, message_count), AMQP_FIELD_LONG, 0},
+  {offsetof(amqp_basic_get_empty_t, cluster_id), AMQP_FIELD_SHORTSTR, 0},
+  {offsetof(amqp_basic_ack_t, delivery_tag), AMQP_FIELD_LONGLONG, 0},
+  {offsetof(amqp_basic_ack_t, multiple), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_reject_t, delivery_tag), AMQP_FIELD_LONGLONG, 0},
+  {offsetof(amqp_basic_reject_t, requeue), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_recover_async_t, requeue), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_recover_t, requeue), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_nack_t, delivery_tag), AMQP_FIELD_LONGLONG, 0},
+  {offsetof(amqp_basic_nack_t, multiple), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_basic_nack_t, requeue), AMQP_FIELD_BIT, 0},
+  {offsetof(amqp_confirm_select_t, nowait), AMQP_FIELD_BIT, 0},
+  {0, 0, 0}
+};
+
+static const amqp_field_desc_t amqp_property_fields[] = {
+  {offsetof(amqp_basic_properties_t, content_type), AMQP_FIELD_SHORTSTR, 15},
+  {offsetof(amqp_basic_properties_t, content_encoding), AMQP_FIELD_SHORTSTR, 14},
+  {offsetof(amqp_basic_properties_t, headers), AMQP_FIELD_TABLE, 13},
+  {offsetof(amqp_basic_properties_t, delivery_mode), AMQP_FIELD_OCTET, 12},
+  {offsetof(amqp_basic_properties_t, priority), AMQP_FIELD_OCTET, 11},
+  {offsetof(amqp_basic_properties_t, correlation_id), AMQP_FIELD_SHORTSTR, 10},
+  {offsetof(amqp_basic_properties_t, reply_to), AMQP_FIELD_SHORTSTR, 9},
+  {offsetof(amqp_basic_properties_t, expiration), AMQP_FIELD_SHORTSTR, 8},
+  {offsetof(amqp_basic_properties_t, message_id), AMQP_FIELD_SHORTSTR, 7},
+  {offsetof(amqp_basic_properties_t, timestamp), AMQP_FIELD_LONGLONG, 6},
+  {offsetof(amqp_basic_properties_t, type), AMQP_FIELD_SHORTSTR, 5},
+  {offsetof(amqp_basic_properties_t, user_id), AMQP_FIELD_SHORTSTR, 4},
+  {offsetof(amqp_basic_properties_t, app_id), AMQP_FIELD_SHORTSTR, 3},
+  {offsetof(amqp_basic_properties_t, cluster_id), AMQP_FIELD_SHORTSTR, 2},
+  {0, 0, 0}
+};
+
+/* sorted by id */
+static const amqp_method_desc_t amqp_methods[] = {
+  {AMQP_CONNECTION_START_METHOD, "AMQP_CONNECTION_START_METHOD", sizeof(amqp_connection_start_t), 0, 5},
+  {AMQP_CONNECTION_START_OK_METHOD, "AMQP_CONNECTION_START_OK_METHOD", sizeof(amqp_connection_start_ok_t), 5, 4},
+  {AMQP_CONNECTION_SECURE_METHOD, "AMQP_CONNECTION_SECURE_METHOD", sizeof(amqp_connection_secure_t), 9, 1},
+  {AMQP_CONNECTION_SECURE_OK_METHOD, "AMQP_CONNECTION_SECURE_OK_METHOD", sizeof(amqp_connection_secure_ok_t), 10, 1},
+  {AMQP_CONNECTION_TUNE_METHOD, "AMQP_CONNECTION_TUNE_METHOD", sizeof(amqp_connection_tune_t), 11, 3},
+  {AMQP_CONNECTION_TUNE_OK_METHOD, "AMQP_CONNECTION_TUNE_OK_METHOD", sizeof(amqp_connection_tune_ok_t), 14, 3},
+  {AMQP_CONNECTION_OPEN_METHOD, "AMQP_CONNECTION_OPEN_METHOD", sizeof(amqp_connection_open_t), 17, 3},
+  {AMQP_CONNECTION_OPEN_OK_METHOD, "AMQP_CONNECTION_OPEN_OK_METHOD", sizeof(amqp_connection_open_ok_t), 20, 1},
+  {AMQP_CONNECTION_CLOSE_METHOD, "AMQP_CONNECTION_CLOSE_METHOD", sizeof(amqp_connection_close_t), 21, 4},
+  {AMQP_CONNECTION_CLOSE_OK_METHOD, "AMQP_CONNECTION_CLOSE_OK_METHOD", sizeof(amqp_connection_close_ok_t), 25, 0},
+  {AMQP_CONNECTION_BLOCKED_METHOD, "AMQP_CONNECTION_BLOCKED_METHOD", sizeof(amqp_connection_blocked_t), 25, 1},
+  {AMQP_CONNECTION_UNBLOCKED_METHOD, "AMQP_CONNECTION_UNBLOCKED_METHOD", sizeof(amqp_connection_unblocked_t), 26, 0},
+  {AMQP_CHANNEL_OPEN_METHOD, "AMQP_CHANNEL_OPEN_METHOD", sizeof(amqp_channel_open_t), 26, 1},
+  {AMQP_CHANNEL_OPEN_OK_METHOD, "AMQP_CHANNEL_OPEN_OK_METHOD", sizeof(amqp_channel_open_ok_t), 27, 1},
+  {AMQP_CHANNEL_FLOW_METHOD, "AMQP_CHANNEL_FLOW_METHOD", sizeof(amqp_channel_flow_t), 28, 1},
+  {AMQP_CHANNEL_FLOW_OK_METHOD, "AMQP_CHANNEL_FLOW_OK_METHOD", sizeof(amqp_channel_flow_ok_t), 29, 1},
+  {AMQP_CHANNEL_CLOSE_METHOD, "AMQP_CHANNEL_CLOSE_METHOD", sizeof(amqp_channel_close_t), 30, 4},
+  {AMQP_CHANNEL_CLOSE_OK_METHOD, "AMQP_CHANNEL_CLOSE_OK_METHOD", sizeof(amqp_channel_close_ok_t), 34, 0},
+  {AMQP_ACCESS_REQUEST_METHOD, "AMQP_ACCESS_REQUEST_METHOD", sizeof(amqp_access_request_t), 34, 6},
+  {AMQP_ACCESS_REQUEST_OK_METHOD, "AMQP_ACCESS_REQUEST_OK_METHOD", sizeof(amqp_access_request_ok_t), 40, 1},
+  {AMQP_EXCHANGE_DECLARE_METHOD, "AMQP_EXCHANGE_DECLARE_METHOD", sizeof(amqp_exchange_declare_t), 41, 9},
+  {AMQP_EXCHANGE_DECLARE_OK_METHOD, "AMQP_EXCHANGE_DECLARE_OK_METHOD", sizeof(amqp_exchange_declare_ok_t), 50, 0},
+  {AMQP_EXCHANGE_DELETE_METHOD, "AMQP_EXCHANGE_DELETE_METHOD", sizeof(amqp_exchange_delete_t), 50, 4},
+  {AMQP_EXCHANGE_DELETE_OK_METHOD, "AMQP_EXCHANGE_DELETE_OK_METHOD", sizeof(amqp_exchange_delete_ok_t), 54, 0},
+  {AMQP_EXCHANGE_BIND_METHOD, "AMQP_EXCHANGE_BIND_METHOD", sizeof(amqp_exchange_bind_t), 54, 6},
+  {AMQP_EXCHANGE_BIND_OK_METHOD, "AMQP_EXCHANGE_BIND_OK_METHOD", sizeof(amqp_exchange_bind_ok_t), 60, 0},
+  {AMQP_EXCHANGE_UNBIND_METHOD, "AMQP_EXCHANGE_UNBIND_METHOD", sizeof(amqp_exchange_unbind_t), 60, 6},
+  {AMQP_EXCHANGE_UNBIND_OK_METHOD, "AMQP_EXCHANGE_UNBIND_OK_METHOD", sizeof(amqp_exchange_unbind_ok_t), 66, 0},
+  {AMQP_QUEUE_DECLARE_METHOD, "AMQP_QUEUE_DECLARE_METHOD", sizeof(amqp_queue_declare_t), 66, 8},
+  {AMQP_QUEUE_DECLARE_OK_METHOD, "AMQP_QUEUE_DECLARE_OK_METHOD", sizeof(amqp_queue_declare_ok_t), 74, 3},
+  {AMQP_QUEUE_BIND_METHOD, "AMQP_QUEUE_BIND_METHOD", sizeof(amqp_queue_bind_t), 77, 6},
+  {AMQP_QUEUE_BIND_OK_METHOD, "AMQP_QUEUE_BIND_OK_METHOD", sizeof(amqp_queue_bind_ok_t), 83, 0},
+  {AMQP_QUEUE_PURGE_METHOD, "AMQP_QUEUE_PURGE_METHOD", sizeof(amqp_queue_purge_t), 83, 3},
+  {AMQP_QUEUE_PURGE_OK_METHOD, "AMQP_QUEUE_PURGE_OK_METHOD", sizeof(amqp_queue_purge_ok_t), 86, 1},
+  {AMQP_QUEUE_DELETE_METHOD, "AMQP_QUEUE_DELETE_METHOD", sizeof(amqp_queue_delete_t), 87, 5},
+  {AMQP_QUEUE_DELETE_OK_METHOD, "AMQP_QUEUE_DELETE_OK_METHOD", sizeof(amqp_queue_delete_ok_t), 92, 1},
+  {AMQP_QUEUE_UNBIND_METHOD, "AMQP_QUEUE_UNBIND_METHOD", sizeof(amqp_queue_unbind_t), 93, 5},
+  {AMQP_QUEUE_UNBIND_OK_METHOD, "AMQP_QUEUE_UNBIND_OK_METHOD", sizeof(amqp_queue_unbind_ok_t), 98, 0},
+  {AMQP_BASIC_QOS_METHOD, "AMQP_BASIC_QOS_METHOD", sizeof(amqp_basic_qos_t), 98, 3},
+  {AMQP_BASIC_QOS_OK_METHOD, "AMQP_BASIC_QOS_OK_METHOD", sizeof(amqp_basic_qos_ok_t), 101, 0},
+  {AMQP_BASIC_CONSUME_METHOD, "AMQP_BASIC_CONSUME_METHOD", sizeof(amqp_basic_consume_t), 101, 8},
+  {AMQP_BASIC_CONSUME_OK_METHOD, "AMQP_BASIC_CONSUME_OK_METHOD", sizeof(amqp_basic_consume_ok_t), 109, 1},
+  {AMQP_BASIC_CANCEL_METHOD, "AMQP_BASIC_CANCEL_METHOD", sizeof(amqp_basic_cancel_t), 110, 2},
+  {AMQP_BASIC_CANCEL_OK_METHOD, "AMQP_BASIC_CANCEL_OK_METHOD", sizeof(amqp_basic_cancel_ok_t), 112, 1},
+  {AMQP_BASIC_PUBLISH_METHOD, "AMQP_BASIC_PUBLISH_METHOD", sizeof(amqp_basic_publish_t), 113, 5},
+  {AMQP_BASIC_RETURN_METHOD, "AMQP_BASIC_RETURN_METHOD", sizeof(amqp_basic_return_t), 118, 4},
+  {AMQP_BASIC_DELIVER_METHOD, "AMQP_BASIC_DELIVER_METHOD", sizeof(amqp_basic_deliver_t), 122, 5},
+  {AMQP_BASIC_GET_METHOD, "AMQP_BASIC_GET_METHOD", sizeof(amqp_basic_get_t), 127, 3},
+  {AMQP_BASIC_GET_OK_METHOD, "AMQP_BASIC_GET_OK_METHOD", sizeof(amqp_basic_get_ok_t), 130, 5},
+  {AMQP_BASIC_GET_EMPTY_METHOD, "AMQP_BASIC_GET_EMPTY_METHOD", sizeof(amqp_basic_get_empty_t), 135, 1},
+  {AMQP_BASIC_ACK_METHOD, "AMQP_BASIC_ACK_METHOD", sizeof(amqp_basic_ack_t), 136, 2},
+  {AMQP_BASIC_REJECT_METHOD, "AMQP_BASIC_REJECT_METHOD", sizeof(amqp_basic_reject_t), 138, 2},
+  {AMQP_BASIC_RECOVER_ASYNC_METHOD, "AMQP_BASIC_RECOVER_ASYNC_METHOD", sizeof(amqp_basic_recover_async_t), 140, 1},
+  {AMQP_BASIC_RECOVER_METHOD, "AMQP_BASIC_RECOVER_METHOD", sizeof(amqp_basic_recover_t), 141, 1},
+  {AMQP_BASIC_RECOVER_OK_METHOD, "AMQP_BASIC_RECOVER_OK_METHOD", sizeof(amqp_basic_recover_ok_t), 142, 0},
+  {AMQP_BASIC_NACK_METHOD, "AMQP_BASIC_NACK_METHOD", sizeof(amqp_basic_nack_t), 142, 3},
+  {AMQP_CONFIRM_SELECT_METHOD, "AMQP_CONFIRM_SELECT_METHOD", sizeof(amqp_confirm_select_t), 145, 1},
+  {AMQP_CONFIRM_SELECT_OK_METHOD, "AMQP_CONFIRM_SELECT_OK_METHOD", sizeof(amqp_confirm_select_ok_t), 146, 0},
+  {AMQP_TX_SELECT_METHOD, "AMQP_TX_SELECT_METHOD", sizeof(amqp_tx_select_t), 146, 0},
+  {AMQP_TX_SELECT_OK_METHOD, "AMQP_TX_SELECT_OK_METHOD", sizeof(amqp_tx_select_ok_t), 146, 0},
+  {AMQP_TX_COMMIT_METHOD, "AMQP_TX_COMMIT_METHOD", sizeof(amqp_tx_commit_t), 146, 0},
+  {AMQP_TX_COMMIT_OK_METHOD, "AMQP_TX_COMMIT_OK_METHOD", sizeof(amqp_tx_commit_ok_t), 146, 0},
+  {AMQP_TX_ROLLBACK_METHOD, "AMQP_TX_ROLLBACK_METHOD", sizeof(amqp_tx_rollback_t), 146, 0},
+  {AMQP_TX_ROLLBACK_OK_METHOD, "AMQP_TX_ROLLBACK_OK_METHOD", sizeof(amqp_tx_rollback_ok_t), 146, 0},
+};
+
+static const amqp_class_desc_t amqp_classes[] = {
+  {AMQP_CONNECTION_CLASS, sizeof(amqp_connection_properties_t), 0, 0},
+  {AMQP_CHANNEL_CLASS, sizeof(amqp_channel_properties_t), 0, 0},
+  {AMQP_ACCESS_CLASS, sizeof(amqp_access_properties_t), 0, 0},
+  {AMQP_EXCHANGE_CLASS, sizeof(amqp_exchange_properties_t), 0, 0},
+  {AMQP_QUEUE_CLASS, sizeof(amqp_queue_properties_t), 0, 0},
+  {AMQP_BASIC_CLASS, sizeof(amqp_basic_properties_t), 0, 14},
+  {AMQP_TX_CLASS, sizeof(amqp_tx_properties_t), 14, 0},
+  {AMQP_CONFIRM_CLASS, sizeof(amqp_confirm_properties_t), 14, 0},
+  {0, 0, 0, 0}
+};
+
+static const amqp_method_desc_t *find_method(amqp_method_number_t methodNumber)
+{
+  size_t lo = 0;
+  size_t hi = sizeof(amqp_methods) / sizeof(amqp_methods[0]);
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (amqp_methods[mid].id < methodNumber) {
+      lo = mid + 1;
+    } else if (amqp_methods[mid].id > methodNumber) {
+      hi = mid;
+    } else {
+      return &amqp_methods[mid];
+    }
+  }
+  return NULL;
+}
+
+static const amqp_class_desc_t *find_class(uint16_t class_id)
+{
+  const amqp_class_desc_t *c;
+
+  for (c = amqp_classes; 0 != c->size; ++c) {
+    if (c->id == class_id) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+/* Decodes count fields into the struct at decoded. flags is NULL for
+   method fields, for properties only the fields it flags are present. */
+static int decode_fields(const amqp_field_desc_t *field, int count,
+                         const amqp_flags_t *flags, amqp_pool_t *pool,
+                         amqp_bytes_t encoded, size_t *offset, char *decoded)
+{
+  uint8_t bit_buffer = 0;
+  int bit = 0;
+
+  for (; count > 0; --count, ++field) {
+    void *value = decoded + field->offset;
+
+    if (flags && !(*flags & ((amqp_flags_t)1 << field->flag))) {
+      continue;
+    }
+    if (AMQP_FIELD_BIT != field->type) {
+      bit = 0;
+    }
+
+    switch (field->type) {
+      case AMQP_FIELD_OCTET:
+        if (!amqp_decode_8(encoded, offset, (uint8_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORT:
+        if (!amqp_decode_16(encoded, offset, (uint16_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONG:
+        if (!amqp_decode_32(encoded, offset, (uint32_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGLONG:
+        if (!amqp_decode_64(encoded, offset, (uint64_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORTSTR: {
+        uint8_t len;
+        if (!amqp_decode_8(encoded, offset, &len)
+            || !amqp_decode_bytes(encoded, offset, (amqp_bytes_t *)value, len))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      }
+      case AMQP_FIELD_LONGSTR: {
+        uint32_t len;
+        if (!amqp_decode_32(encoded, offset, &len)
+            || !amqp_decode_bytes(encoded, offset, (amqp_bytes_t *)value, len))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      }
+      case AMQP_FIELD_BIT:
+        if (0 == bit && !amqp_decode_8(encoded, offset, &bit_buffer))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        *(amqp_boolean_t *)value = (bit_buffer & (1 << bit)) ? 1 : 0;
+        bit = (bit + 1) & 7;
+        break;
+      case AMQP_FIELD_TABLE: {
+        int res = amqp_decode_table(encoded, pool, (amqp_table_t *)value, offset);
+        if (res < 0) return res;
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+static int encode_fields(const amqp_field_desc_t *field, int count,
+                         const amqp_flags_t *flags, amqp_bytes_t encoded,
+                         size_t *offset, char *decoded)
+{
+  uint8_t bit_buffer = 0;
+  int bit = 0;
+
+  for (; count > 0; --count, ++field) {
+    void *value = decoded + field->offset;
+
+    if (flags && !(*flags & ((amqp_flags_t)1 << field->flag))) {
+      continue;
+    }
+    if (bit && AMQP_FIELD_BIT != field->type) {
+      if (!amqp_encode_8(encoded, offset, bit_buffer))
+        return AMQP_STATUS_BAD_AMQP_DATA;
+      bit = 0;
+    }
+
+    switch (field->type) {
+      case AMQP_FIELD_OCTET:
+        if (!amqp_encode_8(encoded, offset, *(uint8_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORT:
+        if (!amqp_encode_16(encoded, offset, *(uint16_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONG:
+        if (!amqp_encode_32(encoded, offset, *(uint32_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGLONG:
+        if (!amqp_encode_64(encoded, offset, *(uint64_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORTSTR:
+        if (!amqp_encode_8(encoded, offset, ((amqp_bytes_t *)value)->len)
+            || !amqp_encode_bytes(encoded, offset, *(amqp_bytes_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGSTR:
+        if (!amqp_encode_32(encoded, offset, ((amqp_bytes_t *)value)->len)
+            || !amqp_encode_bytes(encoded, offset, *(amqp_bytes_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_BIT:
+        if (0 == bit) bit_buffer = 0;
+        if (*(amqp_boolean_t *)value) bit_buffer |= (1 << bit);
+        if (8 == ++bit) {
+          if (!amqp_encode_8(encoded, offset, bit_buffer))
+            return AMQP_STATUS_BAD_AMQP_DATA;
+          bit = 0;
+        }
+        break;
+      case AMQP_FIELD_TABLE: {
+        int res = amqp_encode_table(encoded, (amqp_table_t *)value, offset);
+        if (res < 0) return res;
+        break;
+      }
+    }
+  }
+  if (bit && !amqp_encode_8(encoded, offset, bit_buffer))
+    return AMQP_STATUS_BAD_AMQP_DATA;
+  return 0;
+}
+
+char const *amqp_method_name(amqp_method_number_t methodNumber) {
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  return (method ? method->name : NULL);
+}
+
+amqp_boolean_t amqp_method_has_content(amqp_method_number_t methodNumber) {
+  switch (methodNumber) {
+    case AMQP_BASIC_PUBLISH_METHOD: return 1;
+    case AMQP_BASIC_RETURN_METHOD: return 1;
+    case AMQP_BASIC_DELIVER_METHOD: return 1;
+    case AMQP_BASIC_GET_OK_METHOD: return 1;
+    default: return 0;
+  }
+}
+
+int amqp_decode_method(amqp_method_number_t methodNumber,
+                       amqp_pool_t *pool,
+                       amqp_bytes_t encoded,
+                       void **decoded)
+{
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  size_t offset = 0;
+  char *m = NULL; /* no fields */
+  int res;
+
+  if (NULL == method) {
+    return AMQP_STATUS_UNKNOWN_METHOD;
+  }
+  if (method->field_count) {
+    m = (char *) amqp_pool_alloc(pool, method->size);
+    if (m == NULL) { return AMQP_STATUS_NO_MEMORY; }
+  }
+  res = decode_fields(&amqp_method_fields[method->first_field],
+                      method->field_count, NULL, pool, encoded, &offset, m);
+  if (res < 0) {
+    return res;
+  }
+  *decoded = m;
+  return 0;
+}
+
+int amqp_decode_properties(uint16_t class_id,
+                           amqp_pool_t *pool,
+                           amqp_bytes_t encoded,
+                           void **decoded)
+{
+  const amqp_class_desc_t *c = find_class(class_id);
+  size_t offset = 0;
+
+  amqp_flags_t flags = 0;
+  int flagword_index = 0;
+  uint16_t partial_flags;
+  char *p;
+  int res;
+
+  do {
+    if (!amqp_decode_16(encoded, &offset, &partial_flags))
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    flags |= (partial_flags << (flagword_index * 16));
+    flagword_index++;
+  } while (partial_flags & 1);
+
+  if (NULL == c) {
+    return AMQP_STATUS_UNKNOWN_CLASS;
+  }
+  p = (char *) amqp_pool_alloc(pool, c->size);
+  if (p == NULL) { return AMQP_STATUS_NO_MEMORY; }
+  *(amqp_flags_t *) p = flags; /* _flags comes first in every class */
+
+  res = decode_fields(&amqp_property_fields[c->first_field], c->field_count,
+                      &flags, pool, encoded, &offset, p);
+  if (res < 0) {
+    return res;
+  }
+  *decoded = p;
+  return 0;
+}
+
+int amqp_encode_method(amqp_method_number_t methodNumber,
+                       void *decoded,
+                       amqp_bytes_t encoded)
+{
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  size_t offset = 0;
+  int res;
+
+  if (NULL == method) {
+    return AMQP_STATUS_UNKNOWN_METHOD;
+  }
+  res = encode_fields(&amqp_method_fields[method->first_field],
+                      method->field_count, NULL, encoded, &offset,
+                      (char *) decoded);
+  if (res < 0) {
+    return res;
+  }
+  return offset;
+}
+
+int amqp_encode_properties(uint16_t class_id,
+                           void *decoded,
+                           amqp_bytes_t encoded)
+{
+  const amqp_class_desc_t *c = find_class(class_id);
+  size_t offset = 0;
+  int res;
+
+  /* Cheat, and get the flags out generically, relying on the
+     similarity of structure between classes */
+  amqp_flags_t flags = * (amqp_flags_t *) decoded; /* cheating! */
+
+  {
+    /* We take a copy of flags to avoid destroying it, as it is used
+       in the field loop below. */
+    amqp_flags_t remaining_flags = flags;
+    do {
+      amqp_flags_t remainder = remaining_flags >> 16;
+      uint16_t partial_flags = remaining_flags & 0xFFFE;
+      if (remainder != 0) { partial_flags |= 1; }
+      if (!amqp_encode_16(encoded, &offset, partial_flags))
+        return AMQP_STATUS_BAD_AMQP_DATA;
+      remaining_flags = remainder;
+    } while (remaining_flags != 0);
+  }
+
+  if (NULL == c) {
+    return AMQP_STATUS_UNKNOWN_CLASS;
+  }
+  res = encode_fields(&amqp_property_fields[c->first_field], c->field_count,
+                      &flags, encoded, &offset, (char *) decoded);
+  if (res < 0) {
+    return res;
+  }
+  return offset;
+}
+
+/**
+ * amqp_channel_open
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @returns amqp_channel_open_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_channel_open_ok_t *
+AMQP_CALL amqp_channel_open(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_channel_open_t req;
+  req.out_of_band = amqp_empty_bytes;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_CHANNEL_OPEN_METHOD, AMQP_CHANNEL_OPEN_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_channel_flow
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] active active
+ * @returns amqp_channel_flow_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_channel_flow_ok_t *
+AMQP_CALL amqp_channel_flow(amqp_connection_state_t state, amqp_channel_t channel, amqp_boolean_t active)
+{
+  amqp_channel_flow_t req;
+  req.active = active;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_CHANNEL_FLOW_METHOD, AMQP_CHANNEL_FLOW_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_exchange_declare
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] exchange exchange
+ * @param [in] type type
+ * @param [in] passive passive
+ * @param [in] durable durable
+ * @param [in] arguments arguments
+ * @returns amqp_exchange_declare_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_exchange_declare_ok_t *
+AMQP_CALL amqp_exchange_declare(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t exchange, amqp_bytes_t type, amqp_boolean_t passive, amqp_boolean_t durable, amqp_table_t arguments)
+{
+  amqp_exchange_declare_t req;
+  req.ticket = 0;
+  req.exchange = exchange;
+  req.type = type;
+  req.passive = passive;
+  req.durable = durable;
+  req.auto_delete = 0;
+  req.internal = 0;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_EXCHANGE_DECLARE_METHOD, AMQP_EXCHANGE_DECLARE_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_exchange_delete
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] exchange exchange
+ * @param [in] if_unused if_unused
+ * @returns amqp_exchange_delete_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_exchange_delete_ok_t *
+AMQP_CALL amqp_exchange_delete(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t exchange, amqp_boolean_t if_unused)
+{
+  amqp_exchange_delete_t req;
+  req.ticket = 0;
+  req.exchange = exchange;
+  req.if_unused = if_unused;
+  req.nowait = 0;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_EXCHANGE_DELETE_METHOD, AMQP_EXCHANGE_DELETE_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_exchange_bind
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] destination destination
+ * @param [in] source source
+ * @param [in] routing_key routing_key
+ * @param [in] arguments arguments
+ * @returns amqp_exchange_bind_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_exchange_bind_ok_t *
+AMQP_CALL amqp_exchange_bind(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t destination, amqp_bytes_t source, amqp_bytes_t routing_key, amqp_table_t arguments)
+{
+  amqp_exchange_bind_t req;
+  req.ticket = 0;
+  req.destination = destination;
+  req.source = source;
+  req.routing_key = routing_key;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_EXCHANGE_BIND_METHOD, AMQP_EXCHANGE_BIND_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_exchange_unbind
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] destination destination
+ * @param [in] source source
+ * @param [in] routing_key routing_key
+ * @param [in] arguments arguments
+ * @returns amqp_exchange_unbind_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_exchange_unbind_ok_t *
+AMQP_CALL amqp_exchange_unbind(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t destination, amqp_bytes_t source, amqp_bytes_t routing_key, amqp_table_t arguments)
+{
+  amqp_exchange_unbind_t req;
+  req.ticket = 0;
+  req.destination = destination;
+  req.source = source;
+  req.routing_key = routing_key;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_EXCHANGE_UNBIND_METHOD, AMQP_EXCHANGE_UNBIND_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_queue_declare
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @param [in] passive passive
+ * @param [in] durable durable
+ * @param [in] exclusive exclusive
+ * @param [in] auto_delete auto_delete
+ * @param [in] arguments arguments
+ * @returns amqp_queue_declare_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_queue_declare_ok_t *
+AMQP_CALL amqp_queue_declare(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue, amqp_boolean_t passive, amqp_boolean_t durable, amqp_boolean_t exclusive, amqp_boolean_t auto_delete, amqp_table_t arguments)
+{
+  amqp_queue_declare_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.passive = passive;
+  req.durable = durable;
+  req.exclusive = exclusive;
+  req.auto_delete = auto_delete;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_QUEUE_DECLARE_METHOD, AMQP_QUEUE_DECLARE_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_queue_bind
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @param [in] exchange exchange
+ * @param [in] routing_key routing_key
+ * @param [in] arguments arguments
+ * @returns amqp_queue_bind_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_queue_bind_ok_t *
+AMQP_CALL amqp_queue_bind(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue, amqp_bytes_t exchange, amqp_bytes_t routing_key, amqp_table_t arguments)
+{
+  amqp_queue_bind_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.exchange = exchange;
+  req.routing_key = routing_key;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_QUEUE_BIND_METHOD, AMQP_QUEUE_BIND_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_queue_purge
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @returns amqp_queue_purge_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_queue_purge_ok_t *
+AMQP_CALL amqp_queue_purge(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue)
+{
+  amqp_queue_purge_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.nowait = 0;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_QUEUE_PURGE_METHOD, AMQP_QUEUE_PURGE_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_queue_delete
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @param [in] if_unused if_unused
+ * @param [in] if_empty if_empty
+ * @returns amqp_queue_delete_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_queue_delete_ok_t *
+AMQP_CALL amqp_queue_delete(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue, amqp_boolean_t if_unused, amqp_boolean_t if_empty)
+{
+  amqp_queue_delete_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.if_unused = if_unused;
+  req.if_empty = if_empty;
+  req.nowait = 0;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_QUEUE_DELETE_METHOD, AMQP_QUEUE_DELETE_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_queue_unbind
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @param [in] exchange exchange
+ * @param [in] routing_key routing_key
+ * @param [in] arguments arguments
+ * @returns amqp_queue_unbind_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_queue_unbind_ok_t *
+AMQP_CALL amqp_queue_unbind(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue, amqp_bytes_t exchange, amqp_bytes_t routing_key, amqp_table_t arguments)
+{
+  amqp_queue_unbind_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.exchange = exchange;
+  req.routing_key = routing_key;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_QUEUE_UNBIND_METHOD, AMQP_QUEUE_UNBIND_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_basic_qos
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] prefetch_size prefetch_size
+ * @param [in] prefetch_count prefetch_count
+ * @param [in] global global
+ * @returns amqp_basic_qos_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_basic_qos_ok_t *
+AMQP_CALL amqp_basic_qos(amqp_connection_state_t state, amqp_channel_t channel, uint32_t prefetch_size, uint16_t prefetch_count, amqp_boolean_t global)
+{
+  amqp_basic_qos_t req;
+  req.prefetch_size = prefetch_size;
+  req.prefetch_count = prefetch_count;
+  req.global = global;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_BASIC_QOS_METHOD, AMQP_BASIC_QOS_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_basic_consume
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] queue queue
+ * @param [in] consumer_tag consumer_tag
+ * @param [in] no_local no_local
+ * @param [in] no_ack no_ack
+ * @param [in] exclusive exclusive
+ * @param [in] arguments arguments
+ * @returns amqp_basic_consume_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_basic_consume_ok_t *
+AMQP_CALL amqp_basic_consume(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t queue, amqp_bytes_t consumer_tag, amqp_boolean_t no_local, amqp_boolean_t no_ack, amqp_boolean_t exclusive, amqp_table_t arguments)
+{
+  amqp_basic_consume_t req;
+  req.ticket = 0;
+  req.queue = queue;
+  req.consumer_tag = consumer_tag;
+  req.no_local = no_local;
+  req.no_ack = no_ack;
+  req.exclusive = exclusive;
+  req.nowait = 0;
+  req.arguments = arguments;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_BASIC_CONSUME_METHOD, AMQP_BASIC_CONSUME_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_basic_cancel
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] consumer_tag consumer_tag
+ * @returns amqp_basic_cancel_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_basic_cancel_ok_t *
+AMQP_CALL amqp_basic_cancel(amqp_connection_state_t state, amqp_channel_t channel, amqp_bytes_t consumer_tag)
+{
+  amqp_basic_cancel_t req;
+  req.consumer_tag = consumer_tag;
+  req.nowait = 0;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_BASIC_CANCEL_METHOD, AMQP_BASIC_CANCEL_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_basic_recover
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @param [in] requeue requeue
+ * @returns amqp_basic_recover_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_basic_recover_ok_t *
+AMQP_CALL amqp_basic_recover(amqp_connection_state_t state, amqp_channel_t channel, amqp_boolean_t requeue)
+{
+  amqp_basic_recover_t req;
+  req.requeue = requeue;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_BASIC_RECOVER_METHOD, AMQP_BASIC_RECOVER_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_tx_select
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @returns amqp_tx_select_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_tx_select_ok_t *
+AMQP_CALL amqp_tx_select(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_tx_select_t req;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_TX_SELECT_METHOD, AMQP_TX_SELECT_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_tx_commit
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @returns amqp_tx_commit_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_tx_commit_ok_t *
+AMQP_CALL amqp_tx_commit(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_tx_commit_t req;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_TX_COMMIT_METHOD, AMQP_TX_COMMIT_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_tx_rollback
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @returns amqp_tx_rollback_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_tx_rollback_ok_t *
+AMQP_CALL amqp_tx_rollback(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_tx_rollback_t req;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_TX_ROLLBACK_METHOD, AMQP_TX_ROLLBACK_OK_METHOD, &req);
+}
+
+
+/**
+ * amqp_confirm_select
+ *
+ * @param [in] state connection state
+ * @param [in] channel the channel to do the RPC on
+ * @returns amqp_confirm_select_ok_t
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_confirm_select_ok_t *
+AMQP_CALL amqp_confirm_select(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_confirm_select_t req;
+  req.nowait = 0;
+
+  return amqp_simple_rpc_decoded(state, channel, AMQP_CONFIRM_SELECT_METHOD, AMQP_CONFIRM_SELECT_OK_METHOD, &req);
+}
+
@@ -26,6 +26,7 @@
 #endif
 
 #include "amqp_ssl_socket.h"
+#include "amqp_ssl_cache.h"
 #include "amqp_private.h"
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -44,10 +45,25 @@ struct amqp_ssl_socket_t {
   int sockfd;
   char *host;
   char *buffer;
-  size_t length;
   int last_error;
+  amqp_ssl_session_cache_t *session_cache;
 };
 
+static void
+amqp_ssl_socket_free_session(void *session)
+{
+  gnutls_datum_t *data = session;
+  gnutls_free(data->data);
+  free(data);
+}
+
+static void
+amqp_ssl_socket_use_session(void *session, void *tls)
+{
+  gnutls_datum_t *data = session;
+  gnutls_session_set_data((gnutls_session_t)tls, data->data, data->size);
+}
+
 static ssize_t
 amqp_ssl_socket_send(void *base,
                      const void *buf,
@@ -58,46 +74,52 @@ amqp_ssl_socket_send(void *base,
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
 
   self->last_error = 0;
-  status = gnutls_record_send(self->session, buf, len);
+  /* the socket is blocking once open, so these only mean a signal or a send
+   * timeout interrupted the write; it has to be repeated with the same data */
+  do {
+    status = gnutls_record_send(self->session, buf, len);
+  } while (GNUTLS_E_AGAIN == status || GNUTLS_E_INTERRUPTED == status);
   if (status < 0) {
     self->last_error = AMQP_STATUS_SSL_ERROR;
   }
   return status;
 }
 
+static ssize_t
+amqp_ssl_socket_write_record(void *base,
+                             const void *buf,
+                             size_t len,
+                             AMQP_UNUSED int more)
+{
+  const char *bytes = buf;
+  ssize_t written;
+  while (len > 0) {
+    written = amqp_ssl_socket_send(base, bytes, len, 0);
+    if (written < 0) {
+      return AMQP_STATUS_SSL_ERROR;
+    }
+    bytes += written;
+    len -= written;
+  }
+  return AMQP_STATUS_OK;
+}
+
 static ssize_t
 amqp_ssl_socket_writev(void *base,
                        const struct iovec *iov,
                        int iovcnt)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
-  ssize_t written = -1;
-  char *bufferp;
-  size_t bytes;
-  int i;
   self->last_error = 0;
-  bytes = 0;
-  for (i = 0; i < iovcnt; ++i) {
-    bytes += iov[i].iov_len;
-  }
-  if (self->length < bytes) {
-    free(self->buffer);
-    self->buffer = malloc(bytes);
+  if (!self->buffer) {
+    self->buffer = malloc(AMQP_TLS_RECORD_SIZE);
     if (!self->buffer) {
-      self->length = 0;
       self->last_error = AMQP_STATUS_NO_MEMORY;
-      goto exit;
+      return AMQP_STATUS_NO_MEMORY;
     }
-    self->length = 0;
-  }
-  bufferp = self->buffer;
-  for (i = 0; i < iovcnt; ++i) {
-    memcpy(bufferp, iov[i].iov_base, iov[i].iov_len);
-    bufferp += iov[i].iov_len;
   }
-  written = amqp_ssl_socket_send(self, self->buffer, bytes, 0);
-exit:
-  return written;
+  return amqp_tls_gather_writev(self, iov, iovcnt, self->buffer,
+                                amqp_ssl_socket_write_record);
 }
 
 static ssize_t
@@ -122,8 +144,10 @@ static int
 amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *timeout)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
+  amqp_timer_t deadline;
   int status;
   self->last_error = 0;
+  AMQP_INIT_TIMER(deadline)
 
   free(self->host);
   self->host = strdup(host);
@@ -132,19 +156,48 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
     return -1;
   }
 
-  self->sockfd = amqp_open_socket_noblock(host, port, timeout);
+  /* with a timeout the socket stays non-blocking until the handshake is
+   * done, so connecting and the handshake share one deadline */
+  self->sockfd = amqp_open_socket_inner(host, port, timeout,
+                                        timeout ? &deadline : NULL);
   if (0 > self->sockfd) {
     self->last_error = -self->sockfd;
     return -1;
   }
   gnutls_transport_set_ptr(self->session,
                            (gnutls_transport_ptr_t)self->sockfd);
+  if (self->session_cache) {
+    amqp_ssl_session_cache_get(self->session_cache, host, port,
+                               amqp_ssl_socket_use_session, self->session);
+  }
   do {
     status = gnutls_handshake(self->session);
+    if (GNUTLS_E_AGAIN == status && timeout) {
+      int res = amqp_socket_wait_fd(self->sockfd,
+                                    gnutls_record_get_direction(self->session),
+                                    &deadline, timeout);
+      if (AMQP_STATUS_OK != res) {
+        self->last_error = res;
+        return -1;
+      }
+    }
   } while (status < 0 && !gnutls_error_is_fatal(status));
 
   if (gnutls_error_is_fatal(status)) {
     self->last_error = AMQP_STATUS_SSL_ERROR;
+  } else if (timeout &&
+             AMQP_STATUS_OK != amqp_socket_set_blocking(self->sockfd, 1)) {
+    self->last_error = AMQP_STATUS_SOCKET_ERROR;
+    status = -1;
+  } else if (self->session_cache) {
+    gnutls_datum_t *data = malloc(sizeof(*data));
+    if (data && GNUTLS_E_SUCCESS == gnutls_session_get_data2(self->session,
+                                                             data)) {
+      amqp_ssl_session_cache_put(self->session_cache, host, port, data,
+                                 amqp_ssl_socket_free_session);
+    } else {
+      free(data);
+    }
   }
 
   return status;
@@ -356,6 +409,76 @@ amqp_ssl_socket_set_verify(amqp_socket_t *base,
   }
 }
 
+void
+amqp_ssl_socket_set_session_cache(amqp_socket_t *base,
+                                  amqp_ssl_session_cache_t *cache)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+  self->session_cache = cache;
+}
+
+int
+amqp_ssl_socket_set_ktls(AMQP_UNUSED amqp_socket_t *base,
+                         amqp_boolean_t enable)
+{
+  /* no kernel TLS offload with this backend */
+  return enable ? AMQP_STATUS_UNSUPPORTED : AMQP_STATUS_OK;
+}
+
+amqp_boolean_t
+amqp_ssl_socket_get_ktls(AMQP_UNUSED amqp_socket_t *base)
+{
+  return 0;
+}
+
+/* shared contexts are not implemented for this backend, sockets keep
+ * their own credentials */
+amqp_ssl_context_t *
+amqp_ssl_context_new(void)
+{
+  return NULL;
+}
+
+void
+amqp_ssl_context_free(AMQP_UNUSED amqp_ssl_context_t *context)
+{
+}
+
+amqp_socket_t *
+amqp_ssl_socket_new_with_context(AMQP_UNUSED amqp_connection_state_t state,
+                                 AMQP_UNUSED amqp_ssl_context_t *context)
+{
+  return NULL;
+}
+
+int
+amqp_ssl_context_set_cacert(AMQP_UNUSED amqp_ssl_context_t *context,
+                            AMQP_UNUSED const char *cacert)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int
+amqp_ssl_context_set_key(AMQP_UNUSED amqp_ssl_context_t *context,
+                         AMQP_UNUSED const char *cert,
+                         AMQP_UNUSED const char *key)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int
+amqp_ssl_context_set_key_buffer(AMQP_UNUSED amqp_ssl_context_t *context,
+                                AMQP_UNUSED const char *cert,
+                                AMQP_UNUSED const void *key,
+                                AMQP_UNUSED size_t n)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
 void
 amqp_set_initialize_ssl_library(AMQP_UNUSED amqp_boolean_t do_initialize)
 {
@@ -0,0 +1,821 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+#include "amqp_os.h"
+
+#ifndef AMQP_IO_THREAD_RING_SIZE
+#define AMQP_IO_THREAD_RING_SIZE 64
+#endif
+
+/* needs poll() and pipe() besides the OS layer */
+#if !defined(AMQP_OS_THREADS) || defined(RABBIT_USE_LWIP)
+
+int amqp_start_io_thread(amqp_connection_state_t state)
+{
+  (void)state;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_stop_io_thread(amqp_connection_state_t state)
+{
+  (void)state;
+  return AMQP_STATUS_OK;
+}
+
+amqp_boolean_t amqp_io_thread_frame_ready(amqp_connection_state_t state)
+{
+  (void)state;
+  return 0;
+}
+
+int amqp_io_thread_wait(amqp_connection_state_t state, struct timeval *timeout)
+{
+  (void)state;
+  (void)timeout;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_io_thread_take_frame(amqp_connection_state_t state,
+                              amqp_frame_t *decoded_frame)
+{
+  (void)state;
+  (void)decoded_frame;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_io_thread_writev(amqp_connection_state_t state,
+                          const struct iovec *iov, int iovcnt)
+{
+  (void)state;
+  (void)iov;
+  (void)iovcnt;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+void amqp_io_thread_release_pools(amqp_connection_state_t state,
+                                  amqp_pool_table_entry_t *entry)
+{
+  (void)state;
+  (void)entry;
+}
+
+#else
+
+#include "amqp_atomic.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/*
+ * Background I/O thread.
+ *
+ * Once started, the I/O thread is the only user of the socket:
+ *  - it recv()s and decodes with amqp_handle_input(), using a decoder of
+ *    its own, and passes the frames to the application thread through an
+ *    inbound SPSC ring. Each frame is decoded into a pool of its own that
+ *    travels with it: the application thread files the pool under the
+ *    frame's channel, so the frame lives exactly as long as one it had
+ *    decoded itself, and hands it back through a second ring when that
+ *    channel's buffers are released;
+ *  - it writes whatever the application queued on the outbound SPSC ring;
+ *  - it sends heartbeats when the connection has been idle and detects the
+ *    broker going silent, independently of what the application is doing.
+ *
+ * The rings are lock-free; the mutex/condition pair and the wake pipe are
+ * only used to sleep when a ring is empty or full.
+ */
+
+typedef struct io_chunk_t_ {
+  size_t len;
+  /* data follows */
+} io_chunk_t;
+
+typedef struct io_slot_t_ {
+  int status;             /* < 0: the I/O thread stopped with this error */
+  size_t bytes_in;        /* read since the previous slot */
+  amqp_frame_t frame;
+  amqp_io_pool_t *pool;   /* frame was decoded into this */
+} io_slot_t;
+
+struct amqp_io_thread_t_ {
+  amqp_connection_state_t state;
+  amqp_os_thread_t thread;
+  int wake_pipe[2];
+  int stop;
+  int io_sleeping;
+  int app_waiting;
+
+  amqp_os_mutex_t lock;
+  amqp_os_cond_t cond;
+
+  /* inbound, I/O thread -> application */
+  io_slot_t in[AMQP_IO_THREAD_RING_SIZE];
+  size_t in_head;
+  size_t in_tail;
+
+  /* released pools, application -> I/O thread */
+  amqp_io_pool_t *pools[AMQP_IO_THREAD_RING_SIZE];
+  size_t pools_head;
+  size_t pools_tail;
+
+  /* outbound, application -> I/O thread */
+  io_chunk_t *out[AMQP_IO_THREAD_RING_SIZE];
+  size_t out_head;
+  size_t out_tail;
+  int out_error;
+
+  /* I/O thread only: the decoder's state (its statistics, traces and
+   * histograms are not the connection's), the pool of the frame being
+   * decoded and what was read but not decoded yet */
+  struct amqp_connection_state_t_ decoder;
+  amqp_io_pool_t *pool;
+  amqp_bytes_t read_buffer;
+  size_t read_offset;
+  size_t read_limit;
+  size_t bytes_in;
+
+  uint64_t last_send;
+  uint64_t last_recv;
+};
+
+#define RING_MASK (AMQP_IO_THREAD_RING_SIZE - 1)
+
+static void wake_io(amqp_io_thread_t *io)
+{
+  if (amqp_atomic_load_int(&io->io_sleeping)) {
+    char c = 0;
+    ssize_t res = write(io->wake_pipe[1], &c, 1);
+    (void)res;
+  }
+}
+
+static void wake_app(amqp_io_thread_t *io)
+{
+  if (amqp_atomic_load_int(&io->app_waiting)) {
+    amqp_os_mutex_lock(&io->lock);
+    amqp_os_cond_broadcast(&io->cond);
+    amqp_os_mutex_unlock(&io->lock);
+  }
+}
+
+/* Sleeps until ready(io) holds or the absolute deadline passes (deadline 0
+ * means forever). */
+static int app_wait(amqp_io_thread_t *io,
+                    amqp_boolean_t (*ready)(amqp_io_thread_t *),
+                    uint64_t deadline)
+{
+  int res = AMQP_STATUS_OK;
+
+  amqp_os_mutex_lock(&io->lock);
+  amqp_atomic_store_int(&io->app_waiting, 1);
+  while (!ready(io)) {
+    uint64_t wait_ns = AMQP_OS_WAIT_FOREVER;
+
+    if (deadline) {
+      uint64_t now = amqp_get_monotonic_timestamp();
+
+      if (0 == now) {
+        res = AMQP_STATUS_TIMER_FAILURE;
+        break;
+      }
+      if (now >= deadline) {
+        res = AMQP_STATUS_TIMEOUT;
+        break;
+      }
+      wait_ns = deadline - now;
+    }
+    amqp_os_cond_wait(&io->cond, &io->lock, wait_ns);
+  }
+  amqp_atomic_store_int(&io->app_waiting, 0);
+  amqp_os_mutex_unlock(&io->lock);
+  return res;
+}
+
+static amqp_boolean_t inbound_ready(amqp_io_thread_t *io)
+{
+  return (amqp_atomic_load_size(&io->in_head) != io->in_tail);
+}
+
+static amqp_boolean_t outbound_space(amqp_io_thread_t *io)
+{
+  return (io->out_head - amqp_atomic_load_size(&io->out_tail) <
+          AMQP_IO_THREAD_RING_SIZE) || amqp_atomic_load_int(&io->out_error);
+}
+
+static void free_pool(amqp_io_pool_t *pool)
+{
+  empty_amqp_pool(&pool->pool);
+  free(pool);
+}
+
+/* I/O thread: a pool for the next frame, preferably one released by the
+ * application */
+static amqp_io_pool_t *next_pool(amqp_io_thread_t *io)
+{
+  amqp_io_pool_t *pool;
+
+  if (amqp_atomic_load_size(&io->pools_head) != io->pools_tail) {
+    pool = io->pools[io->pools_tail & RING_MASK];
+    amqp_atomic_store_size(&io->pools_tail, io->pools_tail + 1);
+    return pool;
+  }
+
+  pool = malloc(sizeof(amqp_io_pool_t));
+  if (NULL != pool) {
+    init_amqp_pool(&pool->pool, io->decoder.frame_max);
+  }
+  return pool;
+}
+
+/* I/O thread: publish an inbound slot, with the frame decoded into io->pool
+ * or, without a frame, the error that stopped the thread */
+static void push_inbound(amqp_io_thread_t *io, int status,
+                         const amqp_frame_t *frame)
+{
+  io_slot_t *slot = &io->in[io->in_head & RING_MASK];
+
+  slot->status = status;
+  slot->bytes_in = io->bytes_in;
+  io->bytes_in = 0;
+  if (NULL != frame) {
+    slot->frame = *frame;
+    slot->pool = io->pool;
+    io->pool = NULL;
+    io->decoder.input_pool = NULL;
+  }
+  amqp_atomic_store_size(&io->in_head, io->in_head + 1);
+  wake_app(io);
+}
+
+static amqp_boolean_t inbound_full(amqp_io_thread_t *io)
+{
+  return (io->in_head - amqp_atomic_load_size(&io->in_tail) >=
+          AMQP_IO_THREAD_RING_SIZE);
+}
+
+/* I/O thread: decodes what has been read while the inbound ring has room */
+static int decode_input(amqp_io_thread_t *io)
+{
+  amqp_connection_state_t decoder = &io->decoder;
+
+  while (io->read_offset < io->read_limit && !inbound_full(io)) {
+    amqp_bytes_t data;
+    amqp_frame_t frame;
+    int res;
+
+    if (NULL == io->pool) {
+      io->pool = next_pool(io);
+      if (NULL == io->pool) {
+        return AMQP_STATUS_NO_MEMORY;
+      }
+      decoder->input_pool = &io->pool->pool;
+    }
+
+    data.len = io->read_limit - io->read_offset;
+    data.bytes = (char *)io->read_buffer.bytes + io->read_offset;
+    res = amqp_handle_input(decoder, data, &frame);
+    if (res < 0) {
+      return res;
+    }
+    io->read_offset += res;
+
+    if (0 == frame.frame_type || AMQP_FRAME_HEARTBEAT == frame.frame_type) {
+      /* heartbeats and ignored frames stop here; a partly read frame keeps
+         its pool until the rest arrives */
+      if (amqp_release_buffers_ok(decoder)) {
+        recycle_amqp_pool(&io->pool->pool);
+      }
+      continue;
+    }
+
+    push_inbound(io, AMQP_STATUS_OK, &frame);
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+static int drain_outbound(amqp_io_thread_t *io, amqp_boolean_t *wrote)
+{
+  struct iovec iov[AMQP_IO_THREAD_RING_SIZE];
+  size_t head = amqp_atomic_load_size(&io->out_head);
+  size_t tail = io->out_tail;
+  int count = 0;
+  int res = AMQP_STATUS_OK;
+
+  *wrote = 0;
+  if (head == tail) {
+    return AMQP_STATUS_OK;
+  }
+
+  for (; tail + count != head; ++count) {
+    io_chunk_t *chunk = io->out[(tail + count) & RING_MASK];
+    iov[count].iov_base = chunk + 1;
+    iov[count].iov_len = chunk->len;
+  }
+
+  res = amqp_socket_writev(io->state->socket, iov, count);
+
+  for (; tail != head; ++tail) {
+    free(io->out[tail & RING_MASK]);
+  }
+  amqp_atomic_store_size(&io->out_tail, tail);
+  wake_app(io);
+
+  *wrote = 1;
+  return res;
+}
+
+static void io_thread_main(void *arg)
+{
+  amqp_io_thread_t *io = arg;
+  amqp_connection_state_t state = io->state;
+  uint64_t heartbeat_ns = (uint64_t)state->heartbeat * AMQP_NS_PER_S;
+  int fd = amqp_socket_get_sockfd(state->socket);
+  int res = AMQP_STATUS_OK;
+
+  while (1) {
+    struct pollfd fds[2];
+    amqp_boolean_t wrote;
+    int timeout_ms = -1;
+    int nfds = 1;
+    uint64_t now;
+
+    res = drain_outbound(io, &wrote);
+    if (AMQP_STATUS_OK != res) {
+      break;
+    }
+
+    res = decode_input(io);
+    if (AMQP_STATUS_OK != res) {
+      break;
+    }
+
+    now = amqp_get_monotonic_timestamp();
+    if (0 == now) {
+      res = AMQP_STATUS_TIMER_FAILURE;
+      break;
+    }
+    if (wrote) {
+      io->last_send = now;
+    }
+    if (io->read_offset < io->read_limit) {
+      /* waiting for the application, not the broker, which has already
+         sent more than we had room for */
+      io->last_recv = now;
+    }
+
+    if (amqp_atomic_load_int(&io->stop)) {
+      break;
+    }
+
+    if (heartbeat_ns) {
+      uint64_t send_at = io->last_send + heartbeat_ns / 2;
+      uint64_t recv_by = io->last_recv + heartbeat_ns * 2 * 11 / 10;
+      uint64_t next;
+
+      if (now >= recv_by) {
+        res = AMQP_STATUS_HEARTBEAT_TIMEOUT;
+        break;
+      }
+      if (now >= send_at) {
+        static const uint8_t heartbeat[HEADER_SIZE + FOOTER_SIZE] =
+          { AMQP_FRAME_HEARTBEAT, 0, 0, 0, 0, 0, 0, AMQP_FRAME_END };
+        res = amqp_socket_send(state->socket, heartbeat, sizeof(heartbeat));
+        if (AMQP_STATUS_OK != res) {
+          break;
+        }
+        AMQP_STAT_OUT(state, frames_out.heartbeat, 1);
+        io->last_send = now;
+        send_at = now + heartbeat_ns / 2;
+      }
+      next = (send_at < recv_by) ? send_at : recv_by;
+      timeout_ms = (int)((next - now) / AMQP_NS_PER_MS) + 1;
+    }
+
+    fds[0].fd = io->wake_pipe[0];
+    fds[0].events = POLLIN;
+    /* read on once everything read so far is decoded and handed over */
+    if (io->read_offset == io->read_limit) {
+      fds[1].fd = fd;
+      fds[1].events = POLLIN;
+      nfds = 2;
+    }
+
+    /* announce we are about to sleep, then look once more so a push that
+       raced with us is not missed */
+    amqp_atomic_store_int(&io->io_sleeping, 1);
+    if (amqp_atomic_load_size(&io->out_head) != io->out_tail ||
+        amqp_atomic_load_int(&io->stop) ||
+        (nfds == 1 && !inbound_full(io))) {
+      amqp_atomic_store_int(&io->io_sleeping, 0);
+      continue;
+    }
+
+    res = poll(fds, nfds, timeout_ms);
+    amqp_atomic_store_int(&io->io_sleeping, 0);
+    if (res < 0) {
+      if (EINTR == errno) {
+        res = AMQP_STATUS_OK;
+        continue;
+      }
+      res = AMQP_STATUS_SOCKET_ERROR;
+      break;
+    }
+    res = AMQP_STATUS_OK;
+
+    if (fds[0].revents & POLLIN) {
+      char buf[64];
+      while (read(io->wake_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    }
+
+    if (nfds == 2 && (fds[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+      ssize_t n = amqp_socket_recv(state->socket, io->read_buffer.bytes,
+                                   io->read_buffer.len, 0);
+      if (n < 0) {
+        res = (int)n;
+        break;
+      }
+      io->last_recv = amqp_get_monotonic_timestamp();
+      io->bytes_in += (size_t)n;
+      io->read_offset = 0;
+      io->read_limit = (size_t)n;
+    }
+  }
+
+  if (AMQP_STATUS_OK != res) {
+    amqp_atomic_store_int(&io->out_error, res);
+    if (AMQP_STATUS_HEARTBEAT_TIMEOUT == res) {
+      amqp_socket_close(state->socket);
+    }
+    /* the application sees the error once it has consumed what was read
+       before it; with the ring full it is reported via out_error instead */
+    if (!inbound_full(io)) {
+      push_inbound(io, res, NULL);
+    } else {
+      wake_app(io);
+    }
+  }
+}
+
+/* Application thread: files the pool a frame was decoded into under the
+ * frame's channel, see amqp_maybe_release_buffers_on_channel() */
+static int adopt_pool(amqp_connection_state_t state, io_slot_t *slot)
+{
+  amqp_pool_table_entry_t *entry =
+    amqp_get_or_create_channel_entry(state, slot->frame.channel);
+
+  if (NULL == entry) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  slot->pool->next = entry->io_pools;
+  entry->io_pools = slot->pool;
+  slot->pool = NULL;
+
+  AMQP_STAT_ADD(state, bytes_in, slot->bytes_in);
+  AMQP_STAT_FRAME(state, frames_in, slot->frame.frame_type);
+  return AMQP_STATUS_OK;
+}
+
+/* After the thread has stopped: decoded frames go to the connection's frame
+ * queue, a partly read frame and undecoded data back to its own decoder. */
+static int hand_back_input(amqp_connection_state_t state, amqp_io_thread_t *io)
+{
+  size_t len;
+  int res;
+
+  for (; io->in_tail != io->in_head; ++io->in_tail) {
+    io_slot_t *slot = &io->in[io->in_tail & RING_MASK];
+
+    if (slot->status < 0) {
+      break;
+    }
+    res = adopt_pool(state, slot);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    amqp_ack_batch_handle_frame(state, &slot->frame);
+    if (!amqp_confirm_handle_frame(state, &slot->frame)) {
+      res = amqp_queue_frame(state, &slot->frame);
+      if (AMQP_STATUS_OK != res) {
+        return res;
+      }
+    }
+  }
+
+  res = amqp_move_input(&io->decoder, state);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+
+  len = io->read_limit - io->read_offset;
+  memcpy(state->sock_inbound_buffer.bytes,
+         (char *)io->read_buffer.bytes + io->read_offset, len);
+  state->sock_inbound_offset = 0;
+  state->sock_inbound_limit = len;
+  io->read_offset = io->read_limit;
+  AMQP_STAT_ADD(state, bytes_in, io->bytes_in);
+  return AMQP_STATUS_OK;
+}
+
+static void io_thread_free(amqp_io_thread_t *io)
+{
+  size_t i;
+
+  for (i = 0; i < AMQP_IO_THREAD_RING_SIZE; ++i) {
+    if (NULL != io->in[i].pool) {
+      free_pool(io->in[i].pool);
+    }
+  }
+  for (; io->pools_tail != io->pools_head; ++io->pools_tail) {
+    free_pool(io->pools[io->pools_tail & RING_MASK]);
+  }
+  if (NULL != io->pool) {
+    free_pool(io->pool);
+  }
+  free(io->read_buffer.bytes);
+  for (; io->out_tail != io->out_head; ++io->out_tail) {
+    free(io->out[io->out_tail & RING_MASK]);
+  }
+  close(io->wake_pipe[0]);
+  close(io->wake_pipe[1]);
+  amqp_os_cond_destroy(&io->cond);
+  amqp_os_mutex_destroy(&io->lock);
+  free(io);
+}
+
+int amqp_start_io_thread(amqp_connection_state_t state)
+{
+  amqp_io_thread_t *io;
+  uint64_t now;
+  size_t len;
+  int res;
+
+  if (NULL != state->io_thread) {
+    return AMQP_STATUS_OK;
+  }
+  if (NULL == state->socket || -1 == amqp_get_sockfd(state) ||
+      NULL != state->publish_queue) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  now = amqp_get_monotonic_timestamp();
+  if (0 == now) {
+    return AMQP_STATUS_TIMER_FAILURE;
+  }
+
+  io = calloc(1, sizeof(amqp_io_thread_t));
+  if (NULL == io) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  io->state = state;
+  io->last_send = now;
+  io->last_recv = now;
+
+  if (pipe(io->wake_pipe) < 0) {
+    free(io);
+    return AMQP_STATUS_SOCKET_ERROR;
+  }
+  fcntl(io->wake_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(io->wake_pipe[1], F_SETFL, O_NONBLOCK);
+  amqp_os_mutex_init(&io->lock);
+  amqp_os_cond_init(&io->cond);
+
+  io->decoder.frame_max = state->frame_max;
+  io->decoder.lazy_properties = state->lazy_properties;
+  io->read_buffer.len = state->sock_inbound_buffer.len;
+  io->read_buffer.bytes = malloc(io->read_buffer.len);
+  io->pool = next_pool(io);
+  if (NULL == io->read_buffer.bytes || NULL == io->pool) {
+    io_thread_free(io);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  io->decoder.input_pool = &io->pool->pool;
+
+  /* the thread carries on from wherever the connection's decoder is */
+  res = amqp_move_input(state, &io->decoder);
+  if (AMQP_STATUS_OK != res) {
+    io_thread_free(io);
+    return res;
+  }
+  len = state->sock_inbound_limit - state->sock_inbound_offset;
+  memcpy(io->read_buffer.bytes,
+         (char *)state->sock_inbound_buffer.bytes + state->sock_inbound_offset,
+         len);
+  io->read_limit = len;
+  state->sock_inbound_offset = 0;
+  state->sock_inbound_limit = 0;
+
+  /* set before the thread runs: amqp_heartbeat_enabled() now reports false
+     for the application thread */
+  state->io_thread = io;
+  if (AMQP_STATUS_OK != amqp_os_thread_create(&io->thread, "amqp-io",
+                                              io_thread_main, io)) {
+    state->io_thread = NULL;
+    hand_back_input(state, io);
+    io_thread_free(io);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+
+  return AMQP_STATUS_OK;
+}
+
+int amqp_stop_io_thread(amqp_connection_state_t state)
+{
+  amqp_io_thread_t *io = state->io_thread;
+  int res;
+  int handed_back;
+
+  if (NULL == io) {
+    return AMQP_STATUS_OK;
+  }
+
+  amqp_atomic_store_int(&io->stop, 1);
+  amqp_atomic_store_int(&io->io_sleeping, 1);
+  wake_io(io);
+  amqp_os_thread_join(&io->thread);
+
+  res = amqp_atomic_load_int(&io->out_error);
+  state->io_thread = NULL;
+  handed_back = hand_back_input(state, io);
+  io_thread_free(io);
+  if (AMQP_STATUS_OK == res) {
+    res = handed_back;
+  }
+
+  if (amqp_heartbeat_enabled(state)) {
+    uint64_t now = amqp_clock_refresh(state);
+    if (0 == now) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    state->next_send_heartbeat = amqp_calc_next_send_heartbeat(state, now);
+    state->next_recv_heartbeat = amqp_calc_next_recv_heartbeat(state, now);
+  }
+
+  return res;
+}
+
+amqp_boolean_t amqp_io_thread_frame_ready(amqp_connection_state_t state)
+{
+  return inbound_ready(state->io_thread);
+}
+
+int amqp_io_thread_wait(amqp_connection_state_t state, struct timeval *timeout)
+{
+  amqp_io_thread_t *io = state->io_thread;
+  uint64_t deadline = 0;
+  int res;
+
+  if (inbound_ready(io)) {
+    return AMQP_STATUS_OK;
+  }
+
+  res = amqp_atomic_load_int(&io->out_error);
+  if (AMQP_STATUS_OK != res && !inbound_ready(io)) {
+    /* the thread is gone and everything it read has been consumed */
+    return res;
+  }
+
+  if (timeout) {
+    uint64_t now = amqp_get_monotonic_timestamp();
+    if (0 == now) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    deadline = now + (uint64_t)timeout->tv_sec * AMQP_NS_PER_S +
+               (uint64_t)timeout->tv_usec * AMQP_NS_PER_US;
+    if (deadline == now) {
+      return AMQP_STATUS_TIMEOUT;
+    }
+  }
+  return app_wait(io, inbound_ready, deadline);
+}
+
+int amqp_io_thread_take_frame(amqp_connection_state_t state,
+                              amqp_frame_t *decoded_frame)
+{
+  amqp_io_thread_t *io = state->io_thread;
+  io_slot_t *slot;
+  int res;
+
+  decoded_frame->frame_type = 0;
+  if (!inbound_ready(io)) {
+    return AMQP_STATUS_OK;
+  }
+
+  slot = &io->in[io->in_tail & RING_MASK];
+  if (slot->status < 0) {
+    /* leave the error slot in place so every later call sees it too */
+    return slot->status;
+  }
+
+  res = adopt_pool(state, slot);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+  *decoded_frame = slot->frame;
+
+  amqp_atomic_store_size(&io->in_tail, io->in_tail + 1);
+  wake_io(io);
+  return AMQP_STATUS_OK;
+}
+
+void amqp_io_thread_release_pools(amqp_connection_state_t state,
+                                  amqp_pool_table_entry_t *entry)
+{
+  amqp_io_thread_t *io = state->io_thread;
+
+  while (NULL != entry->io_pools) {
+    amqp_io_pool_t *pool = entry->io_pools;
+
+    entry->io_pools = pool->next;
+    if (NULL == io || io->pools_head - amqp_atomic_load_size(&io->pools_tail)
+                      >= AMQP_IO_THREAD_RING_SIZE) {
+      free_pool(pool);
+      continue;
+    }
+    recycle_amqp_pool(&pool->pool);
+    io->pools[io->pools_head & RING_MASK] = pool;
+    amqp_atomic_store_size(&io->pools_head, io->pools_head + 1);
+  }
+}
+
+int amqp_io_thread_writev(amqp_connection_state_t state,
+                          const struct iovec *iov, int iovcnt)
+{
+  amqp_io_thread_t *io = state->io_thread;
+  io_chunk_t *chunk;
+  size_t len = 0;
+  uint8_t *p;
+  int res;
+  int i;
+
+  res = amqp_atomic_load_int(&io->out_error);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+
+  for (i = 0; i < iovcnt; ++i) {
+    len += iov[i].iov_len;
+  }
+  chunk = malloc(sizeof(io_chunk_t) + len);
+  if (NULL == chunk) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  chunk->len = len;
+  p = (uint8_t *)(chunk + 1);
+  for (i = 0; i < iovcnt; ++i) {
+    memcpy(p, iov[i].iov_base, iov[i].iov_len);
+    p += iov[i].iov_len;
+  }
+
+  if (!outbound_space(io)) {
+    wake_io(io);
+    res = app_wait(io, outbound_space, 0);
+    if (AMQP_STATUS_OK == res) {
+      res = amqp_atomic_load_int(&io->out_error);
+    }
+    if (AMQP_STATUS_OK != res) {
+      free(chunk);
+      return res;
+    }
+  }
+
+  io->out[io->out_head & RING_MASK] = chunk;
+  amqp_atomic_store_size(&io->out_head, io->out_head + 1);
+  wake_io(io);
+  return AMQP_STATUS_OK;
+}
+
+#endif
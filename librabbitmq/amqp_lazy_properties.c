@@ -0,0 +1,219 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Lazily decoded basic properties.
+ *
+ * Only the flags are read when the content header arrives, properties._flags
+ * starts out as AMQP_LAZY_PROPERTIES_FLAG. The properties
+ * are encoded one after the other in flag order, so decoding one means
+ * stepping over the length of each present property before it, which is
+ * cheap next to decoding (and allocating) the headers table. Decoded
+ * properties are memoised in lazy->properties.
+ */
+
+enum {
+  FIELD_SHORTSTR,
+  FIELD_OCTET,
+  FIELD_TIMESTAMP,
+  FIELD_TABLE
+};
+
+static const struct {
+  amqp_flags_t flag;
+  uint8_t type;
+  uint16_t offset;
+} basic_fields[] = {
+#define FIELD(flag, type, name) \
+  { flag, type, offsetof(amqp_basic_properties_t, name) }
+  FIELD(AMQP_BASIC_CONTENT_TYPE_FLAG, FIELD_SHORTSTR, content_type),
+  FIELD(AMQP_BASIC_CONTENT_ENCODING_FLAG, FIELD_SHORTSTR, content_encoding),
+  FIELD(AMQP_BASIC_HEADERS_FLAG, FIELD_TABLE, headers),
+  FIELD(AMQP_BASIC_DELIVERY_MODE_FLAG, FIELD_OCTET, delivery_mode),
+  FIELD(AMQP_BASIC_PRIORITY_FLAG, FIELD_OCTET, priority),
+  FIELD(AMQP_BASIC_CORRELATION_ID_FLAG, FIELD_SHORTSTR, correlation_id),
+  FIELD(AMQP_BASIC_REPLY_TO_FLAG, FIELD_SHORTSTR, reply_to),
+  FIELD(AMQP_BASIC_EXPIRATION_FLAG, FIELD_SHORTSTR, expiration),
+  FIELD(AMQP_BASIC_MESSAGE_ID_FLAG, FIELD_SHORTSTR, message_id),
+  FIELD(AMQP_BASIC_TIMESTAMP_FLAG, FIELD_TIMESTAMP, timestamp),
+  FIELD(AMQP_BASIC_TYPE_FLAG, FIELD_SHORTSTR, type),
+  FIELD(AMQP_BASIC_USER_ID_FLAG, FIELD_SHORTSTR, user_id),
+  FIELD(AMQP_BASIC_APP_ID_FLAG, FIELD_SHORTSTR, app_id),
+  FIELD(AMQP_BASIC_CLUSTER_ID_FLAG, FIELD_SHORTSTR, cluster_id)
+#undef FIELD
+};
+
+#define BASIC_FIELD_COUNT (sizeof(basic_fields) / sizeof(basic_fields[0]))
+
+static int skip_field(amqp_bytes_t raw, size_t *offset, uint8_t type)
+{
+  amqp_bytes_t skipped;
+  uint8_t len8;
+  uint32_t len32;
+
+  switch (type) {
+  case FIELD_SHORTSTR:
+    return amqp_decode_8(raw, offset, &len8) &&
+           amqp_decode_bytes(raw, offset, &skipped, len8);
+  case FIELD_OCTET:
+    return amqp_decode_bytes(raw, offset, &skipped, 1);
+  case FIELD_TIMESTAMP:
+    return amqp_decode_bytes(raw, offset, &skipped, 8);
+  default:
+    return amqp_decode_32(raw, offset, &len32) &&
+           amqp_decode_bytes(raw, offset, &skipped, len32);
+  }
+}
+
+static int decode_field(amqp_lazy_properties_t *lazy, size_t *offset,
+                        uint8_t type, void *field)
+{
+  uint8_t len;
+
+  switch (type) {
+  case FIELD_SHORTSTR:
+    if (!amqp_decode_8(lazy->raw, offset, &len) ||
+        !amqp_decode_bytes(lazy->raw, offset, (amqp_bytes_t *)field, len)) {
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    }
+    return AMQP_STATUS_OK;
+  case FIELD_OCTET:
+    return amqp_decode_8(lazy->raw, offset, (uint8_t *)field)
+           ? AMQP_STATUS_OK : AMQP_STATUS_BAD_AMQP_DATA;
+  case FIELD_TIMESTAMP:
+    return amqp_decode_64(lazy->raw, offset, (uint64_t *)field)
+           ? AMQP_STATUS_OK : AMQP_STATUS_BAD_AMQP_DATA;
+  default:
+    return amqp_decode_table(lazy->raw, lazy->pool, (amqp_table_t *)field,
+                             offset);
+  }
+}
+
+int amqp_lazy_properties_get(amqp_lazy_properties_t *lazy, amqp_flags_t flags)
+{
+  amqp_flags_t wanted = flags & lazy->flags & ~lazy->properties._flags;
+  size_t offset = 0;
+  size_t i;
+  int res;
+
+  for (i = 0; wanted && i < BASIC_FIELD_COUNT; ++i) {
+    if (!(lazy->flags & basic_fields[i].flag)) {
+      continue;
+    }
+    if (!(wanted & basic_fields[i].flag)) {
+      if (!skip_field(lazy->raw, &offset, basic_fields[i].type)) {
+        return AMQP_STATUS_BAD_AMQP_DATA;
+      }
+      continue;
+    }
+    res = decode_field(lazy, &offset, basic_fields[i].type,
+                       (char *)&lazy->properties + basic_fields[i].offset);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+    lazy->properties._flags |= basic_fields[i].flag;
+    wanted &= ~basic_fields[i].flag;
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_lazy_properties_decode(amqp_pool_t *pool, amqp_bytes_t encoded,
+                                void **decoded)
+{
+  amqp_lazy_properties_t *lazy;
+  size_t offset = 0;
+  int flagword_index = 0;
+  uint16_t partial_flags;
+
+  lazy = amqp_pool_alloc(pool, sizeof(amqp_lazy_properties_t));
+  if (NULL == lazy) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  memset(lazy, 0, sizeof(amqp_lazy_properties_t));
+  lazy->properties._flags = AMQP_LAZY_PROPERTIES_FLAG;
+
+  do {
+    if (!amqp_decode_16(encoded, &offset, &partial_flags)) {
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    }
+    lazy->flags |= (partial_flags << (flagword_index * 16));
+    flagword_index++;
+  } while (partial_flags & 1);
+
+  lazy->raw.bytes = amqp_offset(encoded.bytes, offset);
+  lazy->raw.len = encoded.len - offset;
+  lazy->pool = pool;
+  *decoded = lazy;
+  return AMQP_STATUS_OK;
+}
+
+int amqp_lazy_properties_encode(amqp_lazy_properties_t *lazy,
+                                amqp_bytes_t encoded)
+{
+  amqp_flags_t remaining_flags = lazy->flags;
+  size_t offset = 0;
+
+  do {
+    amqp_flags_t remainder = remaining_flags >> 16;
+    uint16_t partial_flags = remaining_flags & 0xFFFE;
+    if (remainder != 0) {
+      partial_flags |= 1;
+    }
+    if (!amqp_encode_16(encoded, &offset, partial_flags)) {
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    }
+    remaining_flags = remainder;
+  } while (remaining_flags != 0);
+
+  if (!amqp_encode_bytes(encoded, &offset, lazy->raw)) {
+    return AMQP_STATUS_BAD_AMQP_DATA;
+  }
+  return (int)offset;
+}
+
+int amqp_lazy_properties_copy(amqp_bytes_t encoded,
+                              amqp_lazy_properties_t **lazy,
+                              amqp_pool_t *pool)
+{
+  amqp_bytes_t copy;
+
+  amqp_pool_alloc_bytes(pool, encoded.len, &copy);
+  if (NULL == copy.bytes) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  memcpy(copy.bytes, encoded.bytes, encoded.len);
+  return amqp_lazy_properties_decode(pool, copy, (void **)lazy);
+}
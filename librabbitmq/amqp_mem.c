@@ -208,7 +208,8 @@ void amqp_bytes_free(amqp_bytes_t bytes)
   free(bytes.bytes);
 }
 
-amqp_pool_t *amqp_get_or_create_channel_pool(amqp_connection_state_t state, amqp_channel_t channel)
+amqp_pool_table_entry_t *amqp_get_or_create_channel_entry(amqp_connection_state_t state,
+                                                          amqp_channel_t channel)
 {
   amqp_pool_table_entry_t *entry;
   size_t index = channel % POOL_TABLE_SIZE;
@@ -219,7 +220,7 @@ amqp_pool_t *amqp_get_or_create_channel_pool(amqp_connection_state_t state, amqp
   for ( ; NULL != entry; entry = entry->next) {
     channel_pool_count++;
     if (channel == entry->channel) {
-      return &entry->pool;
+      return entry;
     }
   }
 
@@ -239,15 +240,24 @@ amqp_pool_t *amqp_get_or_create_channel_pool(amqp_connection_state_t state, amqp
   }
 
   entry->channel = channel;
+  entry->io_pools = NULL;
   entry->next = state->pool_table[index];
   state->pool_table[index] = entry;
 
   init_amqp_pool(&entry->pool, state->frame_max);
 
-  return &entry->pool;
+  return entry;
 }
 
-amqp_pool_t *amqp_get_channel_pool(amqp_connection_state_t state, amqp_channel_t channel)
+amqp_pool_t *amqp_get_or_create_channel_pool(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_pool_table_entry_t *entry = amqp_get_or_create_channel_entry(state, channel);
+
+  return (NULL != entry ? &entry->pool : NULL);
+}
+
+amqp_pool_table_entry_t *amqp_get_channel_entry(amqp_connection_state_t state,
+                                                amqp_channel_t channel)
 {
   amqp_pool_table_entry_t *entry;
   size_t index = channel % POOL_TABLE_SIZE;
@@ -256,9 +266,16 @@ amqp_pool_t *amqp_get_channel_pool(amqp_connection_state_t state, amqp_channel_t
 
   for ( ; NULL != entry; entry = entry->next) {
     if (channel == entry->channel) {
-      return &entry->pool;
+      return entry;
     }
   }
 
   return NULL;
 }
+
+amqp_pool_t *amqp_get_channel_pool(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_pool_table_entry_t *entry = amqp_get_channel_entry(state, channel);
+
+  return (NULL != entry ? &entry->pool : NULL);
+}
@@ -0,0 +1,561 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include "amqp_memory_socket.h"
+#include "amqp_os.h"
+#include "amqp_socket.h"
+#include "amqp_timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef AMQP_OS_THREADS
+
+amqp_socket_t *amqp_memory_socket_new(amqp_connection_state_t state,
+                                      size_t capacity)
+{
+  (void)state;
+  (void)capacity;
+  return NULL;
+}
+
+amqp_socket_t *amqp_memory_socket_new_peer(amqp_connection_state_t state,
+                                           amqp_socket_t *peer)
+{
+  (void)state;
+  (void)peer;
+  return NULL;
+}
+
+int amqp_memory_socket_set_io_limits(amqp_socket_t *self,
+                                     const size_t *recv_limits,
+                                     size_t recv_count,
+                                     const size_t *send_limits,
+                                     size_t send_count)
+{
+  (void)self;
+  (void)recv_limits;
+  (void)recv_count;
+  (void)send_limits;
+  (void)send_count;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_memory_socket_peer_write(amqp_socket_t *self, const void *buf,
+                                  size_t len)
+{
+  (void)self;
+  (void)buf;
+  (void)len;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_memory_socket_peer_read(amqp_socket_t *self, void *buf, size_t len)
+{
+  (void)self;
+  (void)buf;
+  (void)len;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+void amqp_memory_socket_peer_close(amqp_socket_t *self)
+{
+  (void)self;
+}
+
+#else
+
+/* One direction of the connection. Every change is broadcast on cond so
+ * both a blocked reader and a blocked writer wake up. */
+struct amqp_memory_ring_t {
+  amqp_os_mutex_t lock;
+  amqp_os_cond_t cond;
+  uint8_t *bytes;
+  size_t capacity;
+  size_t head;                  /* offset of the oldest unread byte */
+  size_t count;
+  amqp_boolean_t writer_closed; /* no more bytes will be written */
+  amqp_boolean_t reader_closed; /* nothing will be read any more */
+  int refs;
+};
+
+struct amqp_io_limits_t {
+  size_t *sizes;
+  size_t count;
+  size_t next;
+};
+
+struct amqp_memory_socket_t {
+  const struct amqp_socket_class_t *klass;
+  struct amqp_memory_ring_t *in;
+  struct amqp_memory_ring_t *out;
+  struct amqp_io_limits_t recv_limits;
+  struct amqp_io_limits_t send_limits;
+#ifdef ENABLE_CONNECTION_STATS
+  amqp_conn_stats_t *stats;
+#endif
+};
+
+#ifdef ENABLE_CONNECTION_STATS
+#define MEMORY_STAT_INC(self, field) ((self)->stats->field++)
+#else
+#define MEMORY_STAT_INC(self, field) ((void)0)
+#endif
+
+static struct amqp_memory_ring_t *ring_new(size_t capacity)
+{
+  struct amqp_memory_ring_t *ring = calloc(1, sizeof(*ring));
+
+  if (NULL == ring) {
+    return NULL;
+  }
+  ring->bytes = malloc(capacity);
+  if (NULL == ring->bytes) {
+    free(ring);
+    return NULL;
+  }
+  if (AMQP_STATUS_OK != amqp_os_mutex_init(&ring->lock)) {
+    free(ring->bytes);
+    free(ring);
+    return NULL;
+  }
+  if (AMQP_STATUS_OK != amqp_os_cond_init(&ring->cond)) {
+    amqp_os_mutex_destroy(&ring->lock);
+    free(ring->bytes);
+    free(ring);
+    return NULL;
+  }
+  ring->capacity = capacity;
+  ring->refs = 1;
+  return ring;
+}
+
+static void ring_retain(struct amqp_memory_ring_t *ring)
+{
+  amqp_os_mutex_lock(&ring->lock);
+  ring->refs++;
+  amqp_os_mutex_unlock(&ring->lock);
+}
+
+static void ring_release(struct amqp_memory_ring_t *ring)
+{
+  int refs;
+
+  if (NULL == ring) {
+    return;
+  }
+  amqp_os_mutex_lock(&ring->lock);
+  refs = --ring->refs;
+  amqp_os_mutex_unlock(&ring->lock);
+
+  if (0 == refs) {
+    amqp_os_cond_destroy(&ring->cond);
+    amqp_os_mutex_destroy(&ring->lock);
+    free(ring->bytes);
+    free(ring);
+  }
+}
+
+/* Both copy helpers are called with the ring locked. */
+static size_t ring_put(struct amqp_memory_ring_t *ring, const uint8_t *buf,
+                       size_t len)
+{
+  size_t tail = (ring->head + ring->count) % ring->capacity;
+  size_t first;
+
+  if (len > ring->capacity - ring->count) {
+    len = ring->capacity - ring->count;
+  }
+  first = len < ring->capacity - tail ? len : ring->capacity - tail;
+  memcpy(ring->bytes + tail, buf, first);
+  memcpy(ring->bytes, buf + first, len - first);
+  ring->count += len;
+  return len;
+}
+
+static size_t ring_take(struct amqp_memory_ring_t *ring, uint8_t *buf,
+                        size_t len)
+{
+  size_t first;
+
+  if (len > ring->count) {
+    len = ring->count;
+  }
+  first = len < ring->capacity - ring->head ? len : ring->capacity - ring->head;
+  memcpy(buf, ring->bytes + ring->head, first);
+  memcpy(buf + first, ring->bytes, len - first);
+  ring->head = (ring->head + len) % ring->capacity;
+  ring->count -= len;
+  return len;
+}
+
+static size_t next_limit(struct amqp_io_limits_t *limits, size_t len)
+{
+  size_t limit;
+
+  if (0 == limits->count) {
+    return len;
+  }
+  limit = limits->sizes[limits->next];
+  limits->next = (limits->next + 1) % limits->count;
+  return (0 == limit || limit > len) ? len : limit;
+}
+
+static int set_limits(struct amqp_io_limits_t *limits, const size_t *sizes,
+                      size_t count)
+{
+  size_t *copy = NULL;
+
+  if (count > 0) {
+    copy = malloc(count * sizeof(size_t));
+    if (NULL == copy) {
+      return AMQP_STATUS_NO_MEMORY;
+    }
+    memcpy(copy, sizes, count * sizeof(size_t));
+  }
+  free(limits->sizes);
+  limits->sizes = copy;
+  limits->count = count;
+  limits->next = 0;
+  return AMQP_STATUS_OK;
+}
+
+static int
+amqp_memory_socket_send_all(struct amqp_memory_socket_t *self,
+                            const void *buf, size_t len)
+{
+  struct amqp_memory_ring_t *ring = self->out;
+  const uint8_t *left = buf;
+
+  amqp_os_mutex_lock(&ring->lock);
+  while (len > 0) {
+    size_t n;
+
+    if (ring->writer_closed || ring->reader_closed) {
+      amqp_os_mutex_unlock(&ring->lock);
+      return AMQP_STATUS_SOCKET_ERROR;
+    }
+    if (ring->count == ring->capacity) {
+      amqp_os_cond_wait(&ring->cond, &ring->lock, AMQP_OS_WAIT_FOREVER);
+      continue;
+    }
+
+    n = ring_put(ring, left, next_limit(&self->send_limits, len));
+    amqp_os_cond_broadcast(&ring->cond);
+    left += n;
+    len -= n;
+    if (len > 0) {
+      MEMORY_STAT_INC(self, partial_writes);
+    }
+  }
+  amqp_os_mutex_unlock(&ring->lock);
+  return AMQP_STATUS_OK;
+}
+
+static ssize_t
+amqp_memory_socket_send(void *base, const void *buf, size_t len)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+
+  MEMORY_STAT_INC(self, send_calls);
+  return amqp_memory_socket_send_all(self, buf, len);
+}
+
+static ssize_t
+amqp_memory_socket_writev(void *base, struct iovec *iov, int iovcnt)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+  int i;
+
+  MEMORY_STAT_INC(self, writev_calls);
+  for (i = 0; i < iovcnt; ++i) {
+    int res = amqp_memory_socket_send_all(self, iov[i].iov_base,
+                                          iov[i].iov_len);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+  }
+  return AMQP_STATUS_OK;
+}
+
+static ssize_t
+amqp_memory_socket_recv(void *base, void *buf, size_t len, int flags)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+  struct amqp_memory_ring_t *ring = self->in;
+  size_t n;
+
+  (void)flags;
+  MEMORY_STAT_INC(self, recv_calls);
+
+  amqp_os_mutex_lock(&ring->lock);
+  while (0 == ring->count) {
+    if (ring->writer_closed || ring->reader_closed) {
+      amqp_os_mutex_unlock(&ring->lock);
+      return AMQP_STATUS_CONNECTION_CLOSED;
+    }
+    amqp_os_cond_wait(&ring->cond, &ring->lock, AMQP_OS_WAIT_FOREVER);
+  }
+  n = ring_take(ring, buf, next_limit(&self->recv_limits, len));
+  amqp_os_cond_broadcast(&ring->cond);
+  amqp_os_mutex_unlock(&ring->lock);
+
+  return (ssize_t)n;
+}
+
+static int
+amqp_memory_socket_wait(void *base, struct timeval *timeout)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+  struct amqp_memory_ring_t *ring = self->in;
+  uint64_t timeout_ns = (uint64_t)timeout->tv_sec * AMQP_NS_PER_S +
+                        (uint64_t)timeout->tv_usec * AMQP_NS_PER_US;
+  uint64_t deadline = amqp_get_monotonic_timestamp();
+  int res = AMQP_STATUS_OK;
+
+  if (0 == deadline) {
+    return AMQP_STATUS_TIMER_FAILURE;
+  }
+  deadline += timeout_ns;
+
+  amqp_os_mutex_lock(&ring->lock);
+  while (0 == ring->count && !ring->writer_closed && !ring->reader_closed) {
+    uint64_t now = amqp_get_monotonic_timestamp();
+    if (0 == now) {
+      res = AMQP_STATUS_TIMER_FAILURE;
+      break;
+    }
+    if (now >= deadline) {
+      res = AMQP_STATUS_TIMEOUT;
+      break;
+    }
+    amqp_os_cond_wait(&ring->cond, &ring->lock, deadline - now);
+  }
+  amqp_os_mutex_unlock(&ring->lock);
+  return res;
+}
+
+static int
+amqp_memory_socket_open(void *base, const char *host, int port,
+                        struct timeval *timeout)
+{
+  (void)base;
+  (void)host;
+  (void)port;
+  (void)timeout;
+  /* connected since creation */
+  return AMQP_STATUS_OK;
+}
+
+static int
+amqp_memory_socket_close(void *base)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+
+  amqp_os_mutex_lock(&self->out->lock);
+  self->out->writer_closed = 1;
+  amqp_os_cond_broadcast(&self->out->cond);
+  amqp_os_mutex_unlock(&self->out->lock);
+
+  amqp_os_mutex_lock(&self->in->lock);
+  self->in->reader_closed = 1;
+  amqp_os_cond_broadcast(&self->in->cond);
+  amqp_os_mutex_unlock(&self->in->lock);
+
+  return AMQP_STATUS_OK;
+}
+
+static int
+amqp_memory_socket_get_sockfd(void *base)
+{
+  (void)base;
+  return -1;
+}
+
+static void
+amqp_memory_socket_delete(void *base)
+{
+  struct amqp_memory_socket_t *self = (struct amqp_memory_socket_t *)base;
+
+  if (self) {
+    amqp_memory_socket_close(self);
+    ring_release(self->in);
+    ring_release(self->out);
+    free(self->recv_limits.sizes);
+    free(self->send_limits.sizes);
+    free(self);
+  }
+}
+
+static const struct amqp_socket_class_t amqp_memory_socket_class = {
+  amqp_memory_socket_writev, /* writev */
+  amqp_memory_socket_send, /* send */
+  amqp_memory_socket_recv, /* recv */
+  amqp_memory_socket_open, /* open */
+  amqp_memory_socket_close, /* close */
+  amqp_memory_socket_get_sockfd, /* get_sockfd */
+  amqp_memory_socket_delete, /* delete */
+  amqp_memory_socket_wait /* wait */
+};
+
+static struct amqp_memory_socket_t *
+amqp_memory_socket_cast(amqp_socket_t *base)
+{
+  if (base->klass != &amqp_memory_socket_class) {
+    amqp_abort("<%p> is not of type amqp_memory_socket_t", base);
+  }
+  return (struct amqp_memory_socket_t *)base;
+}
+
+static struct amqp_memory_socket_t *
+amqp_memory_socket_alloc(amqp_connection_state_t state)
+{
+  struct amqp_memory_socket_t *self = calloc(1, sizeof(*self));
+
+  if (!self) {
+    return NULL;
+  }
+  self->klass = &amqp_memory_socket_class;
+#ifdef ENABLE_CONNECTION_STATS
+  self->stats = &state->stats;
+#else
+  (void)state;
+#endif
+  return self;
+}
+
+amqp_socket_t *
+amqp_memory_socket_new(amqp_connection_state_t state, size_t capacity)
+{
+  struct amqp_memory_socket_t *self;
+
+  if (0 == capacity) {
+    return NULL;
+  }
+  self = amqp_memory_socket_alloc(state);
+  if (!self) {
+    return NULL;
+  }
+  self->in = ring_new(capacity);
+  self->out = ring_new(capacity);
+  if (NULL == self->in || NULL == self->out) {
+    ring_release(self->in);
+    ring_release(self->out);
+    free(self);
+    return NULL;
+  }
+
+  amqp_set_socket(state, (amqp_socket_t *)self);
+
+  return (amqp_socket_t *)self;
+}
+
+amqp_socket_t *
+amqp_memory_socket_new_peer(amqp_connection_state_t state, amqp_socket_t *peer)
+{
+  struct amqp_memory_socket_t *other = amqp_memory_socket_cast(peer);
+  struct amqp_memory_socket_t *self = amqp_memory_socket_alloc(state);
+
+  if (!self) {
+    return NULL;
+  }
+  ring_retain(other->out);
+  ring_retain(other->in);
+  self->in = other->out;
+  self->out = other->in;
+
+  amqp_set_socket(state, (amqp_socket_t *)self);
+
+  return (amqp_socket_t *)self;
+}
+
+int
+amqp_memory_socket_set_io_limits(amqp_socket_t *base,
+                                 const size_t *recv_limits, size_t recv_count,
+                                 const size_t *send_limits, size_t send_count)
+{
+  struct amqp_memory_socket_t *self = amqp_memory_socket_cast(base);
+  int res;
+
+  res = set_limits(&self->recv_limits, recv_limits, recv_count);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+  return set_limits(&self->send_limits, send_limits, send_count);
+}
+
+int
+amqp_memory_socket_peer_write(amqp_socket_t *base, const void *buf,
+                              size_t len)
+{
+  struct amqp_memory_ring_t *ring = amqp_memory_socket_cast(base)->in;
+  int n;
+
+  amqp_os_mutex_lock(&ring->lock);
+  if (ring->writer_closed || ring->reader_closed) {
+    n = AMQP_STATUS_SOCKET_ERROR;
+  } else {
+    n = (int)ring_put(ring, buf, len);
+    amqp_os_cond_broadcast(&ring->cond);
+  }
+  amqp_os_mutex_unlock(&ring->lock);
+  return n;
+}
+
+int
+amqp_memory_socket_peer_read(amqp_socket_t *base, void *buf, size_t len)
+{
+  struct amqp_memory_ring_t *ring = amqp_memory_socket_cast(base)->out;
+  int n;
+
+  amqp_os_mutex_lock(&ring->lock);
+  n = (int)ring_take(ring, buf, len);
+  if (0 == n && ring->writer_closed) {
+    n = AMQP_STATUS_CONNECTION_CLOSED;
+  }
+  amqp_os_cond_broadcast(&ring->cond);
+  amqp_os_mutex_unlock(&ring->lock);
+  return n;
+}
+
+void
+amqp_memory_socket_peer_close(amqp_socket_t *base)
+{
+  struct amqp_memory_ring_t *ring = amqp_memory_socket_cast(base)->in;
+
+  amqp_os_mutex_lock(&ring->lock);
+  ring->writer_closed = 1;
+  amqp_os_cond_broadcast(&ring->cond);
+  amqp_os_mutex_unlock(&ring->lock);
+}
+
+#endif /* AMQP_OS_THREADS */
@@ -0,0 +1,166 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/**
+ * An in-process socket connection.
+ *
+ * Bytes written to a memory socket go into a fixed size ring buffer and
+ * bytes read come from another one, without a file descriptor or the kernel
+ * involved. The other ends of the rings are either a second memory socket
+ * created with amqp_memory_socket_new_peer() (for example serving a fake
+ * broker connection on another thread) or driven directly with
+ * amqp_memory_socket_peer_write() and amqp_memory_socket_peer_read().
+ *
+ * Writes block while the ring is full and reads block while it is empty,
+ * so a single thread driving both ends must size the rings for its
+ * traffic. amqp_get_sockfd() returns -1 for memory sockets and they cannot
+ * be used with amqp_start_io_thread().
+ *
+ * Memory sockets need the OS threading layer; on platforms without it
+ * amqp_memory_socket_new() returns NULL.
+ */
+
+#ifndef AMQP_MEMORY_SOCKET_H
+#define AMQP_MEMORY_SOCKET_H
+
+#include <amqp.h>
+
+AMQP_BEGIN_DECLS
+
+/**
+ * Create a new memory socket.
+ *
+ * The socket is connected as soon as it is created, amqp_socket_open() is
+ * not needed. Call amqp_destroy_connection() to release socket resources.
+ *
+ * \param [in] state the connection object to attach the socket to
+ * \param [in] capacity the size in bytes of each direction's ring buffer
+ * \return A new socket object or NULL if an error occurred.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_socket_t *
+AMQP_CALL
+amqp_memory_socket_new(amqp_connection_state_t state, size_t capacity);
+
+/**
+ * Create the other end of a memory socket.
+ *
+ * What one socket writes the other one reads. The rings are shared and
+ * released when both sockets have been deleted.
+ *
+ * \param [in] state the connection object to attach the socket to
+ * \param [in] peer a socket returned by amqp_memory_socket_new()
+ * \return A new socket object or NULL if an error occurred.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_socket_t *
+AMQP_CALL
+amqp_memory_socket_new_peer(amqp_connection_state_t state,
+                            amqp_socket_t *peer);
+
+/**
+ * Inject partial reads and writes.
+ *
+ * Each recv call on the socket returns at most the next entry of
+ * recv_limits bytes, and each write the socket makes into its ring accepts
+ * at most the next entry of send_limits bytes, the rest being written by
+ * further steps the way a partial send(2) is retried. Both lists are used
+ * in a cycle; an entry of 0 means unlimited and a count of 0 removes the
+ * limit. This makes split frames and partial writes reproducible.
+ *
+ * \param [in] self a memory socket
+ * \param [in] recv_limits the successive recv sizes, copied
+ * \param [in] recv_count the number of entries in recv_limits
+ * \param [in] send_limits the successive write sizes, copied
+ * \param [in] send_count the number of entries in send_limits
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_NO_MEMORY otherwise
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_memory_socket_set_io_limits(amqp_socket_t *self,
+                                 const size_t *recv_limits, size_t recv_count,
+                                 const size_t *send_limits, size_t send_count);
+
+/**
+ * Make bytes available for the socket to read, without blocking.
+ *
+ * \param [in] self a memory socket
+ * \param [in] buf the bytes to deliver
+ * \param [in] len the number of bytes at buf
+ * \return the number of bytes copied, less than len if the ring is full,
+ *          or AMQP_STATUS_SOCKET_ERROR if the socket has been closed
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_memory_socket_peer_write(amqp_socket_t *self, const void *buf,
+                              size_t len);
+
+/**
+ * Take the bytes the socket has written, without blocking.
+ *
+ * \param [in] self a memory socket
+ * \param [out] buf receives the bytes
+ * \param [in] len the size of buf
+ * \return the number of bytes copied, 0 if there are none, or
+ *          AMQP_STATUS_CONNECTION_CLOSED if there are none and the socket
+ *          has been closed
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_memory_socket_peer_read(amqp_socket_t *self, void *buf, size_t len);
+
+/**
+ * Signal end of stream to the socket.
+ *
+ * Once the bytes already written have been read, reads on the socket fail
+ * with AMQP_STATUS_CONNECTION_CLOSED.
+ *
+ * \param [in] self a memory socket
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL
+amqp_memory_socket_peer_close(amqp_socket_t *self);
+
+AMQP_END_DECLS
+
+#endif /* AMQP_MEMORY_SOCKET_H */
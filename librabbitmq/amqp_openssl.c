@@ -30,8 +30,10 @@
 #endif
 
 #include "amqp_ssl_socket.h"
+#include "amqp_ssl_cache.h"
 #include "amqp_socket.h"
 #include "amqp_private.h"
+#include "amqp_atomic.h"
 #include "threads.h"
 
 #include <ctype.h>
@@ -41,6 +43,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+# define AMQP_HAVE_KTLS
+# include <errno.h>
+# include <sys/socket.h>
+# include <sys/uio.h>
+#endif
 
 static int initialize_openssl(void);
 static int destroy_openssl(void);
@@ -62,17 +70,101 @@ static pthread_mutex_t openssl_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t *amqp_openssl_lockarray = NULL;
 #endif /* ENABLE_THREAD_SAFETY */
 
+struct amqp_ssl_context_t_ {
+  SSL_CTX *ctx;
+  int refs;
+  amqp_boolean_t in_use;      /* shared with sockets, no longer mutable */
+};
+
 struct amqp_ssl_socket_t {
   const struct amqp_socket_class_t *klass;
-  SSL_CTX *ctx;
+  amqp_ssl_context_t *context;
   int sockfd;
   SSL *ssl;
   char *buffer;
-  size_t length;
   amqp_boolean_t verify;
+  amqp_boolean_t ktls;
+  amqp_boolean_t ktls_send;
   int internal_error;
+  amqp_ssl_session_cache_t *session_cache;
+  char *session_host;
+  int session_port;
+#ifdef ENABLE_CONNECTION_STATS
+  amqp_conn_stats_t *stats;
+#endif
 };
 
+#ifdef ENABLE_CONNECTION_STATS
+#define SSL_STAT_INC(self, field) ((self)->stats->field++)
+#else
+#define SSL_STAT_INC(self, field) ((void)0)
+#endif
+
+static void
+amqp_ssl_socket_free_session(void *session)
+{
+  SSL_SESSION_free(session);
+}
+
+static void
+amqp_ssl_socket_use_session(void *session, void *ssl)
+{
+  SSL_set_session(ssl, session);
+}
+
+/* Called for each session the broker issues, which for TLS 1.3 is after
+ * the handshake; returning 1 keeps the reference for the cache. */
+static int
+amqp_ssl_socket_new_session(SSL *ssl, SSL_SESSION *session)
+{
+  struct amqp_ssl_socket_t *self = SSL_get_app_data(ssl);
+  if (!self || !self->session_cache || !self->session_host) {
+    return 0;
+  }
+  amqp_ssl_session_cache_put(self->session_cache, self->session_host,
+                             self->session_port, session,
+                             amqp_ssl_socket_free_session);
+  return 1;
+}
+
+#ifdef AMQP_HAVE_KTLS
+/* Once the kernel builds the records the socket takes plaintext, so a frame
+ * goes out in one gathering sendmsg() without passing through OpenSSL. */
+static ssize_t
+amqp_ssl_socket_ktls_writev(struct amqp_ssl_socket_t *self,
+                            struct iovec *iov,
+                            int iovcnt)
+{
+  struct msghdr msg;
+  ssize_t res;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+  while (msg.msg_iovlen > 0) {
+    res = sendmsg(self->sockfd, &msg, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      self->internal_error = errno;
+      return AMQP_STATUS_SOCKET_ERROR;
+    }
+    while (msg.msg_iovlen > 0 && (size_t)res >= msg.msg_iov->iov_len) {
+      res -= msg.msg_iov->iov_len;
+      ++msg.msg_iov;
+      --msg.msg_iovlen;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + res;
+      msg.msg_iov->iov_len -= res;
+    }
+  }
+  self->internal_error = 0;
+  return AMQP_STATUS_OK;
+}
+#endif
+
 static ssize_t
 amqp_ssl_socket_send(void *base,
                      const void *buf,
@@ -80,6 +172,14 @@ amqp_ssl_socket_send(void *base,
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
   ssize_t res;
+#ifdef AMQP_HAVE_KTLS
+  if (self->ktls_send) {
+    struct iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    return amqp_ssl_socket_ktls_writev(self, &iov, 1);
+  }
+#endif
   ERR_clear_error();
   self->internal_error = 0;
 
@@ -106,37 +206,38 @@ amqp_ssl_socket_send(void *base,
   return res;
 }
 
+/* more is ignored: the socket BIO SSL_write() writes through takes no send
+ * flags, so there is no way to pass MSG_MORE on. Each record still goes out
+ * in a single send, so a gathered write costs one per 16KB rather than one
+ * per frame. */
+static ssize_t
+amqp_ssl_socket_write_record(void *base,
+                             const void *buf,
+                             size_t len,
+                             AMQP_UNUSED int more)
+{
+  return amqp_ssl_socket_send(base, buf, len);
+}
+
 static ssize_t
 amqp_ssl_socket_writev(void *base,
                        struct iovec *iov,
                        int iovcnt)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
-  ssize_t ret = -1;
-  char *bufferp;
-  size_t bytes;
-  int i;
-  bytes = 0;
-  for (i = 0; i < iovcnt; ++i) {
-    bytes += iov[i].iov_len;
-  }
-  if (self->length < bytes) {
-    self->buffer = realloc(self->buffer, bytes);
+#ifdef AMQP_HAVE_KTLS
+  if (self->ktls_send) {
+    return amqp_ssl_socket_ktls_writev(self, iov, iovcnt);
+  }
+#endif
+  if (!self->buffer) {
+    self->buffer = malloc(AMQP_TLS_RECORD_SIZE);
     if (!self->buffer) {
-      self->length = 0;
-      ret = AMQP_STATUS_NO_MEMORY;
-      goto exit;
+      return AMQP_STATUS_NO_MEMORY;
     }
-    self->length = bytes;
-  }
-  bufferp = self->buffer;
-  for (i = 0; i < iovcnt; ++i) {
-    memcpy(bufferp, iov[i].iov_base, iov[i].iov_len);
-    bufferp += iov[i].iov_len;
   }
-  ret = amqp_ssl_socket_send(self, self->buffer, bytes);
-exit:
-  return ret;
+  return amqp_tls_gather_writev(self, iov, iovcnt, self->buffer,
+                                amqp_ssl_socket_write_record);
 }
 
 static ssize_t
@@ -231,15 +332,56 @@ error:
   goto exit;
 }
 
+/* Drives the handshake on a non-blocking socket when a deadline is given,
+ * waiting for whichever direction OpenSSL asks for. The wait happens here,
+ * WANT_READ/WANT_WRITE are never returned to the caller. */
+static int
+amqp_ssl_socket_connect(struct amqp_ssl_socket_t *self, amqp_timer_t *deadline,
+                        struct timeval *timeout)
+{
+  int res;
+  int status;
+
+  while (1) {
+    res = SSL_connect(self->ssl);
+    if (1 == res) {
+      return AMQP_STATUS_OK;
+    }
+    switch (SSL_get_error(self->ssl, res)) {
+      case SSL_ERROR_WANT_READ:
+        if (!deadline) {
+          continue;
+        }
+        status = amqp_socket_wait_fd(self->sockfd, 0, deadline, timeout);
+        break;
+      case SSL_ERROR_WANT_WRITE:
+        if (!deadline) {
+          continue;
+        }
+        status = amqp_socket_wait_fd(self->sockfd, 1, deadline, timeout);
+        break;
+      default:
+        self->internal_error = ERR_peek_error();
+        return AMQP_STATUS_SSL_CONNECTION_FAILED;
+    }
+    if (AMQP_STATUS_OK != status) {
+      self->internal_error = 0;
+      return status;
+    }
+  }
+}
+
 static int
 amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *timeout)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
+  amqp_timer_t deadline;
   long result;
   int status;
   ERR_clear_error();
+  AMQP_INIT_TIMER(deadline)
 
-  self->ssl = SSL_new(self->ctx);
+  self->ssl = SSL_new(self->context->ctx);
   if (!self->ssl) {
     self->internal_error = ERR_peek_error();
     status = AMQP_STATUS_SSL_ERROR;
@@ -247,7 +389,10 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
   }
 
   SSL_set_mode(self->ssl, SSL_MODE_AUTO_RETRY);
-  self->sockfd = amqp_open_socket_noblock(host, port, timeout);
+  /* with a timeout the socket stays non-blocking until the handshake is
+   * done, so connecting and the handshake share one deadline */
+  self->sockfd = amqp_open_socket_inner(host, port, timeout,
+                                        timeout ? &deadline : NULL);
   if (0 > self->sockfd) {
     status = self->sockfd;
     self->internal_error = amqp_os_socket_error();
@@ -262,12 +407,31 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
     goto error_out2;
   }
 
-  status = SSL_connect(self->ssl);
-  if (!status) {
-    self->internal_error = SSL_get_error(self->ssl, status);
-    status = AMQP_STATUS_SSL_CONNECTION_FAILED;
+#ifdef AMQP_HAVE_KTLS
+  if (self->ktls) {
+    SSL_set_options(self->ssl, SSL_OP_ENABLE_KTLS);
+  }
+#endif
+
+  if (self->session_cache) {
+    free(self->session_host);
+    self->session_host = strdup(host);
+    self->session_port = port;
+    SSL_set_app_data(self->ssl, self);
+    amqp_ssl_session_cache_get(self->session_cache, host, port,
+                               amqp_ssl_socket_use_session, self->ssl);
+  }
+
+  status = amqp_ssl_socket_connect(self, timeout ? &deadline : NULL,
+                                   timeout);
+  if (AMQP_STATUS_OK != status) {
     goto error_out2;
   }
+  if (timeout && AMQP_STATUS_OK != amqp_socket_set_blocking(self->sockfd, 1)) {
+    self->internal_error = amqp_os_socket_error();
+    status = AMQP_STATUS_SOCKET_ERROR;
+    goto error_out3;
+  }
 
   result = SSL_get_verify_result(self->ssl);
   if (X509_V_OK != result) {
@@ -284,6 +448,19 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
     }
   }
 
+  if (self->session_cache) {
+    if (SSL_session_reused(self->ssl)) {
+      SSL_STAT_INC(self, tls_session_hits);
+    } else {
+      SSL_STAT_INC(self, tls_session_misses);
+    }
+  }
+
+#ifdef AMQP_HAVE_KTLS
+  /* stays in userspace if the kernel or the negotiated cipher can't */
+  self->ktls_send = self->ktls && BIO_get_ktls_send(SSL_get_wbio(self->ssl));
+#endif
+
   self->internal_error = 0;
   status = AMQP_STATUS_OK;
 
@@ -306,11 +483,14 @@ amqp_ssl_socket_close(void *base)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
 
+  self->ktls_send = 0;
   if (self->ssl) {
     SSL_shutdown(self->ssl);
     SSL_free(self->ssl);
     self->ssl = NULL;
   }
+  free(self->session_host);
+  self->session_host = NULL;
 
   if (-1 != self->sockfd) {
     if (amqp_os_socket_close(self->sockfd)) {
@@ -338,11 +518,10 @@ amqp_ssl_socket_delete(void *base)
   if (self) {
     amqp_ssl_socket_close(self);
 
-    SSL_CTX_free(self->ctx);
+    amqp_ssl_context_free(self->context);
     free(self->buffer);
     free(self);
   }
-  destroy_openssl();
 }
 
 static const struct amqp_socket_class_t amqp_ssl_socket_class = {
@@ -352,14 +531,51 @@ static const struct amqp_socket_class_t amqp_ssl_socket_class = {
   amqp_ssl_socket_open, /* open */
   amqp_ssl_socket_close, /* close */
   amqp_ssl_socket_get_sockfd, /* get_sockfd */
-  amqp_ssl_socket_delete /* delete */
+  amqp_ssl_socket_delete, /* delete */
+  NULL /* wait */
 };
 
-amqp_socket_t *
-amqp_ssl_socket_new(amqp_connection_state_t state)
+amqp_ssl_context_t *
+amqp_ssl_context_new(void)
+{
+  amqp_ssl_context_t *context = calloc(1, sizeof(*context));
+  if (!context) {
+    return NULL;
+  }
+  if (initialize_openssl()) {
+    free(context);
+    return NULL;
+  }
+
+  context->ctx = SSL_CTX_new(SSLv23_client_method());
+  if (!context->ctx) {
+    free(context);
+    destroy_openssl();
+    return NULL;
+  }
+  /* sessions are only kept by an amqp_ssl_session_cache_t, if any */
+  SSL_CTX_set_session_cache_mode(context->ctx, SSL_SESS_CACHE_CLIENT |
+                                 SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context->ctx, amqp_ssl_socket_new_session);
+  context->refs = 1;
+  return context;
+}
+
+void
+amqp_ssl_context_free(amqp_ssl_context_t *context)
+{
+  if (context && 0 == amqp_atomic_add_int(&context->refs, -1)) {
+    SSL_CTX_free(context->ctx);
+    free(context);
+    destroy_openssl();
+  }
+}
+
+static amqp_socket_t *
+amqp_ssl_socket_new_inner(amqp_connection_state_t state,
+                          amqp_ssl_context_t *context)
 {
   struct amqp_ssl_socket_t *self = calloc(1, sizeof(*self));
-  int status;
   if (!self) {
     return NULL;
   }
@@ -367,36 +583,84 @@ amqp_ssl_socket_new(amqp_connection_state_t state)
   self->sockfd = -1;
   self->klass = &amqp_ssl_socket_class;
   self->verify = 1;
+  amqp_atomic_add_int(&context->refs, 1);
+  self->context = context;
+#ifdef ENABLE_CONNECTION_STATS
+  self->stats = &state->stats;
+#endif
 
-  status = initialize_openssl();
-  if (status) {
-    goto error;
-  }
+  amqp_set_socket(state, (amqp_socket_t *)self);
 
-  self->ctx = SSL_CTX_new(SSLv23_client_method());
-  if (!self->ctx) {
-    goto error;
+  return (amqp_socket_t *)self;
+}
+
+amqp_socket_t *
+amqp_ssl_socket_new(amqp_connection_state_t state)
+{
+  amqp_ssl_context_t *context = amqp_ssl_context_new();
+  amqp_socket_t *self;
+  if (!context) {
+    return NULL;
   }
+  /* the socket holds the only reference to its private context */
+  self = amqp_ssl_socket_new_inner(state, context);
+  amqp_ssl_context_free(context);
+  return self;
+}
 
-  amqp_set_socket(state, (amqp_socket_t *)self);
+amqp_socket_t *
+amqp_ssl_socket_new_with_context(amqp_connection_state_t state,
+                                 amqp_ssl_context_t *context)
+{
+  if (NULL == context) {
+    return NULL;
+  }
+  context->in_use = 1;
+  return amqp_ssl_socket_new_inner(state, context);
+}
 
-  return (amqp_socket_t *)self;
-error:
-  amqp_ssl_socket_delete((amqp_socket_t *)self);
-  return NULL;
+int
+amqp_ssl_context_set_cacert(amqp_ssl_context_t *context,
+                            const char *cacert)
+{
+  int status;
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  status = SSL_CTX_load_verify_locations(context->ctx, cacert, NULL);
+  if (1 != status) {
+    return AMQP_STATUS_SSL_ERROR;
+  }
+  return AMQP_STATUS_OK;
 }
 
 int
 amqp_ssl_socket_set_cacert(amqp_socket_t *base,
                            const char *cacert)
 {
-  int status;
   struct amqp_ssl_socket_t *self;
   if (base->klass != &amqp_ssl_socket_class) {
     amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
   }
   self = (struct amqp_ssl_socket_t *)base;
-  status = SSL_CTX_load_verify_locations(self->ctx, cacert, NULL);
+  return amqp_ssl_context_set_cacert(self->context, cacert);
+}
+
+int
+amqp_ssl_context_set_key(amqp_ssl_context_t *context,
+                         const char *cert,
+                         const char *key)
+{
+  int status;
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  status = SSL_CTX_use_certificate_chain_file(context->ctx, cert);
+  if (1 != status) {
+    return AMQP_STATUS_SSL_ERROR;
+  }
+  status = SSL_CTX_use_PrivateKey_file(context->ctx, key,
+                                       SSL_FILETYPE_PEM);
   if (1 != status) {
     return AMQP_STATUS_SSL_ERROR;
   }
@@ -408,22 +672,12 @@ amqp_ssl_socket_set_key(amqp_socket_t *base,
                         const char *cert,
                         const char *key)
 {
-  int status;
   struct amqp_ssl_socket_t *self;
   if (base->klass != &amqp_ssl_socket_class) {
     amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
   }
   self = (struct amqp_ssl_socket_t *)base;
-  status = SSL_CTX_use_certificate_chain_file(self->ctx, cert);
-  if (1 != status) {
-    return AMQP_STATUS_SSL_ERROR;
-  }
-  status = SSL_CTX_use_PrivateKey_file(self->ctx, key,
-                                       SSL_FILETYPE_PEM);
-  if (1 != status) {
-    return AMQP_STATUS_SSL_ERROR;
-  }
-  return AMQP_STATUS_OK;
+  return amqp_ssl_context_set_key(self->context, cert, key);
 }
 
 static int
@@ -437,20 +691,18 @@ password_cb(AMQP_UNUSED char *buffer,
 }
 
 int
-amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
-                               const char *cert,
-                               const void *key,
-                               size_t n)
+amqp_ssl_context_set_key_buffer(amqp_ssl_context_t *context,
+                                const char *cert,
+                                const void *key,
+                                size_t n)
 {
   int status = AMQP_STATUS_OK;
   BIO *buf = NULL;
   RSA *rsa = NULL;
-  struct amqp_ssl_socket_t *self;
-  if (base->klass != &amqp_ssl_socket_class) {
-    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  if (context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
   }
-  self = (struct amqp_ssl_socket_t *)base;
-  status = SSL_CTX_use_certificate_chain_file(self->ctx, cert);
+  status = SSL_CTX_use_certificate_chain_file(context->ctx, cert);
   if (1 != status) {
     return AMQP_STATUS_SSL_ERROR;
   }
@@ -462,10 +714,11 @@ amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
   if (!rsa) {
     goto error;
   }
-  status = SSL_CTX_use_RSAPrivateKey(self->ctx, rsa);
+  status = SSL_CTX_use_RSAPrivateKey(context->ctx, rsa);
   if (1 != status) {
     goto error;
   }
+  status = AMQP_STATUS_OK;
 exit:
   BIO_vfree(buf);
   RSA_free(rsa);
@@ -475,6 +728,20 @@ error:
   goto exit;
 }
 
+int
+amqp_ssl_socket_set_key_buffer(amqp_socket_t *base,
+                               const char *cert,
+                               const void *key,
+                               size_t n)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+  return amqp_ssl_context_set_key_buffer(self->context, cert, key, n);
+}
+
 int
 amqp_ssl_socket_set_cert(amqp_socket_t *base,
                          const char *cert)
@@ -485,7 +752,10 @@ amqp_ssl_socket_set_cert(amqp_socket_t *base,
     amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
   }
   self = (struct amqp_ssl_socket_t *)base;
-  status = SSL_CTX_use_certificate_chain_file(self->ctx, cert);
+  if (self->context->in_use) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  status = SSL_CTX_use_certificate_chain_file(self->context->ctx, cert);
   if (1 != status) {
     return AMQP_STATUS_SSL_ERROR;
   }
@@ -504,6 +774,47 @@ amqp_ssl_socket_set_verify(amqp_socket_t *base,
   self->verify = verify;
 }
 
+void
+amqp_ssl_socket_set_session_cache(amqp_socket_t *base,
+                                  amqp_ssl_session_cache_t *cache)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+  self->session_cache = cache;
+}
+
+int
+amqp_ssl_socket_set_ktls(amqp_socket_t *base,
+                         amqp_boolean_t enable)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+#ifdef AMQP_HAVE_KTLS
+  self->ktls = enable;
+  return AMQP_STATUS_OK;
+#else
+  self->ktls = 0;
+  return enable ? AMQP_STATUS_UNSUPPORTED : AMQP_STATUS_OK;
+#endif
+}
+
+amqp_boolean_t
+amqp_ssl_socket_get_ktls(amqp_socket_t *base)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+  return self->ktls_send;
+}
+
 void
 amqp_set_initialize_ssl_library(amqp_boolean_t do_initialize)
 {
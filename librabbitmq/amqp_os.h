@@ -0,0 +1,158 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef AMQP_OS_H
+#define AMQP_OS_H
+
+/*
+ * Minimal OS layer for the library's concurrency features: threads,
+ * mutexes, condition variables, counting semaphores, bounded queues and a
+ * monotonic clock. There is a POSIX backend (amqp_os_posix.c) and a
+ * FreeRTOS backend (amqp_os_freertos.c, selected by RABBIT_USE_LWIP);
+ * AMQP_OS_THREADS is defined when one of them is available.
+ *
+ * Functions return amqp_status_enum values. Timeouts are relative, in
+ * nanoseconds; AMQP_OS_WAIT_FOREVER blocks indefinitely and 0 polls.
+ */
+
+#include "amqp.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define AMQP_OS_WAIT_FOREVER UINT64_MAX
+
+#ifndef AMQP_OS_THREAD_STACK_SIZE
+#define AMQP_OS_THREAD_STACK_SIZE 4096
+#endif
+
+#ifndef AMQP_OS_THREAD_PRIORITY
+#define AMQP_OS_THREAD_PRIORITY 2
+#endif
+
+#if defined(RABBIT_USE_LWIP)
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#define AMQP_OS_THREADS 1
+#define amqp_os_thread_yield() taskYIELD()
+
+typedef struct amqp_os_thread_t_ {
+  TaskHandle_t handle;
+  SemaphoreHandle_t done;
+} amqp_os_thread_t;
+
+typedef SemaphoreHandle_t amqp_os_mutex_t;
+
+typedef struct amqp_os_cond_t_ {
+  SemaphoreHandle_t sem;
+  int waiters;              /* protected by the mutex used with the cond */
+} amqp_os_cond_t;
+
+typedef SemaphoreHandle_t amqp_os_sem_t;
+
+#elif !defined(_WIN32)
+
+#include <pthread.h>
+#include <sched.h>
+
+#define AMQP_OS_THREADS 1
+#define amqp_os_thread_yield() ((void)sched_yield())
+
+typedef struct amqp_os_thread_t_ {
+  pthread_t handle;
+} amqp_os_thread_t;
+
+typedef pthread_mutex_t amqp_os_mutex_t;
+
+typedef pthread_cond_t amqp_os_cond_t;
+
+typedef struct amqp_os_sem_t_ {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned int count;
+} amqp_os_sem_t;
+
+#else
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+
+#define amqp_os_thread_yield() ((void)SwitchToThread())
+
+#endif
+
+#ifdef AMQP_OS_THREADS
+
+typedef void (*amqp_os_thread_fn)(void *arg);
+
+typedef struct amqp_os_queue_t_ amqp_os_queue_t;
+
+/* Starts fn(arg) on a new thread. name, stack size and priority only
+ * matter to the FreeRTOS backend. */
+int amqp_os_thread_create(amqp_os_thread_t *thread, const char *name,
+                          amqp_os_thread_fn fn, void *arg);
+/* Waits for the thread to return and releases it. */
+int amqp_os_thread_join(amqp_os_thread_t *thread);
+
+int amqp_os_mutex_init(amqp_os_mutex_t *mutex);
+void amqp_os_mutex_destroy(amqp_os_mutex_t *mutex);
+void amqp_os_mutex_lock(amqp_os_mutex_t *mutex);
+void amqp_os_mutex_unlock(amqp_os_mutex_t *mutex);
+
+int amqp_os_cond_init(amqp_os_cond_t *cond);
+void amqp_os_cond_destroy(amqp_os_cond_t *cond);
+/* Returns AMQP_STATUS_TIMEOUT if timeout_ns passed without a signal.
+ * Spurious wakeups are possible, so wait in a loop. */
+int amqp_os_cond_wait(amqp_os_cond_t *cond, amqp_os_mutex_t *mutex,
+                      uint64_t timeout_ns);
+void amqp_os_cond_signal(amqp_os_cond_t *cond);
+void amqp_os_cond_broadcast(amqp_os_cond_t *cond);
+
+int amqp_os_sem_init(amqp_os_sem_t *sem, unsigned int initial);
+void amqp_os_sem_destroy(amqp_os_sem_t *sem);
+int amqp_os_sem_post(amqp_os_sem_t *sem);
+int amqp_os_sem_wait(amqp_os_sem_t *sem, uint64_t timeout_ns);
+
+/* Fixed-capacity FIFO of fixed-size items, safe for any number of
+ * producers and consumers. */
+amqp_os_queue_t *amqp_os_queue_new(size_t item_size, size_t capacity);
+void amqp_os_queue_free(amqp_os_queue_t *queue);
+int amqp_os_queue_send(amqp_os_queue_t *queue, const void *item,
+                       uint64_t timeout_ns);
+int amqp_os_queue_recv(amqp_os_queue_t *queue, void *item,
+                       uint64_t timeout_ns);
+
+/* Nanoseconds from an arbitrary epoch, 0 on failure. */
+uint64_t amqp_os_monotonic_ns(void);
+
+#endif /* AMQP_OS_THREADS */
+
+#endif /* AMQP_OS_H */
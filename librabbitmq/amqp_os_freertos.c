@@ -0,0 +1,278 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_os.h"
+#include <stdlib.h>
+
+#if defined(AMQP_OS_THREADS) && defined(RABBIT_USE_LWIP)
+
+#include "amqp_timer.h"
+#include "queue.h"
+
+/*
+ * FreeRTOS backend of the OS layer.
+ *
+ * FreeRTOS has neither joinable tasks nor condition variables: a task
+ * signals a semaphore as it exits, and a condition variable is a counting
+ * semaphore plus a waiter count kept under the caller's mutex.
+ */
+
+struct amqp_os_queue_t_ {
+  QueueHandle_t handle;
+};
+
+typedef struct thread_start_t_ {
+  amqp_os_thread_fn fn;
+  void *arg;
+  SemaphoreHandle_t done;
+} thread_start_t;
+
+static TickType_t to_ticks(uint64_t timeout_ns)
+{
+  uint64_t ticks;
+
+  if (AMQP_OS_WAIT_FOREVER == timeout_ns) {
+    return portMAX_DELAY;
+  }
+  /* round up so a short wait still waits */
+  ticks = (timeout_ns * configTICK_RATE_HZ + AMQP_NS_PER_S - 1) / AMQP_NS_PER_S;
+  if (ticks >= portMAX_DELAY) {
+    return portMAX_DELAY - 1;
+  }
+  return (TickType_t)ticks;
+}
+
+static void thread_trampoline(void *arg)
+{
+  thread_start_t start = *(thread_start_t *)arg;
+
+  vPortFree(arg);
+  start.fn(start.arg);
+  xSemaphoreGive(start.done);
+  vTaskDelete(NULL);
+}
+
+int amqp_os_thread_create(amqp_os_thread_t *thread, const char *name,
+                          amqp_os_thread_fn fn, void *arg)
+{
+  thread_start_t *start = pvPortMalloc(sizeof(thread_start_t));
+
+  if (NULL == start) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  thread->done = xSemaphoreCreateBinary();
+  if (NULL == thread->done) {
+    vPortFree(start);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  start->fn = fn;
+  start->arg = arg;
+  start->done = thread->done;
+
+  if (pdPASS != xTaskCreate(thread_trampoline, name ? name : "amqp",
+                            AMQP_OS_THREAD_STACK_SIZE / sizeof(StackType_t),
+                            start, AMQP_OS_THREAD_PRIORITY, &thread->handle)) {
+    vSemaphoreDelete(thread->done);
+    vPortFree(start);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_os_thread_join(amqp_os_thread_t *thread)
+{
+  xSemaphoreTake(thread->done, portMAX_DELAY);
+  vSemaphoreDelete(thread->done);
+  return AMQP_STATUS_OK;
+}
+
+int amqp_os_mutex_init(amqp_os_mutex_t *mutex)
+{
+  *mutex = xSemaphoreCreateMutex();
+  return (NULL != *mutex) ? AMQP_STATUS_OK : AMQP_STATUS_NO_MEMORY;
+}
+
+void amqp_os_mutex_destroy(amqp_os_mutex_t *mutex)
+{
+  vSemaphoreDelete(*mutex);
+}
+
+void amqp_os_mutex_lock(amqp_os_mutex_t *mutex)
+{
+  xSemaphoreTake(*mutex, portMAX_DELAY);
+}
+
+void amqp_os_mutex_unlock(amqp_os_mutex_t *mutex)
+{
+  xSemaphoreGive(*mutex);
+}
+
+int amqp_os_cond_init(amqp_os_cond_t *cond)
+{
+  cond->waiters = 0;
+  cond->sem = xSemaphoreCreateCounting(0x7fff, 0);
+  return (NULL != cond->sem) ? AMQP_STATUS_OK : AMQP_STATUS_NO_MEMORY;
+}
+
+void amqp_os_cond_destroy(amqp_os_cond_t *cond)
+{
+  vSemaphoreDelete(cond->sem);
+}
+
+int amqp_os_cond_wait(amqp_os_cond_t *cond, amqp_os_mutex_t *mutex,
+                      uint64_t timeout_ns)
+{
+  BaseType_t woken;
+
+  cond->waiters++;
+  xSemaphoreGive(*mutex);
+  woken = xSemaphoreTake(cond->sem, to_ticks(timeout_ns));
+  xSemaphoreTake(*mutex, portMAX_DELAY);
+
+  if (pdTRUE == woken) {
+    return AMQP_STATUS_OK;
+  }
+  /* a signal may have raced with the timeout; it already took us off the
+     waiter count, so consume its token */
+  if (pdTRUE == xSemaphoreTake(cond->sem, 0)) {
+    return AMQP_STATUS_OK;
+  }
+  cond->waiters--;
+  return AMQP_STATUS_TIMEOUT;
+}
+
+void amqp_os_cond_signal(amqp_os_cond_t *cond)
+{
+  if (cond->waiters > 0) {
+    cond->waiters--;
+    xSemaphoreGive(cond->sem);
+  }
+}
+
+void amqp_os_cond_broadcast(amqp_os_cond_t *cond)
+{
+  while (cond->waiters > 0) {
+    cond->waiters--;
+    xSemaphoreGive(cond->sem);
+  }
+}
+
+int amqp_os_sem_init(amqp_os_sem_t *sem, unsigned int initial)
+{
+  *sem = xSemaphoreCreateCounting(0x7fff, initial);
+  return (NULL != *sem) ? AMQP_STATUS_OK : AMQP_STATUS_NO_MEMORY;
+}
+
+void amqp_os_sem_destroy(amqp_os_sem_t *sem)
+{
+  vSemaphoreDelete(*sem);
+}
+
+int amqp_os_sem_post(amqp_os_sem_t *sem)
+{
+  return (pdTRUE == xSemaphoreGive(*sem)) ? AMQP_STATUS_OK
+                                          : AMQP_STATUS_NO_MEMORY;
+}
+
+int amqp_os_sem_wait(amqp_os_sem_t *sem, uint64_t timeout_ns)
+{
+  return (pdTRUE == xSemaphoreTake(*sem, to_ticks(timeout_ns)))
+         ? AMQP_STATUS_OK : AMQP_STATUS_TIMEOUT;
+}
+
+amqp_os_queue_t *amqp_os_queue_new(size_t item_size, size_t capacity)
+{
+  amqp_os_queue_t *queue;
+
+  if (0 == item_size || 0 == capacity) {
+    return NULL;
+  }
+  queue = malloc(sizeof(amqp_os_queue_t));
+  if (NULL == queue) {
+    return NULL;
+  }
+  queue->handle = xQueueCreate(capacity, item_size);
+  if (NULL == queue->handle) {
+    free(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+void amqp_os_queue_free(amqp_os_queue_t *queue)
+{
+  if (NULL == queue) {
+    return;
+  }
+  vQueueDelete(queue->handle);
+  free(queue);
+}
+
+int amqp_os_queue_send(amqp_os_queue_t *queue, const void *item,
+                       uint64_t timeout_ns)
+{
+  return (pdTRUE == xQueueSend(queue->handle, item, to_ticks(timeout_ns)))
+         ? AMQP_STATUS_OK : AMQP_STATUS_TIMEOUT;
+}
+
+int amqp_os_queue_recv(amqp_os_queue_t *queue, void *item,
+                       uint64_t timeout_ns)
+{
+  return (pdTRUE == xQueueReceive(queue->handle, item, to_ticks(timeout_ns)))
+         ? AMQP_STATUS_OK : AMQP_STATUS_TIMEOUT;
+}
+
+uint64_t amqp_os_monotonic_ns(void)
+{
+#if defined(AMQP_64BIT_TIME_FUNC)
+  return amqp_get_monotonic_timestamp();
+#else
+  /* extend the tick counter to 64 bits; it has to be read at least once
+     per wrap, which the heartbeat logic easily does */
+  static TickType_t last_tick;
+  static uint64_t wraps;
+  TickType_t tick;
+  uint64_t ticks;
+
+  taskENTER_CRITICAL();
+  tick = xTaskGetTickCount();
+  if (tick < last_tick) {
+    wraps++;
+  }
+  last_tick = tick;
+  ticks = wraps * ((uint64_t)(TickType_t)~(TickType_t)0 + 1) + tick;
+  taskEXIT_CRITICAL();
+
+  return ticks * (AMQP_NS_PER_S / configTICK_RATE_HZ);
+#endif
+}
+
+#endif
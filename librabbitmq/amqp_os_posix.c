@@ -0,0 +1,334 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_os.h"
+#include <stdlib.h>
+
+#if defined(AMQP_OS_THREADS) && !defined(RABBIT_USE_LWIP)
+
+#include "amqp_timer.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * POSIX backend of the OS layer. Condition variables wait on
+ * CLOCK_MONOTONIC where the platform allows it so that timeouts are not
+ * affected by wall clock changes.
+ */
+
+struct amqp_os_queue_t_ {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  size_t item_size;
+  size_t capacity;
+  size_t head;
+  size_t count;
+  /* items follow */
+};
+
+typedef struct thread_start_t_ {
+  amqp_os_thread_fn fn;
+  void *arg;
+} thread_start_t;
+
+static void *thread_trampoline(void *arg)
+{
+  thread_start_t start = *(thread_start_t *)arg;
+
+  free(arg);
+  start.fn(start.arg);
+  return NULL;
+}
+
+int amqp_os_thread_create(amqp_os_thread_t *thread, const char *name,
+                          amqp_os_thread_fn fn, void *arg)
+{
+  thread_start_t *start = malloc(sizeof(thread_start_t));
+
+  (void)name;
+  if (NULL == start) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  start->fn = fn;
+  start->arg = arg;
+  if (0 != pthread_create(&thread->handle, NULL, thread_trampoline, start)) {
+    free(start);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_os_thread_join(amqp_os_thread_t *thread)
+{
+  if (0 != pthread_join(thread->handle, NULL)) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_os_mutex_init(amqp_os_mutex_t *mutex)
+{
+  return (0 == pthread_mutex_init(mutex, NULL)) ? AMQP_STATUS_OK
+                                                 : AMQP_STATUS_NO_MEMORY;
+}
+
+void amqp_os_mutex_destroy(amqp_os_mutex_t *mutex)
+{
+  pthread_mutex_destroy(mutex);
+}
+
+void amqp_os_mutex_lock(amqp_os_mutex_t *mutex)
+{
+  pthread_mutex_lock(mutex);
+}
+
+void amqp_os_mutex_unlock(amqp_os_mutex_t *mutex)
+{
+  pthread_mutex_unlock(mutex);
+}
+
+int amqp_os_cond_init(amqp_os_cond_t *cond)
+{
+  int res;
+#if defined(__APPLE__)
+  res = pthread_cond_init(cond, NULL);
+#else
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  res = pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+#endif
+  return (0 == res) ? AMQP_STATUS_OK : AMQP_STATUS_NO_MEMORY;
+}
+
+void amqp_os_cond_destroy(amqp_os_cond_t *cond)
+{
+  pthread_cond_destroy(cond);
+}
+
+int amqp_os_cond_wait(amqp_os_cond_t *cond, amqp_os_mutex_t *mutex,
+                      uint64_t timeout_ns)
+{
+  struct timespec ts;
+  int res;
+
+  if (AMQP_OS_WAIT_FOREVER == timeout_ns) {
+    pthread_cond_wait(cond, mutex);
+    return AMQP_STATUS_OK;
+  }
+
+#if defined(__APPLE__)
+  ts.tv_sec = timeout_ns / AMQP_NS_PER_S;
+  ts.tv_nsec = timeout_ns % AMQP_NS_PER_S;
+  res = pthread_cond_timedwait_relative_np(cond, mutex, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  timeout_ns += (uint64_t)ts.tv_nsec;
+  ts.tv_sec += timeout_ns / AMQP_NS_PER_S;
+  ts.tv_nsec = timeout_ns % AMQP_NS_PER_S;
+  res = pthread_cond_timedwait(cond, mutex, &ts);
+#endif
+  return (ETIMEDOUT == res) ? AMQP_STATUS_TIMEOUT : AMQP_STATUS_OK;
+}
+
+void amqp_os_cond_signal(amqp_os_cond_t *cond)
+{
+  pthread_cond_signal(cond);
+}
+
+void amqp_os_cond_broadcast(amqp_os_cond_t *cond)
+{
+  pthread_cond_broadcast(cond);
+}
+
+/* Waits on cond until ready() holds or timeout_ns has passed. */
+static int wait_until(pthread_cond_t *cond, pthread_mutex_t *lock,
+                      int (*ready)(void *), void *arg, uint64_t timeout_ns)
+{
+  uint64_t deadline = 0;
+
+  if (AMQP_OS_WAIT_FOREVER != timeout_ns) {
+    deadline = amqp_os_monotonic_ns() + timeout_ns;
+  }
+
+  while (!ready(arg)) {
+    uint64_t left = AMQP_OS_WAIT_FOREVER;
+
+    if (deadline) {
+      uint64_t now = amqp_os_monotonic_ns();
+      if (now >= deadline) {
+        return AMQP_STATUS_TIMEOUT;
+      }
+      left = deadline - now;
+    }
+    amqp_os_cond_wait(cond, lock, left);
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_os_sem_init(amqp_os_sem_t *sem, unsigned int initial)
+{
+  sem->count = initial;
+  if (0 != pthread_mutex_init(&sem->lock, NULL)) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  if (AMQP_STATUS_OK != amqp_os_cond_init(&sem->cond)) {
+    pthread_mutex_destroy(&sem->lock);
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  return AMQP_STATUS_OK;
+}
+
+void amqp_os_sem_destroy(amqp_os_sem_t *sem)
+{
+  pthread_cond_destroy(&sem->cond);
+  pthread_mutex_destroy(&sem->lock);
+}
+
+int amqp_os_sem_post(amqp_os_sem_t *sem)
+{
+  pthread_mutex_lock(&sem->lock);
+  sem->count++;
+  pthread_cond_signal(&sem->cond);
+  pthread_mutex_unlock(&sem->lock);
+  return AMQP_STATUS_OK;
+}
+
+static int sem_ready(void *arg)
+{
+  return ((amqp_os_sem_t *)arg)->count > 0;
+}
+
+int amqp_os_sem_wait(amqp_os_sem_t *sem, uint64_t timeout_ns)
+{
+  int res;
+
+  pthread_mutex_lock(&sem->lock);
+  res = wait_until(&sem->cond, &sem->lock, sem_ready, sem, timeout_ns);
+  if (AMQP_STATUS_OK == res) {
+    sem->count--;
+  }
+  pthread_mutex_unlock(&sem->lock);
+  return res;
+}
+
+amqp_os_queue_t *amqp_os_queue_new(size_t item_size, size_t capacity)
+{
+  amqp_os_queue_t *queue;
+
+  if (0 == item_size || 0 == capacity) {
+    return NULL;
+  }
+  queue = calloc(1, sizeof(amqp_os_queue_t) + item_size * capacity);
+  if (NULL == queue) {
+    return NULL;
+  }
+  queue->item_size = item_size;
+  queue->capacity = capacity;
+  pthread_mutex_init(&queue->lock, NULL);
+  amqp_os_cond_init(&queue->not_empty);
+  amqp_os_cond_init(&queue->not_full);
+  return queue;
+}
+
+void amqp_os_queue_free(amqp_os_queue_t *queue)
+{
+  if (NULL == queue) {
+    return;
+  }
+  pthread_cond_destroy(&queue->not_full);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue);
+}
+
+static void *queue_slot(amqp_os_queue_t *queue, size_t index)
+{
+  return (char *)(queue + 1) + (index % queue->capacity) * queue->item_size;
+}
+
+static int queue_has_space(void *arg)
+{
+  amqp_os_queue_t *queue = arg;
+  return queue->count < queue->capacity;
+}
+
+static int queue_has_items(void *arg)
+{
+  return ((amqp_os_queue_t *)arg)->count > 0;
+}
+
+int amqp_os_queue_send(amqp_os_queue_t *queue, const void *item,
+                       uint64_t timeout_ns)
+{
+  int res;
+
+  pthread_mutex_lock(&queue->lock);
+  res = wait_until(&queue->not_full, &queue->lock, queue_has_space, queue,
+                   timeout_ns);
+  if (AMQP_STATUS_OK == res) {
+    memcpy(queue_slot(queue, queue->head + queue->count), item,
+           queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return res;
+}
+
+int amqp_os_queue_recv(amqp_os_queue_t *queue, void *item,
+                       uint64_t timeout_ns)
+{
+  int res;
+
+  pthread_mutex_lock(&queue->lock);
+  res = wait_until(&queue->not_empty, &queue->lock, queue_has_items, queue,
+                   timeout_ns);
+  if (AMQP_STATUS_OK == res) {
+    memcpy(item, queue_slot(queue, queue->head), queue->item_size);
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return res;
+}
+
+uint64_t amqp_os_monotonic_ns(void)
+{
+  return amqp_get_monotonic_timestamp();
+}
+
+#endif
@@ -26,6 +26,7 @@
 #endif
 
 #include "amqp_ssl_socket.h"
+#include "amqp_ssl_cache.h"
 #include "amqp_private.h"
 #include <polarssl/ctr_drbg.h>
 #include <polarssl/entropy.h>
@@ -51,10 +52,25 @@ struct amqp_ssl_socket_t {
   ssl_context *ssl;
   ssl_session *session;
   char *buffer;
-  size_t length;
   int last_error;
+  amqp_ssl_session_cache_t *session_cache;
 };
 
+#if POLARSSL_VERSION_NUMBER >= 0x01030000
+static void
+amqp_ssl_socket_free_session(void *session)
+{
+  ssl_session_free(session);
+  free(session);
+}
+
+static void
+amqp_ssl_socket_use_session(void *session, void *ssl)
+{
+  ssl_set_session(ssl, session);
+}
+#endif
+
 static ssize_t
 amqp_ssl_socket_send(void *base,
                      const void *buf,
@@ -65,7 +81,12 @@ amqp_ssl_socket_send(void *base,
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
 
   self->last_error = 0;
-  status = ssl_write(self->ssl, buf, len);
+  /* the socket is blocking once open, so these only mean a signal or a send
+   * timeout interrupted the write; it has to be repeated with the same data */
+  do {
+    status = ssl_write(self->ssl, buf, len);
+  } while (POLARSSL_ERR_NET_WANT_WRITE == status ||
+           POLARSSL_ERR_NET_WANT_READ == status);
   if (status < 0) {
     self->last_error = AMQP_STATUS_SSL_ERROR;
   }
@@ -73,40 +94,41 @@ amqp_ssl_socket_send(void *base,
   return status;
 }
 
+static ssize_t
+amqp_ssl_socket_write_record(void *base,
+                             const void *buf,
+                             size_t len,
+                             AMQP_UNUSED int more)
+{
+  const char *bytes = buf;
+  ssize_t written;
+  while (len > 0) {
+    written = amqp_ssl_socket_send(base, (const unsigned char *)bytes, len, 0);
+    if (written < 0) {
+      return AMQP_STATUS_SSL_ERROR;
+    }
+    bytes += written;
+    len -= written;
+  }
+  return AMQP_STATUS_OK;
+}
+
 static ssize_t
 amqp_ssl_socket_writev(void *base,
                        const struct iovec *iov,
                        int iovcnt)
 {
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
-  ssize_t written = -1;
-  char *bufferp;
-  size_t bytes;
-  int i;
   self->last_error = 0;
-  bytes = 0;
-  for (i = 0; i < iovcnt; ++i) {
-    bytes += iov[i].iov_len;
-  }
-  if (self->length < bytes) {
-    free(self->buffer);
-    self->buffer = malloc(bytes);
+  if (!self->buffer) {
+    self->buffer = malloc(AMQP_TLS_RECORD_SIZE);
     if (!self->buffer) {
-      self->length = 0;
       self->last_error = AMQP_STATUS_NO_MEMORY;
-      goto exit;
+      return AMQP_STATUS_NO_MEMORY;
     }
-    self->length = bytes;
-  }
-  bufferp = self->buffer;
-  for (i = 0; i < iovcnt; ++i) {
-    memcpy(bufferp, iov[i].iov_base, iov[i].iov_len);
-    bufferp += iov[i].iov_len;
   }
-  written = amqp_ssl_socket_send(self, (const unsigned char *)self->buffer,
-                      bytes, 0);
-exit:
-  return written;
+  return amqp_tls_gather_writev(self, iov, iovcnt, self->buffer,
+                                amqp_ssl_socket_write_record);
 }
 
 static ssize_t
@@ -132,22 +154,17 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
 {
   int status;
   struct amqp_ssl_socket_t *self = (struct amqp_ssl_socket_t *)base;
+  amqp_timer_t deadline;
   self->last_error = 0;
+  AMQP_INIT_TIMER(deadline)
 
-  if (timeout && (timeout->tv_sec != 0 || timeout->tv_usec != 0)) {
-    /* We don't support PolarSSL for now because it uses its own connect() wrapper
-     * It is not too hard to implement net_connect() with noblock support,
-     * but then we will have to maintain that piece of code and keep it synced with main PolarSSL code base
-     */
-    return AMQP_STATUS_INVALID_PARAMETER;
-  }
-
-  status = net_connect(&self->sockfd, host, port);
-  if (status) {
-    /* This isn't quite right. We should probably translate between
-     * POLARSSL_ERR_* to our internal error codes
-     */
-    self->last_error = AMQP_STATUS_SSL_ERROR;
+  /* net_recv() and net_send() only need the descriptor, so connect with our
+   * own code; with a timeout the socket stays non-blocking until the
+   * handshake is done and both share one deadline */
+  self->sockfd = amqp_open_socket_inner(host, port, timeout,
+                                        timeout ? &deadline : NULL);
+  if (0 > self->sockfd) {
+    self->last_error = -self->sockfd;
     return -1;
   }
   if (self->cacert) {
@@ -158,16 +175,47 @@ amqp_ssl_socket_open(void *base, const char *host, int port, struct timeval *tim
   if (self->key && self->cert) {
     ssl_set_own_cert(self->ssl, self->cert, self->key);
   }
+#if POLARSSL_VERSION_NUMBER >= 0x01030000
+  if (self->session_cache) {
+    amqp_ssl_session_cache_get(self->session_cache, host, port,
+                               amqp_ssl_socket_use_session, self->ssl);
+  }
+#endif
   while (0 != (status = ssl_handshake(self->ssl))) {
+    int res = AMQP_STATUS_OK;
     switch (status) {
     case POLARSSL_ERR_NET_WANT_READ:
     case POLARSSL_ERR_NET_WANT_WRITE:
-      continue;
+      if (timeout) {
+        res = amqp_socket_wait_fd(self->sockfd,
+                                  POLARSSL_ERR_NET_WANT_WRITE == status,
+                                  &deadline, timeout);
+      }
+      break;
     default:
-      self->last_error = AMQP_STATUS_SSL_ERROR;
+      res = AMQP_STATUS_SSL_ERROR;
       break;
     }
+    if (AMQP_STATUS_OK != res) {
+      self->last_error = res;
+      return -1;
+    }
+  }
+  if (timeout && AMQP_STATUS_OK != amqp_socket_set_blocking(self->sockfd, 1)) {
+    self->last_error = AMQP_STATUS_SOCKET_ERROR;
+    return -1;
+  }
+#if POLARSSL_VERSION_NUMBER >= 0x01030000
+  if (0 == status && self->session_cache) {
+    ssl_session *session = calloc(1, sizeof(*session));
+    if (session && 0 == ssl_get_session(self->ssl, session)) {
+      amqp_ssl_session_cache_put(self->session_cache, host, port, session,
+                                 amqp_ssl_socket_free_session);
+    } else {
+      free(session);
+    }
   }
+#endif
   return status;
 }
 
@@ -356,6 +404,76 @@ amqp_ssl_socket_set_verify(amqp_socket_t *base,
   }
 }
 
+void
+amqp_ssl_socket_set_session_cache(amqp_socket_t *base,
+                                  amqp_ssl_session_cache_t *cache)
+{
+  struct amqp_ssl_socket_t *self;
+  if (base->klass != &amqp_ssl_socket_class) {
+    amqp_abort("<%p> is not of type amqp_ssl_socket_t", base);
+  }
+  self = (struct amqp_ssl_socket_t *)base;
+  self->session_cache = cache;
+}
+
+int
+amqp_ssl_socket_set_ktls(AMQP_UNUSED amqp_socket_t *base,
+                         amqp_boolean_t enable)
+{
+  /* no kernel TLS offload with this backend */
+  return enable ? AMQP_STATUS_UNSUPPORTED : AMQP_STATUS_OK;
+}
+
+amqp_boolean_t
+amqp_ssl_socket_get_ktls(AMQP_UNUSED amqp_socket_t *base)
+{
+  return 0;
+}
+
+/* shared contexts are not implemented for this backend, sockets keep
+ * their own credentials */
+amqp_ssl_context_t *
+amqp_ssl_context_new(void)
+{
+  return NULL;
+}
+
+void
+amqp_ssl_context_free(AMQP_UNUSED amqp_ssl_context_t *context)
+{
+}
+
+amqp_socket_t *
+amqp_ssl_socket_new_with_context(AMQP_UNUSED amqp_connection_state_t state,
+                                 AMQP_UNUSED amqp_ssl_context_t *context)
+{
+  return NULL;
+}
+
+int
+amqp_ssl_context_set_cacert(AMQP_UNUSED amqp_ssl_context_t *context,
+                            AMQP_UNUSED const char *cacert)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int
+amqp_ssl_context_set_key(AMQP_UNUSED amqp_ssl_context_t *context,
+                         AMQP_UNUSED const char *cert,
+                         AMQP_UNUSED const char *key)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int
+amqp_ssl_context_set_key_buffer(AMQP_UNUSED amqp_ssl_context_t *context,
+                                AMQP_UNUSED const char *cert,
+                                AMQP_UNUSED const void *key,
+                                AMQP_UNUSED size_t n)
+{
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
 void
 amqp_set_initialize_ssl_library(AMQP_UNUSED amqp_boolean_t do_initialize)
 {
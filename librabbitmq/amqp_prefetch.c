@@ -0,0 +1,308 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef AMQP_DEFAULT_PREFETCH_INTERVAL_MS
+#define AMQP_DEFAULT_PREFETCH_INTERVAL_MS 1000
+#endif
+
+/*
+ * Adaptive prefetch.
+ *
+ * amqp_consume_message() reports when the application comes back for the
+ * next message (the gap since the previous return is processing time) and
+ * when a delivery is handed out (the gap since the call is time spent
+ * waiting on the broker). Once per interval the controller looks at those
+ * averages and at how many deliveries are sitting in the frame queue:
+ *
+ *  - a backlog above max_backlog means prefetch is buying nothing but
+ *    memory, so it is cut by a quarter;
+ *  - otherwise, if the consumer spent more than 1/8th of its time idle
+ *    with nothing queued, prefetch is raised in proportion to the idle
+ *    fraction.
+ *
+ * basic.qos is only sent when the value actually changes.
+ */
+
+static amqp_prefetch_ctl_t *
+find_ctl(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_prefetch_ctl_t *ctl;
+
+  for (ctl = state->prefetch_ctls; NULL != ctl; ctl = ctl->next) {
+    if (ctl->channel == channel) {
+      return ctl;
+    }
+  }
+  return NULL;
+}
+
+static size_t queued_deliveries(amqp_connection_state_t state,
+                                amqp_channel_t channel)
+{
+  amqp_link_t *cur;
+  size_t count = 0;
+
+  for (cur = state->first_queued_frame; NULL != cur; cur = cur->next) {
+    amqp_frame_t *frame = cur->data;
+    if (frame->channel == channel &&
+        AMQP_FRAME_METHOD == frame->frame_type &&
+        AMQP_BASIC_DELIVER_METHOD == frame->payload.method.id) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static amqp_rpc_reply_t send_qos(amqp_connection_state_t state,
+                                 amqp_channel_t channel, uint16_t count)
+{
+  amqp_method_number_t replies[2] = { AMQP_BASIC_QOS_OK_METHOD, 0 };
+  amqp_basic_qos_t req;
+
+  req.prefetch_size = 0;
+  req.prefetch_count = count;
+  req.global = 0;
+
+  return amqp_simple_rpc(state, channel, AMQP_BASIC_QOS_METHOD, replies, &req);
+}
+
+static amqp_rpc_reply_t adjust(amqp_connection_state_t state,
+                               amqp_prefetch_ctl_t *ctl, uint64_t now)
+{
+  amqp_rpc_reply_t ret;
+  uint64_t elapsed = now - ctl->interval_start;
+  uint64_t n = ctl->interval_deliveries;
+  uint32_t target = ctl->stats.prefetch_count;
+
+  memset(&ret, 0, sizeof(amqp_rpc_reply_t));
+  ret.reply_type = AMQP_RESPONSE_NORMAL;
+
+  ctl->stats.backlog = queued_deliveries(state, ctl->channel);
+  ctl->stats.arrival_rate = (uint32_t)(n * AMQP_NS_PER_S / (elapsed ? elapsed : 1));
+  ctl->stats.avg_processing_ns = ctl->interval_processing / n;
+  ctl->stats.avg_wait_ns = ctl->interval_wait / n;
+
+  if (ctl->stats.backlog > ctl->config.max_backlog) {
+    target -= (target / 4) ? (target / 4) : 1;
+  } else if (0 == ctl->stats.backlog &&
+             ctl->stats.avg_wait_ns * 8 > ctl->stats.avg_processing_ns) {
+    uint64_t idle = ctl->stats.avg_wait_ns;
+    uint64_t busy = ctl->stats.avg_processing_ns;
+    uint64_t step = (uint64_t)target * idle / (idle + busy);
+    target += step ? step : 1;
+  }
+
+  if (target < ctl->config.min_prefetch) {
+    target = ctl->config.min_prefetch;
+  }
+  if (target > ctl->config.max_prefetch) {
+    target = ctl->config.max_prefetch;
+  }
+
+  ctl->interval_start = now;
+  ctl->interval_deliveries = 0;
+  ctl->interval_processing = 0;
+  ctl->interval_wait = 0;
+
+  if (target != ctl->stats.prefetch_count) {
+    ret = send_qos(state, ctl->channel, (uint16_t)target);
+    if (AMQP_RESPONSE_NORMAL == ret.reply_type) {
+      if (target > ctl->stats.prefetch_count) {
+        ctl->stats.increases++;
+      } else {
+        ctl->stats.decreases++;
+      }
+      ctl->stats.prefetch_count = (uint16_t)target;
+    }
+  }
+
+  return ret;
+}
+
+amqp_rpc_reply_t amqp_prefetch_consume_begin(amqp_connection_state_t state,
+                                             uint64_t *now)
+{
+  amqp_rpc_reply_t ret;
+  amqp_prefetch_ctl_t *ctl;
+
+  memset(&ret, 0, sizeof(amqp_rpc_reply_t));
+  ret.reply_type = AMQP_RESPONSE_NORMAL;
+
+  *now = amqp_clock_refresh(state);
+  if (0 == *now) {
+    ret.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+    ret.library_error = AMQP_STATUS_TIMER_FAILURE;
+    return ret;
+  }
+
+  ctl = find_ctl(state, state->prefetch_last_channel);
+  if (NULL == ctl || 0 == ctl->last_return) {
+    return ret;
+  }
+
+  ctl->interval_processing += *now - ctl->last_return;
+  ctl->last_return = 0;
+
+  if (ctl->interval_deliveries > 0 &&
+      *now - ctl->interval_start >= ctl->interval) {
+    ret = adjust(state, ctl, *now);
+  }
+  return ret;
+}
+
+void amqp_prefetch_consume_end(amqp_connection_state_t state,
+                               amqp_channel_t channel, uint64_t begin)
+{
+  amqp_prefetch_ctl_t *ctl = find_ctl(state, channel);
+  uint64_t now;
+
+  if (NULL == ctl) {
+    return;
+  }
+
+  /* the delivery has been read, a clock failure only loses this sample */
+  now = amqp_clock_refresh(state);
+  if (0 == now) {
+    return;
+  }
+
+  ctl->interval_wait += now - begin;
+  ctl->interval_deliveries++;
+  ctl->stats.deliveries++;
+  ctl->last_return = now;
+  state->prefetch_last_channel = channel;
+}
+
+void amqp_prefetch_release(amqp_connection_state_t state, amqp_channel_t channel)
+{
+  amqp_prefetch_ctl_t **link = &state->prefetch_ctls;
+
+  while (NULL != *link) {
+    amqp_prefetch_ctl_t *ctl = *link;
+    if (ctl->channel == channel) {
+      *link = ctl->next;
+      free(ctl);
+      return;
+    }
+    link = &ctl->next;
+  }
+}
+
+void amqp_prefetch_destroy_all(amqp_connection_state_t state)
+{
+  while (NULL != state->prefetch_ctls) {
+    amqp_prefetch_release(state, state->prefetch_ctls->channel);
+  }
+}
+
+amqp_rpc_reply_t amqp_set_adaptive_prefetch(amqp_connection_state_t state,
+                                            amqp_channel_t channel,
+                                            const amqp_prefetch_config_t *config)
+{
+  amqp_prefetch_ctl_t *ctl = find_ctl(state, channel);
+  uint64_t now;
+
+  memset(&state->most_recent_api_result, 0,
+         sizeof(state->most_recent_api_result));
+
+  if (NULL == config) {
+    amqp_prefetch_release(state, channel);
+    state->most_recent_api_result.reply_type = AMQP_RESPONSE_NORMAL;
+    return state->most_recent_api_result;
+  }
+
+  if (0 == config->min_prefetch ||
+      config->min_prefetch > config->max_prefetch ||
+      config->initial_prefetch < config->min_prefetch ||
+      config->initial_prefetch > config->max_prefetch ||
+      config->interval.tv_sec < 0 || config->interval.tv_usec < 0) {
+    state->most_recent_api_result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+    state->most_recent_api_result.library_error = AMQP_STATUS_INVALID_PARAMETER;
+    return state->most_recent_api_result;
+  }
+
+  now = amqp_clock_refresh(state);
+  if (0 == now) {
+    state->most_recent_api_result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+    state->most_recent_api_result.library_error = AMQP_STATUS_TIMER_FAILURE;
+    return state->most_recent_api_result;
+  }
+
+  state->most_recent_api_result = send_qos(state, channel, config->initial_prefetch);
+  if (AMQP_RESPONSE_NORMAL != state->most_recent_api_result.reply_type) {
+    return state->most_recent_api_result;
+  }
+
+  if (NULL == ctl) {
+    ctl = calloc(1, sizeof(amqp_prefetch_ctl_t));
+    if (NULL == ctl) {
+      state->most_recent_api_result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
+      state->most_recent_api_result.library_error = AMQP_STATUS_NO_MEMORY;
+      return state->most_recent_api_result;
+    }
+    ctl->channel = channel;
+    ctl->next = state->prefetch_ctls;
+    state->prefetch_ctls = ctl;
+  }
+
+  ctl->config = *config;
+  ctl->interval = (uint64_t)config->interval.tv_sec * AMQP_NS_PER_S +
+                  (uint64_t)config->interval.tv_usec * AMQP_NS_PER_US;
+  if (0 == ctl->interval) {
+    ctl->interval = (uint64_t)AMQP_DEFAULT_PREFETCH_INTERVAL_MS * AMQP_NS_PER_MS;
+  }
+  ctl->interval_start = now;
+  ctl->interval_deliveries = 0;
+  ctl->interval_processing = 0;
+  ctl->interval_wait = 0;
+  ctl->last_return = 0;
+  ctl->stats.prefetch_count = config->initial_prefetch;
+
+  return state->most_recent_api_result;
+}
+
+int amqp_get_prefetch_stats(amqp_connection_state_t state,
+                            amqp_channel_t channel,
+                            amqp_prefetch_stats_t *stats)
+{
+  amqp_prefetch_ctl_t *ctl = find_ctl(state, channel);
+
+  if (NULL == ctl || NULL == stats) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  *stats = ctl->stats;
+  return AMQP_STATUS_OK;
+}
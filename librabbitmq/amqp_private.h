@@ -81,6 +81,7 @@ amqp_ssl_error_string(int err);
 
 #include "amqp_socket.h"
 #include "amqp_timer.h"
+#include "amqp_trace.h"
 
 /*
  * Connection states: XXX FIX THIS
@@ -124,12 +125,112 @@ typedef struct amqp_link_t_ {
 
 #define POOL_TABLE_SIZE 16
 
+#ifdef AMQP_TRACE_RING
+/* events kept per connection, must be a power of two */
+#ifndef AMQP_TRACE_RING_SIZE
+#define AMQP_TRACE_RING_SIZE 256
+#endif
+
+typedef struct amqp_trace_ring_t_ {
+  int head;  /* number of events ever claimed */
+  amqp_trace_event_t events[AMQP_TRACE_RING_SIZE];
+} amqp_trace_ring_t;
+#endif
+
+#ifdef ENABLE_LATENCY_HISTOGRAMS
+/* Log-linear histogram geometry: each power of two is split into
+ * 2^AMQP_HISTOGRAM_SUB_BITS buckets, values of 2^AMQP_HISTOGRAM_MAX_BITS ns
+ * and above land in the last bucket. */
+#ifndef AMQP_HISTOGRAM_SUB_BITS
+#define AMQP_HISTOGRAM_SUB_BITS 3
+#endif
+#ifndef AMQP_HISTOGRAM_MAX_BITS
+#define AMQP_HISTOGRAM_MAX_BITS 36
+#endif
+#define AMQP_HISTOGRAM_BUCKETS \
+  ((AMQP_HISTOGRAM_MAX_BITS - AMQP_HISTOGRAM_SUB_BITS + 1) << AMQP_HISTOGRAM_SUB_BITS)
+
+typedef struct amqp_histogram_data_t_ {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint32_t buckets[AMQP_HISTOGRAM_BUCKETS];
+} amqp_histogram_data_t;
+#endif
+
+/* a pool the I/O thread decoded a frame into, see amqp_io_thread.c */
+typedef struct amqp_io_pool_t_ {
+  struct amqp_io_pool_t_ *next;
+  amqp_pool_t pool;
+} amqp_io_pool_t;
+
 typedef struct amqp_pool_table_entry_t_ {
   struct amqp_pool_table_entry_t_ *next;
   amqp_pool_t pool;
   amqp_channel_t channel;
+  /* pools holding frames of this channel that the I/O thread decoded,
+   * released together with pool */
+  amqp_io_pool_t *io_pools;
 } amqp_pool_table_entry_t;
 
+typedef struct amqp_publish_node_t_ amqp_publish_node_t;
+typedef struct amqp_publish_queue_t_ amqp_publish_queue_t;
+typedef struct amqp_io_thread_t_ amqp_io_thread_t;
+
+/* publisher confirm bookkeeping for one channel, see amqp_confirm.c */
+typedef struct amqp_confirm_window_t_ {
+  struct amqp_confirm_window_t_ *next;
+  amqp_channel_t channel;
+  uint64_t next_seqno;   /* delivery tag the next publish will get */
+  uint64_t oldest_seqno; /* oldest delivery tag not yet handed to the user */
+  size_t size;
+  uint8_t *slots;        /* amqp_confirm_slot_enum, indexed by tag % size */
+} amqp_confirm_window_t;
+
+/* a connection's timers in an amqp_timer_wheel_t, see amqp_timer_wheel.c */
+typedef struct amqp_timer_entry_t_ amqp_timer_entry_t;
+
+/* ack accumulator for one channel, see amqp_ack.c */
+typedef struct amqp_ack_batch_t_ {
+  struct amqp_ack_batch_t_ *next;
+  amqp_channel_t channel;
+  unsigned int max_count;
+  uint64_t max_delay;
+  amqp_boolean_t seeded; /* a delivery has been seen since enabling */
+  uint64_t acked_upto;   /* every tag <= this is acked or pending */
+  uint64_t ooo_mask;     /* bit n: tag acked_upto + 1 + n was settled alone */
+  uint64_t pending_tag;  /* tag the batched multiple=1 ack will carry */
+  unsigned int pending_count;
+  uint64_t deadline;
+} amqp_ack_batch_t;
+
+/* adaptive basic.qos state for one channel, see amqp_prefetch.c */
+typedef struct amqp_prefetch_ctl_t_ {
+  struct amqp_prefetch_ctl_t_ *next;
+  amqp_channel_t channel;
+  amqp_prefetch_config_t config;
+  uint64_t interval;
+  uint64_t interval_start;
+  uint64_t interval_deliveries;
+  uint64_t interval_processing;
+  uint64_t interval_wait;
+  uint64_t last_return;  /* when the last delivery was handed out, 0 if none */
+  amqp_prefetch_stats_t stats;
+} amqp_prefetch_ctl_t;
+
+#define CONSUMER_TABLE_SIZE 16
+
+/* registered consumer, see amqp_dispatch.c */
+typedef struct amqp_consumer_entry_t_ {
+  struct amqp_consumer_entry_t_ *next;
+  uint32_t hash;
+  amqp_channel_t channel;
+  amqp_bytes_t tag;
+  amqp_consumer_handler_t handler;
+  void *ctx;
+} amqp_consumer_entry_t;
+
 struct amqp_connection_state_t_ {
   amqp_pool_table_entry_t *pool_table[POOL_TABLE_SIZE];
 
@@ -148,10 +249,39 @@ struct amqp_connection_state_t_ {
   size_t inbound_offset;
   size_t target_size;
 
+  /* if set, amqp_handle_input() decodes into this pool rather than the
+   * channel's; the I/O thread's decoder uses it */
+  amqp_pool_t *input_pool;
+
+#ifdef AMQP_FRAMING_PRUNED
+  /* content of a dropped method still to skip, see amqp_handle_input() */
+  amqp_boolean_t discard_content;
+  amqp_channel_t discard_channel;
+  uint64_t discard_remaining;
+#endif
+
   amqp_bytes_t outbound_buffer;
 
+  /* optional user-space output buffer, see amqp_set_write_buffer().
+   * write_buffer.len == 0 means frames are written straight to the socket.
+   */
+  amqp_bytes_t write_buffer;
+  size_t write_buffer_used;
+  size_t write_flush_threshold;
+  uint64_t write_flush_delay;
+  uint64_t write_flush_deadline;
+
   amqp_socket_t *socket;
 
+  amqp_publish_queue_t *publish_queue;
+  amqp_io_thread_t *io_thread;
+
+  amqp_confirm_window_t *confirm_windows;
+  amqp_ack_batch_t *ack_batches;
+  amqp_prefetch_ctl_t *prefetch_ctls;
+  amqp_channel_t prefetch_last_channel;
+  amqp_consumer_entry_t *consumer_table[CONSUMER_TABLE_SIZE];
+
   amqp_bytes_t sock_inbound_buffer;
   size_t sock_inbound_offset;
   size_t sock_inbound_limit;
@@ -164,16 +294,181 @@ struct amqp_connection_state_t_ {
   uint64_t next_recv_heartbeat;
   uint64_t next_send_heartbeat;
 
+  /* see amqp_set_clock(), now is the last reading */
+  amqp_clock_fn clock;
+  void *clock_arg;
+  uint64_t now;
+
+  amqp_timer_entry_t *timer_entry;
+
+  amqp_boolean_t lazy_properties; /* see amqp_set_lazy_properties() */
+
   amqp_table_t server_properties;
   amqp_pool_t properties_pool;
+
+#ifdef ENABLE_CONNECTION_STATS
+  amqp_conn_stats_t stats;
+#endif
+#ifdef ENABLE_LATENCY_HISTOGRAMS
+  amqp_histogram_data_t histograms[AMQP_HISTOGRAM_COUNT];
+  uint64_t socket_write_ns; /* running total, see AMQP_HIST_SOCKET_TIME */
+#endif
+#ifdef AMQP_TRACE_RING
+  amqp_trace_ring_t trace;
+#endif
 };
 
+/* Statistics counters, see amqp_get_connection_stats(). Without
+ * ENABLE_CONNECTION_STATS they, and their arguments, compile out.
+ * Outbound counters are also bumped by whichever publisher thread drains
+ * the publish queue (see amqp_publisher.c) and by the I/O thread, so they
+ * go through AMQP_STAT_OUT and AMQP_STAT_FRAME_OUT, which add atomically. */
+#ifdef ENABLE_CONNECTION_STATS
+#include "amqp_atomic.h"
+
+#define AMQP_STAT_INC(state, field) ((state)->stats.field++)
+#define AMQP_STAT_ADD(state, field, n) ((state)->stats.field += (n))
+#define AMQP_STAT_OUT(state, field, n) \
+  ((void)amqp_atomic_add_u64(&(state)->stats.field, (n)))
+#define AMQP_STAT_FRAME(state, dir, type) \
+  amqp_stat_frame(&(state)->stats.dir, (type))
+#define AMQP_STAT_FRAME_OUT(state, type) \
+  amqp_stat_frame_out(&(state)->stats.frames_out, (type))
+#define AMQP_STAT_QUEUED(state) amqp_stat_queued(&(state)->stats)
+#define AMQP_STAT_DEQUEUED(state) ((state)->stats.queued_frames--)
+
+static inline uint64_t *amqp_stat_frame_counter(amqp_frame_counts_t *counts,
+                                                uint8_t type)
+{
+  switch (type) {
+  case AMQP_FRAME_METHOD:
+    return &counts->method;
+  case AMQP_FRAME_HEADER:
+    return &counts->header;
+  case AMQP_FRAME_BODY:
+    return &counts->body;
+  case AMQP_FRAME_HEARTBEAT:
+    return &counts->heartbeat;
+  default:
+    return NULL;
+  }
+}
+
+static inline void amqp_stat_frame(amqp_frame_counts_t *counts, uint8_t type)
+{
+  uint64_t *counter = amqp_stat_frame_counter(counts, type);
+  if (NULL != counter) {
+    (*counter)++;
+  }
+}
+
+static inline void amqp_stat_frame_out(amqp_frame_counts_t *counts,
+                                       uint8_t type)
+{
+  uint64_t *counter = amqp_stat_frame_counter(counts, type);
+  if (NULL != counter) {
+    amqp_atomic_add_u64(counter, 1);
+  }
+}
+
+static inline void amqp_stat_queued(amqp_conn_stats_t *stats)
+{
+  if (++stats->queued_frames > stats->queued_frames_max) {
+    stats->queued_frames_max = stats->queued_frames;
+  }
+}
+#else
+#define AMQP_STAT_INC(state, field) ((void)0)
+#define AMQP_STAT_ADD(state, field, n) ((void)0)
+#define AMQP_STAT_OUT(state, field, n) ((void)0)
+#define AMQP_STAT_FRAME(state, dir, type) ((void)0)
+#define AMQP_STAT_FRAME_OUT(state, type) ((void)0)
+#define AMQP_STAT_QUEUED(state) ((void)0)
+#define AMQP_STAT_DEQUEUED(state) ((void)0)
+#endif
+
+/* Latency histograms, see amqp_get_histogram(). Without
+ * ENABLE_LATENCY_HISTOGRAMS no timestamps are taken. AMQP_HIST_SOCKET_TIME
+ * is the total time spent in socket writes so far; callers sample it
+ * before and after an operation to time just its socket part. */
+#ifdef ENABLE_LATENCY_HISTOGRAMS
+#define AMQP_HIST_NOW() amqp_get_monotonic_timestamp()
+#define AMQP_HIST_SINCE(state, which, start) \
+  amqp_histogram_record_since((state), (which), (start))
+#define AMQP_HIST_RECORD(state, which, value) \
+  amqp_histogram_record((state), (which), (value))
+#define AMQP_HIST_SOCKET_TIME(state) ((state)->socket_write_ns)
+
+void amqp_histogram_record(amqp_connection_state_t state,
+                           amqp_histogram_enum which, uint64_t value);
+void amqp_histogram_record_since(amqp_connection_state_t state,
+                                 amqp_histogram_enum which, uint64_t start);
+#else
+#define AMQP_HIST_NOW() ((uint64_t)0)
+#define AMQP_HIST_SINCE(state, which, start) ((void)(start))
+#define AMQP_HIST_RECORD(state, which, value) ((void)(value))
+#define AMQP_HIST_SOCKET_TIME(state) ((uint64_t)0)
+#endif
+
+/* Trace points, see amqp_trace.h. AMQP_TRACE records against a connection,
+ * AMQP_TRACE_TO against a ring pointer (NULL for the process-wide ring),
+ * which sockets keep since they have no connection pointer. */
+#if defined(AMQP_TRACE_RING)
+#define AMQP_TRACE(state, event, a0, a1, a2, a3) \
+  AMQP_TRACE_TO(&(state)->trace, event, a0, a1, a2, a3)
+#define AMQP_TRACE_TO(ring, event, a0, a1, a2, a3) \
+  amqp_trace_record((ring), AMQP_TRACE_##event, (uint32_t)(a0), \
+                    (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3))
+
+void amqp_trace_record(amqp_trace_ring_t *ring, amqp_trace_id_enum id,
+                       uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+#elif defined(AMQP_TRACE_PRINTF)
+#define AMQP_TRACE(state, event, a0, a1, a2, a3) \
+  AMQP_TRACE_TO(NULL, event, a0, a1, a2, a3)
+#define AMQP_TRACE_TO(ring, event, a0, a1, a2, a3) \
+  amqp_trace_print(AMQP_TRACE_##event, (uint32_t)(a0), (uint32_t)(a1), \
+                   (uint32_t)(a2), (uint32_t)(a3))
+
+void amqp_trace_print(amqp_trace_id_enum id, uint32_t a0, uint32_t a1,
+                      uint32_t a2, uint32_t a3);
+#else
+#define AMQP_TRACE(state, event, a0, a1, a2, a3) ((void)0)
+#define AMQP_TRACE_TO(ring, event, a0, a1, a2, a3) ((void)0)
+#endif
+
 amqp_pool_t *amqp_get_or_create_channel_pool(amqp_connection_state_t connection, amqp_channel_t channel);
 amqp_pool_t *amqp_get_channel_pool(amqp_connection_state_t state, amqp_channel_t channel);
+amqp_pool_table_entry_t *amqp_get_or_create_channel_entry(amqp_connection_state_t state,
+                                                          amqp_channel_t channel);
+amqp_pool_table_entry_t *amqp_get_channel_entry(amqp_connection_state_t state,
+                                                amqp_channel_t channel);
+
+/* Moves a partly read frame from one connection's decoder to another's,
+ * copying what was read into to's input pool; from is left idle. */
+int amqp_move_input(amqp_connection_state_t from, amqp_connection_state_t to);
 
 static inline amqp_boolean_t amqp_heartbeat_enabled(amqp_connection_state_t state)
 {
-  return (state->heartbeat > 0);
+  /* with the I/O thread running, heartbeats are its business */
+  return (state->heartbeat > 0 && NULL == state->io_thread);
+}
+
+/* Reads the connection's clock and caches the reading, 0 on failure. Done
+ * once per socket read or write and for the recv heartbeat check of
+ * amqp_basic_publish(); everything else uses amqp_clock_now(). */
+static inline uint64_t amqp_clock_refresh(amqp_connection_state_t state)
+{
+  state->now = (NULL != state->clock ? state->clock(state->clock_arg)
+                                     : amqp_get_monotonic_timestamp());
+  return state->now;
+}
+
+/* The last reading, which can be behind by the time since the last socket
+ * operation. Send deadlines computed from it come early, never late; the
+ * recv heartbeat deadline is always computed from a fresh reading. */
+static inline uint64_t amqp_clock_now(amqp_connection_state_t state)
+{
+  return (0 != state->now ? state->now : amqp_clock_refresh(state));
 }
 
 static inline uint64_t amqp_calc_next_send_heartbeat(amqp_connection_state_t state, uint64_t cur)
@@ -188,8 +483,109 @@ static inline uint64_t amqp_calc_next_recv_heartbeat(amqp_connection_state_t sta
   return cur + ((uint64_t)state->heartbeat * (uint64_t)AMQP_NS_PER_S * 2 * 11/10);
 }
 
+static inline amqp_boolean_t amqp_write_pending(amqp_connection_state_t state)
+{
+  return (state->write_buffer_used > 0);
+}
+
 int amqp_try_recv(amqp_connection_state_t state, uint64_t current_time);
 
+size_t amqp_usable_body_payload_size(int frame_max);
+
+/* Encodes a method, header or heartbeat frame into buffer, returning the
+ * number of bytes used or an amqp_status_enum error. */
+int amqp_encode_frame_non_body(const amqp_frame_t *frame, amqp_bytes_t buffer);
+
+/* Take/release the socket writer role when shared publishing is enabled;
+ * both drain the publish queue. Only the connection's own thread calls
+ * these, and calls nest: the role is released by the outermost unlock. */
+int amqp_publish_queue_lock(amqp_connection_state_t state);
+int amqp_publish_queue_unlock(amqp_connection_state_t state);
+void amqp_publish_queue_destroy(amqp_connection_state_t state);
+
+/* Replacements for socket recv/writev and frame decoding while the I/O
+ * thread owns the socket: wait blocks until a decoded frame (or the error
+ * that stopped the thread) is ready, take_frame hands it over. */
+amqp_boolean_t amqp_io_thread_frame_ready(amqp_connection_state_t state);
+int amqp_io_thread_wait(amqp_connection_state_t state, struct timeval *timeout);
+int amqp_io_thread_take_frame(amqp_connection_state_t state,
+                              amqp_frame_t *decoded_frame);
+int amqp_io_thread_writev(amqp_connection_state_t state,
+                          const struct iovec *iov, int iovcnt);
+/* Gives the I/O thread back the pools of a channel being released (frees
+ * them once the thread is gone). */
+void amqp_io_thread_release_pools(amqp_connection_state_t state,
+                                  amqp_pool_table_entry_t *entry);
+
+/* Reads at most one frame off the wire (ignoring the queue), queueing it
+ * unless it was consumed internally, e.g., a publisher confirm. */
+int amqp_pump_frame(amqp_connection_state_t state, struct timeval *timeout);
+
+amqp_boolean_t amqp_confirm_handle_frame(amqp_connection_state_t state,
+                                         amqp_frame_t *frame);
+/* Waits for room in the channel's confirm window, amqp_confirm_sent() then
+ * takes the next sequence number once the basic.publish is out. */
+int amqp_confirm_reserve(amqp_connection_state_t state, amqp_channel_t channel);
+void amqp_confirm_sent(amqp_connection_state_t state, amqp_channel_t channel);
+void amqp_confirm_release(amqp_connection_state_t state, amqp_channel_t channel);
+void amqp_confirm_destroy_all(amqp_connection_state_t state);
+
+void amqp_ack_batch_settled(amqp_connection_state_t state,
+                            amqp_channel_t channel, uint64_t delivery_tag,
+                            amqp_boolean_t multiple);
+int amqp_ack_batch_flush_all(amqp_connection_state_t state);
+/* Tracks deliveries and drops batches the broker closed, for every frame
+ * read. */
+void amqp_ack_batch_handle_frame(amqp_connection_state_t state,
+                                 amqp_frame_t *frame);
+/* The earliest time-limited batch deadline, 0 if none is pending. */
+uint64_t amqp_ack_batch_next_deadline(amqp_connection_state_t state);
+int amqp_ack_batch_release(amqp_connection_state_t state, amqp_channel_t channel);
+void amqp_ack_batch_destroy_all(amqp_connection_state_t state);
+
+/* Around waiting for a delivery: begin adjusts the prefetch count, with a
+ * basic.qos RPC, before the wait; end only records the sample, so it cannot
+ * fail once a delivery has been read. */
+amqp_rpc_reply_t amqp_prefetch_consume_begin(amqp_connection_state_t state,
+                                             uint64_t *now);
+void amqp_prefetch_consume_end(amqp_connection_state_t state,
+                               amqp_channel_t channel, uint64_t begin);
+void amqp_prefetch_release(amqp_connection_state_t state, amqp_channel_t channel);
+void amqp_prefetch_destroy_all(amqp_connection_state_t state);
+
+void amqp_timer_entry_destroy(amqp_connection_state_t state);
+
+/* Lazy mode counterpart of amqp_decode_properties() for basic content
+ * headers, *decoded is an amqp_lazy_properties_t allocated from pool. */
+int amqp_lazy_properties_decode(amqp_pool_t *pool, amqp_bytes_t encoded,
+                                void **decoded);
+/* Same, from a copy of encoded made in pool. */
+int amqp_lazy_properties_copy(amqp_bytes_t encoded,
+                              amqp_lazy_properties_t **lazy,
+                              amqp_pool_t *pool);
+/* amqp_encode_properties() for lazily decoded properties, which are sent
+ * as they were received. */
+int amqp_lazy_properties_encode(amqp_lazy_properties_t *lazy,
+                                amqp_bytes_t encoded);
+
+/* The lazily decoded properties of a content header frame, NULL if they
+ * were decoded eagerly (or built by the caller). */
+static inline amqp_lazy_properties_t *
+amqp_frame_lazy_properties(const amqp_frame_t *frame)
+{
+  amqp_basic_properties_t *properties = frame->payload.properties.decoded;
+
+  if (AMQP_BASIC_CLASS == frame->payload.properties.class_id &&
+      (properties->_flags & AMQP_LAZY_PROPERTIES_FLAG)) {
+    return (amqp_lazy_properties_t *)properties;
+  }
+  return NULL;
+}
+
+void amqp_consumer_table_release(amqp_connection_state_t state,
+                                 amqp_channel_t channel);
+void amqp_consumer_table_destroy(amqp_connection_state_t state);
+
 static inline void *amqp_offset(void *data, size_t offset)
 {
   return (char *)data + offset;
@@ -0,0 +1,395 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include "amqp_atomic.h"
+#include "amqp_os.h"
+#include <string.h>
+
+#ifndef AMQP_PUBLISH_MAX_IOV
+#define AMQP_PUBLISH_MAX_IOV 64
+#endif
+
+/*
+ * Shared publishing.
+ *
+ * Publisher threads encode each message (method, header and body frames)
+ * into one contiguous node and push it onto an intrusive MPSC queue
+ * (Vyukov's algorithm: producers only ever exchange the head pointer). The
+ * socket is owned by whichever thread holds the writer flag; a publisher
+ * that finds the flag free takes it and drains the whole queue with writev,
+ * otherwise it leaves its node for the current writer. The connection's own
+ * thread takes the flag for the duration of each of its writes, and for a
+ * whole message in amqp_basic_publish(), so its calls nest.
+ */
+
+struct amqp_publish_node_t_ {
+  struct amqp_publish_node_t_ *next;
+  size_t len;
+#ifdef ENABLE_CONNECTION_STATS
+  size_t body_frames;
+#endif
+  /* encoded frames follow */
+};
+
+struct amqp_publish_queue_t_ {
+  amqp_publish_node_t *head;
+  amqp_publish_node_t *tail;
+  amqp_publish_node_t stub;
+  int writer;
+  int error;
+  int owner_depth; /* nesting of amqp_publish_queue_lock(), owner thread only */
+};
+
+struct amqp_publisher_t_ {
+  amqp_connection_state_t state;
+  amqp_channel_t channel;
+  amqp_bytes_t scratch;
+};
+
+static void queue_push(amqp_publish_queue_t *q, amqp_publish_node_t *node)
+{
+  amqp_publish_node_t *prev;
+
+  amqp_atomic_store_ptr(&node->next, NULL);
+  prev = amqp_atomic_xchg_ptr(&q->head, node);
+  amqp_atomic_store_ptr(&prev->next, node);
+}
+
+/* Only called by the thread holding the writer flag. Returns NULL when the
+ * queue is empty or a producer is half way through a push. */
+static amqp_publish_node_t *queue_pop(amqp_publish_queue_t *q)
+{
+  amqp_publish_node_t *tail = q->tail;
+  amqp_publish_node_t *next = amqp_atomic_load_ptr(&tail->next);
+
+  if (tail == &q->stub) {
+    if (NULL == next) {
+      return NULL;
+    }
+    q->tail = next;
+    tail = next;
+    next = amqp_atomic_load_ptr(&tail->next);
+  }
+
+  if (NULL != next) {
+    q->tail = next;
+    return tail;
+  }
+
+  if (tail != amqp_atomic_load_ptr(&q->head)) {
+    return NULL;
+  }
+
+  queue_push(q, &q->stub);
+
+  next = amqp_atomic_load_ptr(&tail->next);
+  if (NULL != next) {
+    q->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+static amqp_boolean_t queue_empty(amqp_publish_queue_t *q)
+{
+  return (q->tail == amqp_atomic_load_ptr(&q->head) ||
+          (q->tail == &q->stub && NULL == amqp_atomic_load_ptr(&q->stub.next)));
+}
+
+/* Writes out everything queued. Caller holds the writer flag. */
+static int queue_drain(amqp_connection_state_t state, amqp_publish_queue_t *q)
+{
+  struct iovec iov[AMQP_PUBLISH_MAX_IOV];
+  amqp_publish_node_t *nodes[AMQP_PUBLISH_MAX_IOV];
+  int res = AMQP_STATUS_OK;
+
+  while (1) {
+    int count = 0;
+    int i;
+
+    while (count < AMQP_PUBLISH_MAX_IOV) {
+      amqp_publish_node_t *node = queue_pop(q);
+      if (NULL == node) {
+        break;
+      }
+      nodes[count] = node;
+      iov[count].iov_base = node + 1;
+      iov[count].iov_len = node->len;
+      count++;
+
+      /* one method frame, one header frame and the body frames */
+      AMQP_STAT_OUT(state, frames_out.method, 1);
+      AMQP_STAT_OUT(state, frames_out.header, 1);
+      AMQP_STAT_OUT(state, frames_out.body, node->body_frames);
+      AMQP_STAT_OUT(state, bytes_out, node->len);
+    }
+
+    if (0 == count) {
+      return res;
+    }
+
+    if (AMQP_STATUS_OK == res && 0 == amqp_atomic_load_int(&q->error)) {
+      res = amqp_socket_writev(state->socket, iov, count);
+      if (AMQP_STATUS_OK != res) {
+        amqp_atomic_store_int(&q->error, res);
+      }
+    }
+
+    for (i = 0; i < count; ++i) {
+      free(nodes[i]);
+    }
+  }
+}
+
+static amqp_boolean_t try_lock(amqp_publish_queue_t *q)
+{
+  return amqp_atomic_cas_int(&q->writer, 0, 1);
+}
+
+static int unlock_and_drain(amqp_connection_state_t state,
+                            amqp_publish_queue_t *q)
+{
+  int res = AMQP_STATUS_OK;
+
+  /* a node pushed while we were writing may have found the flag taken, so
+   * keep going until the queue is seen empty with the flag released */
+  while (1) {
+    amqp_atomic_store_int(&q->writer, 0);
+    if (queue_empty(q) || !try_lock(q)) {
+      return res;
+    }
+    res = queue_drain(state, q);
+  }
+}
+
+int amqp_publish_queue_lock(amqp_connection_state_t state)
+{
+  amqp_publish_queue_t *q = state->publish_queue;
+
+  if (q->owner_depth++ > 0) {
+    return AMQP_STATUS_OK;
+  }
+  while (!try_lock(q)) {
+    amqp_os_thread_yield();
+  }
+  return queue_drain(state, q);
+}
+
+int amqp_publish_queue_unlock(amqp_connection_state_t state)
+{
+  amqp_publish_queue_t *q = state->publish_queue;
+
+  if (--q->owner_depth > 0) {
+    return AMQP_STATUS_OK;
+  }
+  return unlock_and_drain(state, q);
+}
+
+void amqp_publish_queue_destroy(amqp_connection_state_t state)
+{
+  amqp_publish_queue_t *q = state->publish_queue;
+  amqp_publish_node_t *node;
+
+  if (NULL == q) {
+    return;
+  }
+
+  while (NULL != (node = queue_pop(q))) {
+    free(node);
+  }
+  free(q);
+  state->publish_queue = NULL;
+}
+
+int amqp_enable_shared_publishing(amqp_connection_state_t state)
+{
+  amqp_publish_queue_t *q;
+
+  if (NULL != state->publish_queue) {
+    return AMQP_STATUS_OK;
+  }
+  if (NULL != state->io_thread) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  q = calloc(1, sizeof(amqp_publish_queue_t));
+  if (NULL == q) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  q->head = &q->stub;
+  q->tail = &q->stub;
+  state->publish_queue = q;
+  return AMQP_STATUS_OK;
+}
+
+amqp_publisher_t *amqp_publisher_new(amqp_connection_state_t state,
+                                     amqp_channel_t channel)
+{
+  amqp_publisher_t *publisher;
+
+  if (NULL == state->publish_queue || 0 == channel) {
+    return NULL;
+  }
+
+  publisher = calloc(1, sizeof(amqp_publisher_t));
+  if (NULL == publisher) {
+    return NULL;
+  }
+
+  /* room for a method frame and a header frame, each up to frame_max */
+  publisher->scratch.len = 2 * (size_t)state->frame_max;
+  publisher->scratch.bytes = malloc(publisher->scratch.len);
+  if (NULL == publisher->scratch.bytes) {
+    free(publisher);
+    return NULL;
+  }
+
+  publisher->state = state;
+  publisher->channel = channel;
+  return publisher;
+}
+
+void amqp_publisher_destroy(amqp_publisher_t *publisher)
+{
+  if (publisher) {
+    free(publisher->scratch.bytes);
+    free(publisher);
+  }
+}
+
+int amqp_publisher_publish(amqp_publisher_t *publisher,
+                           amqp_bytes_t exchange, amqp_bytes_t routing_key,
+                           amqp_boolean_t mandatory, amqp_boolean_t immediate,
+                           amqp_basic_properties_t const *properties,
+                           amqp_bytes_t body)
+{
+  amqp_connection_state_t state = publisher->state;
+  amqp_publish_queue_t *q = state->publish_queue;
+  size_t payload_max = amqp_usable_body_payload_size(state->frame_max);
+  amqp_basic_publish_t m;
+  amqp_basic_properties_t default_properties;
+  amqp_frame_t frame;
+  amqp_bytes_t out;
+  amqp_publish_node_t *node;
+  size_t method_len;
+  size_t header_len;
+  size_t body_frames;
+  size_t body_offset;
+  uint8_t *p;
+  int res;
+
+  res = amqp_atomic_load_int(&q->error);
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+
+  m.exchange = exchange;
+  m.routing_key = routing_key;
+  m.mandatory = mandatory;
+  m.immediate = immediate;
+  m.ticket = 0;
+
+  frame.frame_type = AMQP_FRAME_METHOD;
+  frame.channel = publisher->channel;
+  frame.payload.method.id = AMQP_BASIC_PUBLISH_METHOD;
+  frame.payload.method.decoded = &m;
+
+  out.bytes = publisher->scratch.bytes;
+  out.len = state->frame_max;
+  res = amqp_encode_frame_non_body(&frame, out);
+  if (res < 0) {
+    return res;
+  }
+  method_len = res;
+
+  if (properties == NULL) {
+    memset(&default_properties, 0, sizeof(default_properties));
+    properties = &default_properties;
+  }
+
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body.len;
+  frame.payload.properties.decoded = (void *) properties;
+
+  out.bytes = amqp_offset(publisher->scratch.bytes, method_len);
+  out.len = state->frame_max;
+  res = amqp_encode_frame_non_body(&frame, out);
+  if (res < 0) {
+    return res;
+  }
+  header_len = res;
+
+  body_frames = (body.len + payload_max - 1) / payload_max;
+  node = malloc(sizeof(amqp_publish_node_t) + method_len + header_len +
+                body.len + body_frames * (HEADER_SIZE + FOOTER_SIZE));
+  if (NULL == node) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+
+  p = (uint8_t *)(node + 1);
+  memcpy(p, publisher->scratch.bytes, method_len + header_len);
+  p += method_len + header_len;
+
+  for (body_offset = 0; body_offset < body.len; ) {
+    size_t len = body.len - body_offset;
+    if (len > payload_max) {
+      len = payload_max;
+    }
+    amqp_e8(p, 0, AMQP_FRAME_BODY);
+    amqp_e16(p, 1, publisher->channel);
+    amqp_e32(p, 3, len);
+    memcpy(p + HEADER_SIZE, amqp_offset(body.bytes, body_offset), len);
+    amqp_e8(p, HEADER_SIZE + len, AMQP_FRAME_END);
+    p += HEADER_SIZE + len + FOOTER_SIZE;
+    body_offset += len;
+  }
+  node->len = p - (uint8_t *)(node + 1);
+#ifdef ENABLE_CONNECTION_STATS
+  node->body_frames = body_frames;
+#endif
+
+  queue_push(q, node);
+
+  /* another thread holds the writer flag and will write this node out */
+  if (!try_lock(q)) {
+    return AMQP_STATUS_OK;
+  }
+  res = queue_drain(state, q);
+  if (AMQP_STATUS_OK == res) {
+    res = unlock_and_drain(state, q);
+  } else {
+    unlock_and_drain(state, q);
+  }
+  return res;
+}
@@ -108,9 +108,8 @@ amqp_os_socket_socket(int domain, int type, int protocol)
   int flags;
 #endif
 
-  RABBIT_INFO("Creating socket");
   int s = socket(domain, type, protocol);
-  RABBIT_INFO("Created socket: %d", s);
+  AMQP_TRACE_TO(NULL, SOCKET_CREATE, s, 0, 0, 0);
   if (s < 0) {
     return s;
   }
@@ -145,9 +144,8 @@ amqp_os_socket_setsockopt(int sock, int level, int optname,
      const char * */
   return setsockopt(sock, level, optname, (const char *)optval, optlen);
 #else
-  RABBIT_INFO("Calling setsockopt on: %d", sock);
   int result = setsockopt(sock, level, optname, optval, optlen);
-  RABBIT_INFO("setsockopt on: %d res=%d", sock, result);
+  AMQP_TRACE_TO(NULL, SOCKET_SETSOCKOPT, sock, optname, result, 0);
   return result;
 #endif
 }
@@ -176,9 +174,8 @@ amqp_os_socket_setsockblock(int sock, int block)
     arg |= O_NONBLOCK;
   }
 
-  RABBIT_INFO("Calling fcntl on: %d %x %x", sock, F_SETFL, arg);
   int result = fcntl(sock, F_SETFL, arg);
-  RABBIT_INFO("Calling fcntl on: %d res=%d", sock, result);
+  AMQP_TRACE_TO(NULL, SOCKET_FCNTL, sock, arg, result, 0);
   if (result < 0) {
     return AMQP_STATUS_SOCKET_ERROR;
   }
@@ -298,6 +295,14 @@ amqp_open_socket(char const *hostname,
 int amqp_open_socket_noblock(char const *hostname,
                      int portnumber,
                      struct timeval *timeout)
+{
+  return amqp_open_socket_inner(hostname, portnumber, timeout, NULL);
+}
+
+int amqp_open_socket_inner(char const *hostname,
+                           int portnumber,
+                           struct timeval *timeout,
+                           amqp_timer_t *deadline)
 {
   struct addrinfo hint;
   struct addrinfo *address_list;
@@ -308,9 +313,13 @@ int amqp_open_socket_noblock(char const *hostname,
   int one = 1; /* for setsockopt */
   int res;
   int timer_error;
-  amqp_timer_t timer;
+  amqp_timer_t local_timer;
+  amqp_timer_t *timer = deadline;
 
-  AMQP_INIT_TIMER(timer)
+  if (!timer) {
+    AMQP_INIT_TIMER(local_timer)
+    timer = &local_timer;
+  }
 
   if (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0)) {
     return AMQP_STATUS_INVALID_PARAMETER;
@@ -368,11 +377,12 @@ int amqp_open_socket_noblock(char const *hostname,
 
       res = connect(sockfd, addr->ai_addr, addr->ai_addrlen);
 
-      RABBIT_INFO("connect sockfd=%d res=%d",sockfd, res);
+      AMQP_TRACE_TO(NULL, SOCKET_CONNECT, sockfd, res, 0, 0);
 
       if (0 == res) {
         /* Connected immediately, set to blocking mode again */
-        if (AMQP_STATUS_OK != amqp_os_socket_setsockblock(sockfd, 1)) {
+        if (!deadline &&
+            AMQP_STATUS_OK != amqp_os_socket_setsockblock(sockfd, 1)) {
           last_error = AMQP_STATUS_SOCKET_ERROR;
           continue;
         }
@@ -385,7 +395,7 @@ int amqp_open_socket_noblock(char const *hostname,
       if (WSAEWOULDBLOCK == amqp_os_socket_error()) {
 #elif defined( RABBIT_USE_LWIP )
       int error = amqp_os_socket_error_lwip(sockfd);
-      RABBIT_INFO(" amqp_os_socket_error(%d)=%d",sockfd,error);
+      AMQP_TRACE_TO(NULL, SOCKET_ERROR, sockfd, error, 0, 0);
       if (EINPROGRESS == error) {
 #else
       if (EINPROGRESS == amqp_os_socket_error()) {
@@ -401,10 +411,10 @@ int amqp_open_socket_noblock(char const *hostname,
           FD_ZERO(&except_fd);
           FD_SET(sockfd, &except_fd);
 
-          timer_error = amqp_timer_update(&timer, timeout);
+          timer_error = amqp_timer_update(timer, timeout);
 
-          RABBIT_INFO(" timer_error=%d",timer_error);
           if (timer_error < 0) {
+            AMQP_TRACE_TO(NULL, CONNECT_TIMER, timer_error, 0, 0, 0);
             last_error = timer_error;
             break;
           }
@@ -413,7 +423,7 @@ int amqp_open_socket_noblock(char const *hostname,
            * failure. Other platforms only need write_fds, passing except_fds
            * seems to be harmless otherwise
            */
-          res = select(sockfd+1, NULL, &write_fd, &except_fd, &timer.tv);
+          res = select(sockfd+1, NULL, &write_fd, &except_fd, &timer->tv);
 
           if (res > 0) {
             int result;
@@ -430,7 +440,8 @@ int amqp_open_socket_noblock(char const *hostname,
             }
 
             /* socket is ready to be written to, set to blocking mode again */
-            if (AMQP_STATUS_OK != amqp_os_socket_setsockblock(sockfd, 1)) {
+            if (!deadline &&
+                AMQP_STATUS_OK != amqp_os_socket_setsockblock(sockfd, 1)) {
               last_error = AMQP_STATUS_SOCKET_ERROR;
               continue;
             }
@@ -489,6 +500,42 @@ int amqp_open_socket_noblock(char const *hostname,
   return sockfd;
 }
 
+int amqp_socket_set_blocking(int sockfd, amqp_boolean_t block)
+{
+  return amqp_os_socket_setsockblock(sockfd, block);
+}
+
+int amqp_socket_wait_fd(int sockfd, amqp_boolean_t for_write,
+                        amqp_timer_t *deadline, struct timeval *timeout)
+{
+  fd_set fds;
+  fd_set except_fd;
+  int res;
+
+  while (1) {
+    res = amqp_timer_update(deadline, timeout);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(sockfd, &fds);
+
+    FD_ZERO(&except_fd);
+    FD_SET(sockfd, &except_fd);
+
+    res = select(sockfd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+                 &except_fd, &deadline->tv);
+    if (0 < res) {
+      return AMQP_STATUS_OK;
+    } else if (0 == res) {
+      return AMQP_STATUS_TIMEOUT;
+    } else if (EINTR != amqp_os_socket_error()) {
+      return AMQP_STATUS_SOCKET_ERROR;
+    }
+  }
+}
+
 int amqp_send_header(amqp_connection_state_t state)
 {
   static const uint8_t header[8] = { 'A', 'M', 'Q', 'P', 0,
@@ -563,6 +610,9 @@ amqp_boolean_t amqp_frames_enqueued(amqp_connection_state_t state)
  */
 amqp_boolean_t amqp_data_in_buffer(amqp_connection_state_t state)
 {
+  if (NULL != state->io_thread) {
+    return amqp_io_thread_frame_ready(state);
+  }
   return (state->sock_inbound_offset < state->sock_inbound_limit);
 }
 
@@ -571,6 +621,11 @@ static int consume_one_frame(amqp_connection_state_t state, amqp_frame_t *decode
   int res;
 
   amqp_bytes_t buffer;
+
+  if (NULL != state->io_thread) {
+    return amqp_io_thread_take_frame(state, decoded_frame);
+  }
+
   buffer.len = state->sock_inbound_limit - state->sock_inbound_offset;
   buffer.bytes = ((char *) state->sock_inbound_buffer.bytes) + state->sock_inbound_offset;
 
@@ -589,10 +644,23 @@ static int recv_with_timeout(amqp_connection_state_t state, uint64_t start, stru
 {
   int res;
 
-  if (timeout) {
+  if (NULL != state->io_thread) {
+    return amqp_io_thread_wait(state, timeout);
+  }
+
+  if (timeout && NULL != state->socket &&
+      NULL != state->socket->klass->wait_sockfn) {
+    res = state->socket->klass->wait_sockfn(state->socket, timeout);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+  } else if (timeout) {
     int fd;
     fd_set read_fd;
     fd_set except_fd;
+#ifdef ENABLE_CONNECTION_STATS
+    uint64_t select_start;
+#endif
 
     fd = amqp_get_sockfd(state);
     if (-1 == fd) {
@@ -606,7 +674,16 @@ static int recv_with_timeout(amqp_connection_state_t state, uint64_t start, stru
       FD_ZERO(&except_fd);
       FD_SET(fd, &except_fd);
 
+#ifdef ENABLE_CONNECTION_STATS
+      select_start = amqp_get_monotonic_timestamp();
+#endif
       res = select(fd + 1, &read_fd, NULL, &except_fd, timeout);
+#ifdef ENABLE_CONNECTION_STATS
+      if (0 != select_start) {
+        AMQP_STAT_ADD(state, select_wait_ns,
+                      amqp_get_monotonic_timestamp() - select_start);
+      }
+#endif
 
       if (0 < res) {
         break;
@@ -617,7 +694,7 @@ static int recv_with_timeout(amqp_connection_state_t state, uint64_t start, stru
           if (timeout) {
             uint64_t end_timestamp;
             uint64_t time_left;
-            uint64_t current_timestamp = amqp_get_monotonic_timestamp();
+            uint64_t current_timestamp = amqp_clock_refresh(state);
             if (0 == current_timestamp) {
               return AMQP_STATUS_TIMER_FAILURE;
             }
@@ -649,9 +726,10 @@ static int recv_with_timeout(amqp_connection_state_t state, uint64_t start, stru
 
   state->sock_inbound_limit = res;
   state->sock_inbound_offset = 0;
+  AMQP_STAT_ADD(state, bytes_in, res);
 
   if (amqp_heartbeat_enabled(state)) {
-    uint64_t current_time = amqp_get_monotonic_timestamp();
+    uint64_t current_time = amqp_clock_refresh(state);
     if (0 == current_time) {
       return AMQP_STATUS_TIMER_FAILURE;
     }
@@ -673,6 +751,11 @@ int amqp_try_recv(amqp_connection_state_t state, uint64_t current_time)
       return res;
     }
 
+    amqp_ack_batch_handle_frame(state, &frame);
+    if (amqp_confirm_handle_frame(state, &frame)) {
+      continue;
+    }
+
     if (frame.frame_type != 0) {
       amqp_pool_t *channel_pool;
       amqp_frame_t *frame_copy;
@@ -701,6 +784,7 @@ int amqp_try_recv(amqp_connection_state_t state, uint64_t current_time)
         state->last_queued_frame->next = link;
       }
       state->last_queued_frame = link;
+      AMQP_STAT_QUEUED(state);
     }
   }
 
@@ -711,15 +795,26 @@ int amqp_try_recv(amqp_connection_state_t state, uint64_t current_time)
   return recv_with_timeout(state, current_time, &tv);
 }
 
+/*
+ * Frames the library consumes itself (heartbeats, publisher confirms) are
+ * never returned. If return_on_internal is set, wait_frame_inner returns
+ * AMQP_STATUS_OK with decoded_frame->frame_type == 0 after consuming a
+ * publisher confirm so the caller can re-check its condition.
+ */
 static int wait_frame_inner(amqp_connection_state_t state,
                             amqp_frame_t *decoded_frame,
-                            struct timeval *timeout)
+                            struct timeval *timeout,
+                            amqp_boolean_t return_on_internal)
 {
   uint64_t current_timestamp = 0;
   uint64_t timeout_timestamp = 0;
   uint64_t next_timestamp = 0;
   struct timeval tv;
   struct timeval *tvp = NULL;
+  /* recv_with_timeout() reads the clock after each recv when heartbeats
+   * are enabled, so only the first pass and a wakeup without data read it
+   * here */
+  amqp_boolean_t clock_fresh = 0;
 
   if (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0)) {
     return AMQP_STATUS_INVALID_PARAMETER;
@@ -737,7 +832,16 @@ static int wait_frame_inner(amqp_connection_state_t state,
 
       if (AMQP_FRAME_HEARTBEAT == decoded_frame->frame_type) {
         amqp_maybe_release_buffers_on_channel(state, 0);
-        RABBIT_INFO("received heartbeat on connection: 0x%08X", state);
+        AMQP_TRACE(state, HEARTBEAT_IN, 0, 0, 0, 0);
+        continue;
+      }
+
+      amqp_ack_batch_handle_frame(state, decoded_frame);
+      if (amqp_confirm_handle_frame(state, decoded_frame)) {
+        if (return_on_internal) {
+          decoded_frame->frame_type = 0;
+          return AMQP_STATUS_OK;
+        }
         continue;
       }
 
@@ -751,7 +855,8 @@ beginrecv:
     if (timeout || amqp_heartbeat_enabled(state)) {
       uint64_t ns_until_next_timeout;
 
-      current_timestamp = amqp_get_monotonic_timestamp();
+      current_timestamp = (clock_fresh ? amqp_clock_now(state)
+                                       : amqp_clock_refresh(state));
       if (0 == current_timestamp) {
         return AMQP_STATUS_TIMER_FAILURE;
       }
@@ -761,17 +866,14 @@ beginrecv:
         heartbeat.channel = 0;
         heartbeat.frame_type = AMQP_FRAME_HEARTBEAT;
 
-        RABBIT_INFO("send a heartbeat from connection: 0x%08X", state);
         res = amqp_send_frame(state, &heartbeat);
+        AMQP_TRACE(state, HEARTBEAT_OUT, res, 0, 0, 0);
         if (AMQP_STATUS_OK != res) {
           return res;
         }
-        RABBIT_INFO("sent a heartbeat from connection: 0x%08X", state);
 
-        current_timestamp = amqp_get_monotonic_timestamp();
-        if (0 == current_timestamp) {
-          return AMQP_STATUS_TIMER_FAILURE;
-        }
+        /* the write refreshed the clock */
+        current_timestamp = amqp_clock_now(state);
       }
 
       if (timeout) {
@@ -813,7 +915,23 @@ beginrecv:
       tvp = &tv;
     }
 
+    /* never block on the socket while batched acks or our own frames sit
+     * in the write buffer, the peer may be waiting on them */
+    if (NULL != state->ack_batches) {
+      res = amqp_ack_batch_flush_all(state);
+      if (AMQP_STATUS_OK != res) {
+        return res;
+      }
+    }
+    if (amqp_write_pending(state)) {
+      res = amqp_flush(state);
+      if (AMQP_STATUS_OK != res) {
+        return res;
+      }
+    }
+
     res = recv_with_timeout(state, current_timestamp, tvp);
+    clock_fresh = (AMQP_STATUS_OK == res && amqp_heartbeat_enabled(state));
 
     if (AMQP_STATUS_TIMEOUT == res) {
       if (next_timestamp == state->next_recv_heartbeat) {
@@ -872,10 +990,22 @@ int amqp_queue_frame(amqp_connection_state_t state, amqp_frame_t *frame)
 
   link->next = NULL;
   state->last_queued_frame = link;
+  AMQP_STAT_QUEUED(state);
 
   return AMQP_STATUS_OK;
 }
 
+int amqp_pump_frame(amqp_connection_state_t state, struct timeval *timeout)
+{
+  amqp_frame_t frame;
+  int res = wait_frame_inner(state, &frame, timeout, 1);
+
+  if (AMQP_STATUS_OK != res || 0 == frame.frame_type) {
+    return res;
+  }
+  return amqp_queue_frame(state, &frame);
+}
+
 int amqp_put_back_frame(amqp_connection_state_t state, amqp_frame_t *frame)
 {
   amqp_link_t *link = amqp_create_link_for_frame(state, frame);
@@ -891,6 +1021,7 @@ int amqp_put_back_frame(amqp_connection_state_t state, amqp_frame_t *frame)
     link->next = state->first_queued_frame;
     state->first_queued_frame = link;
   }
+  AMQP_STAT_QUEUED(state);
 
   return AMQP_STATUS_OK;
 }
@@ -911,6 +1042,7 @@ int amqp_simple_wait_frame_on_channel(amqp_connection_state_t state,
       if (NULL == state->first_queued_frame) {
         state->last_queued_frame = NULL;
       }
+      AMQP_STAT_DEQUEUED(state);
 
       *decoded_frame = *frame_ptr;
 
@@ -919,7 +1051,7 @@ int amqp_simple_wait_frame_on_channel(amqp_connection_state_t state,
   }
 
   while (1) {
-    res = wait_frame_inner(state, decoded_frame, NULL);
+    res = wait_frame_inner(state, decoded_frame, NULL, 0);
 
     if (AMQP_STATUS_OK != res) {
       return res;
@@ -952,10 +1084,11 @@ int amqp_simple_wait_frame_noblock(amqp_connection_state_t state,
     if (state->first_queued_frame == NULL) {
       state->last_queued_frame = NULL;
     }
+    AMQP_STAT_DEQUEUED(state);
     *decoded_frame = *f;
     return AMQP_STATUS_OK;
   } else {
-    return wait_frame_inner(state, decoded_frame, timeout);
+    return wait_frame_inner(state, decoded_frame, timeout, 0);
   }
 }
 
@@ -1017,6 +1150,9 @@ amqp_rpc_reply_t amqp_simple_rpc(amqp_connection_state_t state,
   memset(&result, 0, sizeof(result));
 
   status = amqp_send_method(state, channel, request_id, decoded_request_method);
+  if (status == AMQP_STATUS_OK) {
+    status = amqp_flush(state);
+  }
   if (status < 0) {
     result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
     result.library_error = status;
@@ -1025,9 +1161,10 @@ amqp_rpc_reply_t amqp_simple_rpc(amqp_connection_state_t state,
 
   {
     amqp_frame_t frame;
+    uint64_t wait_start = AMQP_HIST_NOW();
 
 retry:
-    status = wait_frame_inner(state, &frame, NULL);
+    status = wait_frame_inner(state, &frame, NULL, 0);
     if (status < 0) {
       result.reply_type = AMQP_RESPONSE_LIBRARY_EXCEPTION;
       result.library_error = status;
@@ -1083,10 +1220,12 @@ retry:
         state->last_queued_frame->next = link;
       }
       state->last_queued_frame = link;
+      AMQP_STAT_QUEUED(state);
 
       goto retry;
     }
 
+    AMQP_HIST_SINCE(state, AMQP_HISTOGRAM_RPC_WAIT, wait_start);
     result.reply_type = (amqp_id_in_reply_list(frame.payload.method.id, expected_reply_ids))
                         ? AMQP_RESPONSE_NORMAL
                         : AMQP_RESPONSE_SERVER_EXCEPTION;
@@ -1159,9 +1298,8 @@ static amqp_rpc_reply_t amqp_login_inner(amqp_connection_state_t state,
   uint16_t server_heartbeat;
   amqp_rpc_reply_t result;
 
-  RABBIT_INFO("amqp_send_header(%08x)", (int)state);
   res = amqp_send_header(state);
-  RABBIT_INFO("amqp_send_header(%08x) res=%d", (int)state, res);
+  AMQP_TRACE(state, SEND_HEADER, res, 0, 0, 0);
   if (AMQP_STATUS_OK != res) {
     goto error_res;
   }
@@ -29,6 +29,7 @@
 #define AMQP_SOCKET_H
 
 #include "amqp.h"
+#include "amqp_timer.h"
 
 #ifdef _WIN32
 # include <WinSock2.h>
@@ -50,6 +51,7 @@ typedef int (*amqp_socket_open_fn)(void *, const char *, int, struct timeval *);
 typedef int (*amqp_socket_close_fn)(void *);
 typedef int (*amqp_socket_get_sockfd_fn)(void *);
 typedef void (*amqp_socket_delete_fn)(void *);
+typedef int (*amqp_socket_wait_fn)(void *, struct timeval *);
 
 /** V-table for amqp_socket_t */
 struct amqp_socket_class_t {
@@ -60,6 +62,9 @@ struct amqp_socket_class_t {
   amqp_socket_close_fn       close_sockfn;
   amqp_socket_get_sockfd_fn  get_fd_sockfn;
   amqp_socket_delete_fn      delete_sockfn;
+  /* Optional: waits until recv will not block, for sockets without a
+   * descriptor select() can use. NULL means select() on get_sockfd. */
+  amqp_socket_wait_fn        wait_sockfn;
 };
 
 /** Abstract base class for amqp_socket_t */
@@ -125,6 +130,37 @@ amqp_socket_writev(amqp_socket_t *self, struct iovec *iov, int iovcnt);
 ssize_t
 amqp_socket_send(amqp_socket_t *self, const void *buf, size_t len);
 
+/* The largest plaintext a single TLS record carries (RFC 5246 6.2.1) */
+#define AMQP_TLS_RECORD_SIZE 16384
+
+/* Writes one TLS record of at most AMQP_TLS_RECORD_SIZE bytes in full.
+ * more is non-zero when further records of the same write follow; it is a
+ * hint that backends which cannot pass MSG_MORE to the socket ignore. */
+typedef ssize_t (*amqp_tls_record_fn)(void *, const void *, size_t, int);
+
+/**
+ * Write vectors to a TLS session one record at a time.
+ *
+ * The vectors are packed into chunks of AMQP_TLS_RECORD_SIZE bytes and each
+ * chunk is handed to write_record, so a frame's header, payload and footer
+ * share one record instead of the message being copied whole or split into
+ * a record per vector. Spans of a vector that fill a record are written in
+ * place; only the bytes that straddle vectors are copied into
+ * record_buffer.
+ *
+ * \param [in,out] self The SSL socket object, passed to write_record.
+ * \param [in] iov One or more data vectors.
+ * \param [in] iovcnt The number of vectors in \e iov.
+ * \param [in] record_buffer AMQP_TLS_RECORD_SIZE bytes of scratch space.
+ * \param [in] write_record Writes one record.
+ *
+ * \return AMQP_STATUS_OK on success, the first error of write_record
+ *          otherwise.
+ */
+ssize_t
+amqp_tls_gather_writev(void *self, const struct iovec *iov, int iovcnt,
+                       char *record_buffer, amqp_tls_record_fn write_record);
+
 /**
  * Receive a message from a socket.
  *
@@ -179,6 +215,50 @@ amqp_socket_delete(amqp_socket_t *self);
 int
 amqp_open_socket_noblock(char const *hostname, int portnumber, struct timeval *timeout);
 
+/**
+ * Open a socket connection for a handshake to continue on.
+ *
+ * Like amqp_open_socket_noblock(), except that when deadline is given the
+ * connection attempt runs against it (it must have been initialized with
+ * AMQP_INIT_TIMER and timeout must be set) and the socket is returned in
+ * non-blocking mode, so a TLS handshake can be driven to completion under
+ * the same deadline with amqp_socket_wait_fd() before
+ * amqp_socket_set_blocking() restores blocking mode.
+ *
+ * \param [in] hostname Connect to this host.
+ * \param [in] portnumber Connect on this remote port.
+ * \param [in] timeout Max allowed time for connecting and the handshake.
+ * \param [in,out] deadline The timer tracking timeout, or NULL.
+ *
+ * \return File descriptor upon success, non-zero negative error code otherwise.
+ */
+int
+amqp_open_socket_inner(char const *hostname, int portnumber,
+                       struct timeval *timeout, amqp_timer_t *deadline);
+
+/**
+ * Wait until a socket is readable or writable, or the deadline passes.
+ *
+ * \param [in] sockfd The socket to wait on.
+ * \param [in] for_write Wait for writability rather than readability.
+ * \param [in,out] deadline The timer tracking timeout.
+ * \param [in] timeout The overall timeout deadline was started with.
+ *
+ * \return AMQP_STATUS_OK when the socket is ready, AMQP_STATUS_TIMEOUT once
+ *         the deadline has passed, another amqp_status_enum value on error.
+ */
+int
+amqp_socket_wait_fd(int sockfd, amqp_boolean_t for_write,
+                    amqp_timer_t *deadline, struct timeval *timeout);
+
+/**
+ * Switch a socket between blocking and non-blocking mode.
+ *
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_SOCKET_ERROR otherwise.
+ */
+int
+amqp_socket_set_blocking(int sockfd, amqp_boolean_t block);
+
 int
 amqp_queue_frame(amqp_connection_state_t state, amqp_frame_t *frame);
 
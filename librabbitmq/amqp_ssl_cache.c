@@ -0,0 +1,175 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_ssl_cache.h"
+#include "amqp_os.h"
+#include "amqp_private.h"
+#include "amqp_timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef AMQP_OS_THREADS
+#define CACHE_LOCK(cache) amqp_os_mutex_lock(&(cache)->mutex)
+#define CACHE_UNLOCK(cache) amqp_os_mutex_unlock(&(cache)->mutex)
+#else
+#define CACHE_LOCK(cache) ((void)0)
+#define CACHE_UNLOCK(cache) ((void)0)
+#endif
+
+struct amqp_ssl_session_entry_t {
+  char *key;                      /* "host:port", NULL if the slot is free */
+  void *session;
+  amqp_ssl_session_free_fn free_session;
+  uint64_t expires;
+};
+
+struct amqp_ssl_session_cache_t_ {
+#ifdef AMQP_OS_THREADS
+  amqp_os_mutex_t mutex;
+#endif
+  uint64_t ttl;
+  size_t size;
+  struct amqp_ssl_session_entry_t *entries;
+};
+
+static void release_entry(struct amqp_ssl_session_entry_t *entry)
+{
+  if (entry->free_session) {
+    entry->free_session(entry->session);
+  }
+  free(entry->key);
+  memset(entry, 0, sizeof(*entry));
+}
+
+static char *make_key(const char *host, int port)
+{
+  size_t len = strlen(host) + 8;
+  char *key = malloc(len);
+  if (key) {
+    snprintf(key, len, "%s:%d", host, port);
+  }
+  return key;
+}
+
+amqp_ssl_session_cache_t *
+amqp_ssl_session_cache_new(size_t max_entries, unsigned int ttl_seconds)
+{
+  amqp_ssl_session_cache_t *cache;
+
+  if (0 == max_entries || 0 == ttl_seconds) {
+    return NULL;
+  }
+  cache = calloc(1, sizeof(*cache));
+  if (!cache) {
+    return NULL;
+  }
+  cache->entries = calloc(max_entries, sizeof(*cache->entries));
+  if (!cache->entries) {
+    free(cache);
+    return NULL;
+  }
+#ifdef AMQP_OS_THREADS
+  if (amqp_os_mutex_init(&cache->mutex)) {
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+#endif
+  cache->ttl = (uint64_t)ttl_seconds * AMQP_NS_PER_S;
+  cache->size = max_entries;
+  return cache;
+}
+
+void
+amqp_ssl_session_cache_free(amqp_ssl_session_cache_t *cache)
+{
+  size_t i;
+
+  if (!cache) {
+    return;
+  }
+  for (i = 0; i < cache->size; ++i) {
+    if (cache->entries[i].key) {
+      release_entry(&cache->entries[i]);
+    }
+  }
+#ifdef AMQP_OS_THREADS
+  amqp_os_mutex_destroy(&cache->mutex);
+#endif
+  free(cache->entries);
+  free(cache);
+}
+
+int
+amqp_ssl_session_cache_get(amqp_ssl_session_cache_t *cache, const char *host,
+                           int port, amqp_ssl_session_use_fn use, void *arg)
+{
+  char *key = make_key(host, port);
+  uint64_t now = amqp_get_monotonic_timestamp();
+  int found = 0;
+  size_t i;
+
+  if (!key) {
+    return 0;
+  }
+  CACHE_LOCK(cache);
+  for (i = 0; i < cache->size; ++i) {
+    struct amqp_ssl_session_entry_t *entry = &cache->entries[i];
+    if (entry->key && 0 == strcmp(entry->key, key)) {
+      if (now < entry->expires) {
+        use(entry->session, arg);
+        found = 1;
+      } else {
+        release_entry(entry);
+      }
+      break;
+    }
+  }
+  CACHE_UNLOCK(cache);
+  free(key);
+  return found;
+}
+
+void
+amqp_ssl_session_cache_put(amqp_ssl_session_cache_t *cache, const char *host,
+                           int port, void *session,
+                           amqp_ssl_session_free_fn free_session)
+{
+  char *key = make_key(host, port);
+  struct amqp_ssl_session_entry_t *slot = NULL;
+  size_t i;
+
+  if (!key) {
+    if (free_session) {
+      free_session(session);
+    }
+    return;
+  }
+  CACHE_LOCK(cache);
+  for (i = 0; i < cache->size; ++i) {
+    struct amqp_ssl_session_entry_t *entry = &cache->entries[i];
+    if (!entry->key) {
+      if (!slot || slot->key) {
+        slot = entry;
+      }
+    } else if (0 == strcmp(entry->key, key)) {
+      slot = entry;
+      break;
+    } else if (!slot || (slot->key && entry->expires < slot->expires)) {
+      slot = entry;
+    }
+  }
+  if (slot->key) {
+    release_entry(slot);
+  }
+  slot->key = key;
+  slot->session = session;
+  slot->free_session = free_session;
+  slot->expires = amqp_get_monotonic_timestamp() + cache->ttl;
+  CACHE_UNLOCK(cache);
+}
@@ -0,0 +1,53 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * Copyright 2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#ifndef AMQP_SSL_CACHE_H
+#define AMQP_SSL_CACHE_H
+
+/*
+ * Backend-neutral storage behind amqp_ssl_session_cache_t.
+ *
+ * Entries are keyed by host and port and hold an opaque session owned by
+ * the cache; free_session releases it when the entry is replaced, expires
+ * or the cache is freed (NULL if the backend owns the session itself).
+ */
+
+#include "amqp_ssl_socket.h"
+
+typedef void (*amqp_ssl_session_free_fn)(void *session);
+typedef void (*amqp_ssl_session_use_fn)(void *session, void *arg);
+
+/* Calls use(session, arg) with the cache locked if an unexpired session for
+ * host:port is cached, so the backend can take its own reference before the
+ * entry can be replaced. Returns 1 if a session was found, 0 otherwise. */
+int
+amqp_ssl_session_cache_get(amqp_ssl_session_cache_t *cache, const char *host,
+                           int port, amqp_ssl_session_use_fn use, void *arg);
+
+/* Stores session for host:port, taking ownership of it, replacing any
+ * session already cached for it or else the entry closest to expiring. */
+void
+amqp_ssl_session_cache_put(amqp_ssl_session_cache_t *cache, const char *host,
+                           int port, void *session,
+                           amqp_ssl_session_free_fn free_session);
+
+#endif /* AMQP_SSL_CACHE_H */
@@ -173,6 +173,260 @@ AMQP_CALL
 amqp_ssl_socket_set_verify(amqp_socket_t *self,
                            amqp_boolean_t verify);
 
+/**
+ * Enable or disable kernel TLS offload.
+ *
+ * When enabled, the socket asks OpenSSL to hand the session keys to the
+ * kernel after the handshake (SSL_OP_ENABLE_KTLS). If the kernel accepts
+ * them, frames are written as plaintext with a single gathering sendmsg()
+ * and the kernel builds and encrypts the TLS records. If the kernel, the
+ * OpenSSL build or the negotiated cipher doesn't support it, the socket
+ * silently keeps encrypting in userspace; use amqp_ssl_socket_get_ktls()
+ * after opening to find out which happened.
+ *
+ * Must be called before the socket is opened. Disabled by default.
+ *
+ * \param [in,out] self An SSL/TLS socket object.
+ * \param [in] enable Enable or disable kernel TLS offload.
+ *
+ * \return AMQP_STATUS_OK on success, AMQP_STATUS_UNSUPPORTED if enable is
+ *         set and the SSL library has no kernel TLS support.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_socket_set_ktls(amqp_socket_t *self,
+                         amqp_boolean_t enable);
+
+/**
+ * Whether an open socket's sends are offloaded to kernel TLS.
+ *
+ * \param [in] self An SSL/TLS socket object.
+ *
+ * \return Non-zero if the kernel is encrypting the socket's writes.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_boolean_t
+AMQP_CALL
+amqp_ssl_socket_get_ktls(amqp_socket_t *self);
+
+/**
+ * A cache of TLS sessions for resuming handshakes, keyed by host and port.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_ssl_session_cache_t_ amqp_ssl_session_cache_t;
+
+/**
+ * Create a TLS session cache.
+ *
+ * Sockets given the cache with amqp_ssl_socket_set_session_cache() store
+ * the session the broker issues them and offer it again the next time a
+ * socket opens a connection to the same host and port, so reconnecting
+ * after a failover takes an abbreviated handshake instead of a full key
+ * exchange. Sessions older than ttl_seconds are not offered; when the
+ * cache is full the session closest to expiring is replaced. The broker
+ * may still decline a session, in which case the handshake is a full one.
+ *
+ * The cache may be shared by sockets of connections on different threads
+ * when the library is built with its OS threading layer.
+ *
+ * \param [in] max_entries The number of host and port pairs to remember.
+ * \param [in] ttl_seconds How long a session may be offered for.
+ *
+ * \return A new cache, or NULL if either argument is 0 or on allocation
+ *         failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_ssl_session_cache_t *
+AMQP_CALL
+amqp_ssl_session_cache_new(size_t max_entries, unsigned int ttl_seconds);
+
+/**
+ * Free a TLS session cache and the sessions it holds.
+ *
+ * No socket may be using the cache any more.
+ *
+ * \param [in] cache The cache to free, may be NULL.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL
+amqp_ssl_session_cache_free(amqp_ssl_session_cache_t *cache);
+
+/**
+ * Resume TLS sessions from a cache.
+ *
+ * Must be called before the socket is opened. The cache must outlive the
+ * socket. With ENABLE_CONNECTION_STATS the connection counts resumed and
+ * full handshakes in tls_session_hits and tls_session_misses.
+ *
+ * The CyaSSL backend does not resume sessions; there this does nothing.
+ *
+ * \param [in,out] self An SSL/TLS socket object.
+ * \param [in] cache The cache to use, or NULL to stop using one.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL
+amqp_ssl_socket_set_session_cache(amqp_socket_t *self,
+                                  amqp_ssl_session_cache_t *cache);
+
+/**
+ * A TLS client configuration shared by many sockets.
+ *
+ * \since v0.6.0
+ */
+typedef struct amqp_ssl_context_t_ amqp_ssl_context_t;
+
+/**
+ * Create a TLS context.
+ *
+ * Each amqp_ssl_socket_new() socket builds its own context and parses its
+ * certificates again; an application opening many connections to the same
+ * brokers can instead load the CA certificates and client key once into a
+ * context and create the sockets with amqp_ssl_socket_new_with_context().
+ *
+ * Once the first socket has been created from it the context is
+ * immutable: the amqp_ssl_context_set_*() functions, and the certificate
+ * and key setters of the sockets using it, fail with
+ * AMQP_STATUS_INVALID_PARAMETER. The context is reference counted and may
+ * be shared by sockets of connections on different threads.
+ *
+ * \return A new context, or NULL on failure or if the SSL backend does not
+ *         support shared contexts.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_ssl_context_t *
+AMQP_CALL
+amqp_ssl_context_new(void);
+
+/**
+ * Release the caller's reference to a TLS context.
+ *
+ * The context is freed when the last socket created from it has been
+ * deleted too.
+ *
+ * \param [in] context The context to release, may be NULL.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+void
+AMQP_CALL
+amqp_ssl_context_free(amqp_ssl_context_t *context);
+
+/**
+ * Create a new SSL/TLS socket object using a shared context.
+ *
+ * Behaves like amqp_ssl_socket_new() except that the certificates and keys
+ * come from context, which the socket keeps a reference to. Peer
+ * verification, the session cache and kernel TLS remain per socket
+ * settings.
+ *
+ * \param [in,out] state The connection object that owns the SSL/TLS socket
+ * \param [in] context A context from amqp_ssl_context_new().
+ * \return A new socket object or NULL if an error occurred or context is
+ *         NULL.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+amqp_socket_t *
+AMQP_CALL
+amqp_ssl_socket_new_with_context(amqp_connection_state_t state,
+                                 amqp_ssl_context_t *context);
+
+#if defined(CONFIG_RABBITMQ_USE_CYASSL_BUFFER) && CONFIG_RABBITMQ_USE_CYASSL_BUFFER
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_context_set_cacert_buffer(amqp_ssl_context_t *context,
+                                   const char *cacert,
+                                   size_t certSize,
+                                   int type);
+#endif
+
+#if !defined(NO_FILESYSTEM) && !defined(NO_CERTS)
+/**
+ * Set a TLS context's CA certificate, see amqp_ssl_socket_set_cacert().
+ *
+ * \param [in,out] context A TLS context no socket uses yet.
+ * \param [in] cacert Path to the CA cert file in PEM format.
+ *
+ * \return \ref AMQP_STATUS_OK on success an \ref amqp_status_enum value on
+ *  failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_context_set_cacert(amqp_ssl_context_t *context,
+                            const char *cacert);
+
+/**
+ * Set a TLS context's client key, see amqp_ssl_socket_set_key().
+ *
+ * \param [in,out] context A TLS context no socket uses yet.
+ * \param [in] cert Path to the client certificate in PEM format.
+ * \param [in] key Path to the client key in PEM format.
+ *
+ * \return \ref AMQP_STATUS_OK on success an \ref amqp_status_enum value on
+ *  failure.
+ *
+ * \since v0.6.0
+ */
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_context_set_key(amqp_ssl_context_t *context,
+                         const char *cert,
+                         const char *key);
+#endif
+
+/**
+ * Set a TLS context's client key from a buffer, see
+ * amqp_ssl_socket_set_key_buffer().
+ *
+ * \since v0.6.0
+ */
+#if defined(CONFIG_RABBITMQ_USE_CYASSL_BUFFER) && CONFIG_RABBITMQ_USE_CYASSL_BUFFER
+
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_context_set_key_buffer(amqp_ssl_context_t *context,
+                                const char *cert,
+                                const size_t certSize,
+                                const char *key,
+                                const size_t keySize,
+                                const int keyType);
+
+#else
+
+AMQP_PUBLIC_FUNCTION
+int
+AMQP_CALL
+amqp_ssl_context_set_key_buffer(amqp_ssl_context_t *context,
+                                const char *cert,
+                                const void *key,
+                                size_t n);
+
+#endif
+
 /**
  * Sets whether rabbitmq-c initializes the underlying SSL library.
  *
@@ -0,0 +1,261 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+
+#ifdef ENABLE_CONNECTION_STATS
+
+static size_t pool_pages(const amqp_pool_t *pool)
+{
+  return (size_t)pool->pages.num_blocks + (size_t)pool->large_blocks.num_blocks;
+}
+
+int amqp_get_connection_stats(amqp_connection_state_t state,
+                              amqp_conn_stats_t *stats)
+{
+  amqp_link_t *link;
+  size_t queued = 0;
+  int i;
+
+  if (NULL == stats) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  /* the running counter only feeds the high-water mark, the queue itself
+   * is the authoritative depth */
+  for (link = state->first_queued_frame; NULL != link; link = link->next) {
+    queued++;
+  }
+  state->stats.queued_frames = queued;
+
+  state->stats.pool_pages = pool_pages(&state->properties_pool);
+  for (i = 0; i < POOL_TABLE_SIZE; ++i) {
+    amqp_pool_table_entry_t *entry = state->pool_table[i];
+    for ( ; NULL != entry; entry = entry->next) {
+      amqp_io_pool_t *io_pool;
+
+      state->stats.pool_pages += pool_pages(&entry->pool);
+      for (io_pool = entry->io_pools; NULL != io_pool;
+           io_pool = io_pool->next) {
+        state->stats.pool_pages += pool_pages(&io_pool->pool);
+      }
+    }
+  }
+
+  *stats = state->stats;
+  return AMQP_STATUS_OK;
+}
+
+#else
+
+int amqp_get_connection_stats(amqp_connection_state_t state,
+                              amqp_conn_stats_t *stats)
+{
+  (void)state;
+  (void)stats;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+#endif
+
+#ifdef ENABLE_LATENCY_HISTOGRAMS
+
+#define SUB_COUNT ((uint64_t)1 << AMQP_HISTOGRAM_SUB_BITS)
+
+static int highest_bit(uint64_t value)
+{
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(value);
+#else
+  int bit = 0;
+  while (value >>= 1) {
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+/* Values below SUB_COUNT get a bucket each; above that, the bits below the
+ * top AMQP_HISTOGRAM_SUB_BITS + 1 are dropped, so every power of two is
+ * split into SUB_COUNT equal buckets. */
+static size_t bucket_index(uint64_t value)
+{
+  int shift;
+
+  if (value < SUB_COUNT) {
+    return (size_t)value;
+  }
+  if (highest_bit(value) >= AMQP_HISTOGRAM_MAX_BITS) {
+    return AMQP_HISTOGRAM_BUCKETS - 1;
+  }
+  shift = highest_bit(value) - AMQP_HISTOGRAM_SUB_BITS;
+  return (size_t)(((uint64_t)(shift + 1) << AMQP_HISTOGRAM_SUB_BITS) +
+                  ((value >> shift) - SUB_COUNT));
+}
+
+static uint64_t bucket_lower(size_t index)
+{
+  int shift;
+
+  if (index < SUB_COUNT) {
+    return index;
+  }
+  shift = (int)(index >> AMQP_HISTOGRAM_SUB_BITS) - 1;
+  return (SUB_COUNT + (index & (SUB_COUNT - 1))) << shift;
+}
+
+static uint64_t bucket_upper(size_t index)
+{
+  if (AMQP_HISTOGRAM_BUCKETS - 1 == index) {
+    return UINT64_MAX;
+  }
+  return bucket_lower(index + 1) - 1;
+}
+
+void amqp_histogram_record(amqp_connection_state_t state,
+                           amqp_histogram_enum which, uint64_t value)
+{
+  amqp_histogram_data_t *h = &state->histograms[which];
+
+  if (0 == h->count || value < h->min) {
+    h->min = value;
+  }
+  if (value > h->max) {
+    h->max = value;
+  }
+  h->count++;
+  h->sum += value;
+  h->buckets[bucket_index(value)]++;
+}
+
+void amqp_histogram_record_since(amqp_connection_state_t state,
+                                 amqp_histogram_enum which, uint64_t start)
+{
+  uint64_t now = amqp_get_monotonic_timestamp();
+
+  /* a failed timestamp is 0, drop the sample rather than record garbage */
+  if (0 != start && 0 != now) {
+    amqp_histogram_record(state, which, now - start);
+  }
+}
+
+static uint64_t percentile(const amqp_histogram_data_t *h,
+                           uint64_t per_thousand)
+{
+  /* rank of the sample the percentile falls on, rounded up */
+  uint64_t rank = (h->count * per_thousand + 999) / 1000;
+  uint64_t seen = 0;
+  size_t i;
+
+  for (i = 0; i < AMQP_HISTOGRAM_BUCKETS; ++i) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper(i);
+      return upper < h->max ? upper : h->max;
+    }
+  }
+  return h->max;
+}
+
+int amqp_get_histogram(amqp_connection_state_t state,
+                       amqp_histogram_enum which,
+                       amqp_histogram_t *summary,
+                       amqp_histogram_bucket_t *buckets,
+                       size_t *bucket_count,
+                       amqp_boolean_t reset)
+{
+  amqp_histogram_data_t *h;
+
+  if ((int)which < 0 || which >= AMQP_HISTOGRAM_COUNT ||
+      (NULL != buckets && NULL == bucket_count)) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  h = &state->histograms[which];
+
+  if (NULL != summary) {
+    memset(summary, 0, sizeof(amqp_histogram_t));
+    if (h->count > 0) {
+      summary->count = h->count;
+      summary->min_ns = h->min;
+      summary->max_ns = h->max;
+      summary->sum_ns = h->sum;
+      summary->p50_ns = percentile(h, 500);
+      summary->p90_ns = percentile(h, 900);
+      summary->p99_ns = percentile(h, 990);
+      summary->p999_ns = percentile(h, 999);
+    }
+  }
+
+  if (NULL != bucket_count) {
+    size_t capacity = (NULL == buckets) ? 0 : *bucket_count;
+    size_t used = 0;
+    size_t i;
+
+    for (i = 0; i < AMQP_HISTOGRAM_BUCKETS; ++i) {
+      if (0 == h->buckets[i]) {
+        continue;
+      }
+      if (used < capacity) {
+        buckets[used].lower_ns = bucket_lower(i);
+        buckets[used].upper_ns = bucket_upper(i);
+        buckets[used].count = h->buckets[i];
+      }
+      used++;
+    }
+    *bucket_count = used;
+  }
+
+  if (reset) {
+    memset(h, 0, sizeof(amqp_histogram_data_t));
+  }
+  return AMQP_STATUS_OK;
+}
+
+#else
+
+int amqp_get_histogram(amqp_connection_state_t state,
+                       amqp_histogram_enum which,
+                       amqp_histogram_t *summary,
+                       amqp_histogram_bucket_t *buckets,
+                       size_t *bucket_count,
+                       amqp_boolean_t reset)
+{
+  (void)state;
+  (void)which;
+  (void)summary;
+  (void)buckets;
+  (void)bucket_count;
+  (void)reset;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+#endif
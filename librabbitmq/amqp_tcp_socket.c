@@ -42,8 +42,20 @@ struct amqp_tcp_socket_t {
   void *buffer;
   size_t buffer_length;
   int internal_error;
+#ifdef ENABLE_CONNECTION_STATS
+  amqp_conn_stats_t *stats;
+#endif
+#ifdef AMQP_TRACE_RING
+  amqp_trace_ring_t *trace;
+#endif
 };
 
+#ifdef ENABLE_CONNECTION_STATS
+#define TCP_STAT_INC(self, field) ((self)->stats->field++)
+#else
+#define TCP_STAT_INC(self, field) ((void)0)
+#endif
+
 
 static ssize_t
 amqp_tcp_socket_send_inner(void *base, const void *buf, size_t len, int flags)
@@ -59,12 +71,14 @@ amqp_tcp_socket_send_inner(void *base, const void *buf, size_t len, int flags)
 #endif
 
 start:
-  RABBIT_INFO("Calling send on: %d", self->sockfd);
+  AMQP_TRACE_TO(self->trace, TCP_SEND, self->sockfd, len_left, flags, 0);
+  TCP_STAT_INC(self, send_calls);
   res = send(self->sockfd, buf_left, len_left, flags);
 
   if (res < 0) {
     self->internal_error = amqp_os_socket_error();
     if (EINTR == self->internal_error) {
+      TCP_STAT_INC(self, eintr_retries);
       goto start;
     } else {
       res = AMQP_STATUS_SOCKET_ERROR;
@@ -74,6 +88,7 @@ start:
       self->internal_error = 0;
       res = AMQP_STATUS_OK;
     } else {
+      TCP_STAT_INC(self, partial_writes);
       buf_left += res;
       len_left -= res;
       goto start;
@@ -99,6 +114,7 @@ amqp_tcp_socket_writev(void *base, struct iovec *iov, int iovcnt)
   DWORD res;
   /* Making the assumption here that WSAsend won't do a partial send
    * unless an error occured, in which case we're hosed so it doesn't matter */
+  TCP_STAT_INC(self, writev_calls);
   if (WSASend(self->sockfd, (LPWSABUF)iov, iovcnt, &res, 0, NULL, NULL) == 0) {
     self->internal_error = 0;
     ret = AMQP_STATUS_OK;
@@ -134,11 +150,13 @@ exit:
   }
 
 start:
+  TCP_STAT_INC(self, writev_calls);
   ret = writev(self->sockfd, iov_left, iovcnt_left);
 
   if (ret < 0) {
     self->internal_error = amqp_os_socket_error();
     if (EINTR == self->internal_error) {
+      TCP_STAT_INC(self, eintr_retries);
       goto start;
     } else {
       self->internal_error = amqp_os_socket_error();
@@ -149,6 +167,7 @@ start:
       self->internal_error = 0;
       ret = AMQP_STATUS_OK;
     } else {
+      TCP_STAT_INC(self, partial_writes);
       len_left -= ret;
       for (i = 0; i < iovcnt_left; ++i) {
         if (ret < (ssize_t)iov_left[i].iov_len) {
@@ -208,12 +227,14 @@ amqp_tcp_socket_recv(void *base, void *buf, size_t len, int flags)
   ssize_t ret;
 
 start:
-  RABBIT_INFO("Calling recv on: %d", self->sockfd);
+  AMQP_TRACE_TO(self->trace, TCP_RECV, self->sockfd, len, 0, 0);
+  TCP_STAT_INC(self, recv_calls);
   ret = recv(self->sockfd, buf, len, flags);
 
   if (0 > ret) {
     self->internal_error = amqp_os_socket_error();
     if (EINTR == self->internal_error) {
+      TCP_STAT_INC(self, eintr_retries);
       goto start;
     } else {
       ret = AMQP_STATUS_SOCKET_ERROR;
@@ -266,7 +287,7 @@ amqp_tcp_socket_delete(void *base)
   struct amqp_tcp_socket_t *self = (struct amqp_tcp_socket_t *)base;
 
   if (self) {
-    RABBIT_INFO("socket delete on: %d", self->sockfd);
+    AMQP_TRACE_TO(self->trace, TCP_DELETE, self->sockfd, 0, 0, 0);
     amqp_tcp_socket_close(self);
     free(self->buffer);
     free(self);
@@ -280,7 +301,8 @@ static const struct amqp_socket_class_t amqp_tcp_socket_class = {
   amqp_tcp_socket_open, /* open */
   amqp_tcp_socket_close, /* close */
   amqp_tcp_socket_get_sockfd, /* get_sockfd */
-  amqp_tcp_socket_delete /* delete */
+  amqp_tcp_socket_delete, /* delete */
+  NULL /* wait */
 };
 
 amqp_socket_t *
@@ -292,6 +314,12 @@ amqp_tcp_socket_new(amqp_connection_state_t state)
   }
   self->klass = &amqp_tcp_socket_class;
   self->sockfd = -1;
+#ifdef ENABLE_CONNECTION_STATS
+  self->stats = &state->stats;
+#endif
+#ifdef AMQP_TRACE_RING
+  self->trace = &state->trace;
+#endif
 
   amqp_set_socket(state, (amqp_socket_t *)self);
 
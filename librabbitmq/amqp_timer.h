@@ -35,6 +35,7 @@
 #endif
 
 #define AMQP_NS_PER_S 1000000000
+#define AMQP_NS_PER_MS 1000000
 #define AMQP_NS_PER_US 1000
 
 #define AMQP_INIT_TIMER(structure) { \
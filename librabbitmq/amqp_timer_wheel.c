@@ -0,0 +1,511 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Deadlines are kept in ticks of the wheel's resolution, rounded up so a
+ * timer never fires early, across AMQP_WHEEL_LEVELS levels of 64 slots.
+ * Level 0 holds the next 64 ticks, one tick per slot; each slot of level n
+ * spans 64^n ticks. When the wheel's tick enters a new level n span, the
+ * slot for that span is cascaded into the levels below. Timers further out
+ * than the top level reaches are parked in it and cascaded again.
+ *
+ * A bitmap per level marks the non-empty slots, so the start of the
+ * earliest non-empty slot, which is the nearest deadline or a lower bound
+ * for it, takes one bit scan per level, and expiring jumps straight from
+ * one occupied slot to the next instead of stepping through empty ticks.
+ */
+
+#define AMQP_WHEEL_BITS 6
+#define AMQP_WHEEL_SLOTS (1 << AMQP_WHEEL_BITS)
+#define AMQP_WHEEL_MASK (AMQP_WHEEL_SLOTS - 1)
+#define AMQP_WHEEL_LEVELS 4
+/* the furthest a timer can be placed from the wheel's current tick */
+#define AMQP_WHEEL_RANGE ((uint64_t)1 << (AMQP_WHEEL_BITS * AMQP_WHEEL_LEVELS))
+
+#ifndef AMQP_TIMER_WHEEL_DEFAULT_TICK_MS
+#define AMQP_TIMER_WHEEL_DEFAULT_TICK_MS 1
+#endif
+
+typedef struct amqp_wheel_timer_t_ {
+  struct amqp_wheel_timer_t_ *next;
+  struct amqp_wheel_timer_t_ **pprev; /* NULL while not armed */
+  struct amqp_timer_entry_t_ *entry;
+  uint64_t expires;                   /* in ticks */
+  uint64_t deadline;                  /* as armed, in ns */
+  unsigned char level;
+  unsigned char slot;
+  unsigned char kind;
+} amqp_wheel_timer_t;
+
+/* one per registered connection, see amqp_timer_wheel_add() */
+struct amqp_timer_entry_t_ {
+  amqp_timer_wheel_t *wheel;
+  amqp_connection_state_t state;
+  struct amqp_timer_entry_t_ *next;
+  amqp_wheel_timer_t timers[AMQP_TIMER_KIND_COUNT];
+};
+
+struct amqp_timer_wheel_t_ {
+  uint64_t tick_ns;
+  uint64_t now_tick;   /* slots have been cascaded up to this tick */
+  amqp_clock_fn clock;
+  void *clock_arg;
+  amqp_timer_entry_t *entries;
+  uint64_t occupied[AMQP_WHEEL_LEVELS];
+  amqp_wheel_timer_t *slots[AMQP_WHEEL_LEVELS][AMQP_WHEEL_SLOTS];
+};
+
+static uint64_t wheel_clock(amqp_timer_wheel_t *wheel)
+{
+  return (NULL != wheel->clock ? wheel->clock(wheel->clock_arg)
+                               : amqp_get_monotonic_timestamp());
+}
+
+static unsigned int lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int)__builtin_ctzll(bits);
+#else
+  unsigned int n = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+static void link_timer(amqp_timer_wheel_t *wheel, amqp_wheel_timer_t *timer)
+{
+  uint64_t delta = (timer->expires > wheel->now_tick
+                    ? timer->expires - wheel->now_tick : 0);
+  uint64_t at;
+  unsigned int level = 0;
+  unsigned int slot;
+
+  if (delta >= AMQP_WHEEL_RANGE) {
+    delta = AMQP_WHEEL_RANGE - 1;
+  }
+  at = wheel->now_tick + delta;
+  while (level < AMQP_WHEEL_LEVELS - 1 &&
+         delta >= (uint64_t)1 << (AMQP_WHEEL_BITS * (level + 1))) {
+    ++level;
+  }
+  slot = (unsigned int)(at >> (AMQP_WHEEL_BITS * level)) & AMQP_WHEEL_MASK;
+
+  timer->level = (unsigned char)level;
+  timer->slot = (unsigned char)slot;
+  timer->next = wheel->slots[level][slot];
+  if (NULL != timer->next) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = &wheel->slots[level][slot];
+  wheel->slots[level][slot] = timer;
+  wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+static void unlink_timer(amqp_timer_wheel_t *wheel, amqp_wheel_timer_t *timer)
+{
+  *timer->pprev = timer->next;
+  if (NULL != timer->next) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->pprev = NULL;
+  if (NULL == wheel->slots[timer->level][timer->slot]) {
+    wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+  }
+}
+
+static void arm_timer(amqp_timer_wheel_t *wheel, amqp_wheel_timer_t *timer,
+                      uint64_t deadline)
+{
+  if (NULL != timer->pprev) {
+    if (timer->deadline == deadline) {
+      return;
+    }
+    unlink_timer(wheel, timer);
+  }
+  timer->deadline = deadline;
+  timer->expires = (deadline + wheel->tick_ns - 1) / wheel->tick_ns;
+  link_timer(wheel, timer);
+}
+
+static void disarm_timer(amqp_timer_wheel_t *wheel, amqp_wheel_timer_t *timer)
+{
+  if (NULL != timer->pprev) {
+    unlink_timer(wheel, timer);
+  }
+}
+
+/* The first tick of the earliest non-empty slot. For level 0 that is when
+ * its timers expire, for the levels above when they are cascaded. */
+static amqp_boolean_t next_tick(amqp_timer_wheel_t *wheel, uint64_t *tick)
+{
+  amqp_boolean_t found = 0;
+  unsigned int level;
+
+  for (level = 0; level < AMQP_WHEEL_LEVELS; ++level) {
+    uint64_t bits = wheel->occupied[level];
+    unsigned int shift = AMQP_WHEEL_BITS * level;
+    unsigned int index = (unsigned int)(wheel->now_tick >> shift) & AMQP_WHEEL_MASK;
+    uint64_t offset;
+    uint64_t start;
+
+    if (0 == bits) {
+      continue;
+    }
+    if (index) {
+      bits = (bits >> index) | (bits << (AMQP_WHEEL_SLOTS - index));
+    }
+    if (0 == level) {
+      offset = lowest_bit(bits);
+    } else {
+      /* the current span's slot was cascaded on entering it, a timer in it
+       * belongs to the same slot one revolution later */
+      offset = (bits >> 1) ? lowest_bit(bits >> 1) + 1 : AMQP_WHEEL_SLOTS;
+    }
+    start = ((wheel->now_tick >> shift) + offset) << shift;
+    if (!found || start < *tick) {
+      *tick = start;
+      found = 1;
+    }
+  }
+  return found;
+}
+
+static void cascade(amqp_timer_wheel_t *wheel)
+{
+  unsigned int level;
+
+  for (level = 1; level < AMQP_WHEEL_LEVELS; ++level) {
+    unsigned int index = (unsigned int)(wheel->now_tick >>
+                                        (AMQP_WHEEL_BITS * level)) & AMQP_WHEEL_MASK;
+    amqp_wheel_timer_t *timer = wheel->slots[level][index];
+
+    wheel->slots[level][index] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << index);
+    while (NULL != timer) {
+      amqp_wheel_timer_t *next = timer->next;
+      link_timer(wheel, timer);
+      timer = next;
+    }
+    if (index) {
+      break;
+    }
+  }
+}
+
+/* Only called with no non-empty slot starting before tick. */
+static void advance(amqp_timer_wheel_t *wheel, uint64_t tick)
+{
+  if (tick == wheel->now_tick) {
+    return;
+  }
+  wheel->now_tick = tick;
+  if (0 == (tick & AMQP_WHEEL_MASK)) {
+    cascade(wheel);
+  }
+}
+
+amqp_timer_wheel_t *amqp_timer_wheel_new(const struct timeval *resolution,
+                                         amqp_clock_fn clock, void *arg)
+{
+  amqp_timer_wheel_t *wheel;
+  uint64_t now;
+
+  if (resolution && (resolution->tv_sec < 0 || resolution->tv_usec < 0)) {
+    return NULL;
+  }
+  wheel = calloc(1, sizeof(*wheel));
+  if (NULL == wheel) {
+    return NULL;
+  }
+  if (resolution) {
+    wheel->tick_ns = (uint64_t)resolution->tv_sec * AMQP_NS_PER_S +
+                     (uint64_t)resolution->tv_usec * AMQP_NS_PER_US;
+  }
+  if (0 == wheel->tick_ns) {
+    wheel->tick_ns = (uint64_t)AMQP_TIMER_WHEEL_DEFAULT_TICK_MS * AMQP_NS_PER_MS;
+  }
+  wheel->clock = clock;
+  wheel->clock_arg = arg;
+
+  now = wheel_clock(wheel);
+  if (0 == now) {
+    free(wheel);
+    return NULL;
+  }
+  wheel->now_tick = now / wheel->tick_ns;
+  return wheel;
+}
+
+void amqp_timer_wheel_free(amqp_timer_wheel_t *wheel)
+{
+  if (NULL == wheel) {
+    return;
+  }
+  while (NULL != wheel->entries) {
+    amqp_timer_wheel_remove(wheel, wheel->entries->state);
+  }
+  free(wheel);
+}
+
+int amqp_timer_wheel_add(amqp_timer_wheel_t *wheel,
+                         amqp_connection_state_t state)
+{
+  amqp_timer_entry_t *entry;
+  int kind;
+
+  if (NULL != state->timer_entry) {
+    return (wheel == state->timer_entry->wheel ? AMQP_STATUS_OK
+                                               : AMQP_STATUS_INVALID_PARAMETER);
+  }
+  entry = calloc(1, sizeof(*entry));
+  if (NULL == entry) {
+    return AMQP_STATUS_NO_MEMORY;
+  }
+  entry->wheel = wheel;
+  entry->state = state;
+  for (kind = 0; kind < AMQP_TIMER_KIND_COUNT; ++kind) {
+    entry->timers[kind].entry = entry;
+    entry->timers[kind].kind = (unsigned char)kind;
+  }
+  entry->next = wheel->entries;
+  wheel->entries = entry;
+  state->timer_entry = entry;
+
+  return amqp_timer_wheel_update(wheel, state);
+}
+
+void amqp_timer_wheel_remove(amqp_timer_wheel_t *wheel,
+                             amqp_connection_state_t state)
+{
+  amqp_timer_entry_t *entry = state->timer_entry;
+  amqp_timer_entry_t **link;
+  int kind;
+
+  if (NULL == entry || wheel != entry->wheel) {
+    return;
+  }
+  for (kind = 0; kind < AMQP_TIMER_KIND_COUNT; ++kind) {
+    disarm_timer(wheel, &entry->timers[kind]);
+  }
+  for (link = &wheel->entries; *link != entry; link = &(*link)->next) {
+  }
+  *link = entry->next;
+  state->timer_entry = NULL;
+  free(entry);
+}
+
+void amqp_timer_entry_destroy(amqp_connection_state_t state)
+{
+  if (NULL != state->timer_entry) {
+    amqp_timer_wheel_remove(state->timer_entry->wheel, state);
+  }
+}
+
+int amqp_timer_wheel_update(amqp_timer_wheel_t *wheel,
+                            amqp_connection_state_t state)
+{
+  amqp_timer_entry_t *entry = state->timer_entry;
+  uint64_t flush;
+
+  if (NULL == entry || wheel != entry->wheel) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  if (amqp_heartbeat_enabled(state)) {
+    arm_timer(wheel, &entry->timers[AMQP_TIMER_SEND_HEARTBEAT],
+              state->next_send_heartbeat);
+    arm_timer(wheel, &entry->timers[AMQP_TIMER_RECV_HEARTBEAT],
+              state->next_recv_heartbeat);
+  } else {
+    disarm_timer(wheel, &entry->timers[AMQP_TIMER_SEND_HEARTBEAT]);
+    disarm_timer(wheel, &entry->timers[AMQP_TIMER_RECV_HEARTBEAT]);
+  }
+
+  flush = amqp_ack_batch_next_deadline(state);
+  if (amqp_write_pending(state) && state->write_flush_delay > 0 &&
+      (0 == flush || state->write_flush_deadline < flush)) {
+    flush = state->write_flush_deadline;
+  }
+  if (0 != flush) {
+    arm_timer(wheel, &entry->timers[AMQP_TIMER_ACK_FLUSH], flush);
+  } else {
+    disarm_timer(wheel, &entry->timers[AMQP_TIMER_ACK_FLUSH]);
+  }
+  return AMQP_STATUS_OK;
+}
+
+int amqp_timer_wheel_set_rpc_timeout(amqp_timer_wheel_t *wheel,
+                                     amqp_connection_state_t state,
+                                     const struct timeval *timeout)
+{
+  amqp_timer_entry_t *entry = state->timer_entry;
+  uint64_t now;
+
+  if (NULL == entry || wheel != entry->wheel ||
+      (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0))) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  if (NULL == timeout) {
+    disarm_timer(wheel, &entry->timers[AMQP_TIMER_RPC_TIMEOUT]);
+    return AMQP_STATUS_OK;
+  }
+  now = wheel_clock(wheel);
+  if (0 == now) {
+    return AMQP_STATUS_TIMER_FAILURE;
+  }
+  arm_timer(wheel, &entry->timers[AMQP_TIMER_RPC_TIMEOUT],
+            now + (uint64_t)timeout->tv_sec * AMQP_NS_PER_S +
+            (uint64_t)timeout->tv_usec * AMQP_NS_PER_US);
+  return AMQP_STATUS_OK;
+}
+
+struct timeval *amqp_timer_wheel_next(amqp_timer_wheel_t *wheel,
+                                      struct timeval *tv)
+{
+  uint64_t tick = 0;
+  uint64_t deadline;
+  uint64_t now;
+
+  if (!next_tick(wheel, &tick)) {
+    return NULL;
+  }
+  deadline = tick * wheel->tick_ns;
+  now = wheel_clock(wheel);
+
+  memset(tv, 0, sizeof(*tv));
+  if (0 != now && deadline > now) {
+    tv->tv_sec = (deadline - now) / AMQP_NS_PER_S;
+    tv->tv_usec = ((deadline - now) % AMQP_NS_PER_S + AMQP_NS_PER_US - 1) /
+                  AMQP_NS_PER_US;
+    if (tv->tv_usec >= 1000000) {
+      tv->tv_sec++;
+      tv->tv_usec -= 1000000;
+    }
+  }
+  return tv;
+}
+
+int amqp_timer_wheel_expire(amqp_timer_wheel_t *wheel,
+                            amqp_timer_event_t *events, int max_events)
+{
+  uint64_t now = wheel_clock(wheel);
+  uint64_t target;
+  int count = 0;
+
+  if (0 == now) {
+    return AMQP_STATUS_TIMER_FAILURE;
+  }
+  target = now / wheel->tick_ns;
+
+  while (wheel->now_tick <= target) {
+    amqp_wheel_timer_t **slot =
+        &wheel->slots[0][wheel->now_tick & AMQP_WHEEL_MASK];
+    uint64_t tick = 0;
+
+    while (NULL != *slot && count < max_events) {
+      amqp_wheel_timer_t *timer = *slot;
+      unlink_timer(wheel, timer);
+      events[count].state = timer->entry->state;
+      events[count].kind = (amqp_timer_kind_enum)timer->kind;
+      events[count].deadline = timer->deadline;
+      ++count;
+    }
+    if (NULL != *slot) {
+      /* out of room, the rest fire on the next call */
+      break;
+    }
+
+    if (!next_tick(wheel, &tick) || tick > target) {
+      advance(wheel, target);
+      break;
+    }
+    advance(wheel, tick);
+  }
+  return count;
+}
+
+int amqp_timer_wheel_handle(amqp_timer_wheel_t *wheel,
+                            const amqp_timer_event_t *event)
+{
+  amqp_connection_state_t state = event->state;
+  uint64_t now;
+  int res = AMQP_STATUS_OK;
+
+  switch (event->kind) {
+    case AMQP_TIMER_SEND_HEARTBEAT:
+      now = amqp_clock_refresh(state);
+      if (0 == now) {
+        return AMQP_STATUS_TIMER_FAILURE;
+      }
+      if (amqp_heartbeat_enabled(state) && now >= state->next_send_heartbeat) {
+        amqp_frame_t heartbeat;
+        heartbeat.channel = 0;
+        heartbeat.frame_type = AMQP_FRAME_HEARTBEAT;
+        res = amqp_send_frame(state, &heartbeat);
+        AMQP_TRACE(state, HEARTBEAT_OUT, res, 0, 0, 0);
+      }
+      break;
+    case AMQP_TIMER_RECV_HEARTBEAT:
+      now = amqp_clock_refresh(state);
+      if (0 == now) {
+        return AMQP_STATUS_TIMER_FAILURE;
+      }
+      if (amqp_heartbeat_enabled(state) && now > state->next_recv_heartbeat) {
+        amqp_socket_close(state->socket);
+        return AMQP_STATUS_HEARTBEAT_TIMEOUT;
+      }
+      break;
+    case AMQP_TIMER_RPC_TIMEOUT:
+      return AMQP_STATUS_TIMEOUT;
+    case AMQP_TIMER_ACK_FLUSH:
+      res = amqp_ack_batch_flush_all(state);
+      if (AMQP_STATUS_OK == res && amqp_write_pending(state)) {
+        res = amqp_flush(state);
+      }
+      break;
+    default:
+      return AMQP_STATUS_INVALID_PARAMETER;
+  }
+  if (AMQP_STATUS_OK != res) {
+    return res;
+  }
+  return amqp_timer_wheel_update(wheel, state);
+}
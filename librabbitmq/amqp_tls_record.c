@@ -0,0 +1,93 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include "amqp_socket.h"
+
+#include <string.h>
+
+/* Shared by the TLS backends and kept apart from amqp_socket.c so that the
+ * record packing can be tested without a TLS library. */
+
+ssize_t
+amqp_tls_gather_writev(void *self, const struct iovec *iov, int iovcnt,
+                       char *record_buffer, amqp_tls_record_fn write_record)
+{
+  size_t remaining = 0;
+  size_t buffered = 0;
+  ssize_t res;
+  int i;
+
+  for (i = 0; i < iovcnt; ++i) {
+    remaining += iov[i].iov_len;
+  }
+
+  for (i = 0; i < iovcnt; ++i) {
+    const char *bytes = iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+
+    while (len > 0) {
+      size_t n = AMQP_TLS_RECORD_SIZE - buffered;
+
+      if (0 == buffered && (len >= AMQP_TLS_RECORD_SIZE || i == iovcnt - 1)) {
+        /* nothing pending to prepend: write straight from the vector */
+        n = len < AMQP_TLS_RECORD_SIZE ? len : AMQP_TLS_RECORD_SIZE;
+        remaining -= n;
+        res = write_record(self, bytes, n, remaining > 0);
+        if (AMQP_STATUS_OK != res) {
+          return res;
+        }
+      } else {
+        if (n > len) {
+          n = len;
+        }
+        memcpy(record_buffer + buffered, bytes, n);
+        buffered += n;
+        if (AMQP_TLS_RECORD_SIZE == buffered) {
+          remaining -= buffered;
+          buffered = 0;
+          res = write_record(self, record_buffer, AMQP_TLS_RECORD_SIZE,
+                             remaining > 0);
+          if (AMQP_STATUS_OK != res) {
+            return res;
+          }
+        }
+      }
+      bytes += n;
+      len -= n;
+    }
+  }
+
+  if (buffered > 0) {
+    return write_record(self, record_buffer, buffered, 0);
+  }
+  return AMQP_STATUS_OK;
+}
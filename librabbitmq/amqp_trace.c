@@ -0,0 +1,148 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+
+#if defined(AMQP_TRACE_RING)
+
+#include "amqp_atomic.h"
+
+#define RING_MASK (AMQP_TRACE_RING_SIZE - 1)
+
+/* events recorded outside any connection */
+static amqp_trace_ring_t global_ring;
+
+/* Claims the next slot with an atomic increment, so any thread may record.
+ * The slot's seq is cleared while it is being written and set last, which
+ * lets the dumper skip slots that are in flux. seq 0 marks exactly that, so
+ * when the counter wraps it is skipped. */
+void amqp_trace_record(amqp_trace_ring_t *ring, amqp_trace_id_enum id,
+                       uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+  uint32_t seq;
+  amqp_trace_event_t *event;
+
+  if (NULL == ring) {
+    ring = &global_ring;
+  }
+  do {
+    seq = (uint32_t)amqp_atomic_add_int(&ring->head, 1);
+  } while (0 == seq);
+  event = &ring->events[(seq - 1) & RING_MASK];
+
+  amqp_atomic_store_int((int *)&event->seq, 0);
+  event->timestamp = amqp_get_monotonic_timestamp();
+  event->id = (uint16_t)id;
+  event->reserved = 0;
+  event->args[0] = a0;
+  event->args[1] = a1;
+  event->args[2] = a2;
+  event->args[3] = a3;
+  amqp_atomic_store_int((int *)&event->seq, (int)seq);
+}
+
+int amqp_trace_dump(amqp_connection_state_t state,
+                    amqp_trace_event_t *events, size_t *count)
+{
+  amqp_trace_ring_t *ring = (NULL == state) ? &global_ring : &state->trace;
+  uint32_t head;
+  uint32_t seq;
+  size_t n;
+  size_t copied = 0;
+
+  if (NULL == events || NULL == count) {
+    return AMQP_STATUS_INVALID_PARAMETER;
+  }
+
+  /* walk the last n sequence numbers modulo 2^32, one more if the range
+   * crosses 0, which is never claimed; slots never written hold seq 0, so
+   * they are skipped like slots in flux */
+  head = (uint32_t)amqp_atomic_load_int(&ring->head);
+  n = (*count < AMQP_TRACE_RING_SIZE) ? *count : AMQP_TRACE_RING_SIZE;
+  seq = head - (uint32_t)n + 1;
+  if (0 == seq || seq > head) {
+    seq--;
+    n++;
+  }
+
+  for ( ; n > 0; --n, ++seq) {
+    amqp_trace_event_t *event = &ring->events[(seq - 1) & RING_MASK];
+
+    if (0 == seq ||
+        (uint32_t)amqp_atomic_load_int((int *)&event->seq) != seq) {
+      continue;
+    }
+    events[copied] = *event;
+    /* overwritten while we copied it */
+    if ((uint32_t)amqp_atomic_load_int((int *)&event->seq) != seq) {
+      continue;
+    }
+    copied++;
+  }
+
+  *count = copied;
+  return AMQP_STATUS_OK;
+}
+
+#else
+
+#if defined(AMQP_TRACE_PRINTF)
+
+#include <stdio.h>
+
+#define AMQP_TRACE_FORMAT(name, format) format,
+
+static const char *trace_formats[] = {
+  AMQP_TRACE_EVENTS(AMQP_TRACE_FORMAT)
+};
+
+void amqp_trace_print(amqp_trace_id_enum id, uint32_t a0, uint32_t a1,
+                      uint32_t a2, uint32_t a3)
+{
+  char line[128];
+
+  snprintf(line, sizeof(line), trace_formats[id], a0, a1, a2, a3);
+  RABBIT_INFO("%s", line);
+}
+
+#endif
+
+int amqp_trace_dump(amqp_connection_state_t state,
+                    amqp_trace_event_t *events, size_t *count)
+{
+  (void)state;
+  (void)events;
+  (void)count;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+#endif
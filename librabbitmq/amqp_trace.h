@@ -0,0 +1,88 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef AMQP_TRACE_H
+#define AMQP_TRACE_H
+
+/*
+ * Trace events.
+ *
+ * Each event has an id and up to four 32-bit integer arguments. With
+ * AMQP_TRACE_RING the library stores them as fixed-size binary records in
+ * a per-connection ring (see amqp_trace_dump()), with AMQP_TRACE_PRINTF it
+ * formats them through RABBIT_INFO, and with neither they compile out.
+ *
+ * This table is the only place the formats live: the host-side decoder
+ * (buildEmbedded/amqp_trace_decode.c) includes it to render dumps, so
+ * events may only be appended, never renumbered. Formats may use %d, %u
+ * and %x only.
+ */
+#define AMQP_TRACE_EVENTS(X)                                                  \
+  X(TUNE,              "tune channel_max=%d frame_max=%d heartbeat=%d")       \
+  X(INPUT,             "input state=%u offset=%u target=%u consumed=%u")      \
+  X(INPUT_HEADER,      "frame header type=%u channel=%u target=%u consumed=%u") \
+  X(INPUT_PROTOCOL,    "protocol header from broker consumed=%u")             \
+  X(DECODE_FAILED,     "decode failed type=%u channel=%u res=%d")             \
+  X(FRAME_IN,          "frame in type=%u channel=%u size=%u")                 \
+  X(ENCODE_METHOD,     "encode method id=0x%08x len=%u res=%d")               \
+  X(ENCODE_PROPERTIES, "encode properties class=%u len=%u res=%d")            \
+  X(ENCODE_INVALID,    "encode unknown frame type=%u")                        \
+  X(SEND_FRAME,        "send frame type=%u channel=%u len=%u res=%d")         \
+  X(STREAM_CHUNK,      "stream body available=%d remaining=%u")               \
+  X(STREAM_BODY,       "stream body len=%u res=%d")                           \
+  X(HEARTBEAT_IN,      "heartbeat received")                                  \
+  X(HEARTBEAT_OUT,     "heartbeat sent res=%d")                               \
+  X(SEND_HEADER,       "protocol header sent res=%d")                         \
+  X(SOCKET_CREATE,     "socket created fd=%d")                                \
+  X(SOCKET_SETSOCKOPT, "setsockopt fd=%d option=%d res=%d")                   \
+  X(SOCKET_FCNTL,      "fcntl fd=%d flags=0x%x res=%d")                       \
+  X(SOCKET_CONNECT,    "connect fd=%d res=%d")                                \
+  X(SOCKET_ERROR,      "connect fd=%d error=%d")                              \
+  X(CONNECT_TIMER,     "connect timer res=%d")                                \
+  X(TCP_SEND,          "tcp send fd=%d len=%u flags=0x%x")                    \
+  X(TCP_RECV,          "tcp recv fd=%d len=%u")                               \
+  X(TCP_DELETE,        "tcp delete fd=%d")                                    \
+  X(SSL_SEND,          "ssl send len=%u flags=0x%x res=%d")                   \
+  X(SSL_SEND_SLOW,     "ssl send took %u s")                                  \
+  X(SSL_RECV,          "ssl recv len=%u res=%d")                              \
+  X(SSL_CLOSE,         "ssl close fd=%d")                                     \
+  X(SSL_DELETE,        "ssl delete fd=%d")                                    \
+  X(SSL_OPEN,          "ssl open port=%d timeout_ms=%d")                      \
+  X(SSL_NEW,           "ssl session new")                                     \
+  X(SSL_CONNECT,       "ssl connect fd=%d")
+
+#define AMQP_TRACE_ENUM(name, format) AMQP_TRACE_##name,
+
+typedef enum amqp_trace_id_enum_ {
+  AMQP_TRACE_EVENTS(AMQP_TRACE_ENUM)
+  AMQP_TRACE_EVENT_COUNT
+} amqp_trace_id_enum;
+
+#undef AMQP_TRACE_ENUM
+
+#endif /* AMQP_TRACE_H */
@@ -0,0 +1,712 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "amqp_private.h"
+#include <stdlib.h>
+#include <string.h>
+#include "amqp_os.h"
+
+#ifndef AMQP_DEFAULT_WORKER_IN_FLIGHT
+#define AMQP_DEFAULT_WORKER_IN_FLIGHT 1024
+#endif
+
+#ifndef AMQP_OS_THREADS
+
+amqp_worker_pool_t *amqp_worker_pool_new(amqp_connection_state_t state,
+                                         int workers, amqp_worker_order_t order,
+                                         int max_in_flight,
+                                         amqp_worker_handler_t handler,
+                                         void *ctx)
+{
+  (void)state;
+  (void)workers;
+  (void)order;
+  (void)max_in_flight;
+  (void)handler;
+  (void)ctx;
+  return NULL;
+}
+
+int amqp_worker_pool_dispatch(amqp_worker_pool_t *pool,
+                              struct timeval *timeout, int max_msgs)
+{
+  (void)pool;
+  (void)timeout;
+  (void)max_msgs;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_worker_pool_drain(amqp_worker_pool_t *pool)
+{
+  (void)pool;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+int amqp_worker_pool_destroy(amqp_worker_pool_t *pool)
+{
+  (void)pool;
+  return AMQP_STATUS_UNSUPPORTED;
+}
+
+#else
+
+#include "amqp_atomic.h"
+
+#ifndef AMQP_WORKER_LANE_BATCH
+#define AMQP_WORKER_LANE_BATCH 16
+#endif
+
+#define LANE_TABLE_SIZE 64
+
+/* While messages are in flight, the dispatcher does not block in the socket
+ * for longer than this, so finished messages get acked promptly. */
+#define ACK_INTERVAL_US 1000
+
+/*
+ * Worker pool.
+ *
+ * Deliveries are sorted into lanes, one per channel (or per consumer tag).
+ * A lane holds a FIFO of messages and is scheduled as a unit: while it has
+ * messages it sits in exactly one worker's deque or is being run by exactly
+ * one worker, which is what keeps each lane in order. Workers pop lanes from
+ * the bottom of their own deque and steal from the top of the others'; after
+ * a batch of messages a lane that still has work is put back at the top of
+ * the worker's deque, so other lanes get a turn and thieves pick it up first.
+ *
+ * Finished messages go back to the dispatching thread on a lock-free MPSC
+ * stack. That thread sends the acks and recycles the message objects, so the
+ * free list is only ever touched by one thread.
+ */
+
+typedef struct worker_lane_t_ worker_lane_t;
+
+typedef struct worker_msg_t_ {
+  struct worker_msg_t_ *next;
+  amqp_worker_result_t result;
+  amqp_envelope_t envelope;
+} worker_msg_t;
+
+struct worker_lane_t_ {
+  worker_lane_t *hash_next;         /* dispatching thread only */
+  worker_lane_t *deque_prev;        /* under the owning worker's lock */
+  worker_lane_t *deque_next;
+  uint32_t hash;
+  amqp_channel_t channel;
+  amqp_bytes_t consumer_tag;
+
+  amqp_os_mutex_t lock;
+  worker_msg_t *head;
+  worker_msg_t *tail;
+  int scheduled;
+};
+
+typedef struct worker_t_ {
+  amqp_worker_pool_t *pool;
+  amqp_os_thread_t thread;
+  int index;
+  amqp_os_mutex_t lock;
+  worker_lane_t *top;
+  worker_lane_t *bottom;
+} worker_t;
+
+struct amqp_worker_pool_t_ {
+  amqp_connection_state_t state;
+  amqp_worker_order_t order;
+  amqp_worker_handler_t handler;
+  void *ctx;
+  int max_in_flight;
+  int in_flight;                    /* dispatching thread only */
+  int nworkers;
+  worker_t *workers;
+
+  worker_lane_t *lanes[LANE_TABLE_SIZE];
+  worker_msg_t *free_msgs;
+
+  /* scheduled lanes sitting in deques, and workers asleep waiting for one */
+  int pending;
+  int idle;
+  int stop;
+  amqp_os_mutex_t idle_lock;
+  amqp_os_cond_t idle_cond;
+
+  /* finished messages */
+  worker_msg_t *done;
+  int dispatcher_waiting;
+  amqp_os_mutex_t done_lock;
+  amqp_os_cond_t done_cond;
+};
+
+static void deque_push_bottom(worker_t *w, worker_lane_t *lane)
+{
+  amqp_os_mutex_lock(&w->lock);
+  lane->deque_next = NULL;
+  lane->deque_prev = w->bottom;
+  if (w->bottom) {
+    w->bottom->deque_next = lane;
+  } else {
+    amqp_atomic_store_ptr(&w->top, lane);
+  }
+  w->bottom = lane;
+  amqp_os_mutex_unlock(&w->lock);
+}
+
+static void deque_push_top(worker_t *w, worker_lane_t *lane)
+{
+  amqp_os_mutex_lock(&w->lock);
+  lane->deque_prev = NULL;
+  lane->deque_next = w->top;
+  if (w->top) {
+    w->top->deque_prev = lane;
+  } else {
+    w->bottom = lane;
+  }
+  amqp_atomic_store_ptr(&w->top, lane);
+  amqp_os_mutex_unlock(&w->lock);
+}
+
+static worker_lane_t *deque_pop_bottom(worker_t *w)
+{
+  worker_lane_t *lane;
+
+  amqp_os_mutex_lock(&w->lock);
+  lane = w->bottom;
+  if (lane) {
+    w->bottom = lane->deque_prev;
+    if (w->bottom) {
+      w->bottom->deque_next = NULL;
+    } else {
+      amqp_atomic_store_ptr(&w->top, NULL);
+    }
+  }
+  amqp_os_mutex_unlock(&w->lock);
+  return lane;
+}
+
+static worker_lane_t *deque_steal_top(worker_t *w)
+{
+  worker_lane_t *lane;
+
+  /* cheap unlocked peek so idle thieves don't hammer empty deques */
+  if (NULL == amqp_atomic_load_ptr(&w->top)) {
+    return NULL;
+  }
+
+  amqp_os_mutex_lock(&w->lock);
+  lane = w->top;
+  if (lane) {
+    amqp_atomic_store_ptr(&w->top, lane->deque_next);
+    if (w->top) {
+      w->top->deque_prev = NULL;
+    } else {
+      w->bottom = NULL;
+    }
+  }
+  amqp_os_mutex_unlock(&w->lock);
+  return lane;
+}
+
+static void announce_lane(amqp_worker_pool_t *pool)
+{
+  amqp_atomic_add_int(&pool->pending, 1);
+  if (amqp_atomic_load_int(&pool->idle) > 0) {
+    amqp_os_mutex_lock(&pool->idle_lock);
+    amqp_os_cond_signal(&pool->idle_cond);
+    amqp_os_mutex_unlock(&pool->idle_lock);
+  }
+}
+
+static worker_lane_t *find_lane(amqp_worker_pool_t *pool, worker_t *self)
+{
+  worker_lane_t *lane = deque_pop_bottom(self);
+  int i;
+
+  for (i = 1; NULL == lane && i < pool->nworkers; ++i) {
+    lane = deque_steal_top(&pool->workers[(self->index + i) % pool->nworkers]);
+  }
+  if (lane) {
+    amqp_atomic_add_int(&pool->pending, -1);
+  }
+  return lane;
+}
+
+static void push_done(amqp_worker_pool_t *pool, worker_msg_t *msg)
+{
+  worker_msg_t *head;
+
+  do {
+    head = amqp_atomic_load_ptr(&pool->done);
+    msg->next = head;
+  } while (!amqp_atomic_cas_ptr(&pool->done, head, msg));
+
+  if (amqp_atomic_load_int(&pool->dispatcher_waiting)) {
+    amqp_os_mutex_lock(&pool->done_lock);
+    amqp_os_cond_signal(&pool->done_cond);
+    amqp_os_mutex_unlock(&pool->done_lock);
+  }
+}
+
+static void worker_main(void *arg)
+{
+  worker_t *self = arg;
+  amqp_worker_pool_t *pool = self->pool;
+
+  while (1) {
+    worker_lane_t *lane = find_lane(pool, self);
+    int n;
+
+    if (NULL == lane) {
+      amqp_os_mutex_lock(&pool->idle_lock);
+      amqp_atomic_add_int(&pool->idle, 1);
+      while (0 == amqp_atomic_load_int(&pool->pending) &&
+             !amqp_atomic_load_int(&pool->stop)) {
+        amqp_os_cond_wait(&pool->idle_cond, &pool->idle_lock, AMQP_OS_WAIT_FOREVER);
+      }
+      amqp_atomic_add_int(&pool->idle, -1);
+      amqp_os_mutex_unlock(&pool->idle_lock);
+
+      if (amqp_atomic_load_int(&pool->stop) &&
+          0 == amqp_atomic_load_int(&pool->pending)) {
+        break;
+      }
+      continue;
+    }
+
+    for (n = 0; n < AMQP_WORKER_LANE_BATCH; ++n) {
+      worker_msg_t *msg;
+
+      amqp_os_mutex_lock(&lane->lock);
+      msg = lane->head;
+      if (msg) {
+        lane->head = msg->next;
+        if (NULL == lane->head) {
+          lane->tail = NULL;
+        }
+      }
+      amqp_os_mutex_unlock(&lane->lock);
+
+      if (NULL == msg) {
+        break;
+      }
+      msg->result = pool->handler(pool->ctx, &msg->envelope);
+      push_done(pool, msg);
+    }
+
+    amqp_os_mutex_lock(&lane->lock);
+    if (NULL == lane->head) {
+      lane->scheduled = 0;
+      amqp_os_mutex_unlock(&lane->lock);
+    } else {
+      amqp_os_mutex_unlock(&lane->lock);
+      deque_push_top(self, lane);
+      announce_lane(pool);
+    }
+  }
+}
+
+static uint32_t lane_hash(amqp_channel_t channel, amqp_bytes_t tag)
+{
+  uint32_t hash = 2166136261u ^ channel;
+  size_t i;
+
+  for (i = 0; i < tag.len; ++i) {
+    hash ^= ((uint8_t *)tag.bytes)[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static worker_lane_t *get_lane(amqp_worker_pool_t *pool,
+                               const amqp_envelope_t *envelope)
+{
+  amqp_bytes_t tag = amqp_empty_bytes;
+  worker_lane_t **bucket;
+  worker_lane_t *lane;
+  uint32_t hash;
+
+  if (AMQP_WORKER_ORDER_CONSUMER_TAG == pool->order) {
+    tag = envelope->consumer_tag;
+  }
+  hash = lane_hash(envelope->channel, tag);
+  bucket = &pool->lanes[hash % LANE_TABLE_SIZE];
+
+  for (lane = *bucket; lane; lane = lane->hash_next) {
+    if (lane->hash == hash && lane->channel == envelope->channel &&
+        lane->consumer_tag.len == tag.len &&
+        0 == memcmp(lane->consumer_tag.bytes, tag.bytes, tag.len)) {
+      return lane;
+    }
+  }
+
+  lane = calloc(1, sizeof(worker_lane_t) + tag.len);
+  if (NULL == lane) {
+    return NULL;
+  }
+  lane->hash = hash;
+  lane->channel = envelope->channel;
+  lane->consumer_tag.len = tag.len;
+  lane->consumer_tag.bytes = lane + 1;
+  if (tag.len) {
+    memcpy(lane->consumer_tag.bytes, tag.bytes, tag.len);
+  }
+  amqp_os_mutex_init(&lane->lock);
+  lane->hash_next = *bucket;
+  *bucket = lane;
+  return lane;
+}
+
+static void schedule(amqp_worker_pool_t *pool, worker_lane_t *lane,
+                     worker_msg_t *msg)
+{
+  int kick;
+
+  msg->next = NULL;
+  amqp_os_mutex_lock(&lane->lock);
+  if (lane->tail) {
+    lane->tail->next = msg;
+  } else {
+    lane->head = msg;
+  }
+  lane->tail = msg;
+  kick = !lane->scheduled;
+  lane->scheduled = 1;
+  amqp_os_mutex_unlock(&lane->lock);
+
+  if (kick) {
+    deque_push_bottom(&pool->workers[lane->hash % pool->nworkers], lane);
+    announce_lane(pool);
+  }
+}
+
+/* Sends the acks for all finished messages and recycles them. */
+static int collect_done(amqp_worker_pool_t *pool)
+{
+  worker_msg_t *list = amqp_atomic_xchg_ptr(&pool->done, NULL);
+  worker_msg_t *fifo = NULL;
+  int res = AMQP_STATUS_OK;
+
+  if (NULL == list) {
+    return AMQP_STATUS_OK;
+  }
+
+  /* the stack is newest first; acks go out in completion order */
+  while (list) {
+    worker_msg_t *next = list->next;
+    list->next = fifo;
+    fifo = list;
+    list = next;
+  }
+
+  while (fifo) {
+    worker_msg_t *msg = fifo;
+    amqp_envelope_t *envelope = &msg->envelope;
+    int ack_res = AMQP_STATUS_OK;
+
+    fifo = msg->next;
+
+    switch (msg->result) {
+      case AMQP_WORKER_ACK:
+        ack_res = amqp_basic_ack(pool->state, envelope->channel,
+                                 envelope->delivery_tag, 0);
+        break;
+      case AMQP_WORKER_REJECT:
+      case AMQP_WORKER_REQUEUE:
+        ack_res = amqp_basic_reject(pool->state, envelope->channel,
+                                    envelope->delivery_tag,
+                                    AMQP_WORKER_REQUEUE == msg->result);
+        break;
+      default:
+        break;
+    }
+    if (AMQP_STATUS_OK == res) {
+      res = ack_res;
+    }
+
+    amqp_destroy_envelope(envelope);
+    msg->next = pool->free_msgs;
+    pool->free_msgs = msg;
+    pool->in_flight--;
+  }
+
+  if (AMQP_STATUS_OK == res) {
+    res = amqp_flush(pool->state);
+  }
+  return res;
+}
+
+/* Blocks until a worker finishes a message. */
+static void wait_done(amqp_worker_pool_t *pool)
+{
+  amqp_os_mutex_lock(&pool->done_lock);
+  amqp_atomic_store_int(&pool->dispatcher_waiting, 1);
+  while (NULL == amqp_atomic_load_ptr(&pool->done)) {
+    amqp_os_cond_wait(&pool->done_cond, &pool->done_lock, AMQP_OS_WAIT_FOREVER);
+  }
+  amqp_atomic_store_int(&pool->dispatcher_waiting, 0);
+  amqp_os_mutex_unlock(&pool->done_lock);
+}
+
+static void stop_workers(amqp_worker_pool_t *pool, int started)
+{
+  int i;
+
+  amqp_os_mutex_lock(&pool->idle_lock);
+  amqp_atomic_store_int(&pool->stop, 1);
+  amqp_os_cond_broadcast(&pool->idle_cond);
+  amqp_os_mutex_unlock(&pool->idle_lock);
+
+  for (i = 0; i < started; ++i) {
+    amqp_os_thread_join(&pool->workers[i].thread);
+  }
+}
+
+static void pool_free(amqp_worker_pool_t *pool)
+{
+  int i;
+
+  for (i = 0; i < LANE_TABLE_SIZE; ++i) {
+    worker_lane_t *lane = pool->lanes[i];
+    while (lane) {
+      worker_lane_t *next = lane->hash_next;
+      amqp_os_mutex_destroy(&lane->lock);
+      free(lane);
+      lane = next;
+    }
+  }
+  while (pool->free_msgs) {
+    worker_msg_t *next = pool->free_msgs->next;
+    free(pool->free_msgs);
+    pool->free_msgs = next;
+  }
+  if (pool->workers) {
+    for (i = 0; i < pool->nworkers; ++i) {
+      amqp_os_mutex_destroy(&pool->workers[i].lock);
+    }
+    free(pool->workers);
+  }
+  amqp_os_cond_destroy(&pool->done_cond);
+  amqp_os_mutex_destroy(&pool->done_lock);
+  amqp_os_cond_destroy(&pool->idle_cond);
+  amqp_os_mutex_destroy(&pool->idle_lock);
+  free(pool);
+}
+
+amqp_worker_pool_t *amqp_worker_pool_new(amqp_connection_state_t state,
+                                         int workers, amqp_worker_order_t order,
+                                         int max_in_flight,
+                                         amqp_worker_handler_t handler,
+                                         void *ctx)
+{
+  amqp_worker_pool_t *pool;
+  int i;
+
+  if (NULL == state || NULL == handler || workers <= 0 || max_in_flight < 0) {
+    return NULL;
+  }
+
+  pool = calloc(1, sizeof(amqp_worker_pool_t));
+  if (NULL == pool) {
+    return NULL;
+  }
+  pool->state = state;
+  pool->order = order;
+  pool->handler = handler;
+  pool->ctx = ctx;
+  pool->max_in_flight = max_in_flight ? max_in_flight
+                                      : AMQP_DEFAULT_WORKER_IN_FLIGHT;
+  pool->nworkers = workers;
+  amqp_os_mutex_init(&pool->idle_lock);
+  amqp_os_cond_init(&pool->idle_cond);
+  amqp_os_mutex_init(&pool->done_lock);
+  amqp_os_cond_init(&pool->done_cond);
+
+  pool->workers = calloc(workers, sizeof(worker_t));
+  if (NULL == pool->workers) {
+    pool_free(pool);
+    return NULL;
+  }
+  for (i = 0; i < workers; ++i) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    amqp_os_mutex_init(&pool->workers[i].lock);
+  }
+  for (i = 0; i < workers; ++i) {
+    if (AMQP_STATUS_OK != amqp_os_thread_create(&pool->workers[i].thread,
+                                                "amqp-worker", worker_main,
+                                                &pool->workers[i])) {
+      stop_workers(pool, i);
+      pool_free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+int amqp_worker_pool_dispatch(amqp_worker_pool_t *pool,
+                              struct timeval *timeout, int max_msgs)
+{
+  amqp_connection_state_t state = pool->state;
+  uint64_t deadline = 0;
+  int count = 0;
+  int res;
+
+  if (timeout) {
+    uint64_t now = amqp_get_monotonic_timestamp();
+    if (0 == now) {
+      return AMQP_STATUS_TIMER_FAILURE;
+    }
+    deadline = now + (uint64_t)timeout->tv_sec * AMQP_NS_PER_S +
+               (uint64_t)timeout->tv_usec * AMQP_NS_PER_US;
+  }
+
+  while (max_msgs <= 0 || count < max_msgs) {
+    struct timeval slice;
+    struct timeval *wait = &slice;
+    amqp_rpc_reply_t ret;
+    worker_lane_t *lane;
+    worker_msg_t *msg;
+
+    res = collect_done(pool);
+    if (AMQP_STATUS_OK != res) {
+      return res;
+    }
+
+    if (pool->in_flight >= pool->max_in_flight) {
+      wait_done(pool);
+      continue;
+    }
+
+    /* only the first message is waited for; after that, or while acks are
+       pending, the socket is only polled */
+    memset(&slice, 0, sizeof(slice));
+    if (0 == count) {
+      uint64_t left = (uint64_t)3600 * AMQP_NS_PER_S;
+
+      if (timeout) {
+        uint64_t now = amqp_get_monotonic_timestamp();
+        if (0 == now) {
+          return AMQP_STATUS_TIMER_FAILURE;
+        }
+        left = (now < deadline) ? deadline - now : 0;
+      } else if (0 == pool->in_flight) {
+        wait = NULL;
+      }
+      if (pool->in_flight > 0 && left > ACK_INTERVAL_US * AMQP_NS_PER_US) {
+        left = ACK_INTERVAL_US * AMQP_NS_PER_US;
+      }
+      slice.tv_sec = left / AMQP_NS_PER_S;
+      slice.tv_usec = (left % AMQP_NS_PER_S) / AMQP_NS_PER_US;
+    }
+
+    msg = pool->free_msgs;
+    if (msg) {
+      pool->free_msgs = msg->next;
+    } else {
+      msg = malloc(sizeof(worker_msg_t));
+      if (NULL == msg) {
+        return AMQP_STATUS_NO_MEMORY;
+      }
+    }
+
+    ret = amqp_consume_message(state, &msg->envelope, wait, 0);
+    if (AMQP_RESPONSE_NORMAL != ret.reply_type) {
+      msg->next = pool->free_msgs;
+      pool->free_msgs = msg;
+
+      if (AMQP_RESPONSE_LIBRARY_EXCEPTION == ret.reply_type &&
+          AMQP_STATUS_TIMEOUT == ret.library_error) {
+        if (count > 0) {
+          break;
+        }
+        if (timeout) {
+          uint64_t now = amqp_get_monotonic_timestamp();
+          if (0 == now) {
+            return AMQP_STATUS_TIMER_FAILURE;
+          }
+          if (now >= deadline) {
+            break;
+          }
+        }
+        continue;
+      }
+      if (count > 0) {
+        break;
+      }
+      return (AMQP_RESPONSE_LIBRARY_EXCEPTION == ret.reply_type)
+             ? ret.library_error : AMQP_STATUS_UNEXPECTED_STATE;
+    }
+    amqp_maybe_release_buffers_on_channel(state, msg->envelope.channel);
+
+    lane = get_lane(pool, &msg->envelope);
+    if (NULL == lane) {
+      amqp_destroy_envelope(&msg->envelope);
+      msg->next = pool->free_msgs;
+      pool->free_msgs = msg;
+      return AMQP_STATUS_NO_MEMORY;
+    }
+    pool->in_flight++;
+    schedule(pool, lane, msg);
+    count++;
+  }
+
+  res = collect_done(pool);
+  return (AMQP_STATUS_OK == res) ? count : res;
+}
+
+int amqp_worker_pool_drain(amqp_worker_pool_t *pool)
+{
+  int res = AMQP_STATUS_OK;
+
+  while (pool->in_flight > 0) {
+    int collect_res;
+
+    wait_done(pool);
+    collect_res = collect_done(pool);
+    if (AMQP_STATUS_OK == res) {
+      res = collect_res;
+    }
+  }
+  return res;
+}
+
+int amqp_worker_pool_destroy(amqp_worker_pool_t *pool)
+{
+  int res;
+
+  if (NULL == pool) {
+    return AMQP_STATUS_OK;
+  }
+  res = amqp_worker_pool_drain(pool);
+  stop_workers(pool, pool->nworkers);
+  pool_free(pool);
+  return res;
+}
+
+#endif
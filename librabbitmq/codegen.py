@@ -38,6 +38,7 @@ from __future__ import division
 from amqp_codegen import *
 import string
 import re
+import sys
 
 
 class Emitter(object):
@@ -190,6 +191,20 @@ class TableType(object):
     def literal(self, value):
         raise NotImplementedError()
 
+# Field type codes of the --compact descriptor tables; the string types
+# carry the width of their length prefix.
+compactTypes = {
+    'octet': "AMQP_FIELD_OCTET",
+    'short': "AMQP_FIELD_SHORT",
+    'long': "AMQP_FIELD_LONG",
+    'longlong': "AMQP_FIELD_LONGLONG",
+    'shortstr': "AMQP_FIELD_SHORTSTR",
+    'longstr': "AMQP_FIELD_LONGSTR",
+    'bit': "AMQP_FIELD_BIT",
+    'table': "AMQP_FIELD_TABLE",
+    'timestamp': "AMQP_FIELD_LONGLONG",
+}
+
 types = {
     'octet': SimpleType(8),
     'short': SimpleType(16),
@@ -234,6 +249,74 @@ apiMethodInfo  = {
 # fields, and the fixed values to use for them.
 apiMethodsSuppressArgs = {"ticket": 0, "nowait": False}
 
+# Passing --methods=class.method,... (or numeric method ids such as
+# 0x003C0028) restricts the generated encoders, decoders, names and API
+# functions to those methods, to save flash on small targets. Inbound
+# methods left out are dropped by amqp_handle_input(). The methods the
+# library itself sends or waits for are always kept.
+methodWhitelist = None
+
+# Passing --compact replaces the switch statements with one case per method
+# by field descriptor tables and a generic interpreter, which is smaller.
+compactCodec = False
+
+coreMethods = [
+    "connection.start", "connection.start-ok",
+    "connection.tune", "connection.tune-ok",
+    "connection.open", "connection.open-ok",
+    "connection.close", "connection.close-ok",
+    "channel.open", "channel.open-ok",
+    "channel.close", "channel.close-ok",
+    # publisher confirms, ack batching and the prefetch controller
+    "confirm.select", "confirm.select-ok",
+    "basic.ack", "basic.nack",
+    "basic.qos", "basic.qos-ok",
+]
+
+def takeOptions(argv):
+    global methodWhitelist, compactCodec
+    for arg in argv[1:]:
+        if arg.startswith("--methods="):
+            argv.remove(arg)
+            names = re.split('[,; ]', arg[len("--methods="):])
+            methodWhitelist = [n for n in names if n]
+        elif arg == "--compact":
+            argv.remove(arg)
+            compactCodec = True
+
+def selectedMethods(spec):
+    methods = spec.allMethods()
+    if methodWhitelist is None:
+        return methods
+
+    byName = {}
+    byId = {}
+    for m in methods:
+        byName[m.klass.name + "." + m.name] = m
+        byId[m.klass.index << 16 | m.index] = m
+
+    selected = []
+    for n in coreMethods + methodWhitelist:
+        m = byName.get(n)
+        if m is None:
+            try:
+                m = byId.get(int(n, 0))
+            except ValueError:
+                pass
+        if m is None:
+            sys.stderr.write("codegen.py: unknown method %s\n" % (n,))
+            sys.exit(1)
+        selected.append(m)
+    return [m for m in methods if m in selected]
+
+def selectedClasses(spec, methods):
+    """The classes whose properties are needed to carry the content of
+    the given methods."""
+    if methodWhitelist is None:
+        return spec.allClasses()
+    return [c for c in spec.allClasses()
+            if [m for m in methods if m.klass == c and m.hasContent]]
+
 AmqpMethod.defName = lambda m: cConstantName(c_ize(m.klass.name) + '_' + c_ize(m.name) + "_method")
 AmqpMethod.fullName = lambda m: "amqp_%s_%s" % (c_ize(m.klass.name), c_ize(m.name))
 AmqpMethod.structName = lambda m: m.fullName() + "_t"
@@ -273,6 +356,20 @@ def cConstantName(s):
 def cFlagName(c, f):
     return cConstantName(c.name + '_' + f.name) + '_FLAG'
 
+def propertyFlagBits(c):
+    """The bit number of each property's flag; bit 0 of every 16 bit flag
+    word says whether another word follows."""
+    bits = []
+    index = 0
+    for f in c.fields:
+        if index % 16 == 15:
+            index = index + 1
+        shortnum = index // 16
+        partialindex = 15 - (index % 16)
+        bits.append(shortnum * 16 + partialindex)
+        index = index + 1
+    return bits
+
 def genErl(spec):
     def fieldTempList(fields):
         return '[' + ', '.join(['F' + str(f.index) for f in fields]) + ']'
@@ -344,7 +441,388 @@ def genErl(spec):
         print "      return offset;"
         print "    }"
 
-    methods = spec.allMethods()
+    def genCompactCodec():
+        print """
+/* Field types of the descriptor tables below. */
+enum {
+  AMQP_FIELD_OCTET,
+  AMQP_FIELD_SHORT,
+  AMQP_FIELD_LONG,
+  AMQP_FIELD_LONGLONG,
+  AMQP_FIELD_SHORTSTR,   /* 8 bit length prefix */
+  AMQP_FIELD_LONGSTR,    /* 32 bit length prefix */
+  AMQP_FIELD_BIT,
+  AMQP_FIELD_TABLE
+};
+
+typedef struct amqp_field_desc_t_ {
+  uint16_t offset;       /* in the method or properties struct */
+  uint8_t type;          /* AMQP_FIELD_* */
+  uint8_t flag;          /* properties only: bit number of the field's flag */
+} amqp_field_desc_t;
+
+typedef struct amqp_method_desc_t_ {
+  amqp_method_number_t id;
+  char const *name;
+  uint16_t size;
+  uint16_t first_field;  /* in amqp_method_fields */
+  uint16_t field_count;
+} amqp_method_desc_t;
+
+typedef struct amqp_class_desc_t_ {
+  uint16_t id;
+  uint16_t size;         /* 0 ends amqp_classes */
+  uint16_t first_field;  /* in amqp_property_fields */
+  uint16_t field_count;
+} amqp_class_desc_t;
+"""
+
+        print "static const amqp_field_desc_t amqp_method_fields[] = {"
+        first = {}
+        count = 0
+        for m in sortedMethods:
+            first[m] = count
+            for f in m.arguments:
+                print "  {offsetof(%s, %s), %s, 0}," % \
+                      (m.structName(), c_ize(f.name),
+                       compactTypes[spec.resolveDomain(f.domain)])
+                count += 1
+        print "  {0, 0, 0}"
+        print "};"
+
+        print
+        print "static const amqp_field_desc_t amqp_property_fields[] = {"
+        count = 0
+        for c in classes:
+            first[c] = count
+            for (f, bit) in zip(c.fields, propertyFlagBits(c)):
+                print "  {offsetof(%s, %s), %s, %d}," % \
+                      (c.structName(), c_ize(f.name),
+                       compactTypes[spec.resolveDomain(f.domain)], bit)
+                count += 1
+        print "  {0, 0, 0}"
+        print "};"
+
+        print
+        print "/* sorted by id */"
+        print "static const amqp_method_desc_t amqp_methods[] = {"
+        for m in sortedMethods:
+            print '  {%s, "%s", sizeof(%s), %d, %d},' % \
+                  (m.defName(), m.defName(), m.structName(), first[m],
+                   len(m.arguments))
+        print "};"
+
+        print
+        print "static const amqp_class_desc_t amqp_classes[] = {"
+        for c in classes:
+            print "  {%s, sizeof(%s), %d, %d}," % \
+                  (cConstantName(c.name + "_class"), c.structName(), first[c],
+                   len(c.fields))
+        print "  {0, 0, 0, 0}"
+        print "};"
+
+        print """
+static const amqp_method_desc_t *find_method(amqp_method_number_t methodNumber)
+{
+  size_t lo = 0;
+  size_t hi = sizeof(amqp_methods) / sizeof(amqp_methods[0]);
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (amqp_methods[mid].id < methodNumber) {
+      lo = mid + 1;
+    } else if (amqp_methods[mid].id > methodNumber) {
+      hi = mid;
+    } else {
+      return &amqp_methods[mid];
+    }
+  }
+  return NULL;
+}
+
+static const amqp_class_desc_t *find_class(uint16_t class_id)
+{
+  const amqp_class_desc_t *c;
+
+  for (c = amqp_classes; 0 != c->size; ++c) {
+    if (c->id == class_id) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+/* Decodes count fields into the struct at decoded. flags is NULL for
+   method fields, for properties only the fields it flags are present. */
+static int decode_fields(const amqp_field_desc_t *field, int count,
+                         const amqp_flags_t *flags, amqp_pool_t *pool,
+                         amqp_bytes_t encoded, size_t *offset, char *decoded)
+{
+  uint8_t bit_buffer = 0;
+  int bit = 0;
+
+  for (; count > 0; --count, ++field) {
+    void *value = decoded + field->offset;
+
+    if (flags && !(*flags & ((amqp_flags_t)1 << field->flag))) {
+      continue;
+    }
+    if (AMQP_FIELD_BIT != field->type) {
+      bit = 0;
+    }
+
+    switch (field->type) {
+      case AMQP_FIELD_OCTET:
+        if (!amqp_decode_8(encoded, offset, (uint8_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORT:
+        if (!amqp_decode_16(encoded, offset, (uint16_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONG:
+        if (!amqp_decode_32(encoded, offset, (uint32_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGLONG:
+        if (!amqp_decode_64(encoded, offset, (uint64_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORTSTR: {
+        uint8_t len;
+        if (!amqp_decode_8(encoded, offset, &len)
+            || !amqp_decode_bytes(encoded, offset, (amqp_bytes_t *)value, len))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      }
+      case AMQP_FIELD_LONGSTR: {
+        uint32_t len;
+        if (!amqp_decode_32(encoded, offset, &len)
+            || !amqp_decode_bytes(encoded, offset, (amqp_bytes_t *)value, len))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      }
+      case AMQP_FIELD_BIT:
+        if (0 == bit && !amqp_decode_8(encoded, offset, &bit_buffer))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        *(amqp_boolean_t *)value = (bit_buffer & (1 << bit)) ? 1 : 0;
+        bit = (bit + 1) & 7;
+        break;
+      case AMQP_FIELD_TABLE: {
+        int res = amqp_decode_table(encoded, pool, (amqp_table_t *)value, offset);
+        if (res < 0) return res;
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+static int encode_fields(const amqp_field_desc_t *field, int count,
+                         const amqp_flags_t *flags, amqp_bytes_t encoded,
+                         size_t *offset, char *decoded)
+{
+  uint8_t bit_buffer = 0;
+  int bit = 0;
+
+  for (; count > 0; --count, ++field) {
+    void *value = decoded + field->offset;
+
+    if (flags && !(*flags & ((amqp_flags_t)1 << field->flag))) {
+      continue;
+    }
+    if (bit && AMQP_FIELD_BIT != field->type) {
+      if (!amqp_encode_8(encoded, offset, bit_buffer))
+        return AMQP_STATUS_BAD_AMQP_DATA;
+      bit = 0;
+    }
+
+    switch (field->type) {
+      case AMQP_FIELD_OCTET:
+        if (!amqp_encode_8(encoded, offset, *(uint8_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORT:
+        if (!amqp_encode_16(encoded, offset, *(uint16_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONG:
+        if (!amqp_encode_32(encoded, offset, *(uint32_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGLONG:
+        if (!amqp_encode_64(encoded, offset, *(uint64_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_SHORTSTR:
+        if (!amqp_encode_8(encoded, offset, ((amqp_bytes_t *)value)->len)
+            || !amqp_encode_bytes(encoded, offset, *(amqp_bytes_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_LONGSTR:
+        if (!amqp_encode_32(encoded, offset, ((amqp_bytes_t *)value)->len)
+            || !amqp_encode_bytes(encoded, offset, *(amqp_bytes_t *)value))
+          return AMQP_STATUS_BAD_AMQP_DATA;
+        break;
+      case AMQP_FIELD_BIT:
+        if (0 == bit) bit_buffer = 0;
+        if (*(amqp_boolean_t *)value) bit_buffer |= (1 << bit);
+        if (8 == ++bit) {
+          if (!amqp_encode_8(encoded, offset, bit_buffer))
+            return AMQP_STATUS_BAD_AMQP_DATA;
+          bit = 0;
+        }
+        break;
+      case AMQP_FIELD_TABLE: {
+        int res = amqp_encode_table(encoded, (amqp_table_t *)value, offset);
+        if (res < 0) return res;
+        break;
+      }
+    }
+  }
+  if (bit && !amqp_encode_8(encoded, offset, bit_buffer))
+    return AMQP_STATUS_BAD_AMQP_DATA;
+  return 0;
+}
+
+char const *amqp_method_name(amqp_method_number_t methodNumber) {
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  return (method ? method->name : NULL);
+}"""
+
+        print """
+amqp_boolean_t amqp_method_has_content(amqp_method_number_t methodNumber) {
+  switch (methodNumber) {"""
+        for m in spec.allMethods():
+            if m.hasContent:
+                print '    case %s: return 1;' % (m.defName())
+        print """    default: return 0;
+  }
+}
+
+int amqp_decode_method(amqp_method_number_t methodNumber,
+                       amqp_pool_t *pool,
+                       amqp_bytes_t encoded,
+                       void **decoded)
+{
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  size_t offset = 0;
+  char *m = NULL; /* no fields */
+  int res;
+
+  if (NULL == method) {
+    return AMQP_STATUS_UNKNOWN_METHOD;
+  }
+  if (method->field_count) {
+    m = (char *) amqp_pool_alloc(pool, method->size);
+    if (m == NULL) { return AMQP_STATUS_NO_MEMORY; }
+  }
+  res = decode_fields(&amqp_method_fields[method->first_field],
+                      method->field_count, NULL, pool, encoded, &offset, m);
+  if (res < 0) {
+    return res;
+  }
+  *decoded = m;
+  return 0;
+}
+
+int amqp_decode_properties(uint16_t class_id,
+                           amqp_pool_t *pool,
+                           amqp_bytes_t encoded,
+                           void **decoded)
+{
+  const amqp_class_desc_t *c = find_class(class_id);
+  size_t offset = 0;
+
+  amqp_flags_t flags = 0;
+  int flagword_index = 0;
+  uint16_t partial_flags;
+  char *p;
+  int res;
+
+  do {
+    if (!amqp_decode_16(encoded, &offset, &partial_flags))
+      return AMQP_STATUS_BAD_AMQP_DATA;
+    flags |= (partial_flags << (flagword_index * 16));
+    flagword_index++;
+  } while (partial_flags & 1);
+
+  if (NULL == c) {
+    return AMQP_STATUS_UNKNOWN_CLASS;
+  }
+  p = (char *) amqp_pool_alloc(pool, c->size);
+  if (p == NULL) { return AMQP_STATUS_NO_MEMORY; }
+  *(amqp_flags_t *) p = flags; /* _flags comes first in every class */
+
+  res = decode_fields(&amqp_property_fields[c->first_field], c->field_count,
+                      &flags, pool, encoded, &offset, p);
+  if (res < 0) {
+    return res;
+  }
+  *decoded = p;
+  return 0;
+}
+
+int amqp_encode_method(amqp_method_number_t methodNumber,
+                       void *decoded,
+                       amqp_bytes_t encoded)
+{
+  const amqp_method_desc_t *method = find_method(methodNumber);
+  size_t offset = 0;
+  int res;
+
+  if (NULL == method) {
+    return AMQP_STATUS_UNKNOWN_METHOD;
+  }
+  res = encode_fields(&amqp_method_fields[method->first_field],
+                      method->field_count, NULL, encoded, &offset,
+                      (char *) decoded);
+  if (res < 0) {
+    return res;
+  }
+  return offset;
+}
+
+int amqp_encode_properties(uint16_t class_id,
+                           void *decoded,
+                           amqp_bytes_t encoded)
+{
+  const amqp_class_desc_t *c = find_class(class_id);
+  size_t offset = 0;
+  int res;
+
+  /* Cheat, and get the flags out generically, relying on the
+     similarity of structure between classes */
+  amqp_flags_t flags = * (amqp_flags_t *) decoded; /* cheating! */
+
+  {
+    /* We take a copy of flags to avoid destroying it, as it is used
+       in the field loop below. */
+    amqp_flags_t remaining_flags = flags;
+    do {
+      amqp_flags_t remainder = remaining_flags >> 16;
+      uint16_t partial_flags = remaining_flags & 0xFFFE;
+      if (remainder != 0) { partial_flags |= 1; }
+      if (!amqp_encode_16(encoded, &offset, partial_flags))
+        return AMQP_STATUS_BAD_AMQP_DATA;
+      remaining_flags = remainder;
+    } while (remaining_flags != 0);
+  }
+
+  if (NULL == c) {
+    return AMQP_STATUS_UNKNOWN_CLASS;
+  }
+  res = encode_fields(&amqp_property_fields[c->first_field], c->field_count,
+                      &flags, encoded, &offset, (char *) decoded);
+  if (res < 0) {
+    return res;
+  }
+  return offset;
+}"""
+
+    methods = selectedMethods(spec)
+    classes = selectedClasses(spec, methods)
+    sortedMethods = sorted(methods, key=lambda m: (m.klass.index, m.index))
 
     print """/* Generated code. Do not edit. Edit and re-run codegen.py instead.
  *
@@ -387,6 +865,7 @@ def genErl(spec):
 #endif
 
 #include "amqp_private.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -412,25 +891,27 @@ amqp_boolean_t amqp_constant_is_hard_error(int constantNumber) {
   }
 }"""
 
-    print """
+    def genSwitchCodec():
+        print """
 char const *amqp_method_name(amqp_method_number_t methodNumber) {
   switch (methodNumber) {"""
-    for m in methods: genLookupMethodName(m)
-    print """    default: return NULL;
+        for m in methods: genLookupMethodName(m)
+        print """    default: return NULL;
   }
 }"""
 
-    print """
+        print """
 amqp_boolean_t amqp_method_has_content(amqp_method_number_t methodNumber) {
   switch (methodNumber) {"""
-    for m in methods:
-        if m.hasContent:
-            print '    case %s: return 1;' % (m.defName())
-    print """    default: return 0;
+        # kept whole so the content of a dropped method can be skipped too
+        for m in spec.allMethods():
+            if m.hasContent:
+                print '    case %s: return 1;' % (m.defName())
+        print """    default: return 0;
   }
 }"""
 
-    print """
+        print """
 int amqp_decode_method(amqp_method_number_t methodNumber,
                        amqp_pool_t *pool,
                        amqp_bytes_t encoded,
@@ -440,12 +921,12 @@ int amqp_decode_method(amqp_method_number_t methodNumber,
   uint8_t bit_buffer;
 
   switch (methodNumber) {"""
-    for m in methods: genDecodeMethodFields(m)
-    print """    default: return AMQP_STATUS_UNKNOWN_METHOD;
+        for m in methods: genDecodeMethodFields(m)
+        print """    default: return AMQP_STATUS_UNKNOWN_METHOD;
   }
 }"""
 
-    print """
+        print """
 int amqp_decode_properties(uint16_t class_id,
                            amqp_pool_t *pool,
                            amqp_bytes_t encoded,
@@ -465,12 +946,12 @@ int amqp_decode_properties(uint16_t class_id,
   } while (partial_flags & 1);
 
   switch (class_id) {"""
-    for c in spec.allClasses(): genDecodeProperties(c)
-    print """    default: return AMQP_STATUS_UNKNOWN_CLASS;
+        for c in classes: genDecodeProperties(c)
+        print """    default: return AMQP_STATUS_UNKNOWN_CLASS;
   }
 }"""
 
-    print """
+        print """
 int amqp_encode_method(amqp_method_number_t methodNumber,
                        void *decoded,
                        amqp_bytes_t encoded)
@@ -479,12 +960,12 @@ int amqp_encode_method(amqp_method_number_t methodNumber,
   uint8_t bit_buffer;
 
   switch (methodNumber) {"""
-    for m in methods: genEncodeMethodFields(m)
-    print """    default: return AMQP_STATUS_UNKNOWN_METHOD;
+        for m in methods: genEncodeMethodFields(m)
+        print """    default: return AMQP_STATUS_UNKNOWN_METHOD;
   }
 }"""
 
-    print """
+        print """
 int amqp_encode_properties(uint16_t class_id,
                            void *decoded,
                            amqp_bytes_t encoded)
@@ -510,11 +991,16 @@ int amqp_encode_properties(uint16_t class_id,
   }
 
   switch (class_id) {"""
-    for c in spec.allClasses(): genEncodeProperties(c)
-    print """    default: return AMQP_STATUS_UNKNOWN_CLASS;
+        for c in classes: genEncodeProperties(c)
+        print """    default: return AMQP_STATUS_UNKNOWN_CLASS;
   }
 }"""
 
+    if compactCodec:
+        genCompactCodec()
+    else:
+        genSwitchCodec()
+
     for m in methods:
         if not m.isSynchronous:
             continue
@@ -614,6 +1100,8 @@ AMQP_BEGIN_DECLS
     print "#define AMQP_PROTOCOL_VERSION_MINOR %d     /**< AMQP protocol version minor */" % (spec.minor)
     print "#define AMQP_PROTOCOL_VERSION_REVISION %d  /**< AMQP protocol version revision */" % (spec.revision)
     print "#define AMQP_PROTOCOL_PORT %d              /**< Default AMQP Port */" % (spec.port)
+    if methodWhitelist is not None:
+        print "#define AMQP_FRAMING_PRUNED 1          /**< Only some methods are supported, see codegen.py */"
 
     for (c,v,cls) in spec.constants:
         print "#define %s %s  /**< Constant: %s */" % (cConstantName(c), v, c)
@@ -752,15 +1240,8 @@ AMQP_CALL amqp_encode_properties(uint16_t class_id,
     for c in spec.allClasses():
         print "#define %s (0x%.04X) /**< %s class id @internal %d */" % \
               (cConstantName(c.name + "_class"), c.index, c.name, c.index)
-        index = 0
-        for f in c.fields:
-            if index % 16 == 15:
-                index = index + 1
-            shortnum = index // 16
-            partialindex = 15 - (index % 16)
-            bitindex = shortnum * 16 + partialindex
+        for (f, bitindex) in zip(c.fields, propertyFlagBits(c)):
             print '#define %s (1 << %d) /**< %s.%s property flag */' % (cFlagName(c, f), bitindex, c.name, f.name)
-            index = index + 1
         print "/** %s class properties */\ntypedef struct %s_ {\n  amqp_flags_t _flags; /**< bit-mask of set fields */\n%s} %s;\n" % \
               (c.name,
                c.structName(),
@@ -769,7 +1250,7 @@ AMQP_CALL amqp_encode_properties(uint16_t class_id,
 
     print "/* API functions for methods */\n"
 
-    for m in methods:
+    for m in selectedMethods(spec):
         if m.isSynchronous and apiMethodInfo.get(m.fullName()) is not False:
             print "%s;" % (m.apiPrototype(),)
 
@@ -785,4 +1266,5 @@ def generateHrl(specPath):
     genHrl(AmqpSpec(specPath))
 
 if __name__ == "__main__":
+    takeOptions(sys.argv)
     do_main(generateHrl, generateErl)
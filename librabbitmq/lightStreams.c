@@ -1,4 +1,9 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "lightStreams.h"
+#include "amqp_os.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -166,6 +171,88 @@ void lsReceiverAbortMessageCommon(lightStreamAggregateP_t lsAggP)
   }
 }
 
+#ifdef AMQP_OS_THREADS
+
+struct lightStreamMailBoxPub_s {
+  amqp_os_queue_t *queue;
+};
+
+static uint64_t lsMailBoxTimeoutNs(uint32_t timeOutMs)
+{
+  if (UINT32_MAX == timeOutMs) return AMQP_OS_WAIT_FOREVER;
+  return (uint64_t)timeOutMs * 1000000;
+}
+
+lightStreamMailBoxPubP_t lsMakeMailBoxCommon(lightStreamAggregateP_t lsAggP, uint32_t timeOutMs, const char *nameStr)
+{
+  lightStreamMailBoxPubP_t mailBox = malloc(sizeof(struct lightStreamMailBoxPub_s));
+  (void)lsAggP;
+  (void)timeOutMs;
+  (void)nameStr;
+
+  if (!mailBox) return NULL;
+
+  mailBox->queue = amqp_os_queue_new(1, 1);
+  if (!mailBox->queue) {
+    free(mailBox);
+    return NULL;
+  }
+  return mailBox;
+}
+
+int lsPostToMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP)
+{
+  char token = 0;
+  (void)lsAggP;
+
+  /* a full mailbox already has a post pending, which is all the receiver
+     needs to know */
+  amqp_os_queue_send(mailBoxInfoP->mailBox->queue, &token, 0);
+  return LS_STATUS_OK;
+}
+
+int lsGetFromMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP)
+{
+  char token;
+  (void)lsAggP;
+
+  if (AMQP_STATUS_OK != amqp_os_queue_recv(mailBoxInfoP->mailBox->queue, &token,
+                                           lsMailBoxTimeoutNs(mailBoxInfoP->timeOutMs))) {
+    return LS_MAILBOX_GET_TIMEOUT;
+  }
+  return LS_STATUS_OK;
+}
+
+int lsEmptyMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP)
+{
+  char token;
+  (void)lsAggP;
+
+  while (AMQP_STATUS_OK == amqp_os_queue_recv(mailBoxInfoP->mailBox->queue, &token, 0))
+    ;
+  return LS_STATUS_OK;
+}
+
+const struct lightStream_class_s lsCommonClass = {
+  lsSocketCommon,
+  lsSetLenCommon,
+  lsSendCommon,
+  lsLenCommon,
+  lsAvailableCommon,
+  lsPeekCommon,
+  lsTookBytesCommon,
+  lsOpenMessageCommon,
+  lsCloseMessageCommon,
+  lsSenderAbortMessageCommon,
+  lsSenderWaitForCloseCommon,
+  lsReceiverAbortMessageCommon,
+  lsMakeMailBoxCommon,
+  lsPostToMailBoxCommon,
+  lsGetFromMailBoxCommon,
+  lsEmptyMailBoxCommon
+};
+
+#endif /* AMQP_OS_THREADS */
 
 int lsSocket(lightStreamAggregateP_t lsAggP, lightStreamSocketSetupP_t setupInfoP)
 {
@@ -110,6 +110,17 @@ void lsSenderAbortMessageCommon(lightStreamAggregateP_t lsAggP);
 int lsSenderWaitForCloseCommon(lightStreamAggregateP_t lsAggP);
 void lsReceiverAbortMessageCommon(lightStreamAggregateP_t lsAggP);
 
+/* Mailboxes on top of the library's OS layer (amqp_os.h), for platforms
+ * where it is available. A mailbox holds at most one pending post; a
+ * timeOutMs of UINT32_MAX waits forever. */
+lightStreamMailBoxPubP_t lsMakeMailBoxCommon(lightStreamAggregateP_t lsAggP, uint32_t timeOutMs, const char *nameStr);
+int lsPostToMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP);
+int lsGetFromMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP);
+int lsEmptyMailBoxCommon(lightStreamAggregateP_t lsAggP, lightStreamMailBoxInfoP_t mailBoxInfoP);
+
+/* A complete class made of the Common functions above. */
+extern const struct lightStream_class_s lsCommonClass;
+
 
 
 
@@ -0,0 +1,63 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The framing codec the library was not built with, its functions renamed
+ * other_* so that test_framing_compact can run both in one program. */
+
+#define amqp_constant_name other_constant_name
+#define amqp_constant_is_hard_error other_constant_is_hard_error
+#define amqp_method_name other_method_name
+#define amqp_method_has_content other_method_has_content
+#define amqp_decode_method other_decode_method
+#define amqp_decode_properties other_decode_properties
+#define amqp_encode_method other_encode_method
+#define amqp_encode_properties other_encode_properties
+#define amqp_channel_open other_channel_open
+#define amqp_channel_flow other_channel_flow
+#define amqp_exchange_declare other_exchange_declare
+#define amqp_exchange_delete other_exchange_delete
+#define amqp_exchange_bind other_exchange_bind
+#define amqp_exchange_unbind other_exchange_unbind
+#define amqp_queue_declare other_queue_declare
+#define amqp_queue_bind other_queue_bind
+#define amqp_queue_purge other_queue_purge
+#define amqp_queue_delete other_queue_delete
+#define amqp_queue_unbind other_queue_unbind
+#define amqp_basic_qos other_basic_qos
+#define amqp_basic_consume other_basic_consume
+#define amqp_basic_cancel other_basic_cancel
+#define amqp_basic_recover other_basic_recover
+#define amqp_tx_select other_tx_select
+#define amqp_tx_commit other_tx_commit
+#define amqp_tx_rollback other_tx_rollback
+#define amqp_confirm_select other_confirm_select
+
+#ifdef AMQP_FRAMING_COMPACT
+#include "amqp_framing.c"
+#else
+#include "amqp_framing_compact.c"
+#endif
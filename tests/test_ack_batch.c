@@ -0,0 +1,289 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* Ack batching over a memory socket pair: the test plays the broker on the
+ * peer connection and checks the basic.ack methods that reach it. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define NS_PER_MS 1000000ULL
+
+static void send_deliver(struct pair *p, uint64_t tag)
+{
+  amqp_basic_deliver_t deliver;
+
+  memset(&deliver, 0, sizeof(deliver));
+  deliver.consumer_tag = amqp_cstring_bytes("ctag");
+  deliver.delivery_tag = tag;
+  check(AMQP_STATUS_OK == amqp_send_method(p->broker, 1,
+                                           AMQP_BASIC_DELIVER_METHOD,
+                                           &deliver),
+        "send deliver");
+}
+
+/* the client reads deliveries from..to, as a consumer would */
+static void deliver(struct pair *p, uint64_t from, uint64_t to)
+{
+  amqp_frame_t frame;
+  uint64_t tag;
+
+  for (tag = from; tag <= to; ++tag) {
+    send_deliver(p, tag);
+    check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->client, &frame) &&
+          AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id,
+          "read deliver");
+  }
+}
+
+static void ack(struct pair *p, uint64_t tag)
+{
+  check(AMQP_STATUS_OK == amqp_basic_ack(p->client, 1, tag, 0), "ack");
+}
+
+static void expect_ack(struct pair *p, uint64_t tag, amqp_boolean_t multiple)
+{
+  struct timeval timeout = {1, 0};
+  amqp_basic_ack_t *m;
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK ==
+        amqp_simple_wait_frame_noblock(p->broker, &frame, &timeout),
+        "broker reads ack");
+  check(AMQP_BASIC_ACK_METHOD == frame.payload.method.id, "basic.ack");
+  m = frame.payload.method.decoded;
+  if (m->delivery_tag != tag || m->multiple != multiple) {
+    fprintf(stderr, "ack %lu/%d, expected %lu/%d\n",
+            (unsigned long)m->delivery_tag, (int)m->multiple,
+            (unsigned long)tag, (int)multiple);
+    abort();
+  }
+}
+
+static void expect_nothing(struct pair *p)
+{
+  struct timeval timeout = {0, 0};
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p->broker, &frame, &timeout),
+        "no ack sent");
+}
+
+static void test_in_order(void)
+{
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 3, NULL),
+        "enable batching");
+  deliver(&p, 1, 5);
+  ack(&p, 1);
+  ack(&p, 2);
+  expect_nothing(&p);
+  ack(&p, 3);
+  expect_ack(&p, 3, 1);
+  ack(&p, 4);
+  ack(&p, 5);
+  expect_nothing(&p);
+  check(AMQP_STATUS_OK == amqp_flush_acks(p.client, 1), "flush");
+  expect_ack(&p, 5, 1);
+  pair_close(&p);
+}
+
+/* acks that skip ahead go out alone and are absorbed once the gap fills */
+static void test_out_of_order(void)
+{
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 2, NULL),
+        "enable batching");
+  deliver(&p, 1, 5);
+  ack(&p, 3);
+  expect_ack(&p, 3, 0);
+  ack(&p, 2);
+  expect_ack(&p, 2, 0);
+  ack(&p, 1);
+  expect_nothing(&p);
+  /* 1..3 are settled, so 4 continues the batch */
+  ack(&p, 4);
+  expect_ack(&p, 4, 1);
+  pair_close(&p);
+}
+
+/* only 64 tags above the batch are remembered */
+static void test_window(void)
+{
+  struct pair p;
+  uint64_t tag;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 1000, NULL),
+        "enable batching");
+  deliver(&p, 1, 67);
+  for (tag = 2; tag <= 64; ++tag) {
+    ack(&p, tag);
+    expect_ack(&p, tag, 0);
+  }
+  ack(&p, 66);
+  expect_ack(&p, 66, 0);
+  /* absorbs 2..64, the batched ack carries the tag acked last */
+  ack(&p, 1);
+  check(AMQP_STATUS_OK == amqp_flush_acks(p.client, 1), "flush");
+  expect_ack(&p, 1, 1);
+  ack(&p, 65);
+  check(AMQP_STATUS_OK == amqp_flush_acks(p.client, 1), "flush");
+  expect_ack(&p, 65, 1);
+  /* 66 was past the window, so 67 can't be batched */
+  ack(&p, 67);
+  expect_ack(&p, 67, 0);
+  pair_close(&p);
+}
+
+static void test_delay(void)
+{
+  struct timeval delay = {1, 0};
+  struct timeval no_wait = {0, 0};
+  uint64_t now = 1000 * NS_PER_MS;
+  amqp_frame_t frame;
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  amqp_set_clock(p.client, fake_clock, &now);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 100, &delay),
+        "enable batching");
+  deliver(&p, 1, 4);
+  ack(&p, 1);
+  now += 500 * NS_PER_MS;
+  ack(&p, 2);
+  expect_nothing(&p);
+  now += 600 * NS_PER_MS;
+  ack(&p, 3);
+  expect_ack(&p, 3, 1);
+
+  /* held back acks go out before the client waits on the socket */
+  ack(&p, 4);
+  expect_nothing(&p);
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p.client, &frame, &no_wait),
+        "client wait");
+  expect_ack(&p, 4, 1);
+  pair_close(&p);
+}
+
+/* enabled on a channel that already had (settled) deliveries */
+static void test_enable_midstream(void)
+{
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  deliver(&p, 1, 3);
+  ack(&p, 1);
+  ack(&p, 2);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 2, NULL),
+        "enable batching");
+  /* no delivery seen since enabling, so this one passes through */
+  ack(&p, 3);
+  expect_ack(&p, 1, 0);
+  expect_ack(&p, 2, 0);
+  expect_ack(&p, 3, 0);
+  deliver(&p, 4, 5);
+  ack(&p, 4);
+  expect_nothing(&p);
+  ack(&p, 5);
+  expect_ack(&p, 5, 1);
+  pair_close(&p);
+}
+
+/* a broker channel.close drops held back acks */
+static void test_broker_close(void)
+{
+  amqp_channel_close_t close;
+  amqp_channel_close_ok_t close_ok;
+  amqp_frame_t frame;
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 10, NULL),
+        "enable batching");
+  memset(&close, 0, sizeof(close));
+  close.reply_code = 406;
+  close.reply_text = amqp_cstring_bytes("PRECONDITION_FAILED");
+  send_deliver(&p, 1);
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 1,
+                                           AMQP_CHANNEL_CLOSE_METHOD, &close),
+        "send channel.close");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.client, &frame) &&
+        AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id,
+        "read deliver");
+  ack(&p, 1);
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.client, &frame) &&
+        AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id,
+        "read channel.close");
+  check(AMQP_STATUS_OK == amqp_send_method(p.client, 1,
+                                           AMQP_CHANNEL_CLOSE_OK_METHOD,
+                                           &close_ok),
+        "send close-ok");
+  check(AMQP_STATUS_OK == amqp_flush_acks(p.client, 1), "flush");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame) &&
+        AMQP_CHANNEL_CLOSE_OK_METHOD == frame.payload.method.id,
+        "only close-ok reaches the broker");
+  expect_nothing(&p);
+
+  /* the reopened channel numbers deliveries from 1 again */
+  check(AMQP_STATUS_OK == amqp_set_ack_batching(p.client, 1, 2, NULL),
+        "enable batching again");
+  deliver(&p, 1, 2);
+  ack(&p, 1);
+  expect_nothing(&p);
+  ack(&p, 2);
+  expect_ack(&p, 2, 1);
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_in_order();
+  test_out_of_order();
+  test_window();
+  test_delay();
+  test_enable_midstream();
+  test_broker_close();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,109 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* A user clock (amqp_set_clock) drives heartbeats over a memory socket: the
+ * test writes raw frames to the peer end and moves the clock by hand. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+/* heartbeats follow a user clock, not the wall clock */
+static void test_user_clock(void)
+{
+  static const uint8_t close_ok[] = {0, 20, 0, 41};
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(conn, PAIR_RING_SIZE);
+  uint64_t now = 1000000000;
+  struct timeval timeout;
+  amqp_frame_t frame;
+  uint8_t out[64];
+
+  /* a first frame takes the connection out of its initial state */
+  amqp_memory_socket_peer_write(socket, out,
+                                put_frame(out, AMQP_FRAME_METHOD, 1,
+                                          close_ok, sizeof(close_ok)));
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "first frame");
+
+  amqp_set_clock(conn, fake_clock, &now);
+  check(AMQP_STATUS_OK == amqp_tune_connection(conn, 0, 131072, 1),
+        "tune with heartbeats");
+
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 1000;
+  now += 500000000;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(conn, &frame, &timeout),
+        "no heartbeat timeout yet");
+  check(8 == amqp_memory_socket_peer_read(socket, out, sizeof(out)) &&
+        AMQP_FRAME_HEARTBEAT == out[0], "heartbeat sent when due");
+
+  now += 3000000000ULL;
+  check(AMQP_STATUS_HEARTBEAT_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(conn, &frame, &timeout),
+        "missed heartbeats detected");
+  amqp_destroy_connection(conn);
+
+  /* publishing alone notices missed heartbeats too */
+  conn = amqp_new_connection();
+  socket = amqp_memory_socket_new(conn, PAIR_RING_SIZE);
+  amqp_memory_socket_peer_write(socket, out,
+                                put_frame(out, AMQP_FRAME_METHOD, 1,
+                                          close_ok, sizeof(close_ok)));
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "first frame");
+  amqp_set_clock(conn, fake_clock, &now);
+  check(AMQP_STATUS_OK == amqp_tune_connection(conn, 0, 131072, 1),
+        "tune with heartbeats");
+  check(AMQP_STATUS_OK ==
+        amqp_basic_publish(conn, 1, amqp_cstring_bytes("x"),
+                           amqp_cstring_bytes("k"), 0, 0, NULL,
+                           amqp_cstring_bytes("m")),
+        "publish in time");
+  now += 3000000000ULL;
+  check(AMQP_STATUS_HEARTBEAT_TIMEOUT ==
+        amqp_basic_publish(conn, 1, amqp_cstring_bytes("x"),
+                           amqp_cstring_bytes("k"), 0, 0, NULL,
+                           amqp_cstring_bytes("m")),
+        "publish notices missed heartbeats");
+  amqp_destroy_connection(conn);
+}
+
+int main(void)
+{
+  test_user_clock();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,251 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* Publisher confirms over a memory socket pair: the test plays the broker
+ * on the peer connection, queueing its replies before the client reads. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define WINDOW 4
+
+static void select_ok(struct pair *p)
+{
+  amqp_confirm_select_ok_t ok;
+  amqp_rpc_reply_t reply;
+
+  check(AMQP_STATUS_OK == amqp_send_method(p->broker, 1,
+                                           AMQP_CONFIRM_SELECT_OK_METHOD,
+                                           &ok),
+        "send select-ok");
+  reply = amqp_confirm_enable(p->client, 1, WINDOW);
+  check(AMQP_RESPONSE_NORMAL == reply.reply_type, "confirm mode");
+}
+
+/* a pair whose client has confirms enabled on channel 1 */
+static void confirm_pair_open(struct pair *p)
+{
+  pair_open(p, PAIR_RING_SIZE);
+  select_ok(p);
+}
+
+static int publish(struct pair *p)
+{
+  return amqp_basic_publish(p->client, 1, amqp_empty_bytes,
+                            amqp_cstring_bytes("q"), 0, 0, NULL,
+                            amqp_cstring_bytes("x"));
+}
+
+static void confirm(struct pair *p, uint64_t tag, amqp_boolean_t multiple,
+                    amqp_boolean_t acked)
+{
+  int res;
+
+  if (acked) {
+    amqp_basic_ack_t ack;
+    ack.delivery_tag = tag;
+    ack.multiple = multiple;
+    res = amqp_send_method(p->broker, 1, AMQP_BASIC_ACK_METHOD, &ack);
+  } else {
+    amqp_basic_nack_t nack;
+    nack.delivery_tag = tag;
+    nack.multiple = multiple;
+    nack.requeue = 0;
+    res = amqp_send_method(p->broker, 1, AMQP_BASIC_NACK_METHOD, &nack);
+  }
+  check(AMQP_STATUS_OK == res, "send confirm");
+}
+
+static void heartbeat(struct pair *p)
+{
+  amqp_frame_t frame;
+
+  frame.frame_type = AMQP_FRAME_HEARTBEAT;
+  frame.channel = 0;
+  check(AMQP_STATUS_OK == amqp_send_frame(p->broker, &frame),
+        "send heartbeat");
+}
+
+/* results come out in publish order, only once the oldest is confirmed */
+static void test_ordering(void)
+{
+  struct pair p;
+  amqp_confirm_t results[8];
+  int i;
+
+  confirm_pair_open(&p);
+  for (i = 0; i < 3; ++i) {
+    check(AMQP_STATUS_OK == publish(&p), "publish");
+  }
+  check(3 == amqp_confirm_last_seqno(p.client, 1), "seqnos 1..3");
+
+  confirm(&p, 2, 0, 0);
+  confirm(&p, 3, 0, 1);
+  check(0 == amqp_confirm_poll(p.client, 1, results, 8), "head pending");
+  check(1 == amqp_confirm_outstanding(p.client, 1), "one outstanding");
+
+  confirm(&p, 1, 0, 1);
+  check(3 == amqp_confirm_poll(p.client, 1, results, 8), "three results");
+  check(1 == results[0].delivery_tag && results[0].acked, "1 acked");
+  check(2 == results[1].delivery_tag && !results[1].acked, "2 nacked");
+  check(3 == results[2].delivery_tag && results[2].acked, "3 acked");
+
+  for (i = 0; i < 3; ++i) {
+    check(AMQP_STATUS_OK == publish(&p), "publish");
+  }
+  confirm(&p, 5, 1, 1);
+  check(2 == amqp_confirm_poll(p.client, 1, results, 8), "multiple ack");
+  check(4 == results[0].delivery_tag && 5 == results[1].delivery_tag,
+        "multiple ack range");
+  check(1 == amqp_confirm_outstanding(p.client, 1), "6 outstanding");
+  pair_close(&p);
+}
+
+/* a full window blocks until the head is confirmed, nacks are not dropped */
+static void test_full_window(void)
+{
+  struct pair p;
+  amqp_confirm_t results[8];
+  int i;
+
+  confirm_pair_open(&p);
+  for (i = 0; i < WINDOW; ++i) {
+    check(AMQP_STATUS_OK == publish(&p), "fill window");
+  }
+
+  /* publish reads past the heartbeat to the ack and retires it unpolled */
+  heartbeat(&p);
+  confirm(&p, 1, 0, 1);
+  check(AMQP_STATUS_OK == publish(&p), "publish after ack");
+  check(5 == amqp_confirm_last_seqno(p.client, 1), "seqno 5");
+  check(WINDOW == amqp_confirm_outstanding(p.client, 1), "2..5 outstanding");
+
+  confirm(&p, 2, 0, 0);
+  check(AMQP_STATUS_UNEXPECTED_STATE == publish(&p), "unpolled nack");
+  check(5 == amqp_confirm_last_seqno(p.client, 1), "no seqno taken");
+  check(1 == amqp_confirm_poll(p.client, 1, results, 8) &&
+        2 == results[0].delivery_tag && !results[0].acked, "nack collected");
+  check(AMQP_STATUS_OK == publish(&p), "publish after poll");
+  check(6 == amqp_confirm_last_seqno(p.client, 1), "seqno 6");
+  pair_close(&p);
+}
+
+/* the broker closing the channel releases a blocked publisher */
+static void test_close_while_blocked(void)
+{
+  struct pair p;
+  amqp_channel_close_t close;
+  amqp_confirm_t results[8];
+  amqp_frame_t frame;
+  int i;
+
+  confirm_pair_open(&p);
+  for (i = 0; i < WINDOW; ++i) {
+    check(AMQP_STATUS_OK == publish(&p), "fill window");
+  }
+
+  memset(&close, 0, sizeof(close));
+  close.reply_code = 404;
+  close.reply_text = amqp_cstring_bytes("NOT_FOUND");
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 1,
+                                           AMQP_CHANNEL_CLOSE_METHOD, &close),
+        "send channel.close");
+  check(AMQP_STATUS_UNEXPECTED_STATE == publish(&p), "blocked publish fails");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.client, &frame) &&
+        AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id,
+        "close left queued");
+  check(0 == amqp_confirm_outstanding(p.client, 1), "window dropped");
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_confirm_poll(p.client, 1, results, 8), "not in confirm mode");
+
+  /* a reopened channel starts numbering from 1 again */
+  select_ok(&p);
+  check(0 == amqp_confirm_last_seqno(p.client, 1), "fresh window");
+  check(AMQP_STATUS_OK == publish(&p), "publish after reopen");
+  confirm(&p, 1, 0, 1);
+  check(1 == amqp_confirm_poll(p.client, 1, results, 8) &&
+        1 == results[0].delivery_tag, "tag 1 after reopen");
+  pair_close(&p);
+}
+
+/* a clock that moves a minute every time it is read */
+static uint64_t stepping_clock(void *arg)
+{
+  uint64_t *now = arg;
+
+  *now += 60 * (uint64_t)1000000000;
+  return *now;
+}
+
+/* the wait deadline is measured on the connection clock */
+static void test_wait(void)
+{
+  struct pair p;
+  struct timeval timeout = {30, 0};
+  amqp_confirm_t results[8];
+  uint64_t now = 1000000000;
+
+  confirm_pair_open(&p);
+  check(AMQP_STATUS_OK == amqp_confirm_wait(p.client, 1, &timeout),
+        "nothing outstanding");
+  check(AMQP_STATUS_OK == publish(&p), "publish");
+  heartbeat(&p);
+  confirm(&p, 1, 0, 1);
+  check(AMQP_STATUS_OK == amqp_confirm_wait(p.client, 1, &timeout),
+        "wait for the ack");
+  check(1 == amqp_confirm_poll(p.client, 1, results, 8) &&
+        1 == results[0].delivery_tag && results[0].acked, "1 acked");
+
+  /* with a real clock this would block for 30 seconds */
+  check(AMQP_STATUS_OK == publish(&p), "publish");
+  amqp_set_clock(p.client, stepping_clock, &now);
+  check(AMQP_STATUS_TIMEOUT == amqp_confirm_wait(p.client, 1, &timeout),
+        "user clock deadline");
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_confirm_wait(p.client, 2, &timeout), "not in confirm mode");
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_ordering();
+  test_full_window();
+  test_close_while_blocked();
+  test_wait();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,257 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* amqp_dispatch() over a memory socket pair: the test plays the broker on
+ * the peer connection, queueing deliveries before the client dispatches. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define RING_SIZE 262144
+#define CONSUMERS 200
+
+/* basic.deliver, a content header and the body split into frame_size
+ * pieces */
+static void deliver(struct pair *p, amqp_channel_t channel, const char *tag,
+                    uint64_t delivery_tag, amqp_bytes_t body,
+                    size_t frame_size)
+{
+  amqp_basic_deliver_t method;
+  amqp_basic_properties_t props;
+  amqp_frame_t frame;
+  size_t sent = 0;
+
+  memset(&method, 0, sizeof(method));
+  method.consumer_tag = amqp_cstring_bytes(tag);
+  method.delivery_tag = delivery_tag;
+  method.exchange = amqp_cstring_bytes("amq.direct");
+  method.routing_key = amqp_cstring_bytes("key");
+  check(AMQP_STATUS_OK == amqp_send_method(p->broker, channel,
+                                           AMQP_BASIC_DELIVER_METHOD,
+                                           &method),
+        "send basic.deliver");
+
+  memset(&props, 0, sizeof(props));
+  props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG;
+  props.content_type = amqp_cstring_bytes("text/plain");
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.channel = channel;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body.len;
+  frame.payload.properties.decoded = &props;
+  check(AMQP_STATUS_OK == amqp_send_frame(p->broker, &frame),
+        "send content header");
+
+  while (sent < body.len) {
+    size_t len = body.len - sent < frame_size ? body.len - sent : frame_size;
+    frame.frame_type = AMQP_FRAME_BODY;
+    frame.channel = channel;
+    frame.payload.body_fragment.bytes = (char *)body.bytes + sent;
+    frame.payload.body_fragment.len = len;
+    check(AMQP_STATUS_OK == amqp_send_frame(p->broker, &frame),
+          "send body frame");
+    sent += len;
+  }
+}
+
+struct seen {
+  int consumer;
+  amqp_channel_t channel;
+  uint64_t delivery_tag;
+  size_t body_len;
+  unsigned long body_sum;
+  int content_type_ok;
+};
+
+static unsigned long sum(amqp_bytes_t bytes)
+{
+  unsigned long s = 0;
+  size_t i;
+
+  for (i = 0; i < bytes.len; ++i) {
+    s = s * 31 + ((unsigned char *)bytes.bytes)[i];
+  }
+  return s;
+}
+
+static struct seen seen[16];
+static int seen_count;
+
+static int record(void *ctx, const amqp_delivery_view_t *delivery)
+{
+  struct seen *s = &seen[seen_count++];
+
+  s->consumer = (int)(size_t)ctx;
+  s->channel = delivery->channel;
+  s->delivery_tag = delivery->delivery_tag;
+  s->body_len = delivery->body.len;
+  s->body_sum = sum(delivery->body);
+  s->content_type_ok =
+    (delivery->properties->_flags & AMQP_BASIC_CONTENT_TYPE_FLAG) &&
+    10 == delivery->properties->content_type.len;
+  return AMQP_STATUS_OK;
+}
+
+static int dispatch_now(struct pair *p, int max_msgs)
+{
+  struct timeval timeout;
+
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  return amqp_dispatch(p->client, &timeout, max_msgs);
+}
+
+/* many registrations share the table; each delivery reaches its own
+ * handler, the same tag on another channel is another consumer */
+static void test_lookup(void)
+{
+  struct pair p;
+  amqp_envelope_t envelope;
+  amqp_rpc_reply_t reply;
+  struct timeval timeout;
+  char tag[32];
+  int i;
+
+  pair_open(&p, RING_SIZE);
+  for (i = 0; i < CONSUMERS; ++i) {
+    sprintf(tag, "ctag-%d", i);
+    check(AMQP_STATUS_OK ==
+          amqp_register_consumer(p.client, 1, amqp_cstring_bytes(tag),
+                                 record, (void *)(size_t)i),
+          "register");
+  }
+  check(AMQP_STATUS_OK ==
+        amqp_register_consumer(p.client, 2, amqp_cstring_bytes("ctag-7"),
+                               record, (void *)(size_t)1000),
+        "register on another channel");
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_register_consumer(p.client, 1, amqp_empty_bytes, record, NULL),
+        "empty tag rejected");
+
+  seen_count = 0;
+  deliver(&p, 1, "ctag-7", 1, amqp_cstring_bytes("seven"), 1024);
+  deliver(&p, 2, "ctag-7", 1, amqp_cstring_bytes("other"), 1024);
+  deliver(&p, 1, "ctag-199", 2, amqp_cstring_bytes("last"), 1024);
+  deliver(&p, 1, "ctag-0", 3, amqp_cstring_bytes("first"), 1024);
+  check(4 == dispatch_now(&p, 0), "four dispatched");
+  check(7 == seen[0].consumer && 1 == seen[0].channel, "ctag-7 on 1");
+  check(1000 == seen[1].consumer && 2 == seen[1].channel, "ctag-7 on 2");
+  check(199 == seen[2].consumer && 2 == seen[2].delivery_tag, "ctag-199");
+  check(0 == seen[3].consumer && 3 == seen[3].delivery_tag, "ctag-0");
+  check(seen[3].body_len == 5 &&
+        seen[3].body_sum == sum(amqp_cstring_bytes("first")) &&
+        seen[3].content_type_ok, "delivery contents");
+
+  /* max_msgs stops early, the rest waits for the next call */
+  seen_count = 0;
+  deliver(&p, 1, "ctag-1", 4, amqp_cstring_bytes("a"), 1024);
+  deliver(&p, 1, "ctag-2", 5, amqp_cstring_bytes("b"), 1024);
+  check(1 == dispatch_now(&p, 1), "one of two");
+  check(1 == dispatch_now(&p, 0), "the other one");
+  check(2 == seen_count && 1 == seen[0].consumer && 2 == seen[1].consumer,
+        "in order");
+
+  /* re-registering replaces, a NULL handler unregisters */
+  check(AMQP_STATUS_OK ==
+        amqp_register_consumer(p.client, 1, amqp_cstring_bytes("ctag-1"),
+                               record, (void *)(size_t)500),
+        "re-register");
+  check(AMQP_STATUS_OK ==
+        amqp_register_consumer(p.client, 1, amqp_cstring_bytes("ctag-2"),
+                               NULL, NULL),
+        "unregister");
+  seen_count = 0;
+  deliver(&p, 1, "ctag-1", 6, amqp_cstring_bytes("c"), 1024);
+  deliver(&p, 1, "ctag-2", 7, amqp_cstring_bytes("d"), 1024);
+  check(1 == dispatch_now(&p, 0), "stops at the unregistered tag");
+  check(500 == seen[0].consumer, "replaced handler");
+  check(AMQP_STATUS_UNEXPECTED_STATE == dispatch_now(&p, 0),
+        "unregistered tag left for the caller");
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  reply = amqp_consume_message(p.client, &envelope, &timeout, 0);
+  check(AMQP_RESPONSE_NORMAL == reply.reply_type &&
+        7 == envelope.delivery_tag && 1 == envelope.message.body.len,
+        "read with amqp_consume_message()");
+  amqp_destroy_envelope(&envelope);
+  pair_close(&p);
+}
+
+/* bodies split over several frames are put back together, a body in a
+ * single frame is handed out as is */
+static void test_reassembly(void)
+{
+  static char body[10000];
+  struct pair p;
+  amqp_bytes_t bytes;
+  size_t i;
+
+  pair_open(&p, RING_SIZE);
+  for (i = 0; i < sizeof(body); ++i) {
+    body[i] = (char)(i * 7 + i / 256);
+  }
+  bytes.bytes = body;
+  bytes.len = sizeof(body);
+  check(AMQP_STATUS_OK ==
+        amqp_register_consumer(p.client, 1, amqp_cstring_bytes("c"), record,
+                               NULL),
+        "register");
+
+  seen_count = 0;
+  deliver(&p, 1, "c", 1, bytes, 1000);
+  deliver(&p, 1, "c", 2, bytes, 3333);
+  deliver(&p, 1, "c", 3, bytes, sizeof(body));
+  bytes.len = 0;
+  deliver(&p, 1, "c", 4, bytes, 1);
+  check(4 == dispatch_now(&p, 0), "four dispatched");
+  bytes.len = sizeof(body);
+  for (i = 0; i < 3; ++i) {
+    check(sizeof(body) == seen[i].body_len &&
+          sum(bytes) == seen[i].body_sum, "body reassembled");
+  }
+  check(0 == seen[3].body_len, "empty body");
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_lookup();
+  test_reassembly();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
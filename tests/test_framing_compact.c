@@ -0,0 +1,248 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* Randomized equivalence of the switch and table-driven (compact) framing
+ * codecs: both decode the same random input to the same result, and
+ * encode the same values, into roomy and short buffers, to the same
+ * bytes. One of them is the library's, the other is built into the test
+ * from framing_other.c. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#define ITERATIONS 300000
+
+char const *other_method_name(amqp_method_number_t methodNumber);
+amqp_boolean_t other_method_has_content(amqp_method_number_t methodNumber);
+int other_decode_method(amqp_method_number_t methodNumber, amqp_pool_t *pool,
+                        amqp_bytes_t encoded, void **decoded);
+int other_decode_properties(uint16_t class_id, amqp_pool_t *pool,
+                            amqp_bytes_t encoded, void **decoded);
+int other_encode_method(amqp_method_number_t methodNumber, void *decoded,
+                        amqp_bytes_t encoded);
+int other_encode_properties(uint16_t class_id, void *decoded,
+                            amqp_bytes_t encoded);
+
+static const amqp_method_number_t methods[] = {
+  AMQP_FRAME_METHOD,
+  AMQP_CONNECTION_START_METHOD,
+  AMQP_CONNECTION_START_OK_METHOD,
+  AMQP_CONNECTION_SECURE_METHOD,
+  AMQP_CONNECTION_SECURE_OK_METHOD,
+  AMQP_CONNECTION_TUNE_METHOD,
+  AMQP_CONNECTION_TUNE_OK_METHOD,
+  AMQP_CONNECTION_OPEN_METHOD,
+  AMQP_CONNECTION_OPEN_OK_METHOD,
+  AMQP_CONNECTION_CLOSE_METHOD,
+  AMQP_CONNECTION_CLOSE_OK_METHOD,
+  AMQP_CONNECTION_BLOCKED_METHOD,
+  AMQP_CONNECTION_UNBLOCKED_METHOD,
+  AMQP_CHANNEL_OPEN_METHOD,
+  AMQP_CHANNEL_OPEN_OK_METHOD,
+  AMQP_CHANNEL_FLOW_METHOD,
+  AMQP_CHANNEL_FLOW_OK_METHOD,
+  AMQP_CHANNEL_CLOSE_METHOD,
+  AMQP_CHANNEL_CLOSE_OK_METHOD,
+  AMQP_ACCESS_REQUEST_METHOD,
+  AMQP_ACCESS_REQUEST_OK_METHOD,
+  AMQP_EXCHANGE_DECLARE_METHOD,
+  AMQP_EXCHANGE_DECLARE_OK_METHOD,
+  AMQP_EXCHANGE_DELETE_METHOD,
+  AMQP_EXCHANGE_DELETE_OK_METHOD,
+  AMQP_EXCHANGE_BIND_METHOD,
+  AMQP_EXCHANGE_BIND_OK_METHOD,
+  AMQP_EXCHANGE_UNBIND_METHOD,
+  AMQP_EXCHANGE_UNBIND_OK_METHOD,
+  AMQP_QUEUE_DECLARE_METHOD,
+  AMQP_QUEUE_DECLARE_OK_METHOD,
+  AMQP_QUEUE_BIND_METHOD,
+  AMQP_QUEUE_BIND_OK_METHOD,
+  AMQP_QUEUE_PURGE_METHOD,
+  AMQP_QUEUE_PURGE_OK_METHOD,
+  AMQP_QUEUE_DELETE_METHOD,
+  AMQP_QUEUE_DELETE_OK_METHOD,
+  AMQP_QUEUE_UNBIND_METHOD,
+  AMQP_QUEUE_UNBIND_OK_METHOD,
+  AMQP_BASIC_QOS_METHOD,
+  AMQP_BASIC_QOS_OK_METHOD,
+  AMQP_BASIC_CONSUME_METHOD,
+  AMQP_BASIC_CONSUME_OK_METHOD,
+  AMQP_BASIC_CANCEL_METHOD,
+  AMQP_BASIC_CANCEL_OK_METHOD,
+  AMQP_BASIC_PUBLISH_METHOD,
+  AMQP_BASIC_RETURN_METHOD,
+  AMQP_BASIC_DELIVER_METHOD,
+  AMQP_BASIC_GET_METHOD,
+  AMQP_BASIC_GET_OK_METHOD,
+  AMQP_BASIC_GET_EMPTY_METHOD,
+  AMQP_BASIC_ACK_METHOD,
+  AMQP_BASIC_REJECT_METHOD,
+  AMQP_BASIC_RECOVER_ASYNC_METHOD,
+  AMQP_BASIC_RECOVER_METHOD,
+  AMQP_BASIC_RECOVER_OK_METHOD,
+  AMQP_BASIC_NACK_METHOD,
+  AMQP_TX_SELECT_METHOD,
+  AMQP_TX_SELECT_OK_METHOD,
+  AMQP_TX_COMMIT_METHOD,
+  AMQP_TX_COMMIT_OK_METHOD,
+  AMQP_TX_ROLLBACK_METHOD,
+  AMQP_TX_ROLLBACK_OK_METHOD,
+  AMQP_CONFIRM_SELECT_METHOD,
+  AMQP_CONFIRM_SELECT_OK_METHOD,
+  0x00FF0001, /* unknown */
+  0x003C0000
+};
+
+#define METHOD_COUNT (sizeof(methods) / sizeof(methods[0]))
+
+static void check(int condition, const char *what, long iteration)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s (iteration %ld)\n", what, iteration);
+    abort();
+  }
+}
+
+/* mostly small values, so lengths and counts often fit the input */
+static void fill_random(uint8_t *buf, size_t len)
+{
+  size_t i;
+  for (i = 0; i < len; ++i) {
+    buf[i] = (uint8_t)(rand() % 8 < 5 ? rand() % 6 : rand());
+  }
+}
+
+static int decode(int other, int properties, amqp_method_number_t id,
+                  uint16_t class_id, amqp_pool_t *pool, amqp_bytes_t encoded,
+                  void **decoded)
+{
+  if (properties) {
+    return (other ? other_decode_properties : amqp_decode_properties)(
+             class_id, pool, encoded, decoded);
+  }
+  return (other ? other_decode_method : amqp_decode_method)(
+           id, pool, encoded, decoded);
+}
+
+static int encode(int other, int properties, amqp_method_number_t id,
+                  uint16_t class_id, void *decoded, amqp_bytes_t encoded)
+{
+  if (properties) {
+    return (other ? other_encode_properties : amqp_encode_properties)(
+             class_id, decoded, encoded);
+  }
+  return (other ? other_encode_method : amqp_encode_method)(
+           id, decoded, encoded);
+}
+
+int main(void)
+{
+  static uint8_t input[128];
+  static uint8_t out[3][4096];
+  size_t i;
+  long iteration;
+  long decoded_ok = 0;
+
+  for (i = 0; i < METHOD_COUNT; ++i) {
+    char const *name = amqp_method_name(methods[i]);
+    char const *other_name = other_method_name(methods[i]);
+    check((NULL == name) == (NULL == other_name) &&
+          (NULL == name || 0 == strcmp(name, other_name)),
+          "method names", (long)i);
+    check(amqp_method_has_content(methods[i]) ==
+          other_method_has_content(methods[i]), "has content", (long)i);
+  }
+
+  srand(7);
+  for (iteration = 0; iteration < ITERATIONS; ++iteration) {
+    int properties = (0 == iteration % 4);
+    amqp_method_number_t id = methods[rand() % METHOD_COUNT];
+    uint16_t class_id = (0 == rand() % 8 ? AMQP_CONNECTION_CLASS
+                                         : AMQP_BASIC_CLASS);
+    amqp_bytes_t encoded;
+    amqp_bytes_t buffers[3];
+    amqp_pool_t pools[2];
+    void *decoded[2];
+    int res[3];
+    int k;
+
+    encoded.len = rand() % sizeof(input);
+    encoded.bytes = input;
+    fill_random(input, encoded.len);
+    if (properties && encoded.len >= 2) {
+      /* a single flag word, often with few flags set */
+      input[0] = (uint8_t)rand();
+      input[1] = (uint8_t)(rand() & 0xFE);
+      if (rand() % 4) {
+        input[0] &= 0xF0;
+      }
+    }
+
+    for (k = 0; k < 2; ++k) {
+      init_amqp_pool(&pools[k], 4096);
+      decoded[k] = NULL;
+      res[k] = decode(k, properties, id, class_id, &pools[k], encoded,
+                      &decoded[k]);
+    }
+    check(res[0] == res[1], "decode result", iteration);
+
+    if (AMQP_STATUS_OK == res[0]) {
+      for (k = 0; k < 3; ++k) {
+        buffers[k].bytes = out[k];
+        buffers[k].len = sizeof(out[k]);
+      }
+      /* each codec encodes its own decoding, the other one the library's */
+      res[0] = encode(0, properties, id, class_id, decoded[0], buffers[0]);
+      res[1] = encode(1, properties, id, class_id, decoded[1], buffers[1]);
+      res[2] = encode(1, properties, id, class_id, decoded[0], buffers[2]);
+      check(res[0] == res[1] && res[0] == res[2], "encode result", iteration);
+      check(res[0] <= 0 || (0 == memcmp(out[0], out[1], res[0]) &&
+                            0 == memcmp(out[0], out[2], res[0])),
+            "encoded bytes", iteration);
+
+      buffers[0].len = buffers[1].len = (res[0] > 0 ? rand() % (res[0] + 1)
+                                                    : 0);
+      res[0] = encode(0, properties, id, class_id, decoded[0], buffers[0]);
+      res[1] = encode(1, properties, id, class_id, decoded[1], buffers[1]);
+      check(res[0] == res[1], "short buffer encode result", iteration);
+      ++decoded_ok;
+    }
+    empty_amqp_pool(&pools[0]);
+    empty_amqp_pool(&pools[1]);
+  }
+
+  check(decoded_ok > ITERATIONS / 100, "enough valid inputs", decoded_ok);
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,226 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* Latency histogram geometry. Samples cannot be injected through the public
+ * API, so amqp_stats.c is built into the test with histograms enabled and
+ * fed known values on a bare connection object. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amqp_private.h"
+
+#define SUB_COUNT ((uint64_t)1 << AMQP_HISTOGRAM_SUB_BITS)
+#define TOP ((uint64_t)1 << AMQP_HISTOGRAM_MAX_BITS)
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+static amqp_connection_state_t new_state(void)
+{
+  amqp_connection_state_t state = calloc(1, sizeof(*state));
+  check(NULL != state, "allocate state");
+  return state;
+}
+
+/* records value alone and returns the bucket it landed in */
+static amqp_histogram_bucket_t bucket_of(amqp_connection_state_t state,
+                                         uint64_t value)
+{
+  amqp_histogram_bucket_t bucket;
+  size_t count = 1;
+
+  amqp_histogram_record(state, AMQP_HISTOGRAM_RPC_WAIT, value);
+  check(AMQP_STATUS_OK == amqp_get_histogram(state, AMQP_HISTOGRAM_RPC_WAIT,
+                                             NULL, &bucket, &count, 1),
+        "read histogram");
+  check(1 == count && 1 == bucket.count, "one sample, one bucket");
+  check(bucket.lower_ns <= value && value <= bucket.upper_ns,
+        "value inside its bucket");
+  return bucket;
+}
+
+static void test_bucket_boundaries(void)
+{
+  amqp_connection_state_t state = new_state();
+  amqp_histogram_bucket_t b;
+  uint64_t v;
+  int bit;
+
+  /* below SUB_COUNT every value has a bucket to itself, and so does every
+     value of the first power of two above it */
+  for (v = 0; v < 2 * SUB_COUNT; ++v) {
+    b = bucket_of(state, v);
+    check(v == b.lower_ns && v == b.upper_ns, "exact small buckets");
+  }
+
+  /* above that each power of two is split into SUB_COUNT buckets: the
+     first and last value of every bucket land in that bucket, and adjacent
+     buckets meet without a gap */
+  for (bit = AMQP_HISTOGRAM_SUB_BITS + 1; bit < AMQP_HISTOGRAM_MAX_BITS;
+       ++bit) {
+    uint64_t width = (uint64_t)1 << (bit - AMQP_HISTOGRAM_SUB_BITS);
+    uint64_t i;
+
+    for (i = 0; i < SUB_COUNT; ++i) {
+      uint64_t lower = ((uint64_t)1 << bit) + i * width;
+
+      b = bucket_of(state, lower);
+      check(lower == b.lower_ns, "bucket starts at its lower bound");
+      if (i + 1 == SUB_COUNT && bit + 1 == AMQP_HISTOGRAM_MAX_BITS) {
+        /* the last bucket is open ended */
+        check(UINT64_MAX == b.upper_ns, "last bucket is open ended");
+        continue;
+      }
+      check(lower + width - 1 == b.upper_ns, "bucket width");
+      b = bucket_of(state, lower + width - 1);
+      check(lower == b.lower_ns && lower + width - 1 == b.upper_ns,
+            "bucket ends at its upper bound");
+      b = bucket_of(state, lower + width);
+      check(lower + width == b.lower_ns, "next value starts the next bucket");
+    }
+  }
+
+  /* everything from 2^MAX_BITS up shares the last bucket */
+  b = bucket_of(state, TOP);
+  check(TOP - TOP / (2 * SUB_COUNT) == b.lower_ns &&
+            UINT64_MAX == b.upper_ns,
+        "overflow bucket");
+  b = bucket_of(state, UINT64_MAX);
+  check(TOP - TOP / (2 * SUB_COUNT) == b.lower_ns, "largest value");
+  free(state);
+}
+
+static void test_summary(void)
+{
+  amqp_connection_state_t state = new_state();
+  amqp_histogram_t summary;
+  amqp_histogram_bucket_t buckets[2];
+  size_t count;
+  int i;
+
+  /* nothing recorded */
+  count = 2;
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, &summary,
+                               buckets, &count, 0),
+        "read empty histogram");
+  check(0 == summary.count && 0 == summary.p99_ns && 0 == count,
+        "empty histogram");
+
+  /* 900 samples of 10ns, 99 of 1000ns and one of 5000ns */
+  for (i = 0; i < 900; ++i) {
+    amqp_histogram_record(state, AMQP_HISTOGRAM_DECODE_METHOD, 10);
+  }
+  for (i = 0; i < 99; ++i) {
+    amqp_histogram_record(state, AMQP_HISTOGRAM_DECODE_METHOD, 1000);
+  }
+  amqp_histogram_record(state, AMQP_HISTOGRAM_DECODE_METHOD, 5000);
+
+  count = 2;
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, &summary,
+                               buckets, &count, 0),
+        "read histogram");
+  check(1000 == summary.count && 10 == summary.min_ns &&
+            5000 == summary.max_ns &&
+            900 * 10 + 99 * 1000 + 5000 == summary.sum_ns,
+        "count, min, max and sum");
+  /* percentiles are bucket upper bounds, capped at the maximum */
+  check(10 == summary.p50_ns && 10 == summary.p90_ns, "p50 and p90");
+  check(1023 == summary.p99_ns && 1023 == summary.p999_ns,
+        "p99 and p999 are the upper bound of their bucket");
+
+  /* the bucket count reports all non-empty buckets, even past capacity */
+  check(3 == count, "three non-empty buckets");
+  check(10 == buckets[0].lower_ns && 900 == buckets[0].count &&
+            960 == buckets[1].lower_ns && 1023 == buckets[1].upper_ns &&
+            99 == buckets[1].count,
+        "buckets in increasing order");
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, NULL,
+                               NULL, &count, 0),
+        "count buckets only");
+  check(3 == count, "bucket count without buckets");
+
+  /* other histograms are independent, reset clears */
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_RPC_WAIT, &summary,
+                               NULL, NULL, 0),
+        "read other histogram");
+  check(0 == summary.count, "histograms are independent");
+  amqp_histogram_record(state, AMQP_HISTOGRAM_RPC_WAIT, 1000);
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_RPC_WAIT, &summary,
+                               NULL, NULL, 0),
+        "read single sample");
+  check(1000 == summary.p50_ns && 1000 == summary.p999_ns,
+        "percentiles are capped at the maximum");
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, NULL,
+                               NULL, NULL, 1),
+        "reset");
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, &summary,
+                               NULL, NULL, 0),
+        "read after reset");
+  check(0 == summary.count && 0 == summary.max_ns, "reset clears");
+
+  /* a failed timestamp drops the sample */
+  amqp_histogram_record_since(state, AMQP_HISTOGRAM_DECODE_METHOD, 0);
+  check(AMQP_STATUS_OK ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_DECODE_METHOD, &summary,
+                               NULL, NULL, 0),
+        "read after failed timestamp");
+  check(0 == summary.count, "no sample without a start time");
+
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_COUNT, &summary, NULL,
+                               NULL, 0),
+        "unknown histogram");
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+            amqp_get_histogram(state, AMQP_HISTOGRAM_RPC_WAIT, NULL, buckets,
+                               NULL, 0),
+        "buckets need a count");
+  free(state);
+}
+
+int main(void)
+{
+  test_bucket_boundaries();
+  test_summary();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,304 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* The background I/O thread over a socketpair: the test plays the broker on
+ * the other end, partly through a second connection and partly with raw
+ * reads and writes, while the client application stays away for a while,
+ * reads frames decoded by the I/O thread, and stops it. */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_tcp_socket.h>
+
+#include "test_pair.h"
+
+static const uint8_t heartbeat[8] =
+  { AMQP_FRAME_HEARTBEAT, 0, 0, 0, 0, 0, 0, AMQP_FRAME_END };
+
+struct socket_pair {
+  struct pair p;
+  int broker_fd;
+};
+
+static void sleep_ms(long ms)
+{
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+/* a tuned client with a heartbeat interval of heartbeat seconds, its I/O
+ * thread running */
+static void socket_pair_open(struct socket_pair *sp, int heartbeat)
+{
+  amqp_socket_t *socket;
+  int fds[2];
+
+  check(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+  sp->p.client = amqp_new_connection();
+  sp->p.broker = amqp_new_connection();
+  socket = amqp_tcp_socket_new(sp->p.client);
+  check(NULL != socket, "client socket");
+  amqp_tcp_socket_set_sockfd(socket, fds[0]);
+  socket = amqp_tcp_socket_new(sp->p.broker);
+  check(NULL != socket, "broker socket");
+  amqp_tcp_socket_set_sockfd(socket, fds[1]);
+  sp->broker_fd = fds[1];
+
+  pair_start(&sp->p);
+  check(AMQP_STATUS_OK ==
+        amqp_tune_connection(sp->p.client, 0, 131072, heartbeat), "tune");
+  check(AMQP_STATUS_OK == amqp_start_io_thread(sp->p.client), "start");
+}
+
+/* counts the heartbeats the client sent, which must be all it sent */
+static int broker_read_heartbeats(struct socket_pair *sp)
+{
+  uint8_t buf[256];
+  int count = 0;
+  ssize_t n;
+  ssize_t i;
+
+  while ((n = recv(sp->broker_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    check(0 == n % sizeof(heartbeat), "whole heartbeat frames");
+    for (i = 0; i < n; i += sizeof(heartbeat)) {
+      check(0 == memcmp(buf + i, heartbeat, sizeof(heartbeat)),
+            "only heartbeats");
+      count++;
+    }
+  }
+  return count;
+}
+
+static void expect_deliver(amqp_connection_state_t state,
+                           amqp_channel_t channel, uint64_t delivery_tag)
+{
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(state, &frame) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        channel == frame.channel &&
+        AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id &&
+        delivery_tag == ((amqp_basic_deliver_t *)
+                         frame.payload.method.decoded)->delivery_tag,
+        "basic.deliver in order");
+}
+
+static void expect_content(amqp_connection_state_t state,
+                           amqp_channel_t channel, amqp_bytes_t body)
+{
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(state, &frame) &&
+        AMQP_FRAME_HEADER == frame.frame_type &&
+        channel == frame.channel &&
+        body.len == frame.payload.properties.body_size,
+        "content header in order");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(state, &frame) &&
+        AMQP_FRAME_BODY == frame.frame_type &&
+        channel == frame.channel &&
+        body.len == frame.payload.body_fragment.len &&
+        0 == memcmp(body.bytes, frame.payload.body_fragment.bytes, body.len),
+        "body in order");
+}
+
+static amqp_bytes_t body_for(char *buf, size_t len, uint64_t delivery_tag)
+{
+  amqp_bytes_t body;
+
+  memset(buf, 'a' + (int)(delivery_tag % 26), len);
+  body.len = len;
+  body.bytes = buf;
+  return body;
+}
+
+/* the application does not call into the library for several heartbeat
+ * intervals and the connection survives: the I/O thread sends heartbeats
+ * and reads the broker's */
+static void test_idle(void)
+{
+  struct socket_pair sp;
+  struct timeval timeout;
+  amqp_frame_t frame;
+  int sent = 0;
+  int i;
+
+  socket_pair_open(&sp, 1);
+  for (i = 0; i < 35; ++i) {
+    sleep_ms(100);
+    if (0 == i % 4) {
+      check(sizeof(heartbeat) ==
+            send(sp.broker_fd, heartbeat, sizeof(heartbeat), 0),
+            "broker heartbeat");
+    }
+    sent += broker_read_heartbeats(&sp);
+  }
+  check(sent >= 5, "client heartbeats every half interval");
+
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(sp.p.client, &frame, &timeout),
+        "connection still open");
+  check(AMQP_STATUS_OK == amqp_stop_io_thread(sp.p.client), "stop");
+  pair_close(&sp.p);
+}
+
+/* a silent broker is noticed without the application's help */
+static void test_broker_silent(void)
+{
+  struct socket_pair sp;
+  amqp_frame_t frame;
+
+  socket_pair_open(&sp, 1);
+  sleep_ms(2500);
+  check(AMQP_STATUS_HEARTBEAT_TIMEOUT ==
+        amqp_simple_wait_frame(sp.p.client, &frame), "heartbeat timeout");
+  check(AMQP_STATUS_HEARTBEAT_TIMEOUT == amqp_stop_io_thread(sp.p.client),
+        "stop reports the error");
+  pair_close(&sp.p);
+}
+
+#define DELIVERIES 300
+#define LARGE_BODY 60000
+
+/* more than the socket buffers hold, so the broker writes from a thread of
+ * its own */
+static void *broker_deliver(void *arg)
+{
+  static char buf[LARGE_BODY];
+  struct pair *p = arg;
+  uint64_t tag;
+
+  for (tag = 1; tag <= DELIVERIES; ++tag) {
+    pair_deliver(p, 1 + tag % 2, tag, body_for(buf, 16 + tag % 50, tag));
+  }
+  pair_deliver(p, 1, DELIVERIES + 1,
+               body_for(buf, sizeof(buf), DELIVERIES + 1));
+  return NULL;
+}
+
+/* frames decoded by the I/O thread arrive in order, across more of them
+ * than the inbound ring holds, while their channels are released as the
+ * application goes */
+static void test_order(void)
+{
+  static char buf[LARGE_BODY];
+  struct socket_pair sp;
+  amqp_frame_t frame;
+  pthread_t broker;
+  uint64_t tag;
+
+  socket_pair_open(&sp, 0);
+  check(0 == pthread_create(&broker, NULL, broker_deliver, &sp.p),
+        "broker thread");
+
+  for (tag = 1; tag <= DELIVERIES; ++tag) {
+    expect_deliver(sp.p.client, 1 + tag % 2, tag);
+    expect_content(sp.p.client, 1 + tag % 2, body_for(buf, 16 + tag % 50, tag));
+    if (0 == tag % 7) {
+      amqp_maybe_release_buffers(sp.p.client);
+    }
+  }
+  expect_deliver(sp.p.client, 1, DELIVERIES + 1);
+  expect_content(sp.p.client, 1,
+                 body_for(buf, sizeof(buf), DELIVERIES + 1));
+  pthread_join(broker, NULL);
+
+  /* and the other way round */
+  check(AMQP_STATUS_OK ==
+        amqp_basic_ack(sp.p.client, 1, DELIVERIES + 1, 0), "ack");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(sp.p.broker, &frame) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_BASIC_ACK_METHOD == frame.payload.method.id,
+        "broker reads the ack");
+  check(AMQP_STATUS_OK == amqp_stop_io_thread(sp.p.client), "stop");
+  pair_close(&sp.p);
+}
+
+/* stopping the thread loses nothing: decoded frames are queued on the
+ * connection and a half read frame is finished by the application thread */
+static void test_stop(void)
+{
+  static const uint8_t partial[] = { AMQP_FRAME_BODY, 0, 1, 0, 0, 0, 4,
+                                     'a', 'b' };
+  static const uint8_t rest[] = { 'c', 'd', AMQP_FRAME_END };
+  struct socket_pair sp;
+  amqp_frame_t frame;
+  char buf[32];
+  uint64_t tag;
+
+  socket_pair_open(&sp, 0);
+  for (tag = 1; tag <= 3; ++tag) {
+    pair_deliver(&sp.p, 1, tag, body_for(buf, sizeof(buf), tag));
+  }
+  check(sizeof(partial) == send(sp.broker_fd, partial, sizeof(partial), 0),
+        "half a frame");
+
+  expect_deliver(sp.p.client, 1, 1);
+  sleep_ms(100);
+  check(AMQP_STATUS_OK == amqp_stop_io_thread(sp.p.client), "stop");
+  check(amqp_frames_enqueued(sp.p.client), "decoded frames queued");
+
+  check(sizeof(rest) == send(sp.broker_fd, rest, sizeof(rest), 0),
+        "rest of the frame");
+  expect_content(sp.p.client, 1, body_for(buf, sizeof(buf), 1));
+  for (tag = 2; tag <= 3; ++tag) {
+    expect_deliver(sp.p.client, 1, tag);
+    expect_content(sp.p.client, 1, body_for(buf, sizeof(buf), tag));
+  }
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(sp.p.client, &frame) &&
+        AMQP_FRAME_BODY == frame.frame_type &&
+        4 == frame.payload.body_fragment.len &&
+        0 == memcmp("abcd", frame.payload.body_fragment.bytes, 4),
+        "the half read frame");
+  pair_close(&sp.p);
+}
+
+int main(void)
+{
+  test_order();
+  test_stop();
+  test_idle();
+  test_broker_silent();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,168 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* Lazy property decoding (amqp_set_lazy_properties) over a memory socket:
+ * the test writes a content header with several properties to the peer end
+ * and decodes them one group at a time. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+/* a delivery with several properties, read back in lazy mode */
+static void test_lazy_properties(void)
+{
+  static uint8_t stream[1024];
+  uint8_t payload[512];
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(conn, PAIR_RING_SIZE);
+  amqp_basic_properties_t props;
+  amqp_table_entry_t header;
+  amqp_lazy_properties_t *lazy;
+  amqp_lazy_message_t lazy_message;
+  amqp_message_t message;
+  amqp_rpc_reply_t reply;
+  amqp_frame_t frame;
+  amqp_bytes_t encoded;
+  uint8_t out[512];
+  size_t header_len;
+  size_t total = 0;
+  int len;
+  int i;
+
+  memset(&props, 0, sizeof(props));
+  props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_HEADERS_FLAG |
+                 AMQP_BASIC_DELIVERY_MODE_FLAG | AMQP_BASIC_MESSAGE_ID_FLAG |
+                 AMQP_BASIC_TIMESTAMP_FLAG;
+  props.content_type = amqp_cstring_bytes("text/plain");
+  header.key = amqp_cstring_bytes("x-tenant");
+  header.value.kind = AMQP_FIELD_KIND_UTF8;
+  header.value.value.bytes = amqp_cstring_bytes("blue");
+  props.headers.num_entries = 1;
+  props.headers.entries = &header;
+  props.delivery_mode = 2;
+  props.message_id = amqp_cstring_bytes("m-17");
+  props.timestamp = 1234567890;
+  memset(payload, 0, 12);
+  payload[1] = 60;
+  payload[11] = 5;
+  encoded.bytes = payload + 12;
+  encoded.len = sizeof(payload) - 12;
+  len = amqp_encode_properties(AMQP_BASIC_CLASS, &props, encoded);
+  check(len > 0, "encode lazy properties");
+  header_len = put_frame(stream, AMQP_FRAME_HEADER, 1, payload, len + 12);
+  total = header_len + put_frame(stream + header_len, AMQP_FRAME_BODY, 1,
+                                 (const uint8_t *)"hello", 5);
+
+  check(NULL != socket, "lazy memory socket created");
+  for (i = 0; i < 3; ++i) {
+    check((int)total == amqp_memory_socket_peer_write(socket, stream, total),
+          "lazy stream fits the ring");
+  }
+  amqp_set_lazy_properties(conn, 1);
+
+  reply = amqp_read_message_lazy(conn, 1, &lazy_message, 0);
+  check(AMQP_RESPONSE_NORMAL == reply.reply_type, "read_message_lazy");
+  check(5 == lazy_message.body.len, "lazy body");
+  lazy = lazy_message.properties;
+  check(NULL != lazy && props._flags == lazy->flags, "lazy flags");
+  check(AMQP_LAZY_PROPERTIES_FLAG == lazy->properties._flags,
+        "nothing decoded yet");
+
+  /* past the headers table without decoding it */
+  check(AMQP_STATUS_OK ==
+        amqp_lazy_properties_get(lazy, AMQP_BASIC_MESSAGE_ID_FLAG),
+        "get message_id");
+  check((AMQP_BASIC_MESSAGE_ID_FLAG | AMQP_LAZY_PROPERTIES_FLAG) ==
+          lazy->properties._flags,
+        "only message_id decoded");
+  check(4 == lazy->properties.message_id.len &&
+        0 == memcmp(lazy->properties.message_id.bytes, "m-17", 4),
+        "message_id value");
+
+  check(AMQP_STATUS_OK ==
+        amqp_lazy_properties_get(lazy, AMQP_BASIC_HEADERS_FLAG |
+                                       AMQP_BASIC_TIMESTAMP_FLAG |
+                                       AMQP_BASIC_PRIORITY_FLAG),
+        "get headers, timestamp and priority");
+  check(!(lazy->properties._flags & AMQP_BASIC_PRIORITY_FLAG),
+        "absent priority");
+  check(1234567890 == lazy->properties.timestamp, "timestamp value");
+  check(1 == lazy->properties.headers.num_entries &&
+        8 == lazy->properties.headers.entries[0].key.len &&
+        AMQP_FIELD_KIND_UTF8 ==
+          lazy->properties.headers.entries[0].value.kind &&
+        0 == memcmp(lazy->properties.headers.entries[0].value.value.bytes.bytes,
+                    "blue", 4),
+        "headers value");
+
+  check(AMQP_STATUS_OK == amqp_lazy_properties_get(lazy, (amqp_flags_t)-1),
+        "get all");
+  check((props._flags | AMQP_LAZY_PROPERTIES_FLAG) ==
+          lazy->properties._flags,
+        "all decoded");
+  check(2 == lazy->properties.delivery_mode &&
+        10 == lazy->properties.content_type.len,
+        "remaining values");
+  amqp_destroy_lazy_message(&lazy_message);
+
+  /* amqp_read_message() still decodes everything */
+  reply = amqp_read_message(conn, 1, &message, 0);
+  check(AMQP_RESPONSE_NORMAL == reply.reply_type, "lazy mode read_message");
+  check(props._flags == message.properties._flags &&
+        2 == message.properties.delivery_mode &&
+        4 == message.properties.message_id.len,
+        "eager properties in lazy mode");
+  amqp_destroy_message(&message);
+
+  /* a lazy header is forwarded as received */
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame) &&
+        AMQP_FRAME_HEADER == frame.frame_type, "lazy header frame");
+  check(AMQP_STATUS_OK == amqp_send_frame(conn, &frame), "forward header");
+  check((int)header_len ==
+          amqp_memory_socket_peer_read(socket, out, sizeof(out)) &&
+        0 == memcmp(out, stream, header_len),
+        "forwarded header unchanged");
+
+  amqp_destroy_connection(conn);
+}
+
+int main(void)
+{
+  test_lazy_properties();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,250 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define RING_SIZE 65536
+#define BODY_SIZE 3000
+#define BODY_FRAME_SIZE 1024
+
+/* basic.deliver, a content header, a heartbeat, the body in three frames
+ * and channel.close-ok */
+static size_t encode_stream(uint8_t *out)
+{
+  uint8_t payload[BODY_SIZE + 64];
+  amqp_basic_deliver_t deliver;
+  amqp_basic_properties_t props;
+  amqp_bytes_t encoded;
+  size_t total = 0;
+  size_t sent;
+  int len;
+
+  memset(&deliver, 0, sizeof(deliver));
+  deliver.consumer_tag = amqp_cstring_bytes("ctag");
+  deliver.delivery_tag = 42;
+  deliver.exchange = amqp_cstring_bytes("amq.direct");
+  deliver.routing_key = amqp_cstring_bytes("key");
+  payload[0] = 0;
+  payload[1] = 60;
+  payload[2] = 0;
+  payload[3] = 60;
+  encoded.bytes = payload + 4;
+  encoded.len = sizeof(payload) - 4;
+  len = amqp_encode_method(AMQP_BASIC_DELIVER_METHOD, &deliver, encoded);
+  check(len > 0, "encode basic.deliver");
+  total += put_frame(out + total, AMQP_FRAME_METHOD, 1, payload, len + 4);
+
+  memset(&props, 0, sizeof(props));
+  props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG;
+  props.content_type = amqp_cstring_bytes("text/plain");
+  memset(payload, 0, 12);
+  payload[1] = 60;
+  payload[10] = (uint8_t)(BODY_SIZE >> 8);
+  payload[11] = (uint8_t)BODY_SIZE;
+  encoded.bytes = payload + 12;
+  encoded.len = sizeof(payload) - 12;
+  len = amqp_encode_properties(AMQP_BASIC_CLASS, &props, encoded);
+  check(len > 0, "encode properties");
+  total += put_frame(out + total, AMQP_FRAME_HEADER, 1, payload, len + 12);
+
+  total += put_frame(out + total, AMQP_FRAME_HEARTBEAT, 0, payload, 0);
+
+  for (sent = 0; sent < BODY_SIZE; sent += BODY_FRAME_SIZE) {
+    size_t n = BODY_SIZE - sent < BODY_FRAME_SIZE ? BODY_SIZE - sent
+                                                  : BODY_FRAME_SIZE;
+    memset(payload, (int)(sent / BODY_FRAME_SIZE) + 'a', n);
+    total += put_frame(out + total, AMQP_FRAME_BODY, 1, payload, n);
+  }
+
+  payload[0] = 0;
+  payload[1] = 20;
+  payload[2] = 0;
+  payload[3] = 41;
+  total += put_frame(out + total, AMQP_FRAME_METHOD, 1, payload, 4);
+  return total;
+}
+
+static void test_split_reads(const size_t *limits, size_t count)
+{
+  static uint8_t stream[BODY_SIZE + 1024];
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(conn, RING_SIZE);
+  size_t len = encode_stream(stream);
+  amqp_frame_t frame;
+  size_t body = 0;
+  int i;
+
+  check(NULL != socket, "memory socket created");
+  check(-1 == amqp_get_sockfd(conn), "memory socket has no descriptor");
+  check(AMQP_STATUS_OK ==
+        amqp_memory_socket_set_io_limits(socket, limits, count, NULL, 0),
+        "set recv limits");
+  check((int)len == amqp_memory_socket_peer_write(socket, stream, len),
+        "stream fits the ring");
+  amqp_memory_socket_peer_close(socket);
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "deliver");
+  check(AMQP_FRAME_METHOD == frame.frame_type && 1 == frame.channel &&
+        AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id,
+        "deliver decoded");
+  check(42 == ((amqp_basic_deliver_t *)frame.payload.method.decoded)->delivery_tag,
+        "delivery tag");
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "header");
+  check(AMQP_FRAME_HEADER == frame.frame_type &&
+        BODY_SIZE == frame.payload.properties.body_size,
+        "header decoded");
+
+  /* the heartbeat is swallowed by amqp_simple_wait_frame() */
+  for (i = 0; body < BODY_SIZE; ++i) {
+    const uint8_t *bytes;
+    size_t j;
+
+    check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "body");
+    check(AMQP_FRAME_BODY == frame.frame_type, "body decoded");
+    bytes = frame.payload.body_fragment.bytes;
+    for (j = 0; j < frame.payload.body_fragment.len; ++j) {
+      check(bytes[j] == 'a' + i, "body contents");
+    }
+    body += frame.payload.body_fragment.len;
+  }
+  check(BODY_SIZE == body, "whole body");
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "close-ok");
+  check(AMQP_CHANNEL_CLOSE_OK_METHOD == frame.payload.method.id,
+        "close-ok decoded");
+  check(AMQP_STATUS_CONNECTION_CLOSED == amqp_simple_wait_frame(conn, &frame),
+        "end of stream");
+
+  amqp_destroy_connection(conn);
+}
+
+static size_t send_ack(const size_t *limits, size_t count, uint8_t *out,
+                       size_t len)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(conn, RING_SIZE);
+  amqp_basic_ack_t ack;
+  size_t total = 0;
+  int n;
+
+  check(AMQP_STATUS_OK ==
+        amqp_memory_socket_set_io_limits(socket, NULL, 0, limits, count),
+        "set send limits");
+  ack.delivery_tag = 0x0102030405060708ULL;
+  ack.multiple = 1;
+  check(AMQP_STATUS_OK ==
+        amqp_send_method(conn, 1, AMQP_BASIC_ACK_METHOD, &ack), "send ack");
+
+  while ((n = amqp_memory_socket_peer_read(socket, out + total,
+                                           len - total)) > 0) {
+    total += n;
+  }
+  check(0 == n, "nothing more to read");
+  amqp_destroy_connection(conn);
+  return total;
+}
+
+static void test_partial_writes(void)
+{
+  static const size_t one[] = {1};
+  static const size_t mixed[] = {3, 0, 5};
+  uint8_t expected[64];
+  uint8_t actual[64];
+  size_t len = send_ack(NULL, 0, expected, sizeof(expected));
+
+  check(8 + 4 + 9 == len, "ack frame size");
+  check(len == send_ack(one, 1, actual, sizeof(actual)) &&
+        0 == memcmp(expected, actual, len), "byte-at-a-time writes");
+  check(len == send_ack(mixed, 3, actual, sizeof(actual)) &&
+        0 == memcmp(expected, actual, len), "mixed writes");
+}
+
+static void test_timeout_and_peer(void)
+{
+  amqp_connection_state_t client = amqp_new_connection();
+  amqp_connection_state_t server = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(client, RING_SIZE);
+  amqp_channel_close_ok_t close_ok;
+  struct timeval timeout;
+  amqp_frame_t frame;
+
+  check(NULL != amqp_memory_socket_new_peer(server, socket), "peer created");
+
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 10000;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(client, &frame, &timeout),
+        "wait times out on an empty ring");
+
+  check(AMQP_STATUS_OK == amqp_send_method(server, 3,
+                                           AMQP_CHANNEL_CLOSE_OK_METHOD,
+                                           &close_ok),
+        "peer sends");
+  timeout.tv_sec = 1;
+  timeout.tv_usec = 0;
+  check(AMQP_STATUS_OK ==
+        amqp_simple_wait_frame_noblock(client, &frame, &timeout),
+        "frame from peer");
+  check(3 == frame.channel &&
+        AMQP_CHANNEL_CLOSE_OK_METHOD == frame.payload.method.id,
+        "peer frame decoded");
+
+  amqp_destroy_connection(server);
+  check(AMQP_STATUS_CONNECTION_CLOSED ==
+        amqp_simple_wait_frame_noblock(client, &frame, &timeout),
+        "peer deleted");
+  amqp_destroy_connection(client);
+}
+
+int main(void)
+{
+  static const size_t whole[] = {0};
+  static const size_t bytes[] = {1};
+  static const size_t headers[] = {6, 1, 1};
+  static const size_t primes[] = {2, 3, 5, 7, 11, 13, 1021};
+
+  test_split_reads(whole, 1);
+  test_split_reads(bytes, 1);
+  test_split_reads(headers, 3);
+  test_split_reads(primes, 7);
+  test_partial_writes();
+  test_timeout_and_peer();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
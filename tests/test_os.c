@@ -0,0 +1,171 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "amqp_os.h"
+#include "amqp_timer.h"
+
+#define THREADS 4
+#define INCREMENTS 100000
+#define QUEUE_ITEMS 10000
+
+static amqp_os_mutex_t counter_lock;
+static int counter;
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+static void increment(void *arg)
+{
+  int i;
+  (void)arg;
+
+  for (i = 0; i < INCREMENTS; ++i) {
+    amqp_os_mutex_lock(&counter_lock);
+    counter++;
+    amqp_os_mutex_unlock(&counter_lock);
+  }
+}
+
+static void test_threads_and_mutex(void)
+{
+  amqp_os_thread_t threads[THREADS];
+  int i;
+
+  check(AMQP_STATUS_OK == amqp_os_mutex_init(&counter_lock), "mutex init");
+  for (i = 0; i < THREADS; ++i) {
+    check(AMQP_STATUS_OK == amqp_os_thread_create(&threads[i], "test",
+                                                  increment, NULL),
+          "thread create");
+  }
+  for (i = 0; i < THREADS; ++i) {
+    check(AMQP_STATUS_OK == amqp_os_thread_join(&threads[i]), "thread join");
+  }
+  check(THREADS * INCREMENTS == counter, "mutex protects counter");
+  amqp_os_mutex_destroy(&counter_lock);
+}
+
+static void test_timeouts(void)
+{
+  amqp_os_mutex_t lock;
+  amqp_os_cond_t cond;
+  amqp_os_sem_t sem;
+  uint64_t start;
+
+  check(AMQP_STATUS_OK == amqp_os_sem_init(&sem, 1), "sem init");
+  check(AMQP_STATUS_OK == amqp_os_sem_wait(&sem, 0), "sem initial count");
+  start = amqp_os_monotonic_ns();
+  check(AMQP_STATUS_TIMEOUT == amqp_os_sem_wait(&sem, 20 * AMQP_NS_PER_MS),
+        "sem wait times out");
+  check(amqp_os_monotonic_ns() - start >= 20 * AMQP_NS_PER_MS,
+        "sem wait lasts the timeout");
+  check(AMQP_STATUS_OK == amqp_os_sem_post(&sem), "sem post");
+  check(AMQP_STATUS_OK == amqp_os_sem_wait(&sem, AMQP_OS_WAIT_FOREVER),
+        "sem wait after post");
+  amqp_os_sem_destroy(&sem);
+
+  check(AMQP_STATUS_OK == amqp_os_mutex_init(&lock), "mutex init");
+  check(AMQP_STATUS_OK == amqp_os_cond_init(&cond), "cond init");
+  amqp_os_mutex_lock(&lock);
+  start = amqp_os_monotonic_ns();
+  while (amqp_os_monotonic_ns() - start < 10 * AMQP_NS_PER_MS) {
+    if (AMQP_STATUS_TIMEOUT ==
+        amqp_os_cond_wait(&cond, &lock, 10 * AMQP_NS_PER_MS)) {
+      break;
+    }
+  }
+  check(amqp_os_monotonic_ns() - start >= 10 * AMQP_NS_PER_MS,
+        "cond wait lasts the timeout");
+  amqp_os_mutex_unlock(&lock);
+  amqp_os_cond_destroy(&cond);
+  amqp_os_mutex_destroy(&lock);
+}
+
+static void produce(void *arg)
+{
+  amqp_os_queue_t *queue = arg;
+  int i;
+
+  for (i = 0; i < QUEUE_ITEMS; ++i) {
+    check(AMQP_STATUS_OK ==
+          amqp_os_queue_send(queue, &i, AMQP_OS_WAIT_FOREVER),
+          "queue send");
+  }
+}
+
+static void test_queue(void)
+{
+  amqp_os_queue_t *queue = amqp_os_queue_new(sizeof(int), 4);
+  amqp_os_thread_t producer;
+  int item;
+  int i;
+
+  check(NULL != queue, "queue new");
+  for (i = 0; i < 4; ++i) {
+    check(AMQP_STATUS_OK == amqp_os_queue_send(queue, &i, 0), "queue fill");
+  }
+  check(AMQP_STATUS_TIMEOUT == amqp_os_queue_send(queue, &i, 0),
+        "full queue rejects");
+  for (i = 0; i < 4; ++i) {
+    check(AMQP_STATUS_OK == amqp_os_queue_recv(queue, &item, 0) && item == i,
+          "queue drains in order");
+  }
+  check(AMQP_STATUS_TIMEOUT == amqp_os_queue_recv(queue, &item, 0),
+        "empty queue times out");
+
+  check(AMQP_STATUS_OK == amqp_os_thread_create(&producer, "producer",
+                                                produce, queue),
+        "producer create");
+  for (i = 0; i < QUEUE_ITEMS; ++i) {
+    check(AMQP_STATUS_OK ==
+          amqp_os_queue_recv(queue, &item, AMQP_OS_WAIT_FOREVER) && item == i,
+          "items arrive in order");
+  }
+  amqp_os_thread_join(&producer);
+  amqp_os_queue_free(queue);
+}
+
+int main(void)
+{
+  uint64_t a = amqp_os_monotonic_ns();
+  uint64_t b = amqp_os_monotonic_ns();
+
+  check(0 != a && b >= a, "monotonic clock");
+  test_threads_and_mutex();
+  test_timeouts();
+  test_queue();
+  return 0;
+}
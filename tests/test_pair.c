@@ -0,0 +1,131 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+uint64_t fake_clock(void *arg)
+{
+  return *(uint64_t *)arg;
+}
+
+size_t put_frame(uint8_t *out, uint8_t type, amqp_channel_t channel,
+                 const uint8_t *payload, size_t len)
+{
+  out[0] = type;
+  out[1] = (uint8_t)(channel >> 8);
+  out[2] = (uint8_t)channel;
+  out[3] = (uint8_t)(len >> 24);
+  out[4] = (uint8_t)(len >> 16);
+  out[5] = (uint8_t)(len >> 8);
+  out[6] = (uint8_t)len;
+  memcpy(out + 7, payload, len);
+  out[7 + len] = AMQP_FRAME_END;
+  return len + 8;
+}
+
+void pair_open(struct pair *p, size_t ring_size)
+{
+  amqp_socket_t *socket;
+
+  p->client = amqp_new_connection();
+  p->broker = amqp_new_connection();
+  socket = amqp_memory_socket_new(p->client, ring_size);
+  check(NULL != socket, "memory socket");
+  check(NULL != amqp_memory_socket_new_peer(p->broker, socket), "peer");
+}
+
+void pair_close(struct pair *p)
+{
+  amqp_destroy_connection(p->broker);
+  amqp_destroy_connection(p->client);
+}
+
+void pair_deliver(struct pair *p, amqp_channel_t channel,
+                  uint64_t delivery_tag, amqp_bytes_t body)
+{
+  amqp_basic_deliver_t method;
+  amqp_basic_properties_t props;
+  amqp_frame_t frame;
+
+  memset(&method, 0, sizeof(method));
+  method.consumer_tag = amqp_cstring_bytes("ctag");
+  method.delivery_tag = delivery_tag;
+  method.exchange = amqp_cstring_bytes("amq.direct");
+  method.routing_key = amqp_cstring_bytes("key");
+  check(AMQP_STATUS_OK == amqp_send_method(p->broker, channel,
+                                           AMQP_BASIC_DELIVER_METHOD,
+                                           &method),
+        "send basic.deliver");
+
+  memset(&props, 0, sizeof(props));
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.channel = channel;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body.len;
+  frame.payload.properties.decoded = &props;
+  check(AMQP_STATUS_OK == amqp_send_frame(p->broker, &frame),
+        "send content header");
+
+  frame.frame_type = AMQP_FRAME_BODY;
+  frame.payload.body_fragment = body;
+  check(AMQP_STATUS_OK == amqp_send_frame(p->broker, &frame),
+        "send body frame");
+}
+
+void pair_start(struct pair *p)
+{
+  amqp_connection_tune_t tune;
+  amqp_frame_t frame;
+
+  memset(&tune, 0, sizeof(tune));
+  check(AMQP_STATUS_OK == amqp_send_method(p->broker, 0,
+                                           AMQP_CONNECTION_TUNE_METHOD,
+                                           &tune),
+        "send tune");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->client, &frame) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_CONNECTION_TUNE_METHOD == frame.payload.method.id,
+        "first frame");
+}
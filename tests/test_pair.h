@@ -0,0 +1,71 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* Shared fixture for the tests that run a connection over a memory socket
+ * pair: the test plays the broker on the peer connection. */
+
+#ifndef TEST_PAIR_H
+#define TEST_PAIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <amqp.h>
+
+/* bytes buffered in each direction unless a test needs more */
+#define PAIR_RING_SIZE 65536
+
+struct pair {
+  amqp_connection_state_t client;
+  amqp_connection_state_t broker;
+};
+
+/* prints what and aborts unless condition holds */
+void check(int condition, const char *what);
+
+/* an amqp_clock_fn that reads the uint64_t arg points to */
+uint64_t fake_clock(void *arg);
+
+/* writes a raw frame carrying payload to out and returns its length, for
+ * tests that feed bytes to amqp_memory_socket_peer_write() */
+size_t put_frame(uint8_t *out, uint8_t type, amqp_channel_t channel,
+                 const uint8_t *payload, size_t len);
+
+/* connects a new client and broker through ring_size byte rings */
+void pair_open(struct pair *p, size_t ring_size);
+
+void pair_close(struct pair *p);
+
+/* the broker sends connection.tune, and reading it takes the client out of
+ * its initial state so that it can be tuned */
+void pair_start(struct pair *p);
+
+/* the broker sends basic.deliver, a content header and a one frame body */
+void pair_deliver(struct pair *p, amqp_channel_t channel,
+                  uint64_t delivery_tag, amqp_bytes_t body);
+
+#endif /* TEST_PAIR_H */
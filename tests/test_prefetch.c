@@ -0,0 +1,286 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The adaptive prefetch controller over a memory socket pair: a fake clock
+ * stands in for processing and waiting time, the test plays the broker and
+ * checks the basic.qos prefetch counts that reach it. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "test_pair.h"
+
+#define NS_PER_MS 1000000ULL
+
+/* reads move the clock on by step, so that every amqp_consume_message()
+ * call appears to wait step nanoseconds for its delivery */
+struct stepping_clock {
+  uint64_t now;
+  uint64_t step;
+};
+
+static uint64_t read_clock(void *arg)
+{
+  struct stepping_clock *clock = arg;
+
+  clock->now += clock->step;
+  return clock->now;
+}
+
+static void send_qos_ok(struct pair *p)
+{
+  amqp_basic_qos_ok_t ok;
+
+  check(AMQP_STATUS_OK ==
+        amqp_send_method(p->broker, 1, AMQP_BASIC_QOS_OK_METHOD, &ok),
+        "send qos-ok");
+}
+
+static void expect_qos(struct pair *p, uint16_t count)
+{
+  struct timeval timeout = {0, 0};
+  amqp_basic_qos_t *m;
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK ==
+        amqp_simple_wait_frame_noblock(p->broker, &frame, &timeout) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_BASIC_QOS_METHOD == frame.payload.method.id,
+        "broker reads basic.qos");
+  m = frame.payload.method.decoded;
+  if (m->prefetch_count != count) {
+    fprintf(stderr, "prefetch %u, expected %u\n",
+            (unsigned)m->prefetch_count, (unsigned)count);
+    abort();
+  }
+}
+
+static void expect_nothing(struct pair *p)
+{
+  struct timeval timeout = {0, 0};
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p->broker, &frame, &timeout),
+        "no basic.qos sent");
+}
+
+static void consume(struct pair *p, uint64_t delivery_tag)
+{
+  amqp_envelope_t envelope;
+  amqp_rpc_reply_t reply;
+
+  reply = amqp_consume_message(p->client, &envelope, NULL, 0);
+  check(AMQP_RESPONSE_NORMAL == reply.reply_type &&
+        delivery_tag == envelope.delivery_tag, "consume");
+  amqp_destroy_envelope(&envelope);
+}
+
+static amqp_prefetch_stats_t get_stats(struct pair *p)
+{
+  amqp_prefetch_stats_t stats;
+
+  check(AMQP_STATUS_OK == amqp_get_prefetch_stats(p->client, 1, &stats),
+        "read prefetch stats");
+  return stats;
+}
+
+static void enable(struct pair *p, uint16_t min, uint16_t max,
+                   uint16_t initial, size_t max_backlog)
+{
+  amqp_prefetch_config_t config;
+
+  config.min_prefetch = min;
+  config.max_prefetch = max;
+  config.initial_prefetch = initial;
+  config.max_backlog = max_backlog;
+  config.interval.tv_sec = 0;
+  config.interval.tv_usec = 100000;
+  check(AMQP_RESPONSE_NORMAL ==
+        amqp_set_adaptive_prefetch(p->client, 1, &config).reply_type,
+        "enable adaptive prefetch");
+}
+
+/* deliveries piling up in the library cut prefetch by a quarter, down to
+ * min_prefetch */
+static void test_backlog_shrinks(void)
+{
+  struct stepping_clock clock = {1000000000, 0};
+  amqp_prefetch_stats_t stats;
+  struct pair p;
+  uint64_t tag;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  amqp_set_clock(p.client, read_clock, &clock);
+  /* the deliveries are queued while the client waits for the first
+   * qos-ok; the others answer the two reductions */
+  for (tag = 1; tag <= 8; ++tag) {
+    pair_deliver(&p, 1, tag, amqp_cstring_bytes("m"));
+  }
+  send_qos_ok(&p);
+  send_qos_ok(&p);
+  send_qos_ok(&p);
+  enable(&p, 6, 20, 10, 4);
+  expect_qos(&p, 10);
+
+  consume(&p, 1);
+  /* backlog 7: 10 - 2 */
+  clock.now += 150 * NS_PER_MS;
+  consume(&p, 2);
+  expect_qos(&p, 8);
+  stats = get_stats(&p);
+  check(8 == stats.prefetch_count && 7 == stats.backlog &&
+        1 == stats.decreases && 0 == stats.increases, "first reduction");
+  check(150 * NS_PER_MS == stats.avg_processing_ns && 0 == stats.avg_wait_ns,
+        "processing time");
+
+  /* backlog 6: 8 - 2 */
+  clock.now += 150 * NS_PER_MS;
+  consume(&p, 3);
+  expect_qos(&p, 6);
+  /* backlog 5: 6 - 1 is below min_prefetch */
+  clock.now += 150 * NS_PER_MS;
+  consume(&p, 4);
+  /* backlog 4 is not above max_backlog */
+  clock.now += 150 * NS_PER_MS;
+  consume(&p, 5);
+  expect_nothing(&p);
+
+  stats = get_stats(&p);
+  check(6 == stats.prefetch_count && 4 == stats.backlog &&
+        2 == stats.decreases && 5 == stats.deliveries, "clamped to min");
+  pair_close(&p);
+}
+
+/* a consumer that waits as long as it works is starved: prefetch grows by
+ * the idle fraction, up to max_prefetch */
+static void test_idle_grows(void)
+{
+  struct stepping_clock clock = {1000000000, 10 * NS_PER_MS};
+  amqp_prefetch_stats_t stats;
+  struct pair p;
+  uint64_t tag;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  amqp_set_clock(p.client, read_clock, &clock);
+  send_qos_ok(&p);
+  enable(&p, 2, 5, 4, 4);
+  expect_qos(&p, 4);
+
+  /* each call reads the clock on entry and after the delivery: 10ms of
+   * processing and 10ms of waiting per message, and the sixth call is the
+   * first one past the 100ms interval, with five deliveries in 110ms */
+  for (tag = 1; tag <= 11; ++tag) {
+    if (6 == tag) {
+      send_qos_ok(&p);
+    }
+    pair_deliver(&p, 1, tag, amqp_cstring_bytes("m"));
+    consume(&p, tag);
+    if (6 == tag) {
+      /* 4 + 4 / 2 is above max_prefetch */
+      expect_qos(&p, 5);
+      stats = get_stats(&p);
+      check(5 == stats.prefetch_count && 1 == stats.increases &&
+            0 == stats.backlog, "raised to max");
+      check(10 * NS_PER_MS == stats.avg_processing_ns &&
+            10 * NS_PER_MS == stats.avg_wait_ns && 45 == stats.arrival_rate,
+            "idle half the time");
+    }
+  }
+  /* the eleventh call evaluates again but cannot go above 5 */
+  expect_nothing(&p);
+  stats = get_stats(&p);
+  check(5 == stats.prefetch_count && 1 == stats.increases &&
+        0 == stats.decreases && 11 == stats.deliveries, "held at max");
+  pair_close(&p);
+}
+
+static void invalid(struct pair *p, uint16_t min, uint16_t max,
+                    uint16_t initial, long interval_usec)
+{
+  amqp_prefetch_config_t config;
+  amqp_rpc_reply_t reply;
+
+  config.min_prefetch = min;
+  config.max_prefetch = max;
+  config.initial_prefetch = initial;
+  config.max_backlog = 4;
+  config.interval.tv_sec = 0;
+  config.interval.tv_usec = interval_usec;
+  reply = amqp_set_adaptive_prefetch(p->client, 1, &config);
+  check(AMQP_RESPONSE_LIBRARY_EXCEPTION == reply.reply_type &&
+        AMQP_STATUS_INVALID_PARAMETER == reply.library_error,
+        "invalid config rejected");
+}
+
+static void test_parameters(void)
+{
+  amqp_prefetch_stats_t stats;
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  invalid(&p, 0, 10, 5, 0);
+  invalid(&p, 6, 5, 5, 0);
+  invalid(&p, 2, 10, 1, 0);
+  invalid(&p, 2, 10, 11, 0);
+  invalid(&p, 2, 10, 5, -1);
+  expect_nothing(&p);
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_get_prefetch_stats(p.client, 1, &stats), "not enabled");
+
+  send_qos_ok(&p);
+  enable(&p, 2, 10, 5, 4);
+  expect_qos(&p, 5);
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_get_prefetch_stats(p.client, 1, NULL), "stats must not be NULL");
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_get_prefetch_stats(p.client, 2, &stats), "other channel");
+
+  /* NULL disables the controller without sending anything */
+  check(AMQP_RESPONSE_NORMAL ==
+        amqp_set_adaptive_prefetch(p.client, 1, NULL).reply_type, "disable");
+  expect_nothing(&p);
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+        amqp_get_prefetch_stats(p.client, 1, &stats), "disabled");
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_backlog_shrinks();
+  test_idle_grows();
+  test_parameters();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,214 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* Shared publishing over a memory socket pair: several threads publish
+ * through their own amqp_publisher_t while the owning thread keeps using
+ * amqp_basic_publish(); the test plays the broker on the peer connection
+ * and checks that every message arrives whole and in per-channel order. */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define RING_SIZE (4 * 1024 * 1024)
+#define PUBLISHERS 4
+#define MESSAGES 2000
+/* the owning thread publishes on the channel after the publishers' */
+#define OWNER_CHANNEL (PUBLISHERS + 1)
+
+/* the body carries the channel and the sequence number; odd sequence
+ * numbers get a body that spans several frames */
+static amqp_bytes_t message_body(char *buf, size_t size, amqp_channel_t channel,
+                                 int seq)
+{
+  amqp_bytes_t body;
+  int len = snprintf(buf, size, "%u:%d:", (unsigned)channel, seq);
+
+  body.bytes = buf;
+  body.len = (size_t)len;
+  if (seq % 2) {
+    memset(buf + len, 'x', size - len);
+    body.len = size;
+  }
+  return body;
+}
+
+struct publisher_thread {
+  pthread_t thread;
+  amqp_connection_state_t state;
+  amqp_channel_t channel;
+  int res;
+};
+
+static void *publish_messages(void *arg)
+{
+  struct publisher_thread *t = arg;
+  amqp_publisher_t *publisher = amqp_publisher_new(t->state, t->channel);
+  char buf[300];
+  int seq;
+
+  t->res = NULL == publisher ? AMQP_STATUS_NO_MEMORY : AMQP_STATUS_OK;
+  for (seq = 0; AMQP_STATUS_OK == t->res && seq < MESSAGES; ++seq) {
+    t->res = amqp_publisher_publish(
+        publisher, amqp_cstring_bytes("amq.direct"), amqp_cstring_bytes("key"),
+        0, 0, NULL, message_body(buf, sizeof(buf), t->channel, seq));
+  }
+  amqp_publisher_destroy(publisher);
+  return NULL;
+}
+
+/* the broker reads one message: publish, header and all its body frames
+ * back to back, on one channel */
+static void expect_message(struct pair *p, int *next_seq,
+                           uint64_t *body_frames)
+{
+  amqp_frame_t frame;
+  amqp_channel_t channel;
+  uint64_t body_size;
+  size_t received = 0;
+  char buf[300];
+  char expected[300];
+  amqp_bytes_t body;
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->broker, &frame),
+        "read basic.publish");
+  check(AMQP_FRAME_METHOD == frame.frame_type &&
+            AMQP_BASIC_PUBLISH_METHOD == frame.payload.method.id,
+        "basic.publish starts a message");
+  channel = frame.channel;
+  check(channel >= 1 && channel <= OWNER_CHANNEL, "publish channel");
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->broker, &frame),
+        "read content header");
+  check(AMQP_FRAME_HEADER == frame.frame_type && channel == frame.channel,
+        "content header follows its publish");
+  body_size = frame.payload.properties.body_size;
+  check(body_size <= sizeof(buf), "body size");
+
+  while (received < body_size) {
+    check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->broker, &frame),
+          "read body frame");
+    check(AMQP_FRAME_BODY == frame.frame_type && channel == frame.channel,
+          "body frames follow their header");
+    check(received + frame.payload.body_fragment.len <= body_size,
+          "body frame length");
+    memcpy(buf + received, frame.payload.body_fragment.bytes,
+           frame.payload.body_fragment.len);
+    received += frame.payload.body_fragment.len;
+    (*body_frames)++;
+  }
+
+  body = message_body(expected, sizeof(expected), channel,
+                      next_seq[channel]);
+  check(body.len == body_size && 0 == memcmp(buf, body.bytes, body.len),
+        "messages arrive in per-channel order");
+  next_seq[channel]++;
+  amqp_maybe_release_buffers(p->broker);
+}
+
+static void test_mpsc_ordering(void)
+{
+  struct pair p;
+  struct publisher_thread threads[PUBLISHERS];
+  int next_seq[OWNER_CHANNEL + 1];
+  uint64_t body_frames = 0;
+  amqp_conn_stats_t stats;
+  amqp_frame_t frame;
+  struct timeval zero = {0, 0};
+  char buf[300];
+  int i;
+  int seq;
+
+  pair_open(&p, RING_SIZE);
+  pair_start(&p);
+  /* small frames so that odd messages need several body frames */
+  check(AMQP_STATUS_OK == amqp_tune_connection(p.client, 0, 4096, 0),
+        "tune client");
+  check(AMQP_STATUS_OK == amqp_enable_shared_publishing(p.client),
+        "enable shared publishing");
+  check(NULL == amqp_publisher_new(p.client, 0),
+        "no publisher on channel 0");
+
+  for (i = 0; i < PUBLISHERS; ++i) {
+    threads[i].state = p.client;
+    threads[i].channel = (amqp_channel_t)(i + 1);
+    check(0 == pthread_create(&threads[i].thread, NULL, publish_messages,
+                              &threads[i]),
+          "start publisher thread");
+  }
+  for (seq = 0; seq < MESSAGES; ++seq) {
+    check(AMQP_STATUS_OK ==
+              amqp_basic_publish(p.client, OWNER_CHANNEL,
+                                 amqp_cstring_bytes("amq.direct"),
+                                 amqp_cstring_bytes("key"), 0, 0, NULL,
+                                 message_body(buf, sizeof(buf), OWNER_CHANNEL,
+                                              seq)),
+          "owner publish");
+  }
+  for (i = 0; i < PUBLISHERS; ++i) {
+    check(0 == pthread_join(threads[i].thread, NULL), "join publisher");
+    check(AMQP_STATUS_OK == threads[i].res, "publisher thread publishes");
+  }
+
+  memset(next_seq, 0, sizeof(next_seq));
+  for (i = 0; i < OWNER_CHANNEL * MESSAGES; ++i) {
+    expect_message(&p, next_seq, &body_frames);
+  }
+  for (i = 1; i <= OWNER_CHANNEL; ++i) {
+    check(MESSAGES == next_seq[i], "every message arrives");
+  }
+  check(AMQP_STATUS_TIMEOUT ==
+            amqp_simple_wait_frame_noblock(p.broker, &frame, &zero),
+        "nothing else written");
+
+  /* the outbound counters are bumped by whichever thread wrote */
+  if (AMQP_STATUS_OK == amqp_get_connection_stats(p.client, &stats)) {
+    check(OWNER_CHANNEL * MESSAGES == stats.frames_out.method,
+          "method frames counted");
+    check(OWNER_CHANNEL * MESSAGES == stats.frames_out.header,
+          "header frames counted");
+    check(body_frames == stats.frames_out.body, "body frames counted");
+  }
+
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_mpsc_ordering();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The backend-neutral TLS session cache with dummy sessions. The cache is
+ * built into the test, which provides the monotonic clock it reads. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amqp_ssl_cache.h"
+#include "amqp_timer.h"
+
+#define NS_PER_S 1000000000ULL
+
+static uint64_t now = 1000 * NS_PER_S;
+static int freed[8];
+
+uint64_t amqp_get_monotonic_timestamp(void)
+{
+  return now;
+}
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+/* dummy sessions are identified by their index in sessions */
+static char sessions[8];
+
+static void *session(int id)
+{
+  return &sessions[id];
+}
+
+static int session_id(void *session)
+{
+  return (int)((char *)session - sessions);
+}
+
+static void free_session(void *session)
+{
+  freed[session_id(session)]++;
+}
+
+static void remember(void *session, void *arg)
+{
+  *(int *)arg = session_id(session);
+}
+
+/* the id of the session cached for host:port, 0 if there is none */
+static int lookup(amqp_ssl_session_cache_t *cache, const char *host, int port)
+{
+  int id = 0;
+  int found = amqp_ssl_session_cache_get(cache, host, port, remember, &id);
+
+  check(found == (0 != id), "get result");
+  return id;
+}
+
+static void test_parameters(void)
+{
+  check(NULL == amqp_ssl_session_cache_new(0, 60), "no entries");
+  check(NULL == amqp_ssl_session_cache_new(4, 0), "no ttl");
+  amqp_ssl_session_cache_free(NULL);
+}
+
+/* sessions are offered until their ttl runs out, then dropped */
+static void test_expiry(void)
+{
+  amqp_ssl_session_cache_t *cache = amqp_ssl_session_cache_new(4, 60);
+
+  memset(freed, 0, sizeof(freed));
+  check(NULL != cache, "cache");
+  check(0 == lookup(cache, "broker", 5671), "empty");
+  amqp_ssl_session_cache_put(cache, "broker", 5671, session(1),
+                             free_session);
+  check(1 == lookup(cache, "broker", 5671), "cached");
+  check(0 == lookup(cache, "broker", 5672), "keyed by port");
+  check(0 == lookup(cache, "other", 5671), "keyed by host");
+
+  now += 59 * NS_PER_S;
+  check(1 == lookup(cache, "broker", 5671), "still fresh");
+  check(0 == freed[1], "not freed while cached");
+  now += NS_PER_S;
+  check(0 == lookup(cache, "broker", 5671), "expired");
+  check(1 == freed[1], "expired session freed");
+  check(0 == lookup(cache, "broker", 5671), "expired entry dropped");
+  check(1 == freed[1], "freed once");
+  amqp_ssl_session_cache_free(cache);
+}
+
+/* a new session for the same host and port replaces the old one */
+static void test_replace(void)
+{
+  amqp_ssl_session_cache_t *cache = amqp_ssl_session_cache_new(2, 60);
+
+  memset(freed, 0, sizeof(freed));
+  amqp_ssl_session_cache_put(cache, "broker", 5671, session(1),
+                             free_session);
+  amqp_ssl_session_cache_put(cache, "other", 5671, session(2),
+                             free_session);
+  now += NS_PER_S;
+  amqp_ssl_session_cache_put(cache, "broker", 5671, session(3),
+                             free_session);
+  check(1 == freed[1], "old session freed");
+  check(3 == lookup(cache, "broker", 5671), "new session");
+  check(2 == lookup(cache, "other", 5671), "other entry kept");
+  check(0 == freed[2] && 0 == freed[3], "nothing else freed");
+  amqp_ssl_session_cache_free(cache);
+}
+
+/* a full cache makes room by evicting the entry closest to expiring */
+static void test_eviction(void)
+{
+  amqp_ssl_session_cache_t *cache = amqp_ssl_session_cache_new(3, 60);
+
+  memset(freed, 0, sizeof(freed));
+  amqp_ssl_session_cache_put(cache, "a", 1, session(1), free_session);
+  now += NS_PER_S;
+  amqp_ssl_session_cache_put(cache, "b", 1, session(2), free_session);
+  now += NS_PER_S;
+  amqp_ssl_session_cache_put(cache, "c", 1, session(3), free_session);
+  now += NS_PER_S;
+  /* refreshing a keeps it, b is now the oldest */
+  amqp_ssl_session_cache_put(cache, "a", 1, session(4), free_session);
+  now += NS_PER_S;
+  amqp_ssl_session_cache_put(cache, "d", 1, session(5), free_session);
+
+  check(1 == freed[1] && 1 == freed[2] && 0 == freed[3], "b evicted");
+  check(0 == lookup(cache, "b", 1), "b gone");
+  check(4 == lookup(cache, "a", 1) && 3 == lookup(cache, "c", 1) &&
+        5 == lookup(cache, "d", 1), "the others kept");
+
+  /* sessions the backend owns are not freed by the cache */
+  amqp_ssl_session_cache_put(cache, "e", 1, session(6), NULL);
+  check(1 == freed[3], "c evicted");
+  check(6 == lookup(cache, "e", 1), "e cached");
+
+  /* freeing the cache releases what it still holds */
+  amqp_ssl_session_cache_free(cache);
+  check(1 == freed[4] && 1 == freed[5] && 0 == freed[6], "all released");
+  check(1 == freed[1] && 1 == freed[2] && 1 == freed[3], "none twice");
+}
+
+int main(void)
+{
+  test_parameters();
+  test_expiry();
+  test_replace();
+  test_eviction();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
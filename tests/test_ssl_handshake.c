@@ -0,0 +1,126 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* A TLS handshake against a loopback listener that never answers must give
+ * up at the open timeout and close the socket it opened. */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <amqp.h>
+#include <amqp_ssl_socket.h>
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* a listener on an ephemeral loopback port */
+static int listen_loopback(int *port)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  check(fd >= 0, "socket");
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  check(0 == bind(fd, (struct sockaddr *)&addr, sizeof(addr)), "bind");
+  check(0 == listen(fd, 1), "listen");
+  check(0 == getsockname(fd, (struct sockaddr *)&addr, &len), "getsockname");
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static void test_silent_server(void)
+{
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_ssl_socket_new(conn);
+  struct timeval timeout = {0, 300000};
+  char buf[4096];
+  double start;
+  double elapsed;
+  ssize_t n;
+  int listener;
+  int peer;
+  int port;
+  int res;
+
+  check(NULL != socket, "ssl socket");
+  listener = listen_loopback(&port);
+
+  /* the kernel completes the TCP handshake; nobody answers the
+   * ClientHello */
+  start = now();
+  res = amqp_socket_open_noblock(socket, "127.0.0.1", port, &timeout);
+  elapsed = now() - start;
+  check(AMQP_STATUS_TIMEOUT == res, "handshake times out");
+  check(elapsed >= 0.25 && elapsed < 5.0, "within the deadline");
+  check(-1 == amqp_socket_get_sockfd(socket), "socket forgotten");
+
+  /* the client's end was closed: the listener reads the ClientHello, then
+   * end of stream */
+  peer = accept(listener, NULL, NULL);
+  check(peer >= 0, "accept");
+  do {
+    n = recv(peer, buf, sizeof(buf), 0);
+  } while (n > 0);
+  check(0 == n, "client closed its descriptor");
+
+  close(peer);
+  close(listener);
+  amqp_destroy_connection(conn);
+}
+
+int main(void)
+{
+  test_silent_server();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
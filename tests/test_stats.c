@@ -0,0 +1,194 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* Connection statistics over a memory socket pair: the test plays the
+ * broker on the peer connection and checks the counters on both ends.
+ * Without ENABLE_CONNECTION_STATS only the UNSUPPORTED result is checked. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+
+static amqp_conn_stats_t get_stats(amqp_connection_state_t state)
+{
+  amqp_conn_stats_t stats;
+
+  check(AMQP_STATUS_OK == amqp_get_connection_stats(state, &stats),
+        "read stats");
+  return stats;
+}
+
+static void test_fresh_connection(void)
+{
+  struct pair p;
+  amqp_conn_stats_t stats;
+  amqp_conn_stats_t zero;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_INVALID_PARAMETER ==
+            amqp_get_connection_stats(p.client, NULL),
+        "stats must not be NULL");
+  stats = get_stats(p.client);
+  memset(&zero, 0, sizeof(zero));
+  stats.pool_pages = 0;
+  check(0 == memcmp(&zero, &stats, sizeof(stats)),
+        "a new connection starts from zero");
+  pair_close(&p);
+}
+
+/* every frame one end sends is counted, by type and in bytes, as it is
+ * received on the other end */
+static void test_frame_counters(void)
+{
+  struct pair p;
+  amqp_frame_t frame;
+  amqp_conn_stats_t client;
+  amqp_conn_stats_t broker;
+  struct timeval zero = {0, 0};
+  char body[4 * 248];
+  int i;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  pair_start(&p);
+  /* 256 byte frames carry 248 bytes of body each */
+  check(AMQP_STATUS_OK == amqp_tune_connection(p.client, 0, 256, 0),
+        "tune client");
+
+  memset(body, 'x', sizeof(body));
+  for (i = 0; i < 2; ++i) {
+    amqp_bytes_t bytes;
+    bytes.bytes = body;
+    bytes.len = sizeof(body);
+    check(AMQP_STATUS_OK ==
+              amqp_basic_publish(p.client, 1, amqp_cstring_bytes("amq.direct"),
+                                 amqp_cstring_bytes("key"), 0, 0, NULL, bytes),
+          "publish");
+  }
+  frame.frame_type = AMQP_FRAME_HEARTBEAT;
+  frame.channel = 0;
+  check(AMQP_STATUS_OK == amqp_send_frame(p.client, &frame),
+        "send heartbeat");
+  /* (publish, header, four bodies) twice; the heartbeat is counted but not
+     returned */
+  for (i = 0; i < 12; ++i) {
+    check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame),
+          "broker reads");
+  }
+  check(AMQP_STATUS_TIMEOUT ==
+            amqp_simple_wait_frame_noblock(p.broker, &frame, &zero),
+        "nothing else written");
+
+  client = get_stats(p.client);
+  broker = get_stats(p.broker);
+  check(1 == client.frames_in.method && 0 == client.frames_in.body,
+        "client received the tune");
+  check(1 == broker.frames_out.method, "broker sent the tune");
+  check(client.bytes_in == broker.bytes_out, "tune bytes in == out");
+
+  check(2 == client.frames_out.method && 2 == client.frames_out.header &&
+            8 == client.frames_out.body && 1 == client.frames_out.heartbeat,
+        "client frames out by type");
+  check(0 == memcmp(&client.frames_out, &broker.frames_in,
+                    sizeof(amqp_frame_counts_t)),
+        "broker frames in match client frames out");
+  check(client.bytes_out == broker.bytes_in, "publish bytes in == out");
+  /* 8 bytes of framing per frame, and the body itself */
+  check(client.bytes_out > 13 * 8 + 2 * sizeof(body), "bytes out");
+  pair_close(&p);
+}
+
+/* frames set aside while an RPC waits for its reply count as queued until
+ * they are read, the high-water mark stays */
+static void test_queued_frames(void)
+{
+  struct pair p;
+  amqp_channel_flow_t flow;
+  amqp_channel_open_ok_t open_ok;
+  amqp_frame_t frame;
+  amqp_conn_stats_t stats;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  flow.active = 1;
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 1,
+                                           AMQP_CHANNEL_FLOW_METHOD, &flow),
+        "send channel.flow");
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 1,
+                                           AMQP_CHANNEL_FLOW_METHOD, &flow),
+        "send channel.flow");
+  memset(&open_ok, 0, sizeof(open_ok));
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 2,
+                                           AMQP_CHANNEL_OPEN_OK_METHOD,
+                                           &open_ok),
+        "send channel.open-ok");
+  check(NULL != amqp_channel_open(p.client, 2), "open channel 2");
+
+  stats = get_stats(p.client);
+  check(2 == stats.queued_frames && 2 == stats.queued_frames_max,
+        "channel 1 frames queued during the RPC");
+  check(stats.pool_pages > 0, "queued frames hold pool pages");
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.client, &frame) &&
+            AMQP_CHANNEL_FLOW_METHOD == frame.payload.method.id,
+        "read queued frame");
+  stats = get_stats(p.client);
+  check(1 == stats.queued_frames && 2 == stats.queued_frames_max,
+        "one frame left");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.client, &frame),
+        "read queued frame");
+  stats = get_stats(p.client);
+  check(0 == stats.queued_frames && 2 == stats.queued_frames_max,
+        "queue drained, high-water mark kept");
+  pair_close(&p);
+}
+
+int main(void)
+{
+  amqp_connection_state_t state = amqp_new_connection();
+  amqp_conn_stats_t stats;
+  int res = amqp_get_connection_stats(state, &stats);
+
+  amqp_destroy_connection(state);
+  if (AMQP_STATUS_UNSUPPORTED == res) {
+    fprintf(stderr, "ok (built without ENABLE_CONNECTION_STATS)\n");
+    return 0;
+  }
+
+  test_fresh_connection();
+  test_frame_counters();
+  test_queued_frames();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
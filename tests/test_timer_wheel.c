@@ -0,0 +1,179 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The timer wheel (amqp_timer_wheel_*) over memory sockets: a fake clock
+ * moves time by hand and the test checks which timers expire when. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+static void test_timer_wheel(void)
+{
+  static const uint8_t close_ok[] = {0, 20, 0, 41};
+  amqp_connection_state_t conn = amqp_new_connection();
+  amqp_socket_t *socket = amqp_memory_socket_new(conn, PAIR_RING_SIZE);
+  uint64_t now = 1000000000;
+  amqp_timer_wheel_t *wheel = amqp_timer_wheel_new(NULL, fake_clock, &now);
+  amqp_timer_event_t events[4];
+  struct timeval tv;
+  amqp_frame_t frame;
+  uint8_t out[64];
+  int i, n, res = AMQP_STATUS_OK;
+
+  amqp_memory_socket_peer_write(socket, out,
+                                put_frame(out, AMQP_FRAME_METHOD, 1,
+                                          close_ok, sizeof(close_ok)));
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(conn, &frame), "first frame");
+  amqp_set_clock(conn, fake_clock, &now);
+  check(AMQP_STATUS_OK == amqp_tune_connection(conn, 0, 131072, 1),
+        "tune with heartbeats");
+
+  check(NULL != wheel && AMQP_STATUS_OK == amqp_timer_wheel_add(wheel, conn),
+        "add to wheel");
+  /* the heartbeat is due in 400ms, the wheel may wake up earlier */
+  check(NULL != amqp_timer_wheel_next(wheel, &tv) && 0 == tv.tv_sec &&
+        0 < tv.tv_usec && tv.tv_usec <= 400000, "next wakeup not late");
+  check(0 == amqp_timer_wheel_expire(wheel, events, 4), "nothing due yet");
+
+  now += 500000000;
+  n = amqp_timer_wheel_expire(wheel, events, 4);
+  check(1 == n && AMQP_TIMER_SEND_HEARTBEAT == events[0].kind &&
+        conn == events[0].state, "send heartbeat expires");
+  check(AMQP_STATUS_OK == amqp_timer_wheel_handle(wheel, &events[0]),
+        "heartbeat handled");
+  check(8 == amqp_memory_socket_peer_read(socket, out, sizeof(out)) &&
+        AMQP_FRAME_HEARTBEAT == out[0], "heartbeat sent by the wheel");
+
+  now += 3000000000ULL;
+  n = amqp_timer_wheel_expire(wheel, events, 4);
+  for (i = 0; i < n; ++i) {
+    if (AMQP_TIMER_RECV_HEARTBEAT == events[i].kind) {
+      res = amqp_timer_wheel_handle(wheel, &events[i]);
+    }
+  }
+  check(AMQP_STATUS_HEARTBEAT_TIMEOUT == res, "missed heartbeats expire");
+
+  amqp_destroy_connection(conn);
+  check(NULL == amqp_timer_wheel_next(wheel, &tv),
+        "destroyed connection leaves the wheel");
+  amqp_timer_wheel_free(wheel);
+}
+
+/* one-shot timers placed on every wheel level, and cancelled while due */
+static void test_timer_wheel_levels(void)
+{
+  /* 1ms ticks: level 1 from 64ms, level 2 from 4.096s, level 3 from
+     262.144s */
+  static const uint64_t timeout_ms[] = {30, 100, 5000, 300000};
+  amqp_connection_state_t conns[4];
+  uint64_t now = 1000000000;
+  uint64_t start = now;
+  amqp_timer_wheel_t *wheel = amqp_timer_wheel_new(NULL, fake_clock, &now);
+  amqp_timer_event_t events[4];
+  struct timeval tv;
+  int others[3];
+  int n = 0;
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    conns[i] = amqp_new_connection();
+    tv.tv_sec = (long)(timeout_ms[i] / 1000);
+    tv.tv_usec = (long)(timeout_ms[i] % 1000) * 1000;
+    check(AMQP_STATUS_OK == amqp_timer_wheel_add(wheel, conns[i]),
+          "connection added");
+    check(AMQP_STATUS_OK ==
+          amqp_timer_wheel_set_rpc_timeout(wheel, conns[i], &tv),
+          "rpc timeout armed");
+  }
+
+  /* each timer cascades down from its level and fires on its tick, not
+     before */
+  for (i = 0; i < 4; ++i) {
+    now = start + timeout_ms[i] * 1000000 - 1000000;
+    check(0 == amqp_timer_wheel_expire(wheel, events, 4), "not due yet");
+    check(NULL != amqp_timer_wheel_next(wheel, &tv) &&
+          tv.tv_sec * 1000000 + tv.tv_usec <= 1000, "next wakeup not late");
+    now += 1000000;
+    check(1 == amqp_timer_wheel_expire(wheel, events, 4) &&
+          conns[i] == events[0].state &&
+          AMQP_TIMER_RPC_TIMEOUT == events[0].kind,
+          "timer fires on its deadline");
+  }
+  check(NULL == amqp_timer_wheel_next(wheel, &tv), "wheel empty");
+
+  /* several due at once, cancelled between two expire calls */
+  tv.tv_sec = 400;
+  tv.tv_usec = 0;
+  for (i = 0; i < 4; ++i) {
+    check(AMQP_STATUS_OK ==
+          amqp_timer_wheel_set_rpc_timeout(wheel, conns[i], &tv),
+          "rpc timeout rearmed");
+  }
+  now += 500 * (uint64_t)1000000000;
+  check(1 == amqp_timer_wheel_expire(wheel, events, 1), "one of four");
+  for (i = 0; i < 4; ++i) {
+    if (conns[i] != events[0].state) {
+      others[n++] = i;
+    }
+  }
+  check(3 == n, "a single connection reported");
+  check(AMQP_STATUS_OK ==
+        amqp_timer_wheel_set_rpc_timeout(wheel, conns[others[0]], NULL),
+        "rpc timeout cancelled");
+  amqp_destroy_connection(conns[others[1]]);
+  conns[others[1]] = NULL;
+  check(1 == amqp_timer_wheel_expire(wheel, events, 4) &&
+        conns[others[2]] == events[0].state,
+        "cancelled timers are not reported");
+  check(0 == amqp_timer_wheel_expire(wheel, events, 4), "reported once");
+  check(NULL == amqp_timer_wheel_next(wheel, &tv), "wheel empty again");
+
+  amqp_timer_wheel_free(wheel);
+  for (i = 0; i < 4; ++i) {
+    if (NULL != conns[i]) {
+      amqp_destroy_connection(conns[i]);
+    }
+  }
+}
+
+int main(void)
+{
+  test_timer_wheel();
+  test_timer_wheel_levels();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,218 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* amqp_tls_gather_writev() with a write_record that logs the records it is
+ * given instead of encrypting them. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amqp_private.h"
+#include "amqp_socket.h"
+
+#define RECORD AMQP_TLS_RECORD_SIZE
+#define MAX_RECORDS 8
+
+struct record {
+  const char *bytes;
+  size_t len;
+  int more;
+};
+
+struct log {
+  struct record records[MAX_RECORDS];
+  int count;
+  /* the call that fails, 0 for none */
+  int fail_at;
+  char written[8 * RECORD];
+  size_t written_len;
+};
+
+static char record_buffer[RECORD];
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+static ssize_t log_record(void *self, const void *buf, size_t len, int more)
+{
+  struct log *log = self;
+  struct record *r;
+
+  check(log->count < MAX_RECORDS, "too many records");
+  check(len > 0 && len <= RECORD, "record size");
+  if (log->count + 1 == log->fail_at) {
+    log->count++;
+    return AMQP_STATUS_SOCKET_ERROR;
+  }
+  r = &log->records[log->count++];
+  r->bytes = buf;
+  r->len = len;
+  r->more = more;
+  memcpy(log->written + log->written_len, buf, len);
+  log->written_len += len;
+  return AMQP_STATUS_OK;
+}
+
+/* vectors of the given lengths over one patterned buffer */
+static char source[8 * RECORD];
+
+static int make_iov(struct iovec *iov, const size_t *lens, int count)
+{
+  size_t offset = 0;
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    iov[i].iov_base = source + offset;
+    iov[i].iov_len = lens[i];
+    offset += lens[i];
+  }
+  return count;
+}
+
+static void gather(struct log *log, const size_t *lens, int count,
+                   ssize_t expected)
+{
+  struct iovec iov[8];
+  size_t total = 0;
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    total += lens[i];
+  }
+  check(expected == amqp_tls_gather_writev(log, iov, make_iov(iov, lens, count),
+                                           record_buffer, log_record),
+        "gather result");
+  if (AMQP_STATUS_OK == expected) {
+    check(total == log->written_len &&
+          0 == memcmp(source, log->written, total), "bytes in order");
+  }
+}
+
+static void expect_record(struct log *log, int i, size_t len, int more,
+                          const char *bytes)
+{
+  check(i < log->count && len == log->records[i].len &&
+        more == log->records[i].more, "record length and more flag");
+  if (bytes) {
+    check(bytes == log->records[i].bytes, "written in place");
+  } else {
+    check(record_buffer == log->records[i].bytes, "written from the buffer");
+  }
+}
+
+/* small vectors that add up to exactly one record go out together */
+static void test_exact_fill(void)
+{
+  static const size_t lens[] = {7, RECORD - 8, 1};
+  static const size_t whole[] = {RECORD};
+  struct log log;
+
+  memset(&log, 0, sizeof(log));
+  gather(&log, lens, 3, AMQP_STATUS_OK);
+  check(1 == log.count, "one record");
+  expect_record(&log, 0, RECORD, 0, NULL);
+
+  /* a single full vector is not copied */
+  memset(&log, 0, sizeof(log));
+  gather(&log, whole, 1, AMQP_STATUS_OK);
+  check(1 == log.count, "one record");
+  expect_record(&log, 0, RECORD, 0, source);
+}
+
+/* a frame header, a payload that crosses a record boundary and a footer */
+static void test_straddle(void)
+{
+  static const size_t lens[] = {7, 20000, 1};
+  struct log log;
+
+  memset(&log, 0, sizeof(log));
+  gather(&log, lens, 3, AMQP_STATUS_OK);
+  check(2 == log.count, "two records");
+  expect_record(&log, 0, RECORD, 1, NULL);
+  expect_record(&log, 1, 7 + 20000 + 1 - RECORD, 0, NULL);
+}
+
+/* the rest of a large last vector is written straight from it */
+static void test_large_last(void)
+{
+  static const size_t lens[] = {7, 40000};
+  struct log log;
+
+  memset(&log, 0, sizeof(log));
+  gather(&log, lens, 2, AMQP_STATUS_OK);
+  check(3 == log.count, "three records");
+  expect_record(&log, 0, RECORD, 1, NULL);
+  expect_record(&log, 1, RECORD, 1, source + RECORD);
+  expect_record(&log, 2, 7 + 40000 - 2 * RECORD, 0, source + 2 * RECORD);
+}
+
+/* the first error stops the write and is returned */
+static void test_error(void)
+{
+  static const size_t lens[] = {7, 40000};
+  static const size_t tail[] = {7, 1};
+  static const size_t empty[] = {0, 0};
+  struct log log;
+
+  memset(&log, 0, sizeof(log));
+  log.fail_at = 2;
+  gather(&log, lens, 2, AMQP_STATUS_SOCKET_ERROR);
+  check(2 == log.count, "no record after the failure");
+
+  memset(&log, 0, sizeof(log));
+  log.fail_at = 1;
+  gather(&log, tail, 2, AMQP_STATUS_SOCKET_ERROR);
+  check(1 == log.count, "a buffered tail fails too");
+
+  memset(&log, 0, sizeof(log));
+  gather(&log, empty, 2, AMQP_STATUS_OK);
+  check(0 == log.count, "nothing to write");
+}
+
+int main(void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(source); ++i) {
+    source[i] = (char)(i * 7 + i / 251);
+  }
+  test_exact_fill();
+  test_straddle();
+  test_large_last();
+  test_error();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}
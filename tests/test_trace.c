@@ -0,0 +1,155 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The trace ring. amqp_trace.c is built into the test with AMQP_TRACE_RING
+ * and records into the ring of a bare connection object, so the ring can be
+ * filled past its size and its sequence counter moved close to wrapping. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amqp_private.h"
+
+#define RING AMQP_TRACE_RING_SIZE
+
+static void check(int condition, const char *what)
+{
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    abort();
+  }
+}
+
+/* event n carries n in its first argument */
+static void record(amqp_connection_state_t state, uint32_t n)
+{
+  amqp_trace_record(NULL == state ? NULL : &state->trace, AMQP_TRACE_TUNE,
+                    n, n + 1, n + 2, n + 3);
+}
+
+/* dumps up to capacity events and checks they are first..first+count-1 in
+ * order, with consecutive sequence numbers ending at last_seq */
+static void expect_events(amqp_connection_state_t state, size_t capacity,
+                          uint32_t first, size_t expected, uint32_t last_seq)
+{
+  amqp_trace_event_t events[2 * RING];
+  size_t count = capacity;
+  uint32_t seq = last_seq;
+  size_t i;
+
+  check(AMQP_STATUS_OK == amqp_trace_dump(state, events, &count), "dump");
+  check(expected == count, "number of events");
+  for (i = count; i-- > 0; ) {
+    check(seq == events[i].seq, "consecutive sequence numbers");
+    if (0 == --seq) {
+      seq--; /* 0 is never used */
+    }
+  }
+  for (i = 0; i < count; ++i) {
+    check(AMQP_TRACE_TUNE == events[i].id && 0 == events[i].reserved,
+          "event id");
+    check(first + i == events[i].args[0] && first + i + 3 == events[i].args[3],
+          "events oldest first");
+    check(0 == i || events[i - 1].timestamp <= events[i].timestamp,
+          "timestamps in order");
+  }
+}
+
+static void test_ring_wraparound(void)
+{
+  amqp_connection_state_t state = calloc(1, sizeof(*state));
+  amqp_trace_event_t events[1];
+  size_t count = 1;
+  uint32_t n;
+
+  check(NULL != state, "allocate state");
+  check(AMQP_STATUS_INVALID_PARAMETER == amqp_trace_dump(state, NULL, &count),
+        "events must not be NULL");
+  check(AMQP_STATUS_INVALID_PARAMETER == amqp_trace_dump(state, events, NULL),
+        "count must not be NULL");
+  expect_events(state, 2 * RING, 0, 0, 0);
+
+  for (n = 1; n <= 5; ++n) {
+    record(state, n);
+  }
+  expect_events(state, 2 * RING, 1, 5, 5);
+  expect_events(state, 3, 3, 3, 5);
+
+  /* fill exactly, then overwrite the oldest events */
+  for ( ; n <= RING; ++n) {
+    record(state, n);
+  }
+  expect_events(state, 2 * RING, 1, RING, RING);
+  for ( ; n <= 3 * RING + 7; ++n) {
+    record(state, n);
+  }
+  expect_events(state, 2 * RING, 2 * RING + 8, RING, 3 * RING + 7);
+  expect_events(state, 10, 3 * RING - 2, 10, 3 * RING + 7);
+  free(state);
+}
+
+/* after 2^32 events the sequence numbers wrap, skipping 0 */
+static void test_sequence_wraparound(void)
+{
+  amqp_connection_state_t state = calloc(1, sizeof(*state));
+  uint32_t n;
+
+  check(NULL != state, "allocate state");
+  state->trace.head = (int)(UINT32_MAX - 20);
+  for (n = 0; n < 10; ++n) {
+    record(state, n);
+  }
+  expect_events(state, 2 * RING, 0, 10, UINT32_MAX - 10);
+
+  for ( ; n < 40; ++n) {
+    record(state, n);
+  }
+  /* 20 before the wrap, 0 skipped, 20 after */
+  expect_events(state, 2 * RING, 0, 40, 20);
+  expect_events(state, 25, 15, 25, 20);
+  free(state);
+}
+
+/* events without a connection go to the process-wide ring */
+static void test_global_ring(void)
+{
+  record(NULL, 1000);
+  record(NULL, 1001);
+  expect_events(NULL, 2, 1000, 2, 2);
+}
+
+int main(void)
+{
+  test_ring_wraparound();
+  test_sequence_wraparound();
+  test_global_ring();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
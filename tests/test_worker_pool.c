@@ -0,0 +1,192 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/* The worker pool over a memory socket pair: the test plays the broker,
+ * queueing deliveries on several channels, and checks that each channel is
+ * processed in order, one message at a time, and that every message is
+ * answered with the ack or reject its handler asked for. */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+#include <amqp_memory_socket.h>
+
+#include "test_pair.h"
+
+#define RING_SIZE 262144
+#define CHANNELS 3
+#define MESSAGES 200
+#define WORKERS 4
+#define IN_FLIGHT 8
+
+/* what the handler answers for a delivery tag */
+static amqp_worker_result_t result_for(uint64_t delivery_tag)
+{
+  if (0 == delivery_tag % 3) {
+    return AMQP_WORKER_REJECT;
+  }
+  if (0 == delivery_tag % 5) {
+    return AMQP_WORKER_REQUEUE;
+  }
+  return AMQP_WORKER_ACK;
+}
+
+struct channel_state {
+  int busy;
+  uint64_t last_tag;
+  int out_of_order;
+  int overlapped;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct channel_state channels[CHANNELS + 1];
+static int handled;
+
+static amqp_worker_result_t handle(void *ctx, const amqp_envelope_t *envelope)
+{
+  struct channel_state *c = &channels[envelope->channel];
+  char expected[32];
+
+  (void)ctx;
+  pthread_mutex_lock(&lock);
+  if (c->busy) {
+    c->overlapped = 1;
+  }
+  c->busy = 1;
+  if (envelope->delivery_tag != c->last_tag + 1) {
+    c->out_of_order = 1;
+  }
+  c->last_tag = envelope->delivery_tag;
+  pthread_mutex_unlock(&lock);
+
+  sprintf(expected, "%u:%u", (unsigned)envelope->channel,
+          (unsigned)envelope->delivery_tag);
+  check(strlen(expected) == envelope->message.body.len &&
+            0 == memcmp(expected, envelope->message.body.bytes,
+                        envelope->message.body.len),
+        "body handed to the worker");
+  /* give other workers a chance to pick up the same channel */
+  sched_yield();
+
+  pthread_mutex_lock(&lock);
+  c->busy = 0;
+  handled++;
+  pthread_mutex_unlock(&lock);
+  return result_for(envelope->delivery_tag);
+}
+
+static void test_channel_order(void)
+{
+  struct pair p;
+  amqp_worker_pool_t *pool;
+  amqp_frame_t frame;
+  struct timeval timeout;
+  struct timeval zero = {0, 0};
+  int answered[CHANNELS + 1][MESSAGES + 1];
+  int dispatched = 0;
+  int ch;
+  int i;
+
+  pair_open(&p, RING_SIZE);
+  pair_start(&p);
+
+  for (i = 1; i <= MESSAGES; ++i) {
+    for (ch = 1; ch <= CHANNELS; ++ch) {
+      char body[32];
+      sprintf(body, "%u:%u", (unsigned)ch, (unsigned)i);
+      pair_deliver(&p, (amqp_channel_t)ch, (uint64_t)i,
+                   amqp_cstring_bytes(body));
+    }
+  }
+
+  pool = amqp_worker_pool_new(p.client, WORKERS, AMQP_WORKER_ORDER_CHANNEL,
+                              IN_FLIGHT, handle, NULL);
+  check(NULL != pool, "worker pool");
+  while (dispatched < CHANNELS * MESSAGES) {
+    int res;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    res = amqp_worker_pool_dispatch(pool, &timeout, 0);
+    check(res > 0, "dispatch");
+    dispatched += res;
+  }
+  check(CHANNELS * MESSAGES == dispatched, "every delivery dispatched");
+  check(AMQP_STATUS_OK == amqp_worker_pool_destroy(pool), "drain and destroy");
+  check(CHANNELS * MESSAGES == handled, "every delivery handled");
+
+  for (ch = 1; ch <= CHANNELS; ++ch) {
+    check(!channels[ch].out_of_order, "a channel is processed in order");
+    check(!channels[ch].overlapped, "a channel is processed one at a time");
+    check(MESSAGES == channels[ch].last_tag, "last delivery handled");
+  }
+
+  /* the broker sees exactly one answer per delivery, the one asked for */
+  memset(answered, 0, sizeof(answered));
+  for (i = 0; i < CHANNELS * MESSAGES; ++i) {
+    uint64_t tag;
+    amqp_worker_result_t result;
+
+    check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame) &&
+              AMQP_FRAME_METHOD == frame.frame_type,
+          "read answer");
+    check(frame.channel >= 1 && frame.channel <= CHANNELS, "answer channel");
+    if (AMQP_BASIC_ACK_METHOD == frame.payload.method.id) {
+      amqp_basic_ack_t *ack = frame.payload.method.decoded;
+      check(!ack->multiple, "single acks without batching");
+      tag = ack->delivery_tag;
+      result = AMQP_WORKER_ACK;
+    } else {
+      amqp_basic_reject_t *reject = frame.payload.method.decoded;
+      check(AMQP_BASIC_REJECT_METHOD == frame.payload.method.id,
+            "ack or reject");
+      tag = reject->delivery_tag;
+      result = reject->requeue ? AMQP_WORKER_REQUEUE : AMQP_WORKER_REJECT;
+    }
+    check(tag >= 1 && tag <= MESSAGES, "answered tag");
+    check(0 == answered[frame.channel][tag]++, "answered once");
+    check(result_for(tag) == result, "answered as the handler asked");
+    amqp_maybe_release_buffers(p.broker);
+  }
+  check(AMQP_STATUS_TIMEOUT ==
+            amqp_simple_wait_frame_noblock(p.broker, &frame, &zero),
+        "nothing else written");
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_channel_order();
+  fprintf(stderr, "ok\n");
+  return 0;
+}
@@ -0,0 +1,272 @@
+/* vim:set ft=c ts=2 sw=2 sts=2 et cindent: */
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+/* The outbound write buffer over a memory socket pair: the test plays the
+ * broker on the peer connection and reads what the client actually wrote. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "test_pair.h"
+
+/* a basic.ack frame: header, method id, delivery tag, bits, frame end */
+#define ACK_FRAME_SIZE 21
+
+static void send_ack(struct pair *p, uint64_t tag)
+{
+  amqp_basic_ack_t ack;
+
+  ack.delivery_tag = tag;
+  ack.multiple = 0;
+  check(AMQP_STATUS_OK ==
+        amqp_send_method(p->client, 1, AMQP_BASIC_ACK_METHOD, &ack),
+        "send ack");
+}
+
+static void expect_nothing(struct pair *p)
+{
+  struct timeval timeout;
+  amqp_frame_t frame;
+
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p->broker, &frame, &timeout),
+        "nothing written");
+}
+
+static void expect_ack(struct pair *p, uint64_t tag)
+{
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->broker, &frame) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_BASIC_ACK_METHOD == frame.payload.method.id &&
+        tag == ((amqp_basic_ack_t *)frame.payload.method.decoded)
+                   ->delivery_tag,
+        "ack written");
+}
+
+static void expect_frame(struct pair *p, uint8_t type, const char *what)
+{
+  amqp_frame_t frame;
+
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p->broker, &frame) &&
+        type == frame.frame_type, what);
+}
+
+/* frames stay buffered until the threshold is reached, then go out in
+ * order */
+static void test_threshold(void)
+{
+  struct pair p;
+  uint64_t tag;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK ==
+        amqp_set_write_buffer(p.client, 1024, 5 * ACK_FRAME_SIZE, NULL),
+        "write buffer");
+
+  for (tag = 1; tag < 5; ++tag) {
+    send_ack(&p, tag);
+    expect_nothing(&p);
+  }
+  send_ack(&p, 5);
+  for (tag = 1; tag <= 5; ++tag) {
+    expect_ack(&p, tag);
+  }
+  expect_nothing(&p);
+
+  /* amqp_flush() writes whatever is pending */
+  send_ack(&p, 6);
+  expect_nothing(&p);
+  check(AMQP_STATUS_OK == amqp_flush(p.client), "flush");
+  expect_ack(&p, 6);
+  check(AMQP_STATUS_OK == amqp_flush(p.client), "flush when empty");
+  expect_nothing(&p);
+  pair_close(&p);
+}
+
+/* a body larger than the buffer goes out behind what was pending */
+static void test_oversized(void)
+{
+  static char body[3000];
+  amqp_bytes_t bytes;
+  amqp_frame_t frame;
+  struct pair p;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_write_buffer(p.client, 1024, 0, NULL),
+        "write buffer");
+  memset(body, 'b', sizeof(body));
+  bytes.len = sizeof(body);
+  bytes.bytes = body;
+
+  send_ack(&p, 1);
+  check(AMQP_STATUS_OK ==
+        amqp_basic_publish(p.client, 1, amqp_empty_bytes,
+                           amqp_cstring_bytes("q"), 0, 0, NULL, bytes),
+        "publish");
+  expect_ack(&p, 1);
+  expect_frame(&p, AMQP_FRAME_METHOD, "basic.publish");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame) &&
+        AMQP_FRAME_HEADER == frame.frame_type &&
+        sizeof(body) == frame.payload.properties.body_size,
+        "content header");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame) &&
+        AMQP_FRAME_BODY == frame.frame_type &&
+        sizeof(body) == frame.payload.body_fragment.len &&
+        0 == memcmp(body, frame.payload.body_fragment.bytes, sizeof(body)),
+        "body");
+  expect_nothing(&p);
+  pair_close(&p);
+}
+
+/* pending frames are written before the client blocks for the broker */
+static void test_flush_before_block(void)
+{
+  struct pair p;
+  struct timeval timeout;
+  amqp_frame_t frame;
+  amqp_basic_qos_ok_t qos_ok;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  check(AMQP_STATUS_OK == amqp_set_write_buffer(p.client, 1024, 0, NULL),
+        "write buffer");
+
+  send_ack(&p, 1);
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 1000;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p.client, &frame, &timeout),
+        "client wait times out");
+  expect_ack(&p, 1);
+
+  /* an RPC request is not held back either */
+  check(AMQP_STATUS_OK == amqp_send_method(p.broker, 1,
+                                           AMQP_BASIC_QOS_OK_METHOD,
+                                           &qos_ok),
+        "send qos-ok");
+  amqp_basic_qos(p.client, 1, 0, 10, 0);
+  check(AMQP_RESPONSE_NORMAL == amqp_get_rpc_reply(p.client).reply_type,
+        "qos rpc");
+  check(AMQP_STATUS_OK == amqp_simple_wait_frame(p.broker, &frame) &&
+        AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_BASIC_QOS_METHOD == frame.payload.method.id,
+        "qos request written");
+  pair_close(&p);
+}
+
+/* with max_delay, the next send writes frames that waited too long */
+static void test_max_delay(void)
+{
+  struct pair p;
+  struct timeval delay;
+  uint64_t now = 1000000000;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  amqp_set_clock(p.client, fake_clock, &now);
+  delay.tv_sec = 0;
+  delay.tv_usec = 10000;
+  check(AMQP_STATUS_OK == amqp_set_write_buffer(p.client, 1024, 0, &delay),
+        "write buffer");
+
+  send_ack(&p, 1);
+  now += 5000000;
+  send_ack(&p, 2);
+  expect_nothing(&p);
+  now += 6000000;
+  send_ack(&p, 3);
+  expect_ack(&p, 1);
+  expect_ack(&p, 2);
+  expect_ack(&p, 3);
+  pair_close(&p);
+}
+
+/* only bytes that reached the socket put off the next heartbeat */
+static void test_heartbeat(void)
+{
+  struct pair p;
+  uint64_t now = 1000000000;
+  amqp_timer_wheel_t *wheel = amqp_timer_wheel_new(NULL, fake_clock, &now);
+  amqp_timer_event_t events[4];
+  struct timeval timeout;
+  amqp_frame_t frame;
+  int n;
+  int i;
+
+  pair_open(&p, PAIR_RING_SIZE);
+  pair_start(&p);
+  amqp_set_clock(p.client, fake_clock, &now);
+  check(AMQP_STATUS_OK == amqp_tune_connection(p.client, 0, 131072, 1),
+        "tune with heartbeats");
+  check(AMQP_STATUS_OK == amqp_set_write_buffer(p.client, 1024, 0, NULL),
+        "write buffer");
+  check(AMQP_STATUS_OK == amqp_timer_wheel_add(wheel, p.client),
+        "wheel");
+
+  /* heartbeats are sent every 400ms; the client's wait reads the clock */
+  now += 300000000;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  check(AMQP_STATUS_TIMEOUT ==
+        amqp_simple_wait_frame_noblock(p.client, &frame, &timeout),
+        "nothing from the broker");
+  send_ack(&p, 1);
+  check(AMQP_STATUS_OK == amqp_timer_wheel_update(wheel, p.client),
+        "wheel update");
+  now += 200000000;
+  n = amqp_timer_wheel_expire(wheel, events, 4);
+  for (i = 0; i < n; ++i) {
+    if (AMQP_TIMER_SEND_HEARTBEAT == events[i].kind) {
+      break;
+    }
+  }
+  check(i < n, "heartbeat due despite the buffered frame");
+
+  amqp_timer_wheel_free(wheel);
+  pair_close(&p);
+}
+
+int main(void)
+{
+  test_threshold();
+  test_oversized();
+  test_flush_before_block();
+  test_max_delay();
+  test_heartbeat();
+
+  fprintf(stderr, "ok\n");
+  return 0;
+}